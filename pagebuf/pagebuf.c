@@ -223,6 +223,564 @@ void pb_trivial_data_put(struct pb_data *data) {
 
 
 
+
+/*******************************************************************************
+ */
+#define PB_INLINE_DATA_ALIGN                              16
+
+#define PB_INLINE_DATA_HEADER_SIZE \
+  (((sizeof(struct pb_data) + PB_INLINE_DATA_ALIGN - 1) / \
+    PB_INLINE_DATA_ALIGN) * PB_INLINE_DATA_ALIGN)
+
+
+
+/*******************************************************************************
+ */
+static struct pb_data_operations pb_inline_data_operations = {
+  .get = &pb_trivial_data_get,
+  .put = &pb_inline_data_put,
+};
+
+const struct pb_data_operations *pb_get_inline_data_operations(void) {
+  return &pb_inline_data_operations;
+}
+
+
+
+/*******************************************************************************
+ */
+struct pb_data *pb_inline_data_create(size_t len,
+    const struct pb_allocator *allocator) {
+  struct pb_data *data =
+    pb_allocator_malloc(allocator, PB_INLINE_DATA_HEADER_SIZE + len);
+  if (!data)
+    return NULL;
+
+  data->data_vec.base = (uint8_t*)data + PB_INLINE_DATA_HEADER_SIZE;
+  data->data_vec.len = len;
+
+  data->responsibility = pb_data_responsibility_owned;
+
+  data->use_count = 1;
+
+  data->operations = pb_get_inline_data_operations();
+  data->allocator = allocator;
+
+  return data;
+}
+
+
+
+/*******************************************************************************
+ */
+void pb_inline_data_put(struct pb_data *data) {
+  if (--data->use_count != 0)
+    return;
+
+  pb_allocator_free(
+    data->allocator, data,
+    PB_INLINE_DATA_HEADER_SIZE + pb_data_get_len(data));
+}
+
+
+
+
+
+
+/*******************************************************************************
+ */
+static struct pb_data_operations pb_atomic_data_operations = {
+  .get = &pb_atomic_data_get,
+  .put = &pb_atomic_data_put,
+};
+
+const struct pb_data_operations *pb_get_atomic_data_operations(void) {
+  return &pb_atomic_data_operations;
+}
+
+
+
+/*******************************************************************************
+ */
+struct pb_data *pb_atomic_data_create(size_t len,
+    const struct pb_allocator *allocator) {
+  struct pb_data *data = pb_trivial_data_create(len, allocator);
+  if (!data)
+    return NULL;
+
+  data->operations = pb_get_atomic_data_operations();
+
+  return data;
+}
+
+struct pb_data *pb_atomic_data_create_ref(const uint8_t *buf, size_t len,
+    const struct pb_allocator *allocator) {
+  struct pb_data *data = pb_trivial_data_create_ref(buf, len, allocator);
+  if (!data)
+    return NULL;
+
+  data->operations = pb_get_atomic_data_operations();
+
+  return data;
+}
+
+
+
+/*******************************************************************************
+ */
+void pb_atomic_data_get(struct pb_data *data) {
+  __atomic_fetch_add(&data->use_count, 1, __ATOMIC_RELAXED);
+}
+
+void pb_atomic_data_put(struct pb_data *data) {
+  const struct pb_allocator *allocator = data->allocator;
+
+  if (__atomic_sub_fetch(&data->use_count, 1, __ATOMIC_ACQ_REL) != 0)
+    return;
+
+  if (data->responsibility == pb_data_responsibility_owned)
+    pb_allocator_free(allocator, pb_data_get_base(data), pb_data_get_len(data));
+
+  pb_allocator_free(allocator, data, sizeof(struct pb_data));
+}
+
+
+
+
+
+
+/*******************************************************************************
+ */
+/** The specialised data struct that notifies the owner of its memory region
+ *  when it is released.
+ */
+struct pb_mem_data {
+  struct pb_data data;
+
+  void (*release)(void *buf, uint64_t len, void *context);
+  void *context;
+};
+
+
+
+/*******************************************************************************
+ */
+static struct pb_data_operations pb_mem_data_operations = {
+  .get = &pb_trivial_data_get,
+  .put = &pb_mem_data_put,
+};
+
+const struct pb_data_operations *pb_get_mem_data_operations(void) {
+  return &pb_mem_data_operations;
+}
+
+
+
+/*******************************************************************************
+ */
+struct pb_data *pb_mem_data_create(void *buf, size_t len,
+    void (*release)(void *buf, uint64_t len, void *context),
+    void *context,
+    const struct pb_allocator *allocator) {
+  struct pb_mem_data *mem_data =
+    pb_allocator_calloc(allocator, sizeof(struct pb_mem_data));
+  if (!mem_data)
+    return NULL;
+
+  mem_data->data.data_vec.base = buf;
+  mem_data->data.data_vec.len = len;
+
+  mem_data->data.responsibility = pb_data_responsibility_owned;
+
+  mem_data->data.use_count = 1;
+
+  mem_data->data.operations = pb_get_mem_data_operations();
+  mem_data->data.allocator = allocator;
+
+  mem_data->release = release;
+  mem_data->context = context;
+
+  return &mem_data->data;
+}
+
+
+
+/*******************************************************************************
+ */
+void pb_mem_data_put(struct pb_data *data) {
+  struct pb_mem_data *mem_data = (struct pb_mem_data*)data;
+
+  if (--data->use_count != 0)
+    return;
+
+  mem_data->release(
+    pb_data_get_base(data), pb_data_get_len(data), mem_data->context);
+
+  pb_allocator_free(data->allocator, mem_data, sizeof(struct pb_mem_data));
+}
+
+
+
+
+
+
+/*******************************************************************************
+ */
+/** The single allocation holding a pb_page, its pb_data and memory region. */
+struct pb_inline_page {
+  struct pb_page page;
+
+  struct pb_data data;
+};
+
+#define PB_INLINE_PAGE_HEADER_SIZE \
+  (((sizeof(struct pb_inline_page) + PB_INLINE_DATA_ALIGN - 1) / \
+    PB_INLINE_DATA_ALIGN) * PB_INLINE_DATA_ALIGN)
+
+
+
+/*******************************************************************************
+ */
+static void pb_inline_page_data_put(struct pb_data * const data);
+
+static struct pb_data_operations pb_inline_page_data_operations = {
+  .get = &pb_trivial_data_get,
+  .put = &pb_inline_page_data_put,
+};
+
+
+
+/*******************************************************************************
+ */
+struct pb_page *pb_inline_page_create(size_t len,
+    const struct pb_allocator *allocator) {
+  struct pb_inline_page *inline_page =
+    pb_allocator_malloc(allocator, PB_INLINE_PAGE_HEADER_SIZE + len);
+  if (!inline_page)
+    return NULL;
+
+  struct pb_data *data = &inline_page->data;
+
+  data->data_vec.base = (uint8_t*)inline_page + PB_INLINE_PAGE_HEADER_SIZE;
+  data->data_vec.len = len;
+
+  data->responsibility = pb_data_responsibility_owned;
+
+  // the reference held by the embedded page for its own storage
+  data->use_count = 1;
+
+  data->operations = &pb_inline_page_data_operations;
+  data->allocator = allocator;
+
+  struct pb_page *page = &inline_page->page;
+
+  page->data = NULL;
+  page->prev = NULL;
+  page->next = NULL;
+  page->embedding_data = data;
+
+  pb_page_set_data(page, data);
+
+  return page;
+}
+
+/*******************************************************************************
+ */
+static void pb_inline_page_data_put(struct pb_data * const data) {
+  if (--data->use_count != 0)
+    return;
+
+  struct pb_inline_page *inline_page =
+    (struct pb_inline_page*)
+      ((uint8_t*)data - offsetof(struct pb_inline_page, data));
+
+  pb_allocator_free(
+    data->allocator, inline_page,
+    PB_INLINE_PAGE_HEADER_SIZE + pb_data_get_len(data));
+}
+
+
+
+/*******************************************************************************
+ */
+/** The allocation holding a run of pb_page instances, each with its own
+ *  pb_data.
+ *
+ * Either the memory region that the pb_data instances divide between them
+ * follows the pages in the same allocation, or each pb_data owns a separate
+ * allocation of its part of the region.
+ *
+ * page_count is the number of pb_data instances that have not yet been
+ * released, the allocation is freed when it reaches zero.
+ */
+struct pb_page_block {
+  size_t page_count;
+
+  size_t size;
+};
+
+/** A page of a page block, along with the pb_data of its part of the memory
+ *  region.
+ */
+struct pb_page_block_page {
+  struct pb_page page;
+
+  struct pb_data data;
+
+  struct pb_page_block *block;
+};
+
+#define PB_PAGE_BLOCK_HEADER_SIZE \
+  (((sizeof(struct pb_page_block) + PB_INLINE_DATA_ALIGN - 1) / \
+    PB_INLINE_DATA_ALIGN) * PB_INLINE_DATA_ALIGN)
+
+#define PB_PAGE_BLOCK_PAGES_SIZE(page_count) \
+  ((((page_count) * sizeof(struct pb_page_block_page) + \
+     PB_INLINE_DATA_ALIGN - 1) / \
+    PB_INLINE_DATA_ALIGN) * PB_INLINE_DATA_ALIGN)
+
+
+
+/*******************************************************************************
+ */
+static void pb_page_block_data_put(struct pb_data * const data);
+static void pb_split_page_block_data_put(struct pb_data * const data);
+
+static struct pb_data_operations pb_page_block_data_operations = {
+  .get = &pb_trivial_data_get,
+  .put = &pb_page_block_data_put,
+};
+
+static struct pb_data_operations pb_split_page_block_data_operations = {
+  .get = &pb_trivial_data_get,
+  .put = &pb_split_page_block_data_put,
+};
+
+
+
+/*******************************************************************************
+ */
+static size_t pb_page_block_get_page_count(size_t len, size_t page_size) {
+  return
+    ((page_size != 0) && (len > 0)) ? ((len + page_size - 1) / page_size) : 1;
+}
+
+/*******************************************************************************
+ * Set up page i of a block, whose pb_data owns the memory region of region_len
+ * bytes at base, with the page viewing its last page_len bytes.
+ */
+static void pb_page_block_init_page(
+    struct pb_page_block * const block,
+    struct pb_page_block_page * const block_pages,
+    size_t i, size_t page_count,
+    uint8_t *base, size_t region_len, size_t page_len,
+    const struct pb_data_operations *operations,
+    const struct pb_allocator *allocator) {
+  struct pb_page_block_page *block_page = &block_pages[i];
+  struct pb_data *data = &block_page->data;
+
+  data->data_vec.base = base;
+  data->data_vec.len = region_len;
+
+  data->responsibility = pb_data_responsibility_owned;
+
+  // the reference held by the embedded page for its own storage
+  data->use_count = 1;
+
+  data->operations = operations;
+  data->allocator = allocator;
+
+  block_page->block = block;
+
+  struct pb_page *page = &block_page->page;
+
+  page->data = NULL;
+  page->prev = (i > 0) ? &block_pages[i - 1].page : NULL;
+  page->next = ((i + 1) < page_count) ? &block_pages[i + 1].page : NULL;
+  page->embedding_data = data;
+
+  pb_page_set_data(page, data);
+
+  page->data_vec.base = base + (region_len - page_len);
+  page->data_vec.len = page_len;
+}
+
+/*******************************************************************************
+ */
+struct pb_page *pb_page_block_create(size_t len, size_t page_size,
+    size_t headroom,
+    const struct pb_allocator *allocator) {
+  size_t page_count = pb_page_block_get_page_count(len, page_size);
+  size_t pages_size = PB_PAGE_BLOCK_PAGES_SIZE(page_count);
+  size_t size = PB_PAGE_BLOCK_HEADER_SIZE + pages_size + headroom + len;
+
+  struct pb_page_block *block = pb_allocator_malloc(allocator, size);
+  if (!block)
+    return NULL;
+
+  block->page_count = page_count;
+  block->size = size;
+
+  struct pb_page_block_page *block_pages =
+    (struct pb_page_block_page*)((uint8_t*)block + PB_PAGE_BLOCK_HEADER_SIZE);
+  uint8_t *base = (uint8_t*)block_pages + pages_size;
+
+  for (size_t i = 0; i < page_count; ++i) {
+    size_t page_len = ((page_size != 0) && (page_size < len)) ? page_size : len;
+
+    // the first page's memory region also holds the headroom
+    size_t region_len = ((i == 0) ? headroom : 0) + page_len;
+
+    pb_page_block_init_page(
+      block, block_pages, i, page_count, base, region_len, page_len,
+      &pb_page_block_data_operations, allocator);
+
+    base += region_len;
+    len -= page_len;
+  }
+
+  return &block_pages[0].page;
+}
+
+/*******************************************************************************
+ */
+struct pb_page *pb_split_page_block_create(size_t len, size_t page_size,
+    size_t headroom,
+    const struct pb_allocator *allocator) {
+  size_t page_count = pb_page_block_get_page_count(len, page_size);
+  size_t size =
+    PB_PAGE_BLOCK_HEADER_SIZE + PB_PAGE_BLOCK_PAGES_SIZE(page_count);
+
+  struct pb_page_block *block = pb_allocator_malloc(allocator, size);
+  if (!block)
+    return NULL;
+
+  block->page_count = page_count;
+  block->size = size;
+
+  struct pb_page_block_page *block_pages =
+    (struct pb_page_block_page*)((uint8_t*)block + PB_PAGE_BLOCK_HEADER_SIZE);
+
+  for (size_t i = 0; i < page_count; ++i) {
+    size_t page_len = ((page_size != 0) && (page_size < len)) ? page_size : len;
+
+    // the first page's memory region also holds the headroom
+    size_t region_len = ((i == 0) ? headroom : 0) + page_len;
+
+    uint8_t *base = pb_allocator_malloc(allocator, region_len);
+    if (!base) {
+      int temp_errno = errno;
+
+      while (i > 0) {
+        struct pb_data *data = &block_pages[--i].data;
+
+        pb_allocator_free(allocator, data->data_vec.base, data->data_vec.len);
+      }
+
+      pb_allocator_free(allocator, block, size);
+
+      errno = temp_errno;
+
+      return NULL;
+    }
+
+    pb_page_block_init_page(
+      block, block_pages, i, page_count, base, region_len, page_len,
+      &pb_split_page_block_data_operations, allocator);
+
+    len -= page_len;
+  }
+
+  return &block_pages[0].page;
+}
+
+/*******************************************************************************
+ */
+struct pb_page *pb_split_page_create(size_t len,
+    const struct pb_allocator *allocator) {
+  return pb_split_page_block_create(len, 0, 0, allocator);
+}
+
+size_t pb_split_page_get_header_size(void) {
+  return PB_PAGE_BLOCK_HEADER_SIZE + PB_PAGE_BLOCK_PAGES_SIZE(1);
+}
+
+/*******************************************************************************
+ */
+static void pb_page_block_release(struct pb_data * const data) {
+  struct pb_page_block_page *block_page =
+    (struct pb_page_block_page*)
+      ((uint8_t*)data - offsetof(struct pb_page_block_page, data));
+  struct pb_page_block *block = block_page->block;
+
+  if (--block->page_count != 0)
+    return;
+
+  pb_allocator_free(data->allocator, block, block->size);
+}
+
+static void pb_page_block_data_put(struct pb_data * const data) {
+  if (--data->use_count != 0)
+    return;
+
+  pb_page_block_release(data);
+}
+
+static void pb_split_page_block_data_put(struct pb_data * const data) {
+  if (--data->use_count != 0)
+    return;
+
+  pb_allocator_free(
+    data->allocator, data->data_vec.base, data->data_vec.len);
+
+  pb_page_block_release(data);
+}
+
+
+
+/*******************************************************************************
+ */
+static struct pb_data_factory pb_trivial_data_factory = {
+  .create = &pb_trivial_data_create,
+  .create_ref = &pb_trivial_data_create_ref,
+  .page_create = &pb_split_page_create,
+  .pages_create = &pb_split_page_block_create,
+};
+
+const struct pb_data_factory *pb_get_trivial_data_factory(void) {
+  return &pb_trivial_data_factory;
+}
+
+
+
+static struct pb_data_factory pb_inline_data_factory = {
+  .create = &pb_inline_data_create,
+  .create_ref = &pb_trivial_data_create_ref,
+  .page_create = &pb_inline_page_create,
+  .pages_create = &pb_page_block_create,
+};
+
+const struct pb_data_factory *pb_get_inline_data_factory(void) {
+  return &pb_inline_data_factory;
+}
+
+
+
+
+static struct pb_data_factory pb_atomic_data_factory = {
+  .create = &pb_atomic_data_create,
+  .create_ref = &pb_atomic_data_create_ref,
+};
+
+const struct pb_data_factory *pb_get_atomic_data_factory(void) {
+  return &pb_atomic_data_factory;
+}
+
+
+
+
+
+
 /*******************************************************************************
  */
 struct pb_page *pb_page_create(struct pb_data *data,
@@ -253,6 +811,8 @@ struct pb_page *pb_page_transfer(const struct pb_page *src_page,
 
 void pb_page_destroy(struct pb_page *page,
     const struct pb_allocator *allocator) {
+  struct pb_data *embedding_data = page->embedding_data;
+
   pb_data_put(page->data);
 
   page->data_vec.base = NULL;
@@ -260,12 +820,34 @@ void pb_page_destroy(struct pb_page *page,
   page->data = NULL;
   page->prev = NULL;
   page->next = NULL;
+  page->embedding_data = NULL;
+
+  // an embedded page is freed along with the embedding data
+  if (embedding_data) {
+    pb_data_put(embedding_data);
+
+    return;
+  }
 
   pb_allocator_free(allocator, page, sizeof(struct pb_page));
 }
 
 
 
+/*******************************************************************************
+ */
+bool pb_page_is_data_shared(const struct pb_page *page) {
+  uint32_t use_count =
+    __atomic_load_n(&page->data->use_count, __ATOMIC_RELAXED);
+
+  if (page->embedding_data == page->data)
+    --use_count;
+
+  return (use_count > 1);
+}
+
+
+
 /*******************************************************************************
  */
 void pb_page_set_data(struct pb_page * const page,
@@ -319,6 +901,11 @@ size_t pb_buffer_iterator_get_len(
   return buffer_iterator->data_vec->len;
 }
 
+struct pb_data *pb_buffer_iterator_get_data(
+    const struct pb_buffer_iterator *buffer_iterator) {
+  return ((const struct pb_page*)buffer_iterator->data_vec)->data;
+}
+
 
 
 
@@ -349,6 +936,7 @@ static struct pb_buffer_strategy pb_trivial_buffer_strategy = {
   .rejects_trim = false,
   .rejects_write = false,
   .rejects_overwrite = false,
+  .headroom = 0,
 };
 
 const struct pb_buffer_strategy *pb_get_trivial_buffer_strategy(void) {
@@ -371,6 +959,7 @@ static struct pb_trivial_buffer_operations pb_trivial_buffer_operations_ = {
   .cmp_iterator = &pb_trivial_buffer_cmp_iterator,
   .next_iterator = &pb_trivial_buffer_next_iterator,
   .prev_iterator = &pb_trivial_buffer_prev_iterator,
+  .get_iterator_at = &pb_trivial_buffer_get_iterator_at,
 
   .get_byte_iterator = &pb_trivial_buffer_get_byte_iterator,
   .get_end_byte_iterator = &pb_trivial_buffer_get_end_byte_iterator,
@@ -391,6 +980,7 @@ static struct pb_trivial_buffer_operations pb_trivial_buffer_operations_ = {
 
   .write_data = &pb_trivial_buffer_write_data,
   .write_data_ref = &pb_trivial_buffer_write_data_ref,
+  .write_data_mem = &pb_trivial_buffer_write_data_mem,
   .write_buffer = &pb_trivial_buffer_write_buffer,
 
   .overwrite_data = &pb_trivial_buffer_overwrite_data,
@@ -398,8 +988,13 @@ static struct pb_trivial_buffer_operations pb_trivial_buffer_operations_ = {
 
   .read_data = &pb_trivial_buffer_read_data,
 
+  .compact = &pb_trivial_buffer_compact,
+
   .clear = &pb_trivial_buffer_clear,
   .destroy = &pb_trivial_buffer_destroy,
+  .destroy_deferred = &pb_trivial_buffer_destroy_deferred,
+
+  .write_data_fill = &pb_trivial_buffer_write_data_fill,
   },
 
   .page_create = &pb_trivial_buffer_page_create,
@@ -460,6 +1055,12 @@ void pb_buffer_prev_iterator(struct pb_buffer * const buffer,
   buffer->operations->prev_iterator(buffer, buffer_iterator);
 }
 
+size_t pb_buffer_get_iterator_at(struct pb_buffer * const buffer,
+    uint64_t offset,
+    struct pb_buffer_iterator * const buffer_iterator) {
+  return buffer->operations->get_iterator_at(buffer, offset, buffer_iterator);
+}
+
 /*******************************************************************************
  */
 void pb_buffer_get_byte_iterator(struct pb_buffer * const buffer,
@@ -562,12 +1163,27 @@ uint64_t pb_buffer_write_data_ref(struct pb_buffer * const buffer,
   return buffer->operations->write_data_ref(buffer, buf, len);
 }
 
+uint64_t pb_buffer_write_data_mem(struct pb_buffer * const buffer,
+    void *buf,
+    uint64_t len,
+    void (*release)(void *buf, uint64_t len, void *context),
+    void *context) {
+  return
+    buffer->operations->write_data_mem(buffer, buf, len, release, context);
+}
+
 uint64_t pb_buffer_write_buffer(struct pb_buffer * const buffer,
     struct pb_buffer * const src_buffer,
     uint64_t len) {
   return buffer->operations->write_buffer(buffer, src_buffer, len);
 }
 
+ssize_t pb_buffer_write_data_fill(struct pb_buffer * const buffer,
+    uint64_t len,
+    ssize_t (*fill)(const struct iovec *iov, int iovcnt, void *context),
+    void *context) {
+  return buffer->operations->write_data_fill(buffer, len, fill, context);
+}
 
 uint64_t pb_buffer_overwrite_data(struct pb_buffer * const buffer,
     const void *buf,
@@ -588,6 +1204,13 @@ uint64_t pb_buffer_read_data(struct pb_buffer * const buffer,
   return buffer->operations->read_data(buffer, buf, len);
 }
 
+/*******************************************************************************
+ */
+uint64_t pb_buffer_compact(struct pb_buffer * const buffer,
+    size_t threshold) {
+  return buffer->operations->compact(buffer, threshold);
+}
+
 /*******************************************************************************
  */
 void pb_buffer_clear(struct pb_buffer * const buffer) {
@@ -598,6 +1221,62 @@ void pb_buffer_destroy(struct pb_buffer * const buffer) {
   buffer->operations->destroy(buffer);
 }
 
+void pb_buffer_destroy_deferred(struct pb_buffer * const buffer,
+    struct pb_reclaimer * const reclaimer) {
+  buffer->operations->destroy_deferred(buffer, reclaimer);
+}
+
+
+
+/*******************************************************************************
+ */
+size_t pb_buffer_get_iovec(struct pb_buffer * const buffer,
+    uint64_t offset, uint64_t len,
+    struct iovec * const iov, size_t max) {
+  struct pb_buffer_iovec_cursor iovec_cursor;
+  pb_buffer_iovec_cursor_init(buffer, &iovec_cursor, offset, len);
+
+  return pb_buffer_iovec_cursor_next(buffer, &iovec_cursor, iov, max);
+}
+
+/*******************************************************************************
+ */
+void pb_buffer_iovec_cursor_init(struct pb_buffer * const buffer,
+    struct pb_buffer_iovec_cursor * const iovec_cursor,
+    uint64_t offset, uint64_t len) {
+  iovec_cursor->page_offset =
+    pb_buffer_get_iterator_at(buffer, offset, &iovec_cursor->buffer_iterator);
+  iovec_cursor->len = len;
+}
+
+size_t pb_buffer_iovec_cursor_next(struct pb_buffer * const buffer,
+    struct pb_buffer_iovec_cursor * const iovec_cursor,
+    struct iovec * const iov, size_t max) {
+  size_t count = 0;
+
+  while ((count < max) &&
+         (iovec_cursor->len > 0) &&
+         !pb_buffer_is_end_iterator(buffer, &iovec_cursor->buffer_iterator)) {
+    struct pb_data_vec *data_vec = iovec_cursor->buffer_iterator.data_vec;
+
+    uint64_t iov_len = data_vec->len - iovec_cursor->page_offset;
+    if (iov_len > iovec_cursor->len)
+      iov_len = iovec_cursor->len;
+
+    iov[count].iov_base = data_vec->base + iovec_cursor->page_offset;
+    iov[count].iov_len = iov_len;
+
+    ++count;
+
+    iovec_cursor->len -= iov_len;
+    iovec_cursor->page_offset = 0;
+
+    pb_buffer_next_iterator(buffer, &iovec_cursor->buffer_iterator);
+  }
+
+  return count;
+}
+
 
 
 /*******************************************************************************
@@ -625,6 +1304,23 @@ struct pb_buffer *pb_trivial_buffer_create_with_alloc(
 struct pb_buffer *pb_trivial_buffer_create_with_strategy_with_alloc(
     const struct pb_buffer_strategy *strategy,
     const struct pb_allocator *allocator) {
+  return
+    pb_trivial_buffer_create_with_data_factory_with_alloc(
+      strategy, pb_get_trivial_data_factory(), allocator);
+}
+
+struct pb_buffer *pb_trivial_buffer_create_with_data_factory(
+    const struct pb_buffer_strategy *strategy,
+    const struct pb_data_factory *data_factory) {
+  return
+    pb_trivial_buffer_create_with_data_factory_with_alloc(
+      strategy, data_factory, pb_get_trivial_allocator());
+}
+
+struct pb_buffer *pb_trivial_buffer_create_with_data_factory_with_alloc(
+    const struct pb_buffer_strategy *strategy,
+    const struct pb_data_factory *data_factory,
+    const struct pb_allocator *allocator) {
   struct pb_buffer_strategy *buffer_strategy =
     pb_allocator_calloc(allocator, sizeof(struct pb_buffer_strategy));
   if (!buffer_strategy)
@@ -653,6 +1349,10 @@ struct pb_buffer *pb_trivial_buffer_create_with_strategy_with_alloc(
   trivial_buffer->data_revision = 0;
   trivial_buffer->data_size = 0;
 
+  trivial_buffer->data_factory = data_factory;
+
+  trivial_buffer->offset_index = NULL;
+
   return &trivial_buffer->buffer;
 }
 
@@ -709,6 +1409,372 @@ void pb_trivial_buffer_decrement_data_size(
   trivial_buffer->data_size -= size;
 }
 
+/*******************************************************************************
+ * The page offset index.
+ *
+ * The index is an array of the pages of the buffer, in sequence, with the
+ * offset of the first byte of each page.  Offsets are measured from a fixed
+ * origin rather than the head of the buffer, so that seeking pages from the
+ * head of the buffer only advances the head of the array, and the offset of
+ * the first byte of the buffer is the offset of the head entry.  The origin
+ * is placed far below the offset of the first page, so that data may be
+ * prepended to the buffer without the offsets running out.
+ *
+ * Entries are added for pages appended to the end of the buffer when the
+ * next lookup is performed, so that writes pay nothing for the index.  Pages
+ * inserted elsewhere are added immediately, shifting the entries on one side
+ * of them.  The page found by the last lookup, and its offset, are kept, so
+ * that inserting in front of it, as inserting after a lookup does, finds its
+ * entry by binary search.
+ */
+struct pb_trivial_buffer_index_entry {
+  struct pb_page *page;
+  uint64_t offset;
+};
+
+struct pb_trivial_buffer_index {
+  struct pb_trivial_buffer_index_entry *entries;
+  size_t capacity;
+
+  size_t head;
+  size_t tail;
+
+  const struct pb_page *lookup_page;
+  uint64_t lookup_offset;
+};
+
+#define PB_TRIVIAL_BUFFER_INDEX_INITIAL_CAPACITY          16
+#define PB_TRIVIAL_BUFFER_INDEX_ORIGIN                    (UINT64_C(1) << 62)
+
+static void pb_trivial_buffer_index_invalidate(
+    struct pb_trivial_buffer * const trivial_buffer) {
+  struct pb_trivial_buffer_index *index = trivial_buffer->offset_index;
+  if (!index)
+    return;
+
+  index->head = 0;
+  index->tail = 0;
+}
+
+static void pb_trivial_buffer_index_destroy(
+    struct pb_trivial_buffer * const trivial_buffer) {
+  struct pb_trivial_buffer_index *index = trivial_buffer->offset_index;
+  if (!index)
+    return;
+
+  const struct pb_allocator *allocator = trivial_buffer->buffer.allocator;
+
+  pb_allocator_free(
+    allocator,
+    index->entries,
+    index->capacity * sizeof(struct pb_trivial_buffer_index_entry));
+  pb_allocator_free(
+    allocator, index, sizeof(struct pb_trivial_buffer_index));
+
+  trivial_buffer->offset_index = NULL;
+}
+
+/*******************************************************************************
+ * Account for the head page of the buffer having seek_len bytes seeked, or
+ * having been removed from the buffer.
+ */
+static void pb_trivial_buffer_index_seek(
+    struct pb_trivial_buffer * const trivial_buffer,
+    const struct pb_page *page,
+    uint64_t seek_len,
+    bool removed) {
+  struct pb_trivial_buffer_index *index = trivial_buffer->offset_index;
+  if (!index ||
+      (index->head == index->tail) ||
+      (index->entries[index->head].page != page))
+    return;
+
+  if (removed)
+    ++index->head;
+  else
+    index->entries[index->head].offset += seek_len;
+}
+
+/*******************************************************************************
+ * Account for the head page of the buffer having grown by len bytes.
+ */
+static void pb_trivial_buffer_index_rewind(
+    struct pb_trivial_buffer * const trivial_buffer,
+    const struct pb_page *page,
+    uint64_t len) {
+  struct pb_trivial_buffer_index *index = trivial_buffer->offset_index;
+  if (!index ||
+      (index->head == index->tail) ||
+      (index->entries[index->head].page != page))
+    return;
+
+  if (index->entries[index->head].offset < len) {
+    pb_trivial_buffer_index_invalidate(trivial_buffer);
+
+    return;
+  }
+
+  index->entries[index->head].offset -= len;
+}
+
+/*******************************************************************************
+ * Account for the tail page of the buffer having been removed.
+ */
+static void pb_trivial_buffer_index_trim(
+    struct pb_trivial_buffer * const trivial_buffer,
+    const struct pb_page *page) {
+  struct pb_trivial_buffer_index *index = trivial_buffer->offset_index;
+  if (!index ||
+      (index->head == index->tail) ||
+      (index->entries[index->tail - 1].page != page))
+    return;
+
+  --index->tail;
+}
+
+/*******************************************************************************
+ * Make room for count more entries at the tail of the index, either by moving
+ * the entries down over the space freed by seeks, or by growing the array.
+ */
+static bool pb_trivial_buffer_index_reserve(
+    struct pb_trivial_buffer * const trivial_buffer,
+    size_t count) {
+  struct pb_trivial_buffer_index *index = trivial_buffer->offset_index;
+  const struct pb_allocator *allocator = trivial_buffer->buffer.allocator;
+
+  if ((index->tail + count) <= index->capacity)
+    return true;
+
+  if ((index->head >= count) && (index->head >= (index->capacity / 2))) {
+    memmove(
+      index->entries,
+      &index->entries[index->head],
+      (index->tail - index->head) *
+        sizeof(struct pb_trivial_buffer_index_entry));
+
+    index->tail -= index->head;
+    index->head = 0;
+
+    return true;
+  }
+
+  size_t capacity =
+    (index->capacity != 0) ?
+      index->capacity * 2 : PB_TRIVIAL_BUFFER_INDEX_INITIAL_CAPACITY;
+  while (capacity < (index->tail + count))
+    capacity *= 2;
+
+  struct pb_trivial_buffer_index_entry *entries =
+    pb_allocator_realloc(
+      allocator,
+      index->entries,
+      index->capacity * sizeof(struct pb_trivial_buffer_index_entry),
+      capacity * sizeof(struct pb_trivial_buffer_index_entry));
+  if (!entries)
+    return false;
+
+  index->entries = entries;
+  index->capacity = capacity;
+
+  return true;
+}
+
+/*******************************************************************************
+ * Make room for count more entries in front of the head of the index, by
+ * growing the array and moving the entries to its middle, so that further
+ * entries may be added at either end without moving them again.
+ */
+static bool pb_trivial_buffer_index_reserve_front(
+    struct pb_trivial_buffer * const trivial_buffer,
+    size_t count) {
+  struct pb_trivial_buffer_index *index = trivial_buffer->offset_index;
+
+  if (index->head >= count)
+    return true;
+
+  size_t used = index->tail - index->head;
+
+  if (!pb_trivial_buffer_index_reserve(
+         trivial_buffer, (index->capacity - index->tail) + used + (2 * count)))
+    return false;
+
+  size_t head = (index->capacity - used) / 2;
+
+  memmove(
+    &index->entries[head],
+    &index->entries[index->head],
+    used * sizeof(struct pb_trivial_buffer_index_entry));
+
+  index->head = head;
+  index->tail = head + used;
+
+  return true;
+}
+
+/*******************************************************************************
+ * Find the last entry whose offset is not beyond the target offset.
+ */
+static size_t pb_trivial_buffer_index_find(
+    const struct pb_trivial_buffer_index *index,
+    uint64_t target) {
+  size_t low = index->head;
+  size_t high = index->tail;
+
+  while ((high - low) > 1) {
+    size_t middle = low + ((high - low) / 2);
+
+    if (index->entries[middle].offset <= target)
+      low = middle;
+    else
+      high = middle;
+  }
+
+  return low;
+}
+
+/*******************************************************************************
+ * Account for count pages having been linked into the buffer in front of
+ * next_page, adding len bytes to the buffer.  If next_page was split to make
+ * the insertion, the first of the pages is its front part.
+ *
+ * The entries on the shorter side of the insertion are moved to make room
+ * for the new entries, so inserts close to the head of the buffer don't
+ * touch the rest of the index.
+ */
+static void pb_trivial_buffer_index_insert(
+    struct pb_trivial_buffer * const trivial_buffer,
+    struct pb_page * const next_page,
+    size_t count,
+    uint64_t len) {
+  struct pb_trivial_buffer_index *index = trivial_buffer->offset_index;
+  if (!index)
+    return;
+
+  if (index->head == index->tail)
+    return;
+
+  size_t position =
+    (next_page == index->lookup_page) ?
+      pb_trivial_buffer_index_find(index, index->lookup_offset) :
+      index->tail;
+
+  if ((position == index->tail) ||
+      (index->entries[position].page != next_page)) {
+    // pages not yet indexed are indexed at the next lookup
+    position = index->head;
+    while ((position < index->tail) &&
+           (index->entries[position].page != next_page))
+      ++position;
+    if (position == index->tail)
+      return;
+  }
+
+  uint64_t offset = index->entries[position].offset;
+  size_t entry;
+
+  if (((position - index->head) < (index->tail - position)) &&
+      (index->entries[index->head].offset >= len)) {
+    size_t head = index->head;
+
+    if (!pb_trivial_buffer_index_reserve_front(trivial_buffer, count)) {
+      pb_trivial_buffer_index_invalidate(trivial_buffer);
+
+      return;
+    }
+
+    position += index->head - head;
+
+    for (entry = index->head; entry < position; ++entry) {
+      index->entries[entry - count] = index->entries[entry];
+      index->entries[entry - count].offset -= len;
+    }
+
+    index->head -= count;
+    position -= count;
+    offset -= len;
+  } else {
+    size_t head = index->head;
+
+    if (!pb_trivial_buffer_index_reserve(trivial_buffer, count)) {
+      pb_trivial_buffer_index_invalidate(trivial_buffer);
+
+      return;
+    }
+
+    position -= head - index->head;
+
+    memmove(
+      &index->entries[position + count],
+      &index->entries[position],
+      (index->tail - position) *
+        sizeof(struct pb_trivial_buffer_index_entry));
+
+    index->tail += count;
+
+    for (entry = position + count + 1; entry < index->tail; ++entry)
+      index->entries[entry].offset += len;
+  }
+
+  struct pb_page *page = next_page;
+  for (entry = 0; entry < count; ++entry)
+    page = page->prev;
+
+  for (entry = position; entry < (position + count); ++entry) {
+    index->entries[entry].page = page;
+    index->entries[entry].offset = offset;
+
+    offset += pb_page_get_len(page);
+    page = page->next;
+  }
+
+  index->entries[position + count].offset = offset;
+
+  if (next_page == index->lookup_page)
+    index->lookup_offset = offset;
+}
+
+/*******************************************************************************
+ * Add entries for pages that have been appended to the end of the buffer
+ * since the index was last updated.
+ */
+static bool pb_trivial_buffer_index_update(
+    struct pb_trivial_buffer * const trivial_buffer) {
+  struct pb_trivial_buffer_index *index = trivial_buffer->offset_index;
+
+  struct pb_page *page;
+  uint64_t offset;
+
+  if (index->head == index->tail) {
+    index->head = 0;
+    index->tail = 0;
+
+    page = trivial_buffer->page_end.next;
+    offset = PB_TRIVIAL_BUFFER_INDEX_ORIGIN;
+  } else {
+    struct pb_trivial_buffer_index_entry *entry =
+      &index->entries[index->tail - 1];
+
+    page = entry->page->next;
+    offset = entry->offset + pb_page_get_len(entry->page);
+  }
+
+  while (page != &trivial_buffer->page_end) {
+    if (!pb_trivial_buffer_index_reserve(trivial_buffer, 1))
+      return false;
+
+    index->entries[index->tail].page = page;
+    index->entries[index->tail].offset = offset;
+    ++index->tail;
+
+    offset += pb_page_get_len(page);
+    page = page->next;
+  }
+
+  return true;
+}
+
+
+
 /*******************************************************************************
  */
 void pb_trivial_buffer_get_iterator(struct pb_buffer * const buffer,
@@ -753,6 +1819,50 @@ void pb_trivial_buffer_prev_iterator(struct pb_buffer * const buffer,
   buffer_iterator->data_vec = &page->prev->data_vec;
 }
 
+size_t pb_trivial_buffer_get_iterator_at(struct pb_buffer * const buffer,
+    uint64_t offset,
+    struct pb_buffer_iterator * const buffer_iterator) {
+  struct pb_trivial_buffer *trivial_buffer = (struct pb_trivial_buffer*)buffer;
+
+  if (offset >= trivial_buffer->data_size) {
+    pb_trivial_buffer_get_end_iterator(buffer, buffer_iterator);
+
+    return 0;
+  }
+
+  if (!trivial_buffer->offset_index) {
+    trivial_buffer->offset_index =
+      pb_allocator_calloc(
+        buffer->allocator, sizeof(struct pb_trivial_buffer_index));
+  }
+
+  struct pb_trivial_buffer_index *index = trivial_buffer->offset_index;
+
+  if (!index || !pb_trivial_buffer_index_update(trivial_buffer)) {
+    // without an index, fall back to walking the pages
+    pb_trivial_buffer_get_iterator(buffer, buffer_iterator);
+
+    while (offset >= pb_buffer_iterator_get_len(buffer_iterator)) {
+      offset -= pb_buffer_iterator_get_len(buffer_iterator);
+
+      pb_trivial_buffer_next_iterator(buffer, buffer_iterator);
+    }
+
+    return offset;
+  }
+
+  uint64_t target = index->entries[index->head].offset + offset;
+
+  size_t position = pb_trivial_buffer_index_find(index, target);
+
+  index->lookup_page = index->entries[position].page;
+  index->lookup_offset = index->entries[position].offset;
+
+  buffer_iterator->data_vec = &index->entries[position].page->data_vec;
+
+  return target - index->entries[position].offset;
+}
+
 /*******************************************************************************
  */
 static char pb_trivial_buffer_byte_iterator_null_char = '\0';
@@ -849,6 +1959,74 @@ void pb_trivial_buffer_prev_byte_iterator(struct pb_buffer * const buffer,
 
 
 
+/*******************************************************************************
+ * Indicate whether the memory region of a page may be grown into, that is,
+ * whether it is owned and not shared with any other page.
+ */
+static bool pb_trivial_buffer_is_page_growable(const struct pb_page *page) {
+  return
+    (page->data->responsibility == pb_data_responsibility_owned) &&
+    (page->data->operations != pb_get_mem_data_operations()) &&
+    !pb_page_is_data_shared(page);
+}
+
+/*******************************************************************************
+ * Create a page for the head of the buffer, leaving the strategy headroom
+ * free at the front of its memory region.
+ */
+static struct pb_page *pb_trivial_buffer_page_create_head(
+    struct pb_buffer * const buffer,
+    size_t capacity, size_t len) {
+  struct pb_trivial_buffer_operations *trivial_operations =
+    (struct pb_trivial_buffer_operations*)buffer->operations;
+  size_t headroom = buffer->strategy->headroom;
+
+  struct pb_page *page =
+    trivial_operations->page_create(buffer, headroom + capacity);
+  if (!page)
+    return NULL;
+
+  page->data_vec.base = (uint8_t*)page->data_vec.base + headroom;
+  page->data_vec.len = len;
+
+  return page;
+}
+
+/*******************************************************************************
+ * Grow the first page of the buffer into the headroom of its memory region.
+ */
+static uint64_t pb_trivial_buffer_grow_head(struct pb_buffer * const buffer,
+    uint64_t len) {
+  struct pb_trivial_buffer *trivial_buffer = (struct pb_trivial_buffer*)buffer;
+
+  if ((buffer->strategy->headroom == 0) || (trivial_buffer->data_size == 0))
+    return 0;
+
+  struct pb_page *page = trivial_buffer->page_end.next;
+
+  if (!pb_trivial_buffer_is_page_growable(page))
+    return 0;
+
+  uint64_t grow_len =
+    (uint64_t)((uint8_t*)pb_page_get_base(page) -
+               (uint8_t*)pb_data_get_base(page->data));
+  if (grow_len > len)
+    grow_len = len;
+  if (grow_len == 0)
+    return 0;
+
+  pb_trivial_buffer_increment_data_revision(buffer);
+
+  page->data_vec.base = (uint8_t*)page->data_vec.base - grow_len;
+  page->data_vec.len += grow_len;
+
+  pb_trivial_buffer_index_rewind(trivial_buffer, page, grow_len);
+
+  pb_trivial_buffer_increment_data_size(buffer, grow_len);
+
+  return grow_len;
+}
+
 /*******************************************************************************
  */
 uint64_t pb_trivial_buffer_insert(struct pb_buffer * const buffer,
@@ -858,9 +2036,13 @@ uint64_t pb_trivial_buffer_insert(struct pb_buffer * const buffer,
   struct pb_trivial_buffer_operations *trivial_operations =
     (struct pb_trivial_buffer_operations*)buffer->operations;
 
-  if (!pb_buffer_is_end_iterator(buffer, buffer_iterator) ||
-      (pb_buffer_get_data_size(buffer) == 0))
+  bool is_end = pb_buffer_is_end_iterator(buffer, buffer_iterator);
+
+  if (!is_end) {
     pb_trivial_buffer_increment_data_revision(buffer);
+  } else if (pb_buffer_get_data_size(buffer) == 0) {
+    pb_trivial_buffer_increment_data_revision(buffer);
+  }
 
   struct pb_page *next_page =
     trivial_operations->resolve_iterator(buffer, buffer_iterator);
@@ -896,11 +2078,59 @@ uint64_t pb_trivial_buffer_insert(struct pb_buffer * const buffer,
   prev_page->next = page;
   next_page->prev = page;
 
+  if (!is_end)
+    pb_trivial_buffer_index_insert(
+      (struct pb_trivial_buffer*)buffer,
+      next_page, (offset != 0) ? 2 : 1, pb_page_get_len(page));
+
   pb_trivial_buffer_increment_data_size(buffer, pb_page_get_len(page));
 
   return pb_page_get_len(page);
 }
 
+/*******************************************************************************
+ * Extend the buffer by a run of pages created together by the data factory,
+ * linking them to the end of the buffer in a single pass.
+ */
+static uint64_t pb_trivial_buffer_extend_pages(struct pb_buffer * const buffer,
+    uint64_t len) {
+  struct pb_trivial_buffer *trivial_buffer = (struct pb_trivial_buffer*)buffer;
+
+  if (len > SIZE_MAX)
+    return 0;
+
+  size_t headroom =
+    (trivial_buffer->data_size == 0) ? buffer->strategy->headroom : 0;
+
+  struct pb_page *page =
+    trivial_buffer->data_factory->pages_create(
+      len, buffer->strategy->page_size, headroom, buffer->allocator);
+  if (!page)
+    return 0;
+
+  if (trivial_buffer->data_size == 0)
+    pb_trivial_buffer_increment_data_revision(buffer);
+
+  struct pb_page *prev_page = trivial_buffer->page_end.prev;
+
+  while (page) {
+    struct pb_page *next_page = page->next;
+
+    page->prev = prev_page;
+    prev_page->next = page;
+
+    prev_page = page;
+    page = next_page;
+  }
+
+  prev_page->next = &trivial_buffer->page_end;
+  trivial_buffer->page_end.prev = prev_page;
+
+  pb_trivial_buffer_increment_data_size(buffer, len);
+
+  return len;
+}
+
 /*******************************************************************************
  */
 uint64_t pb_trivial_buffer_extend(struct pb_buffer * const buffer,
@@ -908,10 +2138,20 @@ uint64_t pb_trivial_buffer_extend(struct pb_buffer * const buffer,
   if (buffer->strategy->rejects_extend)
     return 0;
 
+  struct pb_trivial_buffer *trivial_buffer = (struct pb_trivial_buffer*)buffer;
   struct pb_trivial_buffer_operations *trivial_operations =
     (struct pb_trivial_buffer_operations*)buffer->operations;
   uint64_t extended = 0;
 
+  // extensions spanning several pages are allocated in one block if possible
+  if ((buffer->strategy->page_size != 0) &&
+      (buffer->strategy->page_size < len) &&
+      (trivial_buffer->data_factory->pages_create)) {
+    extended = pb_trivial_buffer_extend_pages(buffer, len);
+    if (extended > 0)
+      return extended;
+  }
+
   while (len > 0) {
     size_t extend_len =
       ((buffer->strategy->page_size != 0) &&
@@ -921,7 +2161,10 @@ uint64_t pb_trivial_buffer_extend(struct pb_buffer * const buffer,
     struct pb_buffer_iterator buffer_iterator;
     pb_buffer_get_end_iterator(buffer, &buffer_iterator);
 
-    struct pb_page *page = trivial_operations->page_create(buffer, extend_len);
+    struct pb_page *page =
+      (pb_buffer_get_data_size(buffer) == 0) ?
+        pb_trivial_buffer_page_create_head(buffer, extend_len, extend_len) :
+        trivial_operations->page_create(buffer, extend_len);
     if (!page)
       return extended;
 
@@ -962,12 +2205,18 @@ uint64_t pb_trivial_buffer_rewind(struct pb_buffer * const buffer,
   if (buffer->strategy->rejects_rewind)
     return 0;
 
-  struct pb_trivial_buffer_operations *trivial_operations =
-    (struct pb_trivial_buffer_operations*)buffer->operations;
   uint64_t rewinded = 0;
 
   while (len > 0) {
-    uint64_t rewind_len =
+    uint64_t rewind_len = pb_trivial_buffer_grow_head(buffer, len);
+    if (rewind_len > 0) {
+      len -= rewind_len;
+      rewinded += rewind_len;
+
+      continue;
+    }
+
+    rewind_len =
       ((buffer->strategy->page_size != 0) &&
        (buffer->strategy->page_size < len)) ?
         buffer->strategy->page_size : len;
@@ -975,7 +2224,8 @@ uint64_t pb_trivial_buffer_rewind(struct pb_buffer * const buffer,
     struct pb_buffer_iterator buffer_iterator;
     pb_buffer_get_iterator(buffer, &buffer_iterator);
 
-    struct pb_page *page = trivial_operations->page_create(buffer, rewind_len);
+    struct pb_page *page =
+      pb_trivial_buffer_page_create_head(buffer, rewind_len, rewind_len);
     if (!page)
       return rewinded;
 
@@ -1015,6 +2265,10 @@ uint64_t pb_trivial_buffer_seek(struct pb_buffer * const buffer, uint64_t len) {
     page->data_vec.base += seek_len;
     page->data_vec.len -= seek_len;
 
+    pb_trivial_buffer_index_seek(
+      (struct pb_trivial_buffer*)buffer, page, seek_len,
+      (pb_page_get_len(page) == 0));
+
     if (pb_page_get_len(page) == 0) {
       pb_buffer_next_iterator(buffer, &buffer_iterator);
 
@@ -1067,6 +2321,8 @@ uint64_t pb_trivial_buffer_trim(struct pb_buffer * const buffer, uint64_t len) {
     page->data_vec.len -= trim_len;
 
     if (pb_page_get_len(page) == 0) {
+      pb_trivial_buffer_index_trim((struct pb_trivial_buffer*)buffer, page);
+
       pb_buffer_prev_iterator(buffer, &buffer_iterator);
 
       struct pb_page *prev_page = (struct pb_page*)buffer_iterator.data_vec;
@@ -1148,6 +2404,28 @@ uint64_t pb_trivial_buffer_insert_data(struct pb_buffer * const buffer,
        buffer->strategy->rejects_insert)
     return 0;
 
+  // data inserted at the head that fits the headroom is copied there
+  struct pb_trivial_buffer *trivial_buffer = (struct pb_trivial_buffer*)buffer;
+  struct pb_trivial_buffer_operations *trivial_operations =
+    (struct pb_trivial_buffer_operations*)buffer->operations;
+
+  if ((offset == 0) &&
+      (len > 0) &&
+      (trivial_buffer->data_size > 0) &&
+      (trivial_operations->resolve_iterator(buffer, buffer_iterator) ==
+         trivial_buffer->page_end.next)) {
+    struct pb_page *page = trivial_buffer->page_end.next;
+
+    if (pb_trivial_buffer_is_page_growable(page) &&
+        ((uint64_t)((uint8_t*)pb_page_get_base(page) -
+                    (uint8_t*)pb_data_get_base(page->data)) >= len) &&
+        (pb_trivial_buffer_grow_head(buffer, len) == len)) {
+      memcpy(pb_page_get_base(page), buf, len);
+
+      return len;
+    }
+  }
+
   return
     pb_trivial_buffer_insert_data1(buffer, buffer_iterator, offset, buf, len);
 }
@@ -1463,17 +2741,116 @@ uint64_t pb_trivial_buffer_insert_buffer(struct pb_buffer * const buffer,
 }
 
 /*******************************************************************************
+ * Get the spare capacity of the tail page, that is, the part of the tail
+ * pages' memory region beyond the end of the page.  Only a memory region that
+ * is owned, and not shared with other pages, may be appended to.
+ */
+static size_t pb_trivial_buffer_get_tail_capacity(
+    struct pb_buffer * const buffer) {
+  struct pb_trivial_buffer *trivial_buffer = (struct pb_trivial_buffer*)buffer;
+
+  if (trivial_buffer->data_size == 0)
+    return 0;
+
+  struct pb_page *page = trivial_buffer->page_end.prev;
+  struct pb_data *data = page->data;
+
+  if (!pb_trivial_buffer_is_page_growable(page))
+    return 0;
+
+  uint8_t *page_end = (uint8_t*)pb_page_get_base_at(page, pb_page_get_len(page));
+  uint8_t *data_end = (uint8_t*)pb_data_get_base_at(data, pb_data_get_len(data));
+
+  return (size_t)(data_end - page_end);
+}
+
+/*******************************************************************************
+ * Append data into the spare capacity of the tail page.
+ */
+static uint64_t pb_trivial_buffer_write_tail(struct pb_buffer * const buffer,
+    const uint8_t *buf,
+    uint64_t len) {
+  struct pb_trivial_buffer *trivial_buffer = (struct pb_trivial_buffer*)buffer;
+
+  uint64_t write_len = pb_trivial_buffer_get_tail_capacity(buffer);
+  if (write_len > len)
+    write_len = len;
+  if (write_len == 0)
+    return 0;
+
+  struct pb_page *page = trivial_buffer->page_end.prev;
+
+  memcpy(pb_page_get_base_at(page, pb_page_get_len(page)), buf, write_len);
+
+  page->data_vec.len += write_len;
+
+  pb_trivial_buffer_increment_data_size(buffer, write_len);
+
+  return write_len;
+}
+
+/*******************************************************************************
+ * Append new pages, allocated with a capacity of a full page_size, so that
+ * subsequent small writes may be appended to the spare capacity.
  */
+static uint64_t pb_trivial_buffer_write_data1(
+    struct pb_buffer * const buffer,
+    const uint8_t *buf,
+    uint64_t len) {
+  struct pb_trivial_buffer_operations *trivial_operations =
+     (struct pb_trivial_buffer_operations*)buffer->operations;
+  uint64_t written = 0;
+
+  while (len > 0) {
+    uint64_t write_len =
+      ((buffer->strategy->page_size != 0) &&
+       (buffer->strategy->page_size < len)) ?
+        buffer->strategy->page_size : len;
+
+    size_t capacity =
+      (buffer->strategy->page_size != 0) ?
+        buffer->strategy->page_size : write_len;
+
+    struct pb_page *page =
+      (pb_buffer_get_data_size(buffer) == 0) ?
+        pb_trivial_buffer_page_create_head(buffer, capacity, write_len) :
+        trivial_operations->page_create(buffer, capacity);
+    if (!page)
+      return written;
+
+    page->data_vec.len = write_len;
+
+    memcpy(pb_page_get_base(page), buf + written, write_len);
+
+    struct pb_buffer_iterator buffer_iterator;
+    pb_buffer_get_end_iterator(buffer, &buffer_iterator);
+
+    write_len = pb_trivial_buffer_insert(buffer, &buffer_iterator, 0, page);
+
+    if (write_len == 0) {
+      pb_page_destroy(page, buffer->allocator);
+      break;
+    }
+
+    len -= write_len;
+    written += write_len;
+  }
+
+  return written;
+}
+
 uint64_t pb_trivial_buffer_write_data(struct pb_buffer * const buffer,
     const void *buf,
     uint64_t len) {
   if (buffer->strategy->rejects_write)
     return 0;
 
-  struct pb_buffer_iterator buffer_iterator;
-  pb_buffer_get_end_iterator(buffer, &buffer_iterator);
+  uint64_t written = pb_trivial_buffer_write_tail(buffer, buf, len);
 
-  return pb_trivial_buffer_insert_data1(buffer, &buffer_iterator, 0, buf, len);
+  return
+    written +
+    pb_trivial_buffer_write_data1(
+      buffer, (const uint8_t*)buf + written, len - written);
 }
 
 uint64_t pb_trivial_buffer_write_data_ref(struct pb_buffer * const buffer,
@@ -1489,6 +2866,55 @@ uint64_t pb_trivial_buffer_write_data_ref(struct pb_buffer * const buffer,
     pb_trivial_buffer_insert_data_ref1(buffer, &buffer_iterator, 0, buf, len);
 }
 
+uint64_t pb_trivial_buffer_write_data_mem(struct pb_buffer * const buffer,
+    void *buf,
+    uint64_t len,
+    void (*release)(void *buf, uint64_t len, void *context),
+    void *context) {
+  struct pb_data *data =
+    (!buffer->strategy->rejects_write) ?
+      pb_mem_data_create(buf, len, release, context, buffer->allocator) :
+      NULL;
+  if (!data) {
+    release(buf, len, context);
+
+    return 0;
+  }
+
+  struct pb_buffer_iterator buffer_iterator;
+  pb_buffer_get_end_iterator(buffer, &buffer_iterator);
+
+  uint64_t written = 0;
+
+  while (len > 0) {
+    uint64_t write_len =
+      ((buffer->strategy->page_size != 0) &&
+       (buffer->strategy->page_size < len)) ?
+        buffer->strategy->page_size : len;
+
+    struct pb_page *page = pb_page_create(data, buffer->allocator);
+    if (!page)
+      break;
+
+    page->data_vec.base = pb_data_get_base_at(data, written);
+    page->data_vec.len = write_len;
+
+    write_len = pb_trivial_buffer_insert(buffer, &buffer_iterator, 0, page);
+
+    if (write_len == 0) {
+      pb_page_destroy(page, buffer->allocator);
+      break;
+    }
+
+    len -= write_len;
+    written += write_len;
+  }
+
+  pb_data_put(data);
+
+  return written;
+}
+
 uint64_t pb_trivial_buffer_write_buffer(struct pb_buffer * const buffer,
     struct pb_buffer * const src_buffer,
     uint64_t len) {
@@ -1521,6 +2947,135 @@ uint64_t pb_trivial_buffer_write_buffer(struct pb_buffer * const buffer,
       buffer, &buffer_iterator, 0, src_buffer, len);
 }
 
+/*******************************************************************************
+ * Offer the spare capacity of the tail page, then new pages of page_size, to
+ * fill, and append what it wrote.  The new pages are only inserted once fill
+ * has returned, so that a failed fill leaves the buffer unchanged.
+ */
+ssize_t pb_trivial_buffer_write_data_fill(struct pb_buffer * const buffer,
+    uint64_t len,
+    ssize_t (*fill)(const struct iovec *iov, int iovcnt, void *context),
+    void *context) {
+  struct pb_trivial_buffer *trivial_buffer = (struct pb_trivial_buffer*)buffer;
+  struct pb_trivial_buffer_operations *trivial_operations =
+    (struct pb_trivial_buffer_operations*)buffer->operations;
+
+  if (buffer->strategy->rejects_write) {
+    errno = EPERM;
+
+    return -1;
+  }
+
+  if (len == 0)
+    return 0;
+
+  struct iovec iov[PB_BUFFER_FILL_IOVEC_SIZE];
+  struct pb_page *pages[PB_BUFFER_FILL_IOVEC_SIZE];
+  size_t page_count = 0;
+  int iovcnt = 0;
+
+  uint64_t tail_len = pb_trivial_buffer_get_tail_capacity(buffer);
+  if (tail_len > len)
+    tail_len = len;
+
+  if (tail_len > 0) {
+    struct pb_page *page = trivial_buffer->page_end.prev;
+
+    iov[0].iov_base = pb_page_get_base_at(page, pb_page_get_len(page));
+    iov[0].iov_len = (size_t)tail_len;
+
+    ++iovcnt;
+  }
+
+  uint64_t offered = tail_len;
+
+  while ((offered < len) && (iovcnt < PB_BUFFER_FILL_IOVEC_SIZE)) {
+    uint64_t page_len =
+      ((buffer->strategy->page_size != 0) &&
+       (buffer->strategy->page_size < (len - offered))) ?
+        buffer->strategy->page_size : (len - offered);
+
+    size_t capacity =
+      (buffer->strategy->page_size != 0) ?
+        buffer->strategy->page_size : page_len;
+
+    struct pb_page *page =
+      ((trivial_buffer->data_size == 0) && (page_count == 0)) ?
+        pb_trivial_buffer_page_create_head(buffer, capacity, 0) :
+        trivial_operations->page_create(buffer, capacity);
+    if (!page)
+      break;
+
+    pages[page_count++] = page;
+
+    iov[iovcnt].iov_base = pb_page_get_base(page);
+    iov[iovcnt].iov_len = (size_t)page_len;
+
+    ++iovcnt;
+
+    offered += page_len;
+  }
+
+  if (iovcnt == 0) {
+    errno = ENOMEM;
+
+    return -1;
+  }
+
+  ssize_t result = fill(iov, iovcnt, context);
+  int temp_errno = errno;
+
+  uint64_t filled = (result > 0) ? (uint64_t)result : 0;
+  uint64_t written = 0;
+
+  if (tail_len > filled)
+    tail_len = filled;
+
+  if (tail_len > 0) {
+    trivial_buffer->page_end.prev->data_vec.len += tail_len;
+
+    pb_trivial_buffer_increment_data_size(buffer, tail_len);
+
+    written += tail_len;
+  }
+
+  struct pb_buffer_iterator buffer_iterator;
+  pb_buffer_get_end_iterator(buffer, &buffer_iterator);
+
+  size_t inserted = 0;
+
+  for (; inserted < page_count; ++inserted) {
+    uint64_t page_len = iov[iovcnt - page_count + inserted].iov_len;
+    if (page_len > filled - written)
+      page_len = filled - written;
+    if (page_len == 0)
+      break;
+
+    struct pb_page *page = pages[inserted];
+
+    page->data_vec.len = page_len;
+
+    if (pb_trivial_buffer_insert(buffer, &buffer_iterator, 0, page) == 0)
+      break;
+
+    written += page_len;
+  }
+
+  // pages that received no data, or that couldn't be inserted
+  for (size_t i = inserted; i < page_count; ++i)
+    pb_page_destroy(pages[i], buffer->allocator);
+
+  if (written < filled) {
+    errno = ENOMEM;
+
+    return -1;
+  }
+
+  errno = temp_errno;
+
+  return result;
+}
+
 /*******************************************************************************
  */
 uint64_t pb_trivial_buffer_overwrite_data(struct pb_buffer * const buffer,
@@ -1542,7 +3097,7 @@ uint64_t pb_trivial_buffer_overwrite_data(struct pb_buffer * const buffer,
     struct pb_page *page = (struct pb_page*)buffer_iterator.data_vec;
 
     if (!buffer->strategy->clone_on_write ||
-        (page->data->use_count > 1) ||
+        pb_page_is_data_shared(page) ||
         (page->data->responsibility == pb_data_responsibility_referenced)) {
       if (!trivial_operations->dup_page_data(buffer, page))
         break;
@@ -1598,7 +3153,7 @@ uint64_t pb_trivial_buffer_overwrite_buffer(struct pb_buffer * const buffer,
     struct pb_page *src_page = (struct pb_page*)src_buffer_iterator.data_vec;
 
     if (!buffer->strategy->clone_on_write ||
-        (page->data->use_count > 1) ||
+        pb_page_is_data_shared(page) ||
         (page->data->responsibility == pb_data_responsibility_referenced)) {
       if (!trivial_operations->dup_page_data(buffer, page))
         break;
@@ -1677,6 +3232,105 @@ uint64_t pb_trivial_buffer_read_data(struct pb_buffer * const buffer,
   return readed;
 }
 
+/*******************************************************************************
+ * Indicate whether a page may be coalesced with its neighbours.
+ */
+static bool pb_trivial_buffer_is_page_compactable(const struct pb_page *page,
+    size_t threshold) {
+  return
+    (pb_page_get_len(page) < threshold) &&
+    !pb_page_is_data_shared(page);
+}
+
+uint64_t pb_trivial_buffer_compact(struct pb_buffer * const buffer,
+    size_t threshold) {
+  struct pb_trivial_buffer *trivial_buffer = (struct pb_trivial_buffer*)buffer;
+  struct pb_trivial_buffer_operations *trivial_operations =
+    (struct pb_trivial_buffer_operations*)buffer->operations;
+  size_t page_size = buffer->strategy->page_size;
+
+  if (threshold == 0)
+    threshold = page_size;
+
+  uint64_t removed = 0;
+
+  struct pb_page *page = trivial_buffer->page_end.next;
+
+  while (page != &trivial_buffer->page_end) {
+    if (!pb_trivial_buffer_is_page_compactable(page, threshold)) {
+      page = page->next;
+
+      continue;
+    }
+
+    // measure the run of compactable pages that fit in a single page
+    struct pb_page *run_end = page->next;
+    size_t run_len = pb_page_get_len(page);
+    uint64_t run_count = 1;
+
+    while ((run_end != &trivial_buffer->page_end) &&
+           pb_trivial_buffer_is_page_compactable(run_end, threshold) &&
+           ((page_size == 0) ||
+            ((run_len + pb_page_get_len(run_end)) <= page_size))) {
+      run_len += pb_page_get_len(run_end);
+      ++run_count;
+
+      run_end = run_end->next;
+    }
+
+    if (run_count == 1) {
+      page = run_end;
+
+      continue;
+    }
+
+    struct pb_page *compact_page =
+      trivial_operations->page_create(
+        buffer, (page_size != 0) ? page_size : run_len);
+    if (!compact_page)
+      break;
+
+    compact_page->data_vec.len = 0;
+
+    while (page != run_end) {
+      struct pb_page *next_page = page->next;
+
+      memcpy(
+        pb_page_get_base_at(compact_page, pb_page_get_len(compact_page)),
+        pb_page_get_base(page),
+        pb_page_get_len(page));
+
+      compact_page->data_vec.len += pb_page_get_len(page);
+
+      page->prev->next = next_page;
+      next_page->prev = page->prev;
+
+      page->prev = NULL;
+      page->next = NULL;
+
+      pb_page_destroy(page, buffer->allocator);
+
+      page = next_page;
+    }
+
+    compact_page->prev = run_end->prev;
+    compact_page->next = run_end;
+
+    run_end->prev->next = compact_page;
+    run_end->prev = compact_page;
+
+    removed += run_count - 1;
+  }
+
+  if (removed > 0) {
+    pb_trivial_buffer_increment_data_revision(buffer);
+
+    pb_trivial_buffer_index_invalidate(trivial_buffer);
+  }
+
+  return removed;
+}
+
 /*******************************************************************************
  */
 static void pb_trivial_buffer_clear_impl(struct pb_buffer * const buffer,
@@ -1691,6 +3345,8 @@ static void pb_trivial_buffer_clear_impl(struct pb_buffer * const buffer,
   struct pb_trivial_buffer *trivial_buffer = (struct pb_trivial_buffer*)buffer;
   trivial_buffer->data_size = 0;
 
+  pb_trivial_buffer_index_invalidate(trivial_buffer);
+
   struct pb_buffer_iterator buffer_iterator;
   get_iterator(buffer, &buffer_iterator);
 
@@ -1733,6 +3389,9 @@ void pb_trivial_buffer_destroy(struct pb_buffer * const buffer) {
   pb_buffer_clear(buffer);
 
   struct pb_trivial_buffer *trivial_buffer = (struct pb_trivial_buffer*)buffer;
+
+  pb_trivial_buffer_index_destroy(trivial_buffer);
+
   struct pb_buffer_strategy *buffer_strategy =
     (struct pb_buffer_strategy*)buffer->strategy;
   const struct pb_allocator *allocator = buffer->allocator;
@@ -1744,6 +3403,83 @@ void pb_trivial_buffer_destroy(struct pb_buffer * const buffer) {
     allocator, trivial_buffer, sizeof(struct pb_trivial_buffer));
 }
 
+/*******************************************************************************
+ */
+/** The pages detached from a trivial buffer, awaiting release. */
+struct pb_trivial_buffer_reclaim_task {
+  struct pb_reclaim_task task;
+
+  /** The next page to release, heading a NULL terminated list. */
+  struct pb_page *page;
+
+  const struct pb_allocator *allocator;
+};
+
+static bool pb_trivial_buffer_reclaim_task_release(
+    struct pb_reclaim_task * const task,
+    uint64_t * const count) {
+  struct pb_trivial_buffer_reclaim_task *reclaim_task =
+    (struct pb_trivial_buffer_reclaim_task*)task;
+
+  while ((*count > 0) && (reclaim_task->page)) {
+    struct pb_page *page = reclaim_task->page;
+
+    reclaim_task->page = page->next;
+
+    page->prev = NULL;
+    page->next = NULL;
+
+    pb_page_destroy(page, reclaim_task->allocator);
+
+    --*count;
+  }
+
+  if (reclaim_task->page)
+    return false;
+
+  pb_allocator_free(
+    reclaim_task->allocator,
+    reclaim_task, sizeof(struct pb_trivial_buffer_reclaim_task));
+
+  return true;
+}
+
+void pb_trivial_buffer_destroy_deferred(struct pb_buffer * const buffer,
+    struct pb_reclaimer * const reclaimer) {
+  struct pb_trivial_buffer *trivial_buffer = (struct pb_trivial_buffer*)buffer;
+
+  if (trivial_buffer->page_end.next == &trivial_buffer->page_end) {
+    pb_buffer_destroy(buffer);
+
+    return;
+  }
+
+  struct pb_trivial_buffer_reclaim_task *reclaim_task =
+    pb_allocator_calloc(
+      buffer->allocator, sizeof(struct pb_trivial_buffer_reclaim_task));
+  if (!reclaim_task) {
+    pb_buffer_destroy(buffer);
+
+    return;
+  }
+
+  reclaim_task->task.release = &pb_trivial_buffer_reclaim_task_release;
+  reclaim_task->allocator = buffer->allocator;
+
+  // detach the page list, leaving the buffer empty
+  reclaim_task->page = trivial_buffer->page_end.next;
+  reclaim_task->page->prev = NULL;
+  trivial_buffer->page_end.prev->next = NULL;
+
+  trivial_buffer->page_end.prev = &trivial_buffer->page_end;
+  trivial_buffer->page_end.next = &trivial_buffer->page_end;
+  trivial_buffer->data_size = 0;
+
+  pb_buffer_destroy(buffer);
+
+  pb_reclaimer_submit(reclaimer, &reclaim_task->task);
+}
+
 
 
 /*******************************************************************************
@@ -1751,9 +3487,14 @@ void pb_trivial_buffer_destroy(struct pb_buffer * const buffer) {
  struct pb_page *pb_trivial_buffer_page_create(
   struct pb_buffer * const buffer,
   size_t len) {
+struct pb_trivial_buffer *trivial_buffer = (struct pb_trivial_buffer*)buffer;
 const struct pb_allocator *allocator = buffer->allocator;
 
-struct pb_data *data = pb_trivial_data_create(len, allocator);
+if (trivial_buffer->data_factory->page_create)
+  return trivial_buffer->data_factory->page_create(len, allocator);
+
+struct pb_data *data =
+  trivial_buffer->data_factory->create(len, allocator);
 if (!data)
   return NULL;
 
@@ -1772,9 +3513,11 @@ return page;
 struct pb_page *pb_trivial_buffer_page_create_ref(
   struct pb_buffer * const buffer,
   const uint8_t *buf, size_t len) {
+struct pb_trivial_buffer *trivial_buffer = (struct pb_trivial_buffer*)buffer;
 const struct pb_allocator *allocator = buffer->allocator;
 
-struct pb_data *data = pb_trivial_data_create_ref(buf, len, allocator);
+struct pb_data *data =
+  trivial_buffer->data_factory->create_ref(buf, len, allocator);
 if (!data)
   return NULL;
 
@@ -1796,10 +3539,11 @@ return page;
 */
 bool pb_trivial_buffer_dup_page_data(struct pb_buffer * const buffer,
   struct pb_page * const page) {
+struct pb_trivial_buffer *trivial_buffer = (struct pb_trivial_buffer*)buffer;
 const struct pb_allocator *allocator = buffer->allocator;
 
 struct pb_data *data =
-  pb_trivial_data_create(pb_page_get_len(page), allocator);
+  trivial_buffer->data_factory->create(pb_page_get_len(page), allocator);
 if (!data)
   return false;
 
@@ -1875,9 +3619,15 @@ uint64_t pb_data_reader_read(
   if (pb_buffer_get_data_revision(buffer) != data_reader->buffer_data_revision)
     pb_data_reader_reset(data_reader);
 
-  if (data_reader->page_offset == pb_buffer_iterator_get_len(buffer_iterator))
+  // resume at the start of the page following the last page read, which may
+  // have been added since
+  if (data_reader->page_offset ==
+        pb_buffer_iterator_get_len(buffer_iterator)) {
     pb_buffer_next_iterator(buffer, buffer_iterator);
 
+    data_reader->page_offset = 0;
+  }
+
   uint64_t readed = 0;
 
   while ((len > 0) &&
@@ -20,6 +20,7 @@
 #define PAGEBUF_H
 
 
+#include <sys/uio.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
@@ -117,7 +118,8 @@ extern "C" {
  *
  * There is no notion of locking in any of the pb_buffer operations.  Reference
  * counted objects such as pb_data do not have their counts modified in a
- * globally atomic fashion.
+ * globally atomic fashion, unless a pb_buffer is created with the atomic data
+ * factory, see pb_get_atomic_data_factory.
  *
  * It is the responsibility of authors to ensure that buffers are not accessed
  * concurrently from across thread boundaries, and even if such a thing is
@@ -249,6 +251,242 @@ const struct pb_allocator *pb_get_trivial_allocator(void);
 
 
 
+/** The slab allocator.
+ *
+ * The slab allocator serves the small, fixed size structs that pb_buffer
+ * instances allocate for every page they create, namely pb_page and pb_data,
+ * or the pair of them that the trivial data factory allocates together, from
+ * preallocated slabs of memory.  Freed structs are retained on a free
+ * list for reuse, so a buffer that continually writes and seeks data reaches
+ * a steady state where struct allocations don't reach the system heap.
+ *
+ * Allocations of any other size, such as memory regions, are passed to the
+ * fallback allocator, which is also used to allocate the slabs themselves.
+ * If no fallback allocator is supplied, the trivial allocator will be used.
+ *
+ * Slabs are retained by the allocator until it is destroyed, at which point
+ * they are released back to the fallback allocator.  It is the responsibility
+ * of authors to ensure that all objects using the slab allocator are
+ * destroyed before the slab allocator itself.
+ *
+ * The slab allocator is not thread safe, an instance should only be used by
+ * buffers that are operated on by a single thread.
+ */
+struct pb_allocator *pb_slab_allocator_create(void);
+struct pb_allocator *pb_slab_allocator_create_with_alloc(
+                                const struct pb_allocator *fallback_allocator);
+
+void pb_slab_allocator_destroy(struct pb_allocator * const allocator);
+
+
+
+/** The caching allocator.
+ *
+ * The caching allocator retains freed memory regions of a single size,
+ * region_size, for reuse.  Buffers that continually allocate and free
+ * memory regions of their page_size, for example by writing then seeking
+ * data, reach a steady state where region allocations don't reach the system
+ * heap.  Typically region_size will be the page_size of the strategy of the
+ * buffers that use the allocator, if region_size is zero then
+ * PB_BUFFER_DEFAULT_PAGE_SIZE is used.
+ *
+ * Every allocation larger than half of region_size, up to region_size, is
+ * served by a cached region, so the regions of pages that are shorter than
+ * a full page, such as the last page of a write, are also reused.
+ *
+ * Each thread using the allocator has a private magazine of at most
+ * PB_CACHING_ALLOCATOR_MAGAZINE_SIZE regions, so allocations and frees on the
+ * same thread don't contend with other threads.  When a threads' magazine
+ * overflows, it is returned in one batch to a shared depot, from which
+ * threads with an empty magazine will take a full one.  The depot is bounded
+ * at PB_CACHING_ALLOCATOR_DEPOT_SIZE magazines, excess regions are freed.
+ *
+ * Allocations of any other size are passed to the fallback allocator, which
+ * is also used to allocate regions when no cached region is available.  If no
+ * fallback allocator is supplied, the trivial allocator will be used.
+ *
+ * Unlike pb_buffer, the caching allocator itself is thread safe, as long as
+ * the fallback allocator is also thread safe.  It is the responsibility of
+ * authors to ensure that all objects using the caching allocator are
+ * destroyed before the caching allocator itself.
+ */
+#define PB_CACHING_ALLOCATOR_MAGAZINE_SIZE                32
+#define PB_CACHING_ALLOCATOR_DEPOT_SIZE                   16
+
+struct pb_allocator *pb_caching_allocator_create(size_t region_size);
+struct pb_allocator *pb_caching_allocator_create_with_alloc(
+                                size_t region_size,
+                                const struct pb_allocator *fallback_allocator);
+
+void pb_caching_allocator_destroy(struct pb_allocator * const allocator);
+
+
+
+/** The arena allocator.
+ *
+ * The arena allocator serves all allocations by advancing through chunks of
+ * memory, and its free operation does nothing.  Memory is instead reclaimed
+ * all at once by pb_arena_allocator_reset, after which the chunks are reused
+ * by later allocations.  This suits request scoped buffers, which may be
+ * created, operated on, then discarded in bulk at the end of the request.
+ *
+ * chunk_size is the size of the chunks taken from the fallback allocator,
+ * if chunk_size is zero then PB_ARENA_ALLOCATOR_DEFAULT_CHUNK_SIZE is used.
+ * Allocations larger than chunk_size are served by a dedicated chunk, which
+ * is released rather than reused on reset.  If no fallback allocator is
+ * supplied, the trivial allocator will be used.
+ *
+ * pb_buffer_destroy remains safe to call on buffers using an arena allocator,
+ * it will release references to pb_data instances held by the buffer but
+ * won't free any memory.  A buffer whose pages only reference data allocated
+ * from the arena may also simply be abandoned before the arena is reset,
+ * making teardown independent of the number of pages in the buffer.  Buffers
+ * that reference data from other allocators, for example through
+ * pb_buffer_insert, must be destroyed before reset so those references are
+ * released.  No object allocated from the arena may be used after reset.
+ *
+ * The arena allocator is not thread safe, an instance should only be used by
+ * buffers that are operated on by a single thread.
+ */
+#define PB_ARENA_ALLOCATOR_DEFAULT_CHUNK_SIZE             65536
+
+struct pb_allocator *pb_arena_allocator_create(size_t chunk_size);
+struct pb_allocator *pb_arena_allocator_create_with_alloc(
+                                size_t chunk_size,
+                                const struct pb_allocator *fallback_allocator);
+
+void pb_arena_allocator_reset(struct pb_allocator * const allocator);
+
+void pb_arena_allocator_destroy(struct pb_allocator * const allocator);
+
+
+
+/** The huge page allocator.
+ *
+ * The huge page allocator backs large memory regions with huge pages, to
+ * reduce the TLB pressure of buffers using a strategy with a large page_size,
+ * such as 2MiB or more.  Allocations of at least threshold bytes are mapped
+ * directly with MAP_HUGETLB, rounded up to a multiple of the huge page size.
+ * When the system has no huge pages reserved, the mapping is instead aligned
+ * to the huge page size and advised with MADV_HUGEPAGE, so that transparent
+ * huge pages may be used.  If threshold is zero then
+ * PB_HUGEPAGE_ALLOCATOR_DEFAULT_THRESHOLD is used.
+ *
+ * Allocations smaller than threshold, such as the pb_page and pb_data
+ * structs, are passed to the fallback allocator.  If no fallback allocator is
+ * supplied, the trivial allocator will be used.
+ *
+ * The huge page allocator is thread safe, as long as the fallback allocator
+ * is also thread safe.
+ */
+#define PB_HUGEPAGE_ALLOCATOR_PAGE_SIZE                   2097152L
+#define PB_HUGEPAGE_ALLOCATOR_DEFAULT_THRESHOLD           PB_HUGEPAGE_ALLOCATOR_PAGE_SIZE
+
+struct pb_allocator *pb_hugepage_allocator_create(size_t threshold);
+struct pb_allocator *pb_hugepage_allocator_create_with_alloc(
+                                size_t threshold,
+                                const struct pb_allocator *fallback_allocator);
+
+void pb_hugepage_allocator_destroy(struct pb_allocator * const allocator);
+
+
+
+/** The stats allocator.
+ *
+ * The stats allocator decorates another allocator, passing all operations
+ * through to it while counting the memory that passes through, using the
+ * sizes already supplied to the free and realloc operations.  This allows
+ * authors to measure the memory held by the buffers using the allocator.
+ *
+ * The stats are retrieved with pb_stats_allocator_get_stats, which copies a
+ * snapshot of the counters into a pb_allocator_stats struct:
+ *
+ * live_bytes: the amount of memory currently allocated.
+ *
+ * high_water_bytes: the highest value live_bytes has reached.
+ *
+ * alloc_count, free_count: the number of allocations and frees performed,
+ *                          a realloc counts as a single allocation.
+ *
+ * size_class_counts: a histogram of allocation sizes.  Size class i counts
+ *                    allocations of at most
+ *                    PB_STATS_ALLOCATOR_MIN_SIZE_CLASS << i bytes that don't
+ *                    fit a smaller class, the last class counting all larger
+ *                    allocations.
+ *
+ * If per_thread is false the counters are shared, and the stats allocator is
+ * only as thread safe as the pb_buffer instances using it.
+ *
+ * If per_thread is true, each thread counts into private counters, which a
+ * snapshot aggregates, so that counting doesn't contend between threads.
+ * Live bytes are published to the shared total in batches of at least
+ * PB_STATS_ALLOCATOR_FLUSH_SIZE, so the high_water_bytes value may lag behind
+ * the true high water mark by that amount per thread.
+ *
+ * If no allocator to decorate is supplied, the trivial allocator will be
+ * used.
+ */
+#define PB_STATS_ALLOCATOR_SIZE_CLASSES                   16
+#define PB_STATS_ALLOCATOR_MIN_SIZE_CLASS                 16
+#define PB_STATS_ALLOCATOR_FLUSH_SIZE                     65536
+
+struct pb_allocator_stats {
+  uint64_t live_bytes;
+  uint64_t high_water_bytes;
+
+  uint64_t alloc_count;
+  uint64_t free_count;
+
+  uint64_t size_class_counts[PB_STATS_ALLOCATOR_SIZE_CLASSES];
+};
+
+struct pb_allocator *pb_stats_allocator_create(bool per_thread);
+struct pb_allocator *pb_stats_allocator_create_with_alloc(
+                                bool per_thread,
+                                const struct pb_allocator *allocator);
+
+void pb_stats_allocator_get_stats(const struct pb_allocator *allocator,
+                                  struct pb_allocator_stats * const stats);
+
+void pb_stats_allocator_destroy(struct pb_allocator * const allocator);
+
+
+
+/** The deferred allocator.
+ *
+ * The deferred allocator decorates another allocator, deferring frees so
+ * that they may be performed in bulk, away from the thread that released the
+ * memory.  This suits pipelines where a producer thread creates pages which
+ * a consumer thread later seeks, such that pb_page and pb_data structs and
+ * their memory regions are released on the consumer thread, but would be
+ * better returned to the allocator on the producer thread, keeping the
+ * allocators' metadata local to the producers' core.
+ *
+ * Frees are queued in a private batch of each thread, of up to
+ * PB_DEFERRED_ALLOCATOR_BATCH_SIZE objects.  Full batches are published to a
+ * shared, lock free, list of pending batches.  Pending batches are returned
+ * to the decorated allocator either by the next allocation made through the
+ * deferred allocator, typically by the producer thread, or explicitly by
+ * pb_deferred_allocator_reclaim, which also publishes the partial batch of
+ * the calling thread.  Partial batches of other threads are published when
+ * those threads exit or the deferred allocator is destroyed.
+ *
+ * If no allocator to decorate is supplied, the trivial allocator will be
+ * used.  The decorated allocator must be thread safe, as objects may be
+ * returned to it from a thread other than the one that allocated them.
+ */
+#define PB_DEFERRED_ALLOCATOR_BATCH_SIZE                  64
+
+struct pb_allocator *pb_deferred_allocator_create(void);
+struct pb_allocator *pb_deferred_allocator_create_with_alloc(
+                                const struct pb_allocator *allocator);
+
+void pb_deferred_allocator_reclaim(struct pb_allocator * const allocator);
+
+void pb_deferred_allocator_destroy(struct pb_allocator * const allocator);
+
+
+
 
 
 
@@ -391,6 +629,9 @@ char pb_buffer_byte_iterator_get_current_byte(
 struct pb_buffer_strategy;
 struct pb_buffer_operations;
 
+/* Pre-declare reclaimer. */
+struct pb_reclaimer;
+
 
 
 /** The base pb_buffer class.
@@ -437,6 +678,9 @@ struct pb_buffer {
 #define PB_BUFFER_DEFAULT_PAGE_SIZE                       4096
 /** The hard maximum size of automatically sized memory regions. */
 #define PB_BUFFER_MAX_PAGE_SIZE                           16777216L
+/** The maximum number of memory regions offered to the fill function of
+ *  write_data_fill. */
+#define PB_BUFFER_FILL_IOVEC_SIZE                         16
 
 
 
@@ -620,12 +864,30 @@ struct pb_buffer_strategy {
    * reject     (true): overwrite operations will immediately return 0.
    */
   bool rejects_overwrite;
+
+  /** The amount of space to leave free at the front of the memory region of
+   *  the first page of the buffer.
+   *
+   * When a page is created at the head of the buffer, its memory region is
+   * allocated headroom bytes larger than the page, with the page placed at
+   * the end.  Rewinds, and inserts of data at the head of the buffer that fit
+   * in the remaining headroom, then grow the first page into the headroom
+   * rather than creating new pages.  This makes prepending protocol headers,
+   * for example, free of allocations.
+   *
+   * Headroom is only used while the first page's memory region is not
+   * shared with other pages.  If this value is zero, no headroom is left.
+   */
+  size_t headroom;
 };
 
 
 
 /** The structure that holds the operations that implement pb_buffer
  *  functionality.
+ *
+ * Operations added since the original interface are appended to the end of
+ * the structure, so that the layout of the existing members is unchanged.
  */
 struct pb_buffer_operations {
   /** Return a revision stamp of the data.
@@ -971,6 +1233,112 @@ struct pb_buffer_operations {
    * structures and free memory blocks associated with the buffer itself.
    */
   void (*destroy)(struct pb_buffer * const buffer);
+
+
+  /** Write data from a memory region to the buffer, taking over the region.
+   *
+   * buf: the start of the source memory region.
+   *
+   * len: the amount of data to write in bytes.
+   *
+   * release: the function to call when the buffer, and any other buffer the
+   *          data has since been shared with, no longer references the
+   *          memory region.  It receives the buf and len values given here,
+   *          and the context.
+   *
+   * context: an opaque value passed to release.
+   *
+   * Data will be appended to the end of the buffer, without being copied.
+   * The memory region must remain valid, and must not be modified by the
+   * caller, until release is called.  Release is called exactly once, even if
+   * not all of the data was written, in which case it may be called before
+   * this function returns.
+   *
+   * The return value is the amount of data successfully written to the
+   * buffer.
+   */
+  uint64_t (*write_data_mem)(struct pb_buffer * const buffer,
+                             void *buf,
+                             uint64_t len,
+                             void (*release)(void *buf, uint64_t len,
+                                             void *context),
+                             void *context);
+
+
+  /** Initialise an iterator to point to the page containing the byte at a
+   *  specific offset in the buffer.
+   *
+   * offset: the offset of the byte in the buffer data.
+   *
+   * The return value is the offset of the byte within the iterator page.
+   * If the offset is beyond the end of the buffer data, the iterator will
+   * point to the 'end' page and the return value will be zero.
+   */
+  size_t (*get_iterator_at)(struct pb_buffer * const buffer,
+                            uint64_t offset,
+                            struct pb_buffer_iterator * const buffer_iterator);
+
+
+  /** Coalesce runs of adjacent small pages into larger pages.
+   *
+   * threshold: pages of less than this many bytes are coalesced.  If zero,
+   *            the page_size of the buffer strategy is used.
+   *
+   * Runs of adjacent pages, each smaller than threshold, are copied into new
+   * pages of up to page_size, which replace them.  Pages whose memory region
+   * is shared with other pages are left untouched.  Compaction is intended to
+   * be called during idle time to restore the performance of iteration,
+   * reading and line searching in fragmented buffers.
+   *
+   * The data revision of the buffer is only changed if pages are replaced.
+   *
+   * The return value is the number of pages removed from the buffer.
+   */
+  uint64_t (*compact)(struct pb_buffer * const buffer,
+                      size_t threshold);
+
+
+  /** Destroy a buffer, leaving the release of its pages to a reclaimer.
+   *
+   * The pages of the buffer are detached from it in constant time and
+   * submitted to the reclaimer, then the buffer itself is destroyed.  The
+   * pages are released later by the reclaimer, using the allocator of the
+   * buffer, which must remain valid until then.
+   *
+   * Implementations that can't detach their pages cheaply may simply destroy
+   * the buffer.
+   */
+  void (*destroy_deferred)(struct pb_buffer * const buffer,
+                           struct pb_reclaimer * const reclaimer);
+
+
+  /** Write data to the buffer from a function that fills memory regions.
+   *
+   * len: the maximum amount of data to write in bytes.
+   *
+   * fill: the function that writes data into the iovcnt memory regions
+   *       described by iov, as readv(2) does.  It receives the context, and
+   *       returns the amount of data written, or a negative value on error.
+   *
+   * context: an opaque value passed to fill.
+   *
+   * The memory regions offered to fill are the spare capacity of the tail
+   * page of the buffer, then the memory regions of new pages, up to len bytes
+   * in total and at most PB_BUFFER_FILL_IOVEC_SIZE regions.  The data written
+   * by fill is appended to the end of the buffer without being copied, and
+   * new pages that receive no data are freed.  Appending to the spare
+   * capacity of the tail page doesn't change the data revision of the buffer.
+   *
+   * The return value is that of fill, which is zero or negative if the buffer
+   * is unchanged.  If the buffer strategy rejects writes, the call fails with
+   * EPERM, and if no memory region can be offered, or not all of the data
+   * written by fill can be appended, it fails with ENOMEM, returning -1.
+   */
+  ssize_t (*write_data_fill)(struct pb_buffer * const buffer,
+                             uint64_t len,
+                             ssize_t (*fill)(const struct iovec *iov,
+                                             int iovcnt, void *context),
+                             void *context);
 };
 
 
@@ -1001,6 +1369,10 @@ void pb_buffer_next_iterator(
 void pb_buffer_prev_iterator(
                             struct pb_buffer * const buffer,
                             struct pb_buffer_iterator * const buffer_iterator);
+size_t pb_buffer_get_iterator_at(
+                            struct pb_buffer * const buffer,
+                            uint64_t offset,
+                            struct pb_buffer_iterator * const buffer_iterator);
 
 
 void pb_buffer_get_byte_iterator(
@@ -1060,10 +1432,23 @@ uint64_t pb_buffer_write_data_ref(
                               struct pb_buffer * const buffer,
                               const void *buf,
                               uint64_t len);
+uint64_t pb_buffer_write_data_mem(
+                              struct pb_buffer * const buffer,
+                              void *buf,
+                              uint64_t len,
+                              void (*release)(void *buf, uint64_t len,
+                                              void *context),
+                              void *context);
 uint64_t pb_buffer_write_buffer(
                               struct pb_buffer * const buffer,
                               struct pb_buffer * const src_buffer,
                               uint64_t len);
+ssize_t pb_buffer_write_data_fill(
+                              struct pb_buffer * const buffer,
+                              uint64_t len,
+                              ssize_t (*fill)(const struct iovec *iov,
+                                              int iovcnt, void *context),
+                              void *context);
 
 
 uint64_t pb_buffer_overwrite_data(
@@ -1081,9 +1466,116 @@ uint64_t pb_buffer_read_data(struct pb_buffer * const buffer,
                              uint64_t len);
 
 
+uint64_t pb_buffer_compact(struct pb_buffer * const buffer,
+                           size_t threshold);
+
+
 void pb_buffer_clear(struct pb_buffer * const buffer);
 void pb_buffer_destroy(
                      struct pb_buffer * const buffer);
+void pb_buffer_destroy_deferred(
+                     struct pb_buffer * const buffer,
+                     struct pb_reclaimer * const reclaimer);
+
+
+
+
+
+
+/** Export a range of buffer data as an array of iovecs.
+ *
+ * pb_buffer_get_iovec describes up to len bytes of the buffer, starting at
+ * offset, as up to max iovecs referencing the pages of the buffer, filling
+ * the caller provided iov array in a single pass.  The return value is the
+ * number of iovecs filled, which describe less than len bytes if the range
+ * spans more than max pages or extends beyond the end of the buffer.
+ *
+ * The iovecs may be passed directly to writev, sendmsg and similar, and
+ * remain valid only until the data revision of the buffer next changes.
+ */
+size_t pb_buffer_get_iovec(struct pb_buffer * const buffer,
+                           uint64_t offset, uint64_t len,
+                           struct iovec * const iov, size_t max);
+
+
+
+/** A resumable cursor for exporting a range of buffer data as iovecs.
+ *
+ * A range spanning more pages than fit in an iovec array, such as IOV_MAX,
+ * is exported in steps by initialising a cursor with
+ * pb_buffer_iovec_cursor_init, then calling pb_buffer_iovec_cursor_next
+ * repeatedly, each call filling up to max iovecs following those of the
+ * previous call, until it returns zero.  Each step continues from where the
+ * previous step finished without searching the buffer again.
+ *
+ * A cursor is invalidated by any change to the data revision of the buffer.
+ */
+struct pb_buffer_iovec_cursor {
+  struct pb_buffer_iterator buffer_iterator;
+
+  /** The offset in the current page of the next data to export. */
+  size_t page_offset;
+
+  /** The length of the range still to be exported. */
+  uint64_t len;
+};
+
+void pb_buffer_iovec_cursor_init(
+                         struct pb_buffer * const buffer,
+                         struct pb_buffer_iovec_cursor * const iovec_cursor,
+                         uint64_t offset, uint64_t len);
+size_t pb_buffer_iovec_cursor_next(
+                         struct pb_buffer * const buffer,
+                         struct pb_buffer_iovec_cursor * const iovec_cursor,
+                         struct iovec * const iov, size_t max);
+
+
+
+
+
+
+/** The reclaimer.
+ *
+ * The reclaimer releases the pages of buffers destroyed by
+ * pb_buffer_destroy_deferred, so that dropping a very large buffer doesn't
+ * stall the thread that owns it.  Destroyed buffers are queued in the
+ * reclaimer, and their pages released in order, either incrementally, up to
+ * max_pages at a time, by pb_reclaimer_reclaim, or continuously by a
+ * background thread started with pb_reclaimer_start, which releases up to
+ * PB_RECLAIMER_THREAD_BATCH_SIZE pages at a time.
+ *
+ * pb_reclaimer_reclaim returns the number of pages released.  It may be
+ * called while the thread is running, in which case the two take turns, so
+ * that pages are still released in order.
+ * pb_reclaimer_is_empty indicates whether all queued pages have been
+ * released.
+ *
+ * Once the thread is started, pages are released on a different thread from
+ * the one that destroyed their buffer.  The allocator of each buffer
+ * submitted must then be thread safe, and any pb_data shared with buffers
+ * still in use must have atomic reference counts, such as those created by
+ * buffers using the atomic data factory.  Neither requirement is checked.
+ *
+ * Destroying the reclaimer stops its thread and releases all remaining
+ * pages.
+ *
+ * If no allocator is supplied, the trivial allocator will be used for the
+ * reclaimer itself.
+ */
+#define PB_RECLAIMER_THREAD_BATCH_SIZE                    256
+
+struct pb_reclaimer *pb_reclaimer_create(void);
+struct pb_reclaimer *pb_reclaimer_create_with_alloc(
+                                const struct pb_allocator *allocator);
+
+bool pb_reclaimer_start(struct pb_reclaimer * const reclaimer);
+
+uint64_t pb_reclaimer_reclaim(struct pb_reclaimer * const reclaimer,
+                              uint64_t max_pages);
+
+bool pb_reclaimer_is_empty(struct pb_reclaimer * const reclaimer);
+
+void pb_reclaimer_destroy(struct pb_reclaimer * const reclaimer);
 
 
 
@@ -1120,6 +1612,53 @@ struct pb_buffer *pb_trivial_buffer_create_with_strategy_with_alloc(
 
 
 
+/* Pre-declare the data factory, see pagebuf_protected.h. */
+struct pb_data_factory;
+
+
+
+/** Get the built in data factories.
+ *
+ * A data factory decides how a trivial buffer creates the pb_data instances
+ * that hold its memory regions.
+ *
+ * The trivial data factory is the default.  It allocates the pb_page and
+ * pb_data of each new page together, and the pb_page and pb_data instances of
+ * runs of new pages together, but always allocates each memory region on its
+ * own at exactly the size of the region, so that allocators specialised for
+ * the page size see every region.
+ *
+ * The inline data factory allocates each pb_data along with its memory region
+ * in a single block, and each new page along with its pb_data and memory
+ * region in a single block, and runs of new pages in a single block.  This
+ * makes the fewest allocations, at the cost of every allocation being larger
+ * than the memory region that it holds.
+ *
+ * The atomic data factory modifies the reference counts of pb_data instances
+ * atomically, so that data may be shared between buffers that are operated on
+ * by different threads.
+ */
+const struct pb_data_factory *pb_get_trivial_data_factory(void);
+const struct pb_data_factory *pb_get_inline_data_factory(void);
+const struct pb_data_factory *pb_get_atomic_data_factory(void);
+
+
+
+/** Factory functions producing pb_trivial_buffer instances that use a specific
+ *  data factory.
+ *
+ * The pb_trivial_buffer_create* functions above use the trivial data factory.
+ */
+struct pb_buffer *pb_trivial_buffer_create_with_data_factory(
+                                    const struct pb_buffer_strategy *strategy,
+                                    const struct pb_data_factory *data_factory);
+struct pb_buffer *pb_trivial_buffer_create_with_data_factory_with_alloc(
+                                    const struct pb_buffer_strategy *strategy,
+                                    const struct pb_data_factory *data_factory,
+                                    const struct pb_allocator *allocator);
+
+
+
 
 
 
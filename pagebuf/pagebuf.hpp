@@ -21,6 +21,8 @@
 
 
 #include <pagebuf/pagebuf.h>
+#include <pagebuf/pagebuf_io.h>
+#include <pagebuf/pagebuf_uring.h>
 
 #include <string>
 
@@ -291,6 +293,21 @@ class buffer {
             strategy, allocator)) {
     }
 
+    buffer(const struct pb_buffer_strategy *strategy,
+           const struct pb_data_factory *data_factory) :
+        buffer_(
+          pb_trivial_buffer_create_with_data_factory(
+            strategy, data_factory)) {
+    }
+
+    buffer(const struct pb_buffer_strategy *strategy,
+           const struct pb_data_factory *data_factory,
+           const struct pb_allocator *allocator) :
+        buffer_(
+          pb_trivial_buffer_create_with_data_factory_with_alloc(
+            strategy, data_factory, allocator)) {
+    }
+
     buffer(buffer&& rvalue) :
         buffer_(rvalue.buffer_) {
       rvalue.buffer_ = 0;
@@ -379,6 +396,29 @@ class buffer {
       return iterator(buffer_, true);
     }
 
+    iterator iterator_at(uint64_t offset, size_t& page_offset) const {
+      iterator itr(buffer_, true);
+      page_offset =
+        pb_buffer_get_iterator_at(buffer_, offset, &itr.buffer_iterator_);
+      return itr;
+    }
+
+  public:
+    size_t get_iovec(uint64_t offset, uint64_t len,
+        struct iovec *iov, size_t max) const {
+      return pb_buffer_get_iovec(buffer_, offset, len, iov, max);
+    }
+
+    void iovec_cursor_init(struct pb_buffer_iovec_cursor *iovec_cursor,
+        uint64_t offset, uint64_t len) const {
+      pb_buffer_iovec_cursor_init(buffer_, iovec_cursor, offset, len);
+    }
+
+    size_t iovec_cursor_next(struct pb_buffer_iovec_cursor *iovec_cursor,
+        struct iovec *iov, size_t max) const {
+      return pb_buffer_iovec_cursor_next(buffer_, iovec_cursor, iov, max);
+    }
+
   public:
     byte_iterator byte_begin() const {
       return byte_iterator(buffer_, false);
@@ -423,6 +463,12 @@ class buffer {
       return pb_buffer_write_data_ref(buffer_, buf, len);
     }
 
+    uint64_t write_mem(void *buf, uint64_t len,
+                       void (*release)(void *buf, uint64_t len, void *context),
+                       void *context) {
+      return pb_buffer_write_data_mem(buffer_, buf, len, release, context);
+    }
+
     uint64_t write(const buffer& src_buf, uint64_t len) {
       return pb_buffer_write_buffer(buffer_, src_buf.buffer_, len);
     }
@@ -441,11 +487,60 @@ class buffer {
       return pb_buffer_read_data(buffer_, buf, len);
     }
 
+  public:
+    ssize_t read_fd(int fd, size_t len) {
+      return pb_buffer_read_fd(buffer_, fd, len);
+    }
+
+    ssize_t write_fd(int fd, size_t len) {
+      return pb_buffer_write_fd(buffer_, fd, len);
+    }
+
+    int recvmmsg(int fd, size_t count, size_t len, size_t *lens) {
+      return pb_buffer_recvmmsg(buffer_, fd, count, len, lens);
+    }
+
+    int sendmmsg(int fd, const size_t *lens, size_t count) {
+      return pb_buffer_sendmmsg(buffer_, fd, lens, count);
+    }
+
+    ssize_t peek_splice_pipe(struct pb_splice_pipe *splice_pipe, size_t len) {
+      return pb_splice_pipe_peek(splice_pipe, buffer_, len);
+    }
+
+    ssize_t zerocopy_send(struct pb_zerocopy_sender *zerocopy_sender,
+        size_t len) {
+      return pb_zerocopy_sender_send(zerocopy_sender, buffer_, len);
+    }
+
+    bool uring_read(struct pb_uring *uring,
+        int fd, size_t len, uint64_t user_data) {
+      return pb_uring_read(uring, buffer_, fd, len, user_data);
+    }
+
+    bool uring_write(struct pb_uring *uring,
+        int fd, size_t len, uint64_t user_data) {
+      return pb_uring_write(uring, buffer_, fd, len, user_data);
+    }
+
+  public:
+    uint64_t compact(size_t threshold = 0) {
+      return pb_buffer_compact(buffer_, threshold);
+    }
+
   public:
     void clear() {
       pb_buffer_clear(buffer_);
     }
 
+  public:
+    void destroy_deferred(struct pb_reclaimer *reclaimer) {
+      if (buffer_) {
+        pb_buffer_destroy_deferred(buffer_, reclaimer);
+        buffer_ = 0;
+      }
+    }
+
   protected:
     void destroy() {
       if (buffer_) {
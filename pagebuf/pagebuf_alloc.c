@@ -0,0 +1,2303 @@
+/*******************************************************************************
+ *  Copyright 2017 Nick Jones <nick.fa.jones@gmail.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ ******************************************************************************/
+
+#include "pagebuf.h"
+#include "pagebuf_protected.h"
+
+#include <sys/mman.h>
+#include <pthread.h>
+#include <errno.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+
+/*******************************************************************************
+ */
+#define PB_SLAB_ALLOCATOR_SLAB_SIZE                       16384
+#define PB_SLAB_ALLOCATOR_ALIGN                           16
+#define PB_SLAB_ALLOCATOR_MAX_CACHES                      4
+
+
+
+/** The header of a slab, located at the start of the slabs' memory block. */
+struct pb_slab {
+  struct pb_slab *next;
+};
+
+#define PB_SLAB_HEADER_SIZE \
+  (((sizeof(struct pb_slab) + PB_SLAB_ALLOCATOR_ALIGN - 1) / \
+    PB_SLAB_ALLOCATOR_ALIGN) * PB_SLAB_ALLOCATOR_ALIGN)
+
+
+
+/** A cache of free objects of one size, carved from slabs. */
+struct pb_slab_cache {
+  size_t object_size;
+
+  void *free_list;
+
+  struct pb_slab *slabs;
+};
+
+
+
+/** The specialised allocator that serves fixed size structs from slabs. */
+struct pb_slab_allocator {
+  struct pb_allocator allocator;
+
+  const struct pb_allocator *fallback_allocator;
+
+  struct pb_slab_cache caches[PB_SLAB_ALLOCATOR_MAX_CACHES];
+  size_t cache_count;
+};
+
+
+
+/*******************************************************************************
+ */
+static size_t pb_slab_allocator_align_size(size_t size) {
+  return
+    ((size + PB_SLAB_ALLOCATOR_ALIGN - 1) / PB_SLAB_ALLOCATOR_ALIGN) *
+     PB_SLAB_ALLOCATOR_ALIGN;
+}
+
+/*******************************************************************************
+ */
+static void pb_slab_allocator_add_cache(
+    struct pb_slab_allocator * const slab_allocator, size_t size) {
+  size_t object_size = pb_slab_allocator_align_size(size);
+
+  size_t position = 0;
+
+  while ((position < slab_allocator->cache_count) &&
+         (slab_allocator->caches[position].object_size < object_size))
+    ++position;
+
+  if ((position < slab_allocator->cache_count) &&
+      (slab_allocator->caches[position].object_size == object_size))
+    return;
+
+  assert(slab_allocator->cache_count < PB_SLAB_ALLOCATOR_MAX_CACHES);
+
+  // caches are kept in ascending order of object size
+  memmove(
+    &slab_allocator->caches[position + 1],
+    &slab_allocator->caches[position],
+    (slab_allocator->cache_count - position) * sizeof(struct pb_slab_cache));
+
+  ++slab_allocator->cache_count;
+
+  struct pb_slab_cache *cache = &slab_allocator->caches[position];
+
+  cache->object_size = object_size;
+  cache->free_list = NULL;
+  cache->slabs = NULL;
+}
+
+static struct pb_slab_cache *pb_slab_allocator_find_cache(
+    const struct pb_allocator *allocator, size_t size) {
+  struct pb_slab_allocator *slab_allocator =
+    (struct pb_slab_allocator*)allocator;
+
+  if ((size == 0) ||
+      (size > slab_allocator->caches[slab_allocator->cache_count - 1].
+                object_size))
+    return NULL;
+
+  size_t object_size = pb_slab_allocator_align_size(size);
+
+  for (size_t i = 0; i < slab_allocator->cache_count; ++i) {
+    if (slab_allocator->caches[i].object_size == object_size)
+      return &slab_allocator->caches[i];
+  }
+
+  return NULL;
+}
+
+/*******************************************************************************
+ */
+static bool pb_slab_cache_grow(
+    struct pb_slab_allocator * const slab_allocator,
+    struct pb_slab_cache * const cache) {
+  struct pb_slab *slab =
+    pb_allocator_malloc(
+      slab_allocator->fallback_allocator, PB_SLAB_ALLOCATOR_SLAB_SIZE);
+  if (!slab)
+    return false;
+
+  slab->next = cache->slabs;
+  cache->slabs = slab;
+
+  uint8_t *object = (uint8_t*)slab + PB_SLAB_HEADER_SIZE;
+  uint8_t *object_end = (uint8_t*)slab + PB_SLAB_ALLOCATOR_SLAB_SIZE;
+
+  while ((object + cache->object_size) <= object_end) {
+    *(void**)object = cache->free_list;
+    cache->free_list = object;
+
+    object += cache->object_size;
+  }
+
+  return true;
+}
+
+static void *pb_slab_cache_pop(
+    struct pb_slab_allocator * const slab_allocator,
+    struct pb_slab_cache * const cache) {
+  if (!cache->free_list &&
+      !pb_slab_cache_grow(slab_allocator, cache))
+    return NULL;
+
+  void *object = cache->free_list;
+  cache->free_list = *(void**)object;
+
+  return object;
+}
+
+static void pb_slab_cache_push(
+    struct pb_slab_cache * const cache, void *object) {
+  *(void**)object = cache->free_list;
+  cache->free_list = object;
+}
+
+/*******************************************************************************
+ */
+static void *pb_slab_allocator_malloc(const struct pb_allocator *allocator,
+    size_t size) {
+  struct pb_slab_allocator *slab_allocator =
+    (struct pb_slab_allocator*)allocator;
+
+  struct pb_slab_cache *cache = pb_slab_allocator_find_cache(allocator, size);
+  if (!cache)
+    return pb_allocator_malloc(slab_allocator->fallback_allocator, size);
+
+  return pb_slab_cache_pop(slab_allocator, cache);
+}
+
+static void *pb_slab_allocator_calloc(const struct pb_allocator *allocator,
+    size_t size) {
+  struct pb_slab_allocator *slab_allocator =
+    (struct pb_slab_allocator*)allocator;
+
+  struct pb_slab_cache *cache = pb_slab_allocator_find_cache(allocator, size);
+  if (!cache)
+    return pb_allocator_calloc(slab_allocator->fallback_allocator, size);
+
+  void *object = pb_slab_cache_pop(slab_allocator, cache);
+  if (!object)
+    return NULL;
+
+  memset(object, 0, cache->object_size);
+
+  return object;
+}
+
+static void *pb_slab_allocator_realloc(const struct pb_allocator *allocator,
+    void *obj, size_t oldsize, size_t newsize) {
+  struct pb_slab_allocator *slab_allocator =
+    (struct pb_slab_allocator*)allocator;
+
+  if (!obj)
+    return pb_slab_allocator_malloc(allocator, newsize);
+
+  struct pb_slab_cache *old_cache =
+    pb_slab_allocator_find_cache(allocator, oldsize);
+  struct pb_slab_cache *new_cache =
+    pb_slab_allocator_find_cache(allocator, newsize);
+
+  if (!old_cache && !new_cache)
+    return
+      pb_allocator_realloc(
+        slab_allocator->fallback_allocator, obj, oldsize, newsize);
+
+  if (old_cache && (old_cache == new_cache))
+    return obj;
+
+  if (newsize == 0) {
+    pb_allocator_free(allocator, obj, oldsize);
+
+    return NULL;
+  }
+
+  void *new_obj = pb_slab_allocator_malloc(allocator, newsize);
+  if (!new_obj)
+    return NULL;
+
+  memcpy(new_obj, obj, (oldsize < newsize) ? oldsize : newsize);
+
+  pb_allocator_free(allocator, obj, oldsize);
+
+  return new_obj;
+}
+
+static void pb_slab_allocator_free(const struct pb_allocator *allocator,
+    void *obj, size_t size) {
+  struct pb_slab_allocator *slab_allocator =
+    (struct pb_slab_allocator*)allocator;
+
+  if (!obj)
+    return;
+
+  struct pb_slab_cache *cache = pb_slab_allocator_find_cache(allocator, size);
+  if (!cache) {
+    pb_allocator_free(slab_allocator->fallback_allocator, obj, size);
+
+    return;
+  }
+
+  pb_slab_cache_push(cache, obj);
+}
+
+/*******************************************************************************
+ */
+static struct pb_allocator_operations pb_slab_allocator_operations = {
+  .malloc = pb_slab_allocator_malloc,
+  .calloc = pb_slab_allocator_calloc,
+  .realloc = pb_slab_allocator_realloc,
+  .free = pb_slab_allocator_free,
+};
+
+
+
+/*******************************************************************************
+ */
+struct pb_allocator *pb_slab_allocator_create(void) {
+  return pb_slab_allocator_create_with_alloc(pb_get_trivial_allocator());
+}
+
+struct pb_allocator *pb_slab_allocator_create_with_alloc(
+    const struct pb_allocator *fallback_allocator) {
+  struct pb_slab_allocator *slab_allocator =
+    pb_allocator_calloc(
+      fallback_allocator, sizeof(struct pb_slab_allocator));
+  if (!slab_allocator)
+    return NULL;
+
+  slab_allocator->allocator.operations = &pb_slab_allocator_operations;
+
+  slab_allocator->fallback_allocator = fallback_allocator;
+
+  // the headers of pages created by the trivial data factory, along with
+  // the structs created one at a time by the other data factories
+  pb_slab_allocator_add_cache(slab_allocator, sizeof(struct pb_page));
+  pb_slab_allocator_add_cache(slab_allocator, sizeof(struct pb_data));
+  pb_slab_allocator_add_cache(
+    slab_allocator, pb_split_page_get_header_size());
+
+  return &slab_allocator->allocator;
+}
+
+/*******************************************************************************
+ */
+void pb_slab_allocator_destroy(struct pb_allocator * const allocator) {
+  struct pb_slab_allocator *slab_allocator =
+    (struct pb_slab_allocator*)allocator;
+  const struct pb_allocator *fallback_allocator =
+    slab_allocator->fallback_allocator;
+
+  for (size_t i = 0; i < slab_allocator->cache_count; ++i) {
+    struct pb_slab_cache *cache = &slab_allocator->caches[i];
+
+    while (cache->slabs) {
+      struct pb_slab *slab = cache->slabs;
+      cache->slabs = slab->next;
+
+      pb_allocator_free(fallback_allocator, slab, PB_SLAB_ALLOCATOR_SLAB_SIZE);
+    }
+
+    cache->free_list = NULL;
+  }
+
+  pb_allocator_free(
+    fallback_allocator, slab_allocator, sizeof(struct pb_slab_allocator));
+}
+
+
+
+
+
+
+/*******************************************************************************
+ */
+/** A batch of cached memory regions. */
+struct pb_caching_magazine {
+  struct pb_caching_magazine *next;
+
+  size_t count;
+
+  void *regions[PB_CACHING_ALLOCATOR_MAGAZINE_SIZE];
+};
+
+
+
+/** Pre declare caching_allocator. */
+struct pb_caching_allocator;
+
+
+
+/** The per thread state of a caching allocator. */
+struct pb_caching_thread_cache {
+  struct pb_caching_allocator *caching_allocator;
+
+  struct pb_caching_magazine *magazine;
+
+  /** Links in the caching allocators' list of thread caches. */
+  struct pb_caching_thread_cache *prev;
+  struct pb_caching_thread_cache *next;
+};
+
+
+
+/** The specialised allocator that caches regions in per thread magazines. */
+struct pb_caching_allocator {
+  struct pb_allocator allocator;
+
+  const struct pb_allocator *fallback_allocator;
+
+  size_t region_size;
+
+  pthread_key_t thread_cache_key;
+
+  /** The depot lock protects all members below. */
+  pthread_mutex_t depot_lock;
+
+  struct pb_caching_magazine *full_magazines;
+  size_t full_magazine_count;
+
+  struct pb_caching_magazine *empty_magazines;
+
+  struct pb_caching_thread_cache *thread_caches;
+};
+
+
+
+/*******************************************************************************
+ */
+static void pb_caching_magazine_drain(
+    struct pb_caching_allocator * const caching_allocator,
+    struct pb_caching_magazine * const magazine) {
+  while (magazine->count > 0) {
+    pb_allocator_free(
+      caching_allocator->fallback_allocator,
+      magazine->regions[--magazine->count],
+      caching_allocator->region_size);
+  }
+}
+
+static void pb_caching_magazine_destroy(
+    struct pb_caching_allocator * const caching_allocator,
+    struct pb_caching_magazine * const magazine) {
+  pb_caching_magazine_drain(caching_allocator, magazine);
+
+  pb_allocator_free(
+    caching_allocator->fallback_allocator,
+    magazine, sizeof(struct pb_caching_magazine));
+}
+
+/*******************************************************************************
+ * Exchange a threads' full magazine for an empty one from the depot.
+ *
+ * The full magazine is only handed to the depot once its replacement is in
+ * hand, if no replacement can be found then NULL is returned and the caller
+ * keeps ownership of the full magazine.
+ */
+static struct pb_caching_magazine *pb_caching_allocator_depot_put(
+    struct pb_caching_allocator * const caching_allocator,
+    struct pb_caching_magazine * const full_magazine) {
+  struct pb_caching_magazine *empty_magazine = NULL;
+  bool overflow = false;
+
+  pthread_mutex_lock(&caching_allocator->depot_lock);
+
+  if (caching_allocator->full_magazine_count <
+        PB_CACHING_ALLOCATOR_DEPOT_SIZE) {
+    empty_magazine = caching_allocator->empty_magazines;
+    if (empty_magazine) {
+      caching_allocator->empty_magazines = empty_magazine->next;
+
+      full_magazine->next = caching_allocator->full_magazines;
+      caching_allocator->full_magazines = full_magazine;
+      ++caching_allocator->full_magazine_count;
+    }
+  } else {
+    overflow = true;
+  }
+
+  pthread_mutex_unlock(&caching_allocator->depot_lock);
+
+  if (!overflow && !empty_magazine) {
+    empty_magazine =
+      pb_allocator_malloc(
+        caching_allocator->fallback_allocator,
+        sizeof(struct pb_caching_magazine));
+    if (!empty_magazine)
+      return NULL;
+
+    pthread_mutex_lock(&caching_allocator->depot_lock);
+
+    if (caching_allocator->full_magazine_count <
+          PB_CACHING_ALLOCATOR_DEPOT_SIZE) {
+      full_magazine->next = caching_allocator->full_magazines;
+      caching_allocator->full_magazines = full_magazine;
+      ++caching_allocator->full_magazine_count;
+    } else {
+      overflow = true;
+    }
+
+    pthread_mutex_unlock(&caching_allocator->depot_lock);
+
+    if (overflow)
+      pb_allocator_free(
+        caching_allocator->fallback_allocator,
+        empty_magazine, sizeof(struct pb_caching_magazine));
+  }
+
+  if (overflow) {
+    // the depot is full, release the regions and reuse the magazine
+    pb_caching_magazine_drain(caching_allocator, full_magazine);
+
+    return full_magazine;
+  }
+
+  empty_magazine->next = NULL;
+  empty_magazine->count = 0;
+
+  return empty_magazine;
+}
+
+/*******************************************************************************
+ * Exchange a threads' empty magazine for a full one from the depot.
+ */
+static struct pb_caching_magazine *pb_caching_allocator_depot_get(
+    struct pb_caching_allocator * const caching_allocator,
+    struct pb_caching_magazine * const empty_magazine) {
+  struct pb_caching_magazine *full_magazine;
+
+  pthread_mutex_lock(&caching_allocator->depot_lock);
+
+  full_magazine = caching_allocator->full_magazines;
+  if (full_magazine) {
+    caching_allocator->full_magazines = full_magazine->next;
+    --caching_allocator->full_magazine_count;
+
+    empty_magazine->next = caching_allocator->empty_magazines;
+    caching_allocator->empty_magazines = empty_magazine;
+  }
+
+  pthread_mutex_unlock(&caching_allocator->depot_lock);
+
+  return full_magazine;
+}
+
+/*******************************************************************************
+ */
+static void pb_caching_thread_cache_destroy(void *arg) {
+  struct pb_caching_thread_cache *thread_cache = arg;
+  struct pb_caching_allocator *caching_allocator =
+    thread_cache->caching_allocator;
+
+  pthread_mutex_lock(&caching_allocator->depot_lock);
+
+  if (thread_cache->prev)
+    thread_cache->prev->next = thread_cache->next;
+  else
+    caching_allocator->thread_caches = thread_cache->next;
+
+  if (thread_cache->next)
+    thread_cache->next->prev = thread_cache->prev;
+
+  pthread_mutex_unlock(&caching_allocator->depot_lock);
+
+  if (thread_cache->magazine)
+    pb_caching_magazine_destroy(caching_allocator, thread_cache->magazine);
+
+  pb_allocator_free(
+    caching_allocator->fallback_allocator,
+    thread_cache, sizeof(struct pb_caching_thread_cache));
+}
+
+static struct pb_caching_thread_cache *pb_caching_allocator_get_thread_cache(
+    struct pb_caching_allocator * const caching_allocator) {
+  struct pb_caching_thread_cache *thread_cache =
+    pthread_getspecific(caching_allocator->thread_cache_key);
+  if (thread_cache)
+    return thread_cache;
+
+  thread_cache =
+    pb_allocator_calloc(
+      caching_allocator->fallback_allocator,
+      sizeof(struct pb_caching_thread_cache));
+  if (!thread_cache)
+    return NULL;
+
+  thread_cache->caching_allocator = caching_allocator;
+
+  thread_cache->magazine =
+    pb_allocator_calloc(
+      caching_allocator->fallback_allocator,
+      sizeof(struct pb_caching_magazine));
+  if (!thread_cache->magazine) {
+    pb_allocator_free(
+      caching_allocator->fallback_allocator,
+      thread_cache, sizeof(struct pb_caching_thread_cache));
+
+    return NULL;
+  }
+
+  if (pthread_setspecific(
+        caching_allocator->thread_cache_key, thread_cache) != 0) {
+    pb_allocator_free(
+      caching_allocator->fallback_allocator,
+      thread_cache->magazine, sizeof(struct pb_caching_magazine));
+    pb_allocator_free(
+      caching_allocator->fallback_allocator,
+      thread_cache, sizeof(struct pb_caching_thread_cache));
+
+    return NULL;
+  }
+
+  pthread_mutex_lock(&caching_allocator->depot_lock);
+
+  thread_cache->next = caching_allocator->thread_caches;
+  if (thread_cache->next)
+    thread_cache->next->prev = thread_cache;
+  caching_allocator->thread_caches = thread_cache;
+
+  pthread_mutex_unlock(&caching_allocator->depot_lock);
+
+  return thread_cache;
+}
+
+/*******************************************************************************
+ */
+static void *pb_caching_allocator_region_get(
+    struct pb_caching_allocator * const caching_allocator) {
+  struct pb_caching_thread_cache *thread_cache =
+    pb_caching_allocator_get_thread_cache(caching_allocator);
+
+  if (thread_cache) {
+    struct pb_caching_magazine *magazine = thread_cache->magazine;
+
+    if (magazine->count == 0) {
+      struct pb_caching_magazine *full_magazine =
+        pb_caching_allocator_depot_get(caching_allocator, magazine);
+      if (full_magazine)
+        thread_cache->magazine = magazine = full_magazine;
+    }
+
+    if (magazine->count > 0)
+      return magazine->regions[--magazine->count];
+  }
+
+  return
+    pb_allocator_malloc(
+      caching_allocator->fallback_allocator, caching_allocator->region_size);
+}
+
+static void pb_caching_allocator_region_put(
+    struct pb_caching_allocator * const caching_allocator, void *region) {
+  struct pb_caching_thread_cache *thread_cache =
+    pb_caching_allocator_get_thread_cache(caching_allocator);
+
+  if (thread_cache) {
+    struct pb_caching_magazine *magazine = thread_cache->magazine;
+
+    if (magazine->count == PB_CACHING_ALLOCATOR_MAGAZINE_SIZE) {
+      struct pb_caching_magazine *empty_magazine =
+        pb_caching_allocator_depot_put(caching_allocator, magazine);
+      if (empty_magazine) {
+        thread_cache->magazine = magazine = empty_magazine;
+      } else {
+        // no magazine to continue with, keep the full one
+        pb_allocator_free(
+          caching_allocator->fallback_allocator,
+          region, caching_allocator->region_size);
+
+        return;
+      }
+    }
+
+    magazine->regions[magazine->count++] = region;
+
+    return;
+  }
+
+  pb_allocator_free(
+    caching_allocator->fallback_allocator,
+    region, caching_allocator->region_size);
+}
+
+/*******************************************************************************
+ * Indicate whether an allocation of size is served by a cached region, which
+ * is the case for sizes above half of the region size, up to the region size.
+ */
+static bool pb_caching_allocator_is_region_class(
+    const struct pb_caching_allocator * const caching_allocator, size_t size) {
+  return
+    (size > (caching_allocator->region_size / 2)) &&
+    (size <= caching_allocator->region_size);
+}
+
+/*******************************************************************************
+ */
+static void *pb_caching_allocator_malloc(const struct pb_allocator *allocator,
+    size_t size) {
+  struct pb_caching_allocator *caching_allocator =
+    (struct pb_caching_allocator*)allocator;
+
+  if (!pb_caching_allocator_is_region_class(caching_allocator, size))
+    return pb_allocator_malloc(caching_allocator->fallback_allocator, size);
+
+  return pb_caching_allocator_region_get(caching_allocator);
+}
+
+static void *pb_caching_allocator_calloc(const struct pb_allocator *allocator,
+    size_t size) {
+  struct pb_caching_allocator *caching_allocator =
+    (struct pb_caching_allocator*)allocator;
+
+  if (!pb_caching_allocator_is_region_class(caching_allocator, size))
+    return pb_allocator_calloc(caching_allocator->fallback_allocator, size);
+
+  void *region = pb_caching_allocator_region_get(caching_allocator);
+  if (!region)
+    return NULL;
+
+  memset(region, 0, size);
+
+  return region;
+}
+
+static void *pb_caching_allocator_realloc(
+    const struct pb_allocator *allocator,
+    void *obj, size_t oldsize, size_t newsize) {
+  struct pb_caching_allocator *caching_allocator =
+    (struct pb_caching_allocator*)allocator;
+
+  if (!obj)
+    return pb_caching_allocator_malloc(allocator, newsize);
+
+  bool old_region =
+    pb_caching_allocator_is_region_class(caching_allocator, oldsize);
+  bool new_region =
+    pb_caching_allocator_is_region_class(caching_allocator, newsize);
+
+  if (!old_region && !new_region)
+    return
+      pb_allocator_realloc(
+        caching_allocator->fallback_allocator, obj, oldsize, newsize);
+
+  // both sizes fit the same cached region
+  if (old_region && new_region)
+    return obj;
+
+  if (newsize == 0) {
+    pb_allocator_free(allocator, obj, oldsize);
+
+    return NULL;
+  }
+
+  void *new_obj = pb_caching_allocator_malloc(allocator, newsize);
+  if (!new_obj)
+    return NULL;
+
+  memcpy(new_obj, obj, (oldsize < newsize) ? oldsize : newsize);
+
+  pb_allocator_free(allocator, obj, oldsize);
+
+  return new_obj;
+}
+
+static void pb_caching_allocator_free(const struct pb_allocator *allocator,
+    void *obj, size_t size) {
+  struct pb_caching_allocator *caching_allocator =
+    (struct pb_caching_allocator*)allocator;
+
+  if (!obj)
+    return;
+
+  if (!pb_caching_allocator_is_region_class(caching_allocator, size)) {
+    pb_allocator_free(caching_allocator->fallback_allocator, obj, size);
+
+    return;
+  }
+
+  pb_caching_allocator_region_put(caching_allocator, obj);
+}
+
+/*******************************************************************************
+ */
+static struct pb_allocator_operations pb_caching_allocator_operations = {
+  .malloc = pb_caching_allocator_malloc,
+  .calloc = pb_caching_allocator_calloc,
+  .realloc = pb_caching_allocator_realloc,
+  .free = pb_caching_allocator_free,
+};
+
+
+
+/*******************************************************************************
+ */
+struct pb_allocator *pb_caching_allocator_create(size_t region_size) {
+  return
+    pb_caching_allocator_create_with_alloc(
+      region_size, pb_get_trivial_allocator());
+}
+
+struct pb_allocator *pb_caching_allocator_create_with_alloc(
+    size_t region_size,
+    const struct pb_allocator *fallback_allocator) {
+  struct pb_caching_allocator *caching_allocator =
+    pb_allocator_calloc(
+      fallback_allocator, sizeof(struct pb_caching_allocator));
+  if (!caching_allocator)
+    return NULL;
+
+  caching_allocator->allocator.operations = &pb_caching_allocator_operations;
+
+  caching_allocator->fallback_allocator = fallback_allocator;
+
+  caching_allocator->region_size =
+    (region_size != 0) ? region_size : PB_BUFFER_DEFAULT_PAGE_SIZE;
+
+  int result =
+    pthread_key_create(
+      &caching_allocator->thread_cache_key, &pb_caching_thread_cache_destroy);
+  if (result != 0) {
+    pb_allocator_free(
+      fallback_allocator, caching_allocator,
+      sizeof(struct pb_caching_allocator));
+
+    errno = result;
+
+    return NULL;
+  }
+
+  pthread_mutex_init(&caching_allocator->depot_lock, NULL);
+
+  return &caching_allocator->allocator;
+}
+
+/*******************************************************************************
+ */
+void pb_caching_allocator_destroy(struct pb_allocator * const allocator) {
+  struct pb_caching_allocator *caching_allocator =
+    (struct pb_caching_allocator*)allocator;
+  const struct pb_allocator *fallback_allocator =
+    caching_allocator->fallback_allocator;
+
+  // thread caches of threads still running are released here instead
+  pthread_key_delete(caching_allocator->thread_cache_key);
+
+  while (caching_allocator->thread_caches) {
+    struct pb_caching_thread_cache *thread_cache =
+      caching_allocator->thread_caches;
+    caching_allocator->thread_caches = thread_cache->next;
+
+    pb_caching_magazine_destroy(caching_allocator, thread_cache->magazine);
+
+    pb_allocator_free(
+      fallback_allocator,
+      thread_cache, sizeof(struct pb_caching_thread_cache));
+  }
+
+  while (caching_allocator->full_magazines) {
+    struct pb_caching_magazine *magazine = caching_allocator->full_magazines;
+    caching_allocator->full_magazines = magazine->next;
+
+    pb_caching_magazine_destroy(caching_allocator, magazine);
+  }
+
+  while (caching_allocator->empty_magazines) {
+    struct pb_caching_magazine *magazine = caching_allocator->empty_magazines;
+    caching_allocator->empty_magazines = magazine->next;
+
+    pb_caching_magazine_destroy(caching_allocator, magazine);
+  }
+
+  pthread_mutex_destroy(&caching_allocator->depot_lock);
+
+  pb_allocator_free(
+    fallback_allocator,
+    caching_allocator, sizeof(struct pb_caching_allocator));
+}
+
+
+
+
+
+
+/*******************************************************************************
+ */
+#define PB_ARENA_ALLOCATOR_ALIGN                          16
+
+
+
+/** The header of an arena chunk, located at the start of the chunks' memory. */
+struct pb_arena_chunk {
+  struct pb_arena_chunk *next;
+
+  size_t size;
+  size_t used;
+};
+
+#define PB_ARENA_CHUNK_HEADER_SIZE \
+  (((sizeof(struct pb_arena_chunk) + PB_ARENA_ALLOCATOR_ALIGN - 1) / \
+    PB_ARENA_ALLOCATOR_ALIGN) * PB_ARENA_ALLOCATOR_ALIGN)
+
+
+
+/** The specialised allocator that bump allocates from chunks. */
+struct pb_arena_allocator {
+  struct pb_allocator allocator;
+
+  const struct pb_allocator *fallback_allocator;
+
+  size_t chunk_size;
+
+  /** Chunks in use, the head being the chunk currently allocated from. */
+  struct pb_arena_chunk *chunks;
+
+  /** Chunks released by reset, available for reuse. */
+  struct pb_arena_chunk *free_chunks;
+
+  /** The most recent allocation, which may be resized in place. */
+  void *last_obj;
+};
+
+
+
+/*******************************************************************************
+ */
+static size_t pb_arena_allocator_align_size(size_t size) {
+  return
+    ((size + PB_ARENA_ALLOCATOR_ALIGN - 1) / PB_ARENA_ALLOCATOR_ALIGN) *
+     PB_ARENA_ALLOCATOR_ALIGN;
+}
+
+/*******************************************************************************
+ */
+static struct pb_arena_chunk *pb_arena_allocator_chunk_get(
+    struct pb_arena_allocator * const arena_allocator, size_t size) {
+  struct pb_arena_chunk *chunk;
+  size_t chunk_size = arena_allocator->chunk_size;
+
+  if ((PB_ARENA_CHUNK_HEADER_SIZE + size) > chunk_size) {
+    chunk_size = PB_ARENA_CHUNK_HEADER_SIZE + size;
+
+    chunk = pb_allocator_malloc(arena_allocator->fallback_allocator, chunk_size);
+  } else if (arena_allocator->free_chunks) {
+    chunk = arena_allocator->free_chunks;
+    arena_allocator->free_chunks = chunk->next;
+  } else {
+    chunk = pb_allocator_malloc(arena_allocator->fallback_allocator, chunk_size);
+  }
+
+  if (!chunk)
+    return NULL;
+
+  chunk->size = chunk_size;
+  chunk->used = PB_ARENA_CHUNK_HEADER_SIZE;
+
+  // a dedicated chunk is kept behind the current chunk, so the remainder of
+  // the current chunk isn't wasted
+  if ((chunk_size > arena_allocator->chunk_size) && arena_allocator->chunks) {
+    chunk->next = arena_allocator->chunks->next;
+    arena_allocator->chunks->next = chunk;
+  } else {
+    chunk->next = arena_allocator->chunks;
+    arena_allocator->chunks = chunk;
+  }
+
+  return chunk;
+}
+
+/*******************************************************************************
+ */
+static void *pb_arena_allocator_malloc(const struct pb_allocator *allocator,
+    size_t size) {
+  struct pb_arena_allocator *arena_allocator =
+    (struct pb_arena_allocator*)allocator;
+  struct pb_arena_chunk *chunk = arena_allocator->chunks;
+
+  size = pb_arena_allocator_align_size(size);
+
+  if (!chunk || ((chunk->size - chunk->used) < size)) {
+    chunk = pb_arena_allocator_chunk_get(arena_allocator, size);
+    if (!chunk)
+      return NULL;
+  }
+
+  void *obj = (uint8_t*)chunk + chunk->used;
+  chunk->used += size;
+
+  arena_allocator->last_obj = (chunk == arena_allocator->chunks) ? obj : NULL;
+
+  return obj;
+}
+
+static void *pb_arena_allocator_calloc(const struct pb_allocator *allocator,
+    size_t size) {
+  void *obj = pb_arena_allocator_malloc(allocator, size);
+  if (!obj)
+    return NULL;
+
+  memset(obj, 0, size);
+
+  return obj;
+}
+
+static void *pb_arena_allocator_realloc(const struct pb_allocator *allocator,
+    void *obj, size_t oldsize, size_t newsize) {
+  struct pb_arena_allocator *arena_allocator =
+    (struct pb_arena_allocator*)allocator;
+  struct pb_arena_chunk *chunk = arena_allocator->chunks;
+
+  if (!obj)
+    return pb_arena_allocator_malloc(allocator, newsize);
+
+  // the most recent allocation can be resized in place if the chunk allows
+  if ((obj == arena_allocator->last_obj) && chunk) {
+    size_t offset = (size_t)((uint8_t*)obj - (uint8_t*)chunk);
+    size_t aligned_newsize = pb_arena_allocator_align_size(newsize);
+
+    if ((offset < chunk->size) &&
+        ((chunk->size - offset) >= aligned_newsize)) {
+      chunk->used = offset + aligned_newsize;
+
+      return obj;
+    }
+  }
+
+  if (newsize <= oldsize)
+    return obj;
+
+  void *new_obj = pb_arena_allocator_malloc(allocator, newsize);
+  if (!new_obj)
+    return NULL;
+
+  memcpy(new_obj, obj, oldsize);
+
+  return new_obj;
+}
+
+static void pb_arena_allocator_free(const struct pb_allocator *allocator,
+    void *obj, size_t size) {
+}
+
+/*******************************************************************************
+ */
+static struct pb_allocator_operations pb_arena_allocator_operations = {
+  .malloc = pb_arena_allocator_malloc,
+  .calloc = pb_arena_allocator_calloc,
+  .realloc = pb_arena_allocator_realloc,
+  .free = pb_arena_allocator_free,
+};
+
+
+
+/*******************************************************************************
+ */
+struct pb_allocator *pb_arena_allocator_create(size_t chunk_size) {
+  return
+    pb_arena_allocator_create_with_alloc(
+      chunk_size, pb_get_trivial_allocator());
+}
+
+struct pb_allocator *pb_arena_allocator_create_with_alloc(
+    size_t chunk_size,
+    const struct pb_allocator *fallback_allocator) {
+  struct pb_arena_allocator *arena_allocator =
+    pb_allocator_calloc(
+      fallback_allocator, sizeof(struct pb_arena_allocator));
+  if (!arena_allocator)
+    return NULL;
+
+  arena_allocator->allocator.operations = &pb_arena_allocator_operations;
+
+  arena_allocator->fallback_allocator = fallback_allocator;
+
+  arena_allocator->chunk_size =
+    (chunk_size != 0) ? chunk_size : PB_ARENA_ALLOCATOR_DEFAULT_CHUNK_SIZE;
+
+  return &arena_allocator->allocator;
+}
+
+/*******************************************************************************
+ */
+void pb_arena_allocator_reset(struct pb_allocator * const allocator) {
+  struct pb_arena_allocator *arena_allocator =
+    (struct pb_arena_allocator*)allocator;
+
+  while (arena_allocator->chunks) {
+    struct pb_arena_chunk *chunk = arena_allocator->chunks;
+    arena_allocator->chunks = chunk->next;
+
+    if (chunk->size > arena_allocator->chunk_size) {
+      pb_allocator_free(
+        arena_allocator->fallback_allocator, chunk, chunk->size);
+
+      continue;
+    }
+
+    chunk->next = arena_allocator->free_chunks;
+    arena_allocator->free_chunks = chunk;
+  }
+
+  arena_allocator->last_obj = NULL;
+}
+
+/*******************************************************************************
+ */
+void pb_arena_allocator_destroy(struct pb_allocator * const allocator) {
+  struct pb_arena_allocator *arena_allocator =
+    (struct pb_arena_allocator*)allocator;
+
+  pb_arena_allocator_reset(allocator);
+
+  while (arena_allocator->free_chunks) {
+    struct pb_arena_chunk *chunk = arena_allocator->free_chunks;
+    arena_allocator->free_chunks = chunk->next;
+
+    pb_allocator_free(
+      arena_allocator->fallback_allocator, chunk, chunk->size);
+  }
+
+  pb_allocator_free(
+    arena_allocator->fallback_allocator,
+    arena_allocator, sizeof(struct pb_arena_allocator));
+}
+
+
+
+
+
+
+/*******************************************************************************
+ */
+/** The specialised allocator that maps large regions with huge pages. */
+struct pb_hugepage_allocator {
+  struct pb_allocator allocator;
+
+  const struct pb_allocator *fallback_allocator;
+
+  size_t threshold;
+
+  /** Cleared once MAP_HUGETLB fails, so it isn't attempted again.  Accessed
+   *  atomically, as any thread may allocate. */
+  bool use_hugetlb;
+};
+
+
+
+/*******************************************************************************
+ */
+static size_t pb_hugepage_allocator_align_size(size_t size) {
+  return
+    ((size + PB_HUGEPAGE_ALLOCATOR_PAGE_SIZE - 1) /
+      PB_HUGEPAGE_ALLOCATOR_PAGE_SIZE) * PB_HUGEPAGE_ALLOCATOR_PAGE_SIZE;
+}
+
+/*******************************************************************************
+ */
+static void *pb_hugepage_allocator_map(
+    struct pb_hugepage_allocator * const hugepage_allocator, size_t size) {
+  size_t map_size = pb_hugepage_allocator_align_size(size);
+  void *region;
+
+#ifdef MAP_HUGETLB
+  if (__atomic_load_n(&hugepage_allocator->use_hugetlb, __ATOMIC_RELAXED)) {
+    region =
+      mmap(
+        NULL, map_size,
+        PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+        -1, 0);
+    if (region != MAP_FAILED)
+      return region;
+
+    __atomic_store_n(&hugepage_allocator->use_hugetlb, false, __ATOMIC_RELAXED);
+  }
+#endif
+
+  // over map so that the region can be aligned to the huge page size
+  uint8_t *base =
+    mmap(
+      NULL, map_size + PB_HUGEPAGE_ALLOCATOR_PAGE_SIZE,
+      PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+      -1, 0);
+  if (base == MAP_FAILED)
+    return NULL;
+
+  size_t lead =
+    (PB_HUGEPAGE_ALLOCATOR_PAGE_SIZE -
+      ((uintptr_t)base % PB_HUGEPAGE_ALLOCATOR_PAGE_SIZE)) %
+      PB_HUGEPAGE_ALLOCATOR_PAGE_SIZE;
+  size_t trail = PB_HUGEPAGE_ALLOCATOR_PAGE_SIZE - lead;
+
+  if (lead > 0)
+    munmap(base, lead);
+  if (trail > 0)
+    munmap(base + lead + map_size, trail);
+
+  region = base + lead;
+
+#ifdef MADV_HUGEPAGE
+  madvise(region, map_size, MADV_HUGEPAGE);
+#endif
+
+  return region;
+}
+
+static void pb_hugepage_allocator_unmap(void *region, size_t size) {
+  munmap(region, pb_hugepage_allocator_align_size(size));
+}
+
+/*******************************************************************************
+ */
+static void *pb_hugepage_allocator_malloc(
+    const struct pb_allocator *allocator, size_t size) {
+  struct pb_hugepage_allocator *hugepage_allocator =
+    (struct pb_hugepage_allocator*)allocator;
+
+  if (size < hugepage_allocator->threshold)
+    return pb_allocator_malloc(hugepage_allocator->fallback_allocator, size);
+
+  return pb_hugepage_allocator_map(hugepage_allocator, size);
+}
+
+static void *pb_hugepage_allocator_calloc(
+    const struct pb_allocator *allocator, size_t size) {
+  struct pb_hugepage_allocator *hugepage_allocator =
+    (struct pb_hugepage_allocator*)allocator;
+
+  if (size < hugepage_allocator->threshold)
+    return pb_allocator_calloc(hugepage_allocator->fallback_allocator, size);
+
+  // anonymous mappings are already zero filled
+  return pb_hugepage_allocator_map(hugepage_allocator, size);
+}
+
+static void *pb_hugepage_allocator_realloc(
+    const struct pb_allocator *allocator,
+    void *obj, size_t oldsize, size_t newsize) {
+  struct pb_hugepage_allocator *hugepage_allocator =
+    (struct pb_hugepage_allocator*)allocator;
+
+  if (!obj)
+    return pb_hugepage_allocator_malloc(allocator, newsize);
+
+  if ((oldsize < hugepage_allocator->threshold) &&
+      (newsize < hugepage_allocator->threshold))
+    return
+      pb_allocator_realloc(
+        hugepage_allocator->fallback_allocator, obj, oldsize, newsize);
+
+  if ((oldsize >= hugepage_allocator->threshold) &&
+      (newsize >= hugepage_allocator->threshold) &&
+      (pb_hugepage_allocator_align_size(oldsize) ==
+         pb_hugepage_allocator_align_size(newsize)))
+    return obj;
+
+  if (newsize == 0) {
+    pb_allocator_free(allocator, obj, oldsize);
+
+    return NULL;
+  }
+
+  void *new_obj = pb_hugepage_allocator_malloc(allocator, newsize);
+  if (!new_obj)
+    return NULL;
+
+  memcpy(new_obj, obj, (oldsize < newsize) ? oldsize : newsize);
+
+  pb_allocator_free(allocator, obj, oldsize);
+
+  return new_obj;
+}
+
+static void pb_hugepage_allocator_free(const struct pb_allocator *allocator,
+    void *obj, size_t size) {
+  struct pb_hugepage_allocator *hugepage_allocator =
+    (struct pb_hugepage_allocator*)allocator;
+
+  if (!obj)
+    return;
+
+  if (size < hugepage_allocator->threshold) {
+    pb_allocator_free(hugepage_allocator->fallback_allocator, obj, size);
+
+    return;
+  }
+
+  pb_hugepage_allocator_unmap(obj, size);
+}
+
+/*******************************************************************************
+ */
+static struct pb_allocator_operations pb_hugepage_allocator_operations = {
+  .malloc = pb_hugepage_allocator_malloc,
+  .calloc = pb_hugepage_allocator_calloc,
+  .realloc = pb_hugepage_allocator_realloc,
+  .free = pb_hugepage_allocator_free,
+};
+
+
+
+/*******************************************************************************
+ */
+struct pb_allocator *pb_hugepage_allocator_create(size_t threshold) {
+  return
+    pb_hugepage_allocator_create_with_alloc(
+      threshold, pb_get_trivial_allocator());
+}
+
+struct pb_allocator *pb_hugepage_allocator_create_with_alloc(
+    size_t threshold,
+    const struct pb_allocator *fallback_allocator) {
+  struct pb_hugepage_allocator *hugepage_allocator =
+    pb_allocator_calloc(
+      fallback_allocator, sizeof(struct pb_hugepage_allocator));
+  if (!hugepage_allocator)
+    return NULL;
+
+  hugepage_allocator->allocator.operations = &pb_hugepage_allocator_operations;
+
+  hugepage_allocator->fallback_allocator = fallback_allocator;
+
+  hugepage_allocator->threshold =
+    (threshold != 0) ? threshold : PB_HUGEPAGE_ALLOCATOR_DEFAULT_THRESHOLD;
+
+  hugepage_allocator->use_hugetlb = true;
+
+  return &hugepage_allocator->allocator;
+}
+
+/*******************************************************************************
+ */
+void pb_hugepage_allocator_destroy(struct pb_allocator * const allocator) {
+  struct pb_hugepage_allocator *hugepage_allocator =
+    (struct pb_hugepage_allocator*)allocator;
+
+  pb_allocator_free(
+    hugepage_allocator->fallback_allocator,
+    hugepage_allocator, sizeof(struct pb_hugepage_allocator));
+}
+
+
+
+
+
+
+/*******************************************************************************
+ */
+/** Pre declare stats_allocator. */
+struct pb_stats_allocator;
+
+
+
+/** A set of counters, shared or private to a thread. */
+struct pb_stats_counters {
+  struct pb_stats_allocator *stats_allocator;
+
+  uint64_t alloc_count;
+  uint64_t free_count;
+
+  /** Live bytes not yet published to the stats allocator. */
+  int64_t live_bytes;
+
+  uint64_t size_class_counts[PB_STATS_ALLOCATOR_SIZE_CLASSES];
+
+  /** Links in the stats allocators' list of thread counters. */
+  struct pb_stats_counters *prev;
+  struct pb_stats_counters *next;
+};
+
+
+
+/** The specialised allocator that counts allocations passed to another. */
+struct pb_stats_allocator {
+  struct pb_allocator allocator;
+
+  const struct pb_allocator *decorated_allocator;
+
+  bool per_thread;
+
+  uint64_t live_bytes;
+  uint64_t high_water_bytes;
+
+  pthread_key_t counters_key;
+
+  /** The counters lock protects the members below when per_thread is set. */
+  pthread_mutex_t counters_lock;
+
+  /** Shared counters, which in per_thread mode accumulate the counters of
+   *  exited threads.
+   */
+  struct pb_stats_counters counters;
+
+  struct pb_stats_counters *thread_counters;
+};
+
+
+
+/*******************************************************************************
+ * Counters are only ever written by their owning thread, but may be read
+ * concurrently by a snapshot.
+ */
+static void pb_stats_counter_add(uint64_t *counter, uint64_t value) {
+  __atomic_store_n(counter, *counter + value, __ATOMIC_RELAXED);
+}
+
+static uint64_t pb_stats_counter_load(const uint64_t *counter) {
+  return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+/*******************************************************************************
+ */
+static void pb_stats_allocator_publish_live_bytes(
+    struct pb_stats_allocator * const stats_allocator, int64_t live_bytes) {
+  uint64_t total =
+    __atomic_add_fetch(
+      &stats_allocator->live_bytes, (uint64_t)live_bytes, __ATOMIC_RELAXED);
+
+  if (live_bytes <= 0)
+    return;
+
+  uint64_t high_water =
+    __atomic_load_n(&stats_allocator->high_water_bytes, __ATOMIC_RELAXED);
+  while (total > high_water) {
+    if (__atomic_compare_exchange_n(
+          &stats_allocator->high_water_bytes, &high_water, total,
+          true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+      break;
+  }
+}
+
+/*******************************************************************************
+ */
+static void pb_stats_thread_counters_destroy(void *arg) {
+  struct pb_stats_counters *counters = arg;
+  struct pb_stats_allocator *stats_allocator = counters->stats_allocator;
+
+  pthread_mutex_lock(&stats_allocator->counters_lock);
+
+  if (counters->prev)
+    counters->prev->next = counters->next;
+  else
+    stats_allocator->thread_counters = counters->next;
+
+  if (counters->next)
+    counters->next->prev = counters->prev;
+
+  // retain the counts of the exiting thread
+  stats_allocator->counters.alloc_count += counters->alloc_count;
+  stats_allocator->counters.free_count += counters->free_count;
+  for (size_t i = 0; i < PB_STATS_ALLOCATOR_SIZE_CLASSES; ++i)
+    stats_allocator->counters.size_class_counts[i] +=
+      counters->size_class_counts[i];
+
+  pthread_mutex_unlock(&stats_allocator->counters_lock);
+
+  pb_stats_allocator_publish_live_bytes(
+    stats_allocator, counters->live_bytes);
+
+  pb_allocator_free(
+    stats_allocator->decorated_allocator,
+    counters, sizeof(struct pb_stats_counters));
+}
+
+static struct pb_stats_counters *pb_stats_allocator_get_thread_counters(
+    struct pb_stats_allocator * const stats_allocator) {
+  struct pb_stats_counters *counters =
+    pthread_getspecific(stats_allocator->counters_key);
+  if (counters)
+    return counters;
+
+  counters =
+    pb_allocator_calloc(
+      stats_allocator->decorated_allocator,
+      sizeof(struct pb_stats_counters));
+  if (!counters)
+    return NULL;
+
+  counters->stats_allocator = stats_allocator;
+
+  if (pthread_setspecific(stats_allocator->counters_key, counters) != 0) {
+    pb_allocator_free(
+      stats_allocator->decorated_allocator,
+      counters, sizeof(struct pb_stats_counters));
+
+    return NULL;
+  }
+
+  pthread_mutex_lock(&stats_allocator->counters_lock);
+
+  counters->next = stats_allocator->thread_counters;
+  if (counters->next)
+    counters->next->prev = counters;
+  stats_allocator->thread_counters = counters;
+
+  pthread_mutex_unlock(&stats_allocator->counters_lock);
+
+  return counters;
+}
+
+/*******************************************************************************
+ */
+static size_t pb_stats_allocator_size_class(size_t size) {
+  size_t size_class = 0;
+
+  while ((size > ((size_t)PB_STATS_ALLOCATOR_MIN_SIZE_CLASS << size_class)) &&
+         (size_class < (PB_STATS_ALLOCATOR_SIZE_CLASSES - 1)))
+    ++size_class;
+
+  return size_class;
+}
+
+static void pb_stats_counters_record(
+    struct pb_stats_counters * const counters,
+    uint64_t alloc_size, uint64_t free_size) {
+  if (alloc_size > 0) {
+    pb_stats_counter_add(&counters->alloc_count, 1);
+    pb_stats_counter_add(
+      &counters->size_class_counts[pb_stats_allocator_size_class(alloc_size)],
+      1);
+  } else {
+    pb_stats_counter_add(&counters->free_count, 1);
+  }
+
+  __atomic_store_n(
+    &counters->live_bytes,
+    counters->live_bytes + (int64_t)alloc_size - (int64_t)free_size,
+    __ATOMIC_RELAXED);
+}
+
+static void pb_stats_allocator_record(
+    struct pb_stats_allocator * const stats_allocator,
+    uint64_t alloc_size, uint64_t free_size) {
+  struct pb_stats_counters *counters;
+
+  if (!stats_allocator->per_thread) {
+    counters = &stats_allocator->counters;
+
+    pb_stats_counters_record(counters, alloc_size, free_size);
+
+    stats_allocator->live_bytes += counters->live_bytes;
+    counters->live_bytes = 0;
+
+    if (stats_allocator->live_bytes > stats_allocator->high_water_bytes)
+      stats_allocator->high_water_bytes = stats_allocator->live_bytes;
+
+    return;
+  }
+
+  counters = pb_stats_allocator_get_thread_counters(stats_allocator);
+  if (!counters) {
+    // no private counters for this thread, use the shared ones
+    pthread_mutex_lock(&stats_allocator->counters_lock);
+
+    counters = &stats_allocator->counters;
+
+    pb_stats_counters_record(counters, alloc_size, free_size);
+
+    int64_t live_bytes = counters->live_bytes;
+    counters->live_bytes = 0;
+
+    pthread_mutex_unlock(&stats_allocator->counters_lock);
+
+    pb_stats_allocator_publish_live_bytes(stats_allocator, live_bytes);
+
+    return;
+  }
+
+  pb_stats_counters_record(counters, alloc_size, free_size);
+
+  if ((counters->live_bytes >= PB_STATS_ALLOCATOR_FLUSH_SIZE) ||
+      (counters->live_bytes <= -PB_STATS_ALLOCATOR_FLUSH_SIZE)) {
+    int64_t live_bytes = counters->live_bytes;
+
+    __atomic_store_n(&counters->live_bytes, 0, __ATOMIC_RELAXED);
+
+    pb_stats_allocator_publish_live_bytes(stats_allocator, live_bytes);
+  }
+}
+
+/*******************************************************************************
+ */
+static void *pb_stats_allocator_malloc(const struct pb_allocator *allocator,
+    size_t size) {
+  struct pb_stats_allocator *stats_allocator =
+    (struct pb_stats_allocator*)allocator;
+
+  void *obj = pb_allocator_malloc(stats_allocator->decorated_allocator, size);
+  if (obj)
+    pb_stats_allocator_record(stats_allocator, size, 0);
+
+  return obj;
+}
+
+static void *pb_stats_allocator_calloc(const struct pb_allocator *allocator,
+    size_t size) {
+  struct pb_stats_allocator *stats_allocator =
+    (struct pb_stats_allocator*)allocator;
+
+  void *obj = pb_allocator_calloc(stats_allocator->decorated_allocator, size);
+  if (obj)
+    pb_stats_allocator_record(stats_allocator, size, 0);
+
+  return obj;
+}
+
+static void *pb_stats_allocator_realloc(const struct pb_allocator *allocator,
+    void *obj, size_t oldsize, size_t newsize) {
+  struct pb_stats_allocator *stats_allocator =
+    (struct pb_stats_allocator*)allocator;
+
+  void *new_obj =
+    pb_allocator_realloc(
+      stats_allocator->decorated_allocator, obj, oldsize, newsize);
+  if (!new_obj && (newsize != 0))
+    return NULL;
+
+  // a reallocation counts as the free of the old object and the allocation
+  // of the new one
+  if (obj)
+    pb_stats_allocator_record(stats_allocator, 0, oldsize);
+  if (newsize != 0)
+    pb_stats_allocator_record(stats_allocator, newsize, 0);
+
+  return new_obj;
+}
+
+static void pb_stats_allocator_free(const struct pb_allocator *allocator,
+    void *obj, size_t size) {
+  struct pb_stats_allocator *stats_allocator =
+    (struct pb_stats_allocator*)allocator;
+
+  if (!obj)
+    return;
+
+  pb_allocator_free(stats_allocator->decorated_allocator, obj, size);
+
+  pb_stats_allocator_record(stats_allocator, 0, size);
+}
+
+/*******************************************************************************
+ */
+static struct pb_allocator_operations pb_stats_allocator_operations = {
+  .malloc = pb_stats_allocator_malloc,
+  .calloc = pb_stats_allocator_calloc,
+  .realloc = pb_stats_allocator_realloc,
+  .free = pb_stats_allocator_free,
+};
+
+
+
+/*******************************************************************************
+ */
+struct pb_allocator *pb_stats_allocator_create(bool per_thread) {
+  return
+    pb_stats_allocator_create_with_alloc(
+      per_thread, pb_get_trivial_allocator());
+}
+
+struct pb_allocator *pb_stats_allocator_create_with_alloc(
+    bool per_thread,
+    const struct pb_allocator *allocator) {
+  struct pb_stats_allocator *stats_allocator =
+    pb_allocator_calloc(allocator, sizeof(struct pb_stats_allocator));
+  if (!stats_allocator)
+    return NULL;
+
+  stats_allocator->allocator.operations = &pb_stats_allocator_operations;
+
+  stats_allocator->decorated_allocator = allocator;
+
+  stats_allocator->per_thread = per_thread;
+
+  stats_allocator->counters.stats_allocator = stats_allocator;
+
+  if (per_thread) {
+    int result =
+      pthread_key_create(
+        &stats_allocator->counters_key, &pb_stats_thread_counters_destroy);
+    if (result != 0) {
+      pb_allocator_free(
+        allocator, stats_allocator, sizeof(struct pb_stats_allocator));
+
+      errno = result;
+
+      return NULL;
+    }
+
+    pthread_mutex_init(&stats_allocator->counters_lock, NULL);
+  }
+
+  return &stats_allocator->allocator;
+}
+
+/*******************************************************************************
+ */
+void pb_stats_allocator_get_stats(const struct pb_allocator *allocator,
+    struct pb_allocator_stats * const stats) {
+  struct pb_stats_allocator *stats_allocator =
+    (struct pb_stats_allocator*)allocator;
+  int64_t live_bytes = 0;
+
+  memset(stats, 0, sizeof(struct pb_allocator_stats));
+
+  if (stats_allocator->per_thread)
+    pthread_mutex_lock(&stats_allocator->counters_lock);
+
+  const struct pb_stats_counters *counters = &stats_allocator->counters;
+
+  while (counters) {
+    stats->alloc_count += pb_stats_counter_load(&counters->alloc_count);
+    stats->free_count += pb_stats_counter_load(&counters->free_count);
+
+    for (size_t i = 0; i < PB_STATS_ALLOCATOR_SIZE_CLASSES; ++i)
+      stats->size_class_counts[i] +=
+        pb_stats_counter_load(&counters->size_class_counts[i]);
+
+    live_bytes += __atomic_load_n(&counters->live_bytes, __ATOMIC_RELAXED);
+
+    counters =
+      (counters == &stats_allocator->counters) ?
+        stats_allocator->thread_counters : counters->next;
+  }
+
+  if (stats_allocator->per_thread)
+    pthread_mutex_unlock(&stats_allocator->counters_lock);
+
+  stats->live_bytes =
+    __atomic_load_n(&stats_allocator->live_bytes, __ATOMIC_RELAXED) +
+    (uint64_t)live_bytes;
+
+  stats->high_water_bytes =
+    __atomic_load_n(&stats_allocator->high_water_bytes, __ATOMIC_RELAXED);
+  if (stats->live_bytes > stats->high_water_bytes)
+    stats->high_water_bytes = stats->live_bytes;
+}
+
+/*******************************************************************************
+ */
+void pb_stats_allocator_destroy(struct pb_allocator * const allocator) {
+  struct pb_stats_allocator *stats_allocator =
+    (struct pb_stats_allocator*)allocator;
+  const struct pb_allocator *decorated_allocator =
+    stats_allocator->decorated_allocator;
+
+  if (stats_allocator->per_thread) {
+    pthread_key_delete(stats_allocator->counters_key);
+
+    while (stats_allocator->thread_counters) {
+      struct pb_stats_counters *counters = stats_allocator->thread_counters;
+      stats_allocator->thread_counters = counters->next;
+
+      pb_allocator_free(
+        decorated_allocator, counters, sizeof(struct pb_stats_counters));
+    }
+
+    pthread_mutex_destroy(&stats_allocator->counters_lock);
+  }
+
+  pb_allocator_free(
+    decorated_allocator, stats_allocator, sizeof(struct pb_stats_allocator));
+}
+
+
+
+
+
+
+/*******************************************************************************
+ */
+/** A batch of deferred frees. */
+struct pb_deferred_batch {
+  struct pb_deferred_batch *next;
+
+  size_t count;
+
+  struct {
+    void *obj;
+    size_t size;
+  } entries[PB_DEFERRED_ALLOCATOR_BATCH_SIZE];
+};
+
+
+
+/** Pre declare deferred_allocator. */
+struct pb_deferred_allocator;
+
+
+
+/** The per thread state of a deferred allocator. */
+struct pb_deferred_thread_cache {
+  struct pb_deferred_allocator *deferred_allocator;
+
+  struct pb_deferred_batch *batch;
+
+  /** Links in the deferred allocators' list of thread caches. */
+  struct pb_deferred_thread_cache *prev;
+  struct pb_deferred_thread_cache *next;
+};
+
+
+
+/** The specialised allocator that defers frees to be performed in bulk. */
+struct pb_deferred_allocator {
+  struct pb_allocator allocator;
+
+  const struct pb_allocator *decorated_allocator;
+
+  /** Full batches awaiting reclamation, pushed and taken atomically. */
+  struct pb_deferred_batch *pending_batches;
+
+  pthread_key_t thread_cache_key;
+
+  /** The thread cache lock protects the list of thread caches. */
+  pthread_mutex_t thread_cache_lock;
+
+  struct pb_deferred_thread_cache *thread_caches;
+};
+
+
+
+/*******************************************************************************
+ */
+static void pb_deferred_allocator_publish(
+    struct pb_deferred_allocator * const deferred_allocator,
+    struct pb_deferred_batch * const batch) {
+  batch->next =
+    __atomic_load_n(&deferred_allocator->pending_batches, __ATOMIC_RELAXED);
+
+  while (!__atomic_compare_exchange_n(
+            &deferred_allocator->pending_batches, &batch->next, batch,
+            true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+static void pb_deferred_allocator_reclaim_pending(
+    struct pb_deferred_allocator * const deferred_allocator) {
+  struct pb_deferred_batch *batch =
+    __atomic_exchange_n(
+      &deferred_allocator->pending_batches, NULL, __ATOMIC_ACQUIRE);
+
+  while (batch) {
+    struct pb_deferred_batch *next_batch = batch->next;
+
+    for (size_t i = 0; i < batch->count; ++i)
+      pb_allocator_free(
+        deferred_allocator->decorated_allocator,
+        batch->entries[i].obj, batch->entries[i].size);
+
+    pb_allocator_free(
+      deferred_allocator->decorated_allocator,
+      batch, sizeof(struct pb_deferred_batch));
+
+    batch = next_batch;
+  }
+}
+
+/*******************************************************************************
+ */
+static void pb_deferred_thread_cache_unlink(
+    struct pb_deferred_allocator * const deferred_allocator,
+    struct pb_deferred_thread_cache * const thread_cache) {
+  if (thread_cache->prev)
+    thread_cache->prev->next = thread_cache->next;
+  else
+    deferred_allocator->thread_caches = thread_cache->next;
+
+  if (thread_cache->next)
+    thread_cache->next->prev = thread_cache->prev;
+}
+
+static void pb_deferred_thread_cache_destroy(void *arg) {
+  struct pb_deferred_thread_cache *thread_cache = arg;
+  struct pb_deferred_allocator *deferred_allocator =
+    thread_cache->deferred_allocator;
+
+  pthread_mutex_lock(&deferred_allocator->thread_cache_lock);
+
+  pb_deferred_thread_cache_unlink(deferred_allocator, thread_cache);
+
+  pthread_mutex_unlock(&deferred_allocator->thread_cache_lock);
+
+  if (thread_cache->batch)
+    pb_deferred_allocator_publish(deferred_allocator, thread_cache->batch);
+
+  pb_allocator_free(
+    deferred_allocator->decorated_allocator,
+    thread_cache, sizeof(struct pb_deferred_thread_cache));
+}
+
+static struct pb_deferred_thread_cache *pb_deferred_allocator_get_thread_cache(
+    struct pb_deferred_allocator * const deferred_allocator) {
+  struct pb_deferred_thread_cache *thread_cache =
+    pthread_getspecific(deferred_allocator->thread_cache_key);
+  if (thread_cache)
+    return thread_cache;
+
+  thread_cache =
+    pb_allocator_calloc(
+      deferred_allocator->decorated_allocator,
+      sizeof(struct pb_deferred_thread_cache));
+  if (!thread_cache)
+    return NULL;
+
+  thread_cache->deferred_allocator = deferred_allocator;
+
+  if (pthread_setspecific(
+        deferred_allocator->thread_cache_key, thread_cache) != 0) {
+    pb_allocator_free(
+      deferred_allocator->decorated_allocator,
+      thread_cache, sizeof(struct pb_deferred_thread_cache));
+
+    return NULL;
+  }
+
+  pthread_mutex_lock(&deferred_allocator->thread_cache_lock);
+
+  thread_cache->next = deferred_allocator->thread_caches;
+  if (thread_cache->next)
+    thread_cache->next->prev = thread_cache;
+  deferred_allocator->thread_caches = thread_cache;
+
+  pthread_mutex_unlock(&deferred_allocator->thread_cache_lock);
+
+  return thread_cache;
+}
+
+/*******************************************************************************
+ */
+static void *pb_deferred_allocator_malloc(
+    const struct pb_allocator *allocator, size_t size) {
+  struct pb_deferred_allocator *deferred_allocator =
+    (struct pb_deferred_allocator*)allocator;
+
+  if (__atomic_load_n(&deferred_allocator->pending_batches, __ATOMIC_RELAXED))
+    pb_deferred_allocator_reclaim_pending(deferred_allocator);
+
+  return pb_allocator_malloc(deferred_allocator->decorated_allocator, size);
+}
+
+static void *pb_deferred_allocator_calloc(
+    const struct pb_allocator *allocator, size_t size) {
+  struct pb_deferred_allocator *deferred_allocator =
+    (struct pb_deferred_allocator*)allocator;
+
+  if (__atomic_load_n(&deferred_allocator->pending_batches, __ATOMIC_RELAXED))
+    pb_deferred_allocator_reclaim_pending(deferred_allocator);
+
+  return pb_allocator_calloc(deferred_allocator->decorated_allocator, size);
+}
+
+static void *pb_deferred_allocator_realloc(
+    const struct pb_allocator *allocator,
+    void *obj, size_t oldsize, size_t newsize) {
+  struct pb_deferred_allocator *deferred_allocator =
+    (struct pb_deferred_allocator*)allocator;
+
+  return
+    pb_allocator_realloc(
+      deferred_allocator->decorated_allocator, obj, oldsize, newsize);
+}
+
+static void pb_deferred_allocator_free(const struct pb_allocator *allocator,
+    void *obj, size_t size) {
+  struct pb_deferred_allocator *deferred_allocator =
+    (struct pb_deferred_allocator*)allocator;
+
+  if (!obj)
+    return;
+
+  struct pb_deferred_thread_cache *thread_cache =
+    pb_deferred_allocator_get_thread_cache(deferred_allocator);
+  if (!thread_cache) {
+    pb_allocator_free(deferred_allocator->decorated_allocator, obj, size);
+
+    return;
+  }
+
+  struct pb_deferred_batch *batch = thread_cache->batch;
+  if (!batch) {
+    batch =
+      pb_allocator_malloc(
+        deferred_allocator->decorated_allocator,
+        sizeof(struct pb_deferred_batch));
+    if (!batch) {
+      pb_allocator_free(deferred_allocator->decorated_allocator, obj, size);
+
+      return;
+    }
+
+    batch->next = NULL;
+    batch->count = 0;
+
+    thread_cache->batch = batch;
+  }
+
+  batch->entries[batch->count].obj = obj;
+  batch->entries[batch->count].size = size;
+
+  if (++batch->count == PB_DEFERRED_ALLOCATOR_BATCH_SIZE) {
+    thread_cache->batch = NULL;
+
+    pb_deferred_allocator_publish(deferred_allocator, batch);
+  }
+}
+
+/*******************************************************************************
+ */
+static struct pb_allocator_operations pb_deferred_allocator_operations = {
+  .malloc = pb_deferred_allocator_malloc,
+  .calloc = pb_deferred_allocator_calloc,
+  .realloc = pb_deferred_allocator_realloc,
+  .free = pb_deferred_allocator_free,
+};
+
+
+
+/*******************************************************************************
+ */
+struct pb_allocator *pb_deferred_allocator_create(void) {
+  return pb_deferred_allocator_create_with_alloc(pb_get_trivial_allocator());
+}
+
+struct pb_allocator *pb_deferred_allocator_create_with_alloc(
+    const struct pb_allocator *allocator) {
+  struct pb_deferred_allocator *deferred_allocator =
+    pb_allocator_calloc(allocator, sizeof(struct pb_deferred_allocator));
+  if (!deferred_allocator)
+    return NULL;
+
+  deferred_allocator->allocator.operations =
+    &pb_deferred_allocator_operations;
+
+  deferred_allocator->decorated_allocator = allocator;
+
+  int result =
+    pthread_key_create(
+      &deferred_allocator->thread_cache_key,
+      &pb_deferred_thread_cache_destroy);
+  if (result != 0) {
+    pb_allocator_free(
+      allocator, deferred_allocator, sizeof(struct pb_deferred_allocator));
+
+    errno = result;
+
+    return NULL;
+  }
+
+  pthread_mutex_init(&deferred_allocator->thread_cache_lock, NULL);
+
+  return &deferred_allocator->allocator;
+}
+
+/*******************************************************************************
+ */
+void pb_deferred_allocator_reclaim(struct pb_allocator * const allocator) {
+  struct pb_deferred_allocator *deferred_allocator =
+    (struct pb_deferred_allocator*)allocator;
+
+  struct pb_deferred_thread_cache *thread_cache =
+    pthread_getspecific(deferred_allocator->thread_cache_key);
+  if (thread_cache && thread_cache->batch) {
+    pb_deferred_allocator_publish(deferred_allocator, thread_cache->batch);
+
+    thread_cache->batch = NULL;
+  }
+
+  pb_deferred_allocator_reclaim_pending(deferred_allocator);
+}
+
+/*******************************************************************************
+ */
+void pb_deferred_allocator_destroy(struct pb_allocator * const allocator) {
+  struct pb_deferred_allocator *deferred_allocator =
+    (struct pb_deferred_allocator*)allocator;
+  const struct pb_allocator *decorated_allocator =
+    deferred_allocator->decorated_allocator;
+
+  pthread_key_delete(deferred_allocator->thread_cache_key);
+
+  while (deferred_allocator->thread_caches) {
+    struct pb_deferred_thread_cache *thread_cache =
+      deferred_allocator->thread_caches;
+
+    pb_deferred_thread_cache_unlink(deferred_allocator, thread_cache);
+
+    if (thread_cache->batch)
+      pb_deferred_allocator_publish(deferred_allocator, thread_cache->batch);
+
+    pb_allocator_free(
+      decorated_allocator,
+      thread_cache, sizeof(struct pb_deferred_thread_cache));
+  }
+
+  pb_deferred_allocator_reclaim_pending(deferred_allocator);
+
+  pthread_mutex_destroy(&deferred_allocator->thread_cache_lock);
+
+  pb_allocator_free(
+    decorated_allocator,
+    deferred_allocator, sizeof(struct pb_deferred_allocator));
+}
+
+
+
+
+
+
+/*******************************************************************************
+ */
+/** The reclaimer, a queue of reclaim tasks released in order. */
+struct pb_reclaimer {
+  const struct pb_allocator *allocator;
+
+  /** The lock protects the queue and the thread state. */
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+
+  struct pb_reclaim_task *head;
+  struct pb_reclaim_task *tail;
+
+  /** The number of tasks submitted and not yet completed, including any
+   *  being released outside of the lock. */
+  size_t pending_count;
+
+  /** Only one task is released outside of the lock at a time, so that pages
+   *  are released in order when pb_reclaimer_reclaim runs alongside the
+   *  thread.  release_cond is signalled when that release finishes. */
+  bool releasing;
+  pthread_cond_t release_cond;
+
+  pthread_t thread;
+  bool thread_started;
+  bool thread_stopping;
+};
+
+
+
+/*******************************************************************************
+ */
+static struct pb_reclaim_task *pb_reclaimer_pop(
+    struct pb_reclaimer * const reclaimer) {
+  struct pb_reclaim_task *task = reclaimer->head;
+  if (!task)
+    return NULL;
+
+  reclaimer->head = task->next;
+  if (!reclaimer->head)
+    reclaimer->tail = NULL;
+
+  task->next = NULL;
+
+  return task;
+}
+
+static void pb_reclaimer_push_front(
+    struct pb_reclaimer * const reclaimer,
+    struct pb_reclaim_task * const task) {
+  task->next = reclaimer->head;
+
+  reclaimer->head = task;
+  if (!reclaimer->tail)
+    reclaimer->tail = task;
+}
+
+/*******************************************************************************
+ * Release up to count pages of the task at the head of the queue, which is
+ * released outside of the lock, after any release already in progress has
+ * finished.  The lock must be held on entry, and is held on return.
+ */
+static bool pb_reclaimer_release_head(
+    struct pb_reclaimer * const reclaimer,
+    uint64_t * const count) {
+  while (reclaimer->releasing)
+    pthread_cond_wait(&reclaimer->release_cond, &reclaimer->lock);
+
+  struct pb_reclaim_task *task = pb_reclaimer_pop(reclaimer);
+  if (!task)
+    return false;
+
+  reclaimer->releasing = true;
+
+  pthread_mutex_unlock(&reclaimer->lock);
+
+  bool complete = task->release(task, count);
+
+  pthread_mutex_lock(&reclaimer->lock);
+
+  if (complete)
+    --reclaimer->pending_count;
+  else
+    pb_reclaimer_push_front(reclaimer, task);
+
+  reclaimer->releasing = false;
+
+  pthread_cond_broadcast(&reclaimer->release_cond);
+
+  return true;
+}
+
+/*******************************************************************************
+ */
+static void *pb_reclaimer_thread(void *arg) {
+  struct pb_reclaimer *reclaimer = arg;
+
+  pthread_mutex_lock(&reclaimer->lock);
+
+  while (!reclaimer->thread_stopping) {
+    uint64_t count = PB_RECLAIMER_THREAD_BATCH_SIZE;
+
+    if (!pb_reclaimer_release_head(reclaimer, &count))
+      pthread_cond_wait(&reclaimer->cond, &reclaimer->lock);
+  }
+
+  pthread_mutex_unlock(&reclaimer->lock);
+
+  return NULL;
+}
+
+
+
+/*******************************************************************************
+ */
+struct pb_reclaimer *pb_reclaimer_create(void) {
+  return pb_reclaimer_create_with_alloc(pb_get_trivial_allocator());
+}
+
+struct pb_reclaimer *pb_reclaimer_create_with_alloc(
+    const struct pb_allocator *allocator) {
+  struct pb_reclaimer *reclaimer =
+    pb_allocator_calloc(allocator, sizeof(struct pb_reclaimer));
+  if (!reclaimer)
+    return NULL;
+
+  reclaimer->allocator = allocator;
+
+  pthread_mutex_init(&reclaimer->lock, NULL);
+  pthread_cond_init(&reclaimer->cond, NULL);
+  pthread_cond_init(&reclaimer->release_cond, NULL);
+
+  return reclaimer;
+}
+
+/*******************************************************************************
+ */
+bool pb_reclaimer_start(struct pb_reclaimer * const reclaimer) {
+  pthread_mutex_lock(&reclaimer->lock);
+
+  if (reclaimer->thread_started) {
+    pthread_mutex_unlock(&reclaimer->lock);
+
+    return true;
+  }
+
+  int result =
+    pthread_create(&reclaimer->thread, NULL, &pb_reclaimer_thread, reclaimer);
+  if (result != 0) {
+    pthread_mutex_unlock(&reclaimer->lock);
+
+    errno = result;
+
+    return false;
+  }
+
+  reclaimer->thread_started = true;
+
+  pthread_mutex_unlock(&reclaimer->lock);
+
+  return true;
+}
+
+/*******************************************************************************
+ */
+void pb_reclaimer_submit(struct pb_reclaimer * const reclaimer,
+    struct pb_reclaim_task * const task) {
+  task->next = NULL;
+
+  pthread_mutex_lock(&reclaimer->lock);
+
+  if (reclaimer->tail)
+    reclaimer->tail->next = task;
+  else
+    reclaimer->head = task;
+  reclaimer->tail = task;
+
+  ++reclaimer->pending_count;
+
+  pthread_cond_signal(&reclaimer->cond);
+
+  pthread_mutex_unlock(&reclaimer->lock);
+}
+
+/*******************************************************************************
+ */
+uint64_t pb_reclaimer_reclaim(struct pb_reclaimer * const reclaimer,
+    uint64_t max_pages) {
+  uint64_t count = max_pages;
+
+  pthread_mutex_lock(&reclaimer->lock);
+
+  while ((count > 0) && pb_reclaimer_release_head(reclaimer, &count));
+
+  pthread_mutex_unlock(&reclaimer->lock);
+
+  return (max_pages - count);
+}
+
+/*******************************************************************************
+ */
+bool pb_reclaimer_is_empty(struct pb_reclaimer * const reclaimer) {
+  pthread_mutex_lock(&reclaimer->lock);
+
+  bool is_empty = (reclaimer->pending_count == 0);
+
+  pthread_mutex_unlock(&reclaimer->lock);
+
+  return is_empty;
+}
+
+/*******************************************************************************
+ */
+void pb_reclaimer_destroy(struct pb_reclaimer * const reclaimer) {
+  pthread_mutex_lock(&reclaimer->lock);
+
+  bool thread_started = reclaimer->thread_started;
+
+  reclaimer->thread_stopping = true;
+
+  pthread_cond_signal(&reclaimer->cond);
+
+  pthread_mutex_unlock(&reclaimer->lock);
+
+  if (thread_started)
+    pthread_join(reclaimer->thread, NULL);
+
+  pb_reclaimer_reclaim(reclaimer, UINT64_MAX);
+
+  pthread_cond_destroy(&reclaimer->release_cond);
+  pthread_cond_destroy(&reclaimer->cond);
+  pthread_mutex_destroy(&reclaimer->lock);
+
+  pb_allocator_free(
+    reclaimer->allocator, reclaimer, sizeof(struct pb_reclaimer));
+}
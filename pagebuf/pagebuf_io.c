@@ -0,0 +1,1029 @@
+/*******************************************************************************
+ *  Copyright 2017 Nick Jones <nick.fa.jones@gmail.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ ******************************************************************************/
+
+#include "pagebuf_io.h"
+#include "pagebuf_protected.h"
+#include "pagebuf_mmap.h"
+
+#include <linux/errqueue.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
+
+
+
+/*******************************************************************************
+ */
+/** The number of times, and the interval in milliseconds at which, destroy
+ *  waits for the kernel to report pending zero copy sends finished. */
+#define PB_ZEROCOPY_SENDER_DRAIN_POLL_COUNT               100
+#define PB_ZEROCOPY_SENDER_DRAIN_POLL_INTERVAL            10
+
+
+
+/*******************************************************************************
+ */
+static ssize_t pb_io_readv(const struct iovec *iov, int iovcnt,
+                           void *context);
+
+
+struct pb_io_region;
+
+static void pb_io_region_put(struct pb_io_region * const region);
+static void pb_io_region_release(void *buf, uint64_t len, void *context);
+
+
+static int pb_io_recvmmsg(struct pb_buffer * const *buffers, size_t count,
+                          int fd, size_t len, size_t *lens);
+static int pb_io_sendmmsg(struct pb_buffer * const *buffers, size_t count,
+                          int fd, const uint64_t *offsets, const size_t *lens);
+
+
+static bool pb_splice_pipe_open(int fds[2]);
+static void pb_splice_pipe_close(int fds[2]);
+
+
+struct pb_zerocopy_send;
+
+static void pb_zerocopy_send_release(
+                              struct pb_zerocopy_sender * const zerocopy_sender,
+                              struct pb_zerocopy_send * const zerocopy_send);
+static size_t pb_zerocopy_sender_release(
+                              struct pb_zerocopy_sender * const zerocopy_sender,
+                              uint32_t lo, uint32_t hi);
+
+
+
+/*******************************************************************************
+ */
+/** The record of a memory region written by pb_buffer_write_region, or
+ *  received into by pb_io_recvmmsg.
+ *
+ * The region is freed with the size it was allocated with, which may be
+ * larger than the length written to the buffers.  The use count holds one
+ * reference for each write of the region to a buffer, and one for the writer
+ * while it is writing the region.  Buffers sharing a region may be released
+ * on different threads, so the use count is atomic.
+ */
+struct pb_io_region {
+  void *buf;
+  size_t len;
+
+  const struct pb_allocator *allocator;
+
+  unsigned int use_count;
+};
+
+/*******************************************************************************
+ */
+static void pb_io_region_put(struct pb_io_region * const region) {
+  if (__atomic_sub_fetch(&region->use_count, 1, __ATOMIC_ACQ_REL) != 0)
+    return;
+
+  const struct pb_allocator *allocator = region->allocator;
+
+  pb_allocator_free(allocator, region->buf, region->len);
+  pb_allocator_free(allocator, region, sizeof(struct pb_io_region));
+}
+
+/*******************************************************************************
+ * Release a memory region written by pb_buffer_write_region, once the buffer
+ * no longer references it.
+ */
+static void pb_io_region_release(void *buf, uint64_t len, void *context) {
+  (void)buf;
+  (void)len;
+
+  pb_io_region_put(context);
+}
+
+/*******************************************************************************
+ * Read from the fd pointed to by context into the memory regions offered by
+ * pb_buffer_write_data_fill.
+ */
+static ssize_t pb_io_readv(const struct iovec *iov, int iovcnt,
+    void *context) {
+  int fd = *(const int*)context;
+
+  ssize_t result;
+
+  do {
+    result = readv(fd, iov, iovcnt);
+  } while ((result < 0) && (errno == EINTR));
+
+  return result;
+}
+
+/*******************************************************************************
+ */
+const struct pb_allocator *pb_buffer_get_region_allocator(
+    const struct pb_buffer *buffer) {
+  if (buffer->operations == pb_get_mmap_buffer_operations())
+    return pb_get_trivial_allocator();
+
+  return buffer->allocator;
+}
+
+/*******************************************************************************
+ */
+uint64_t pb_buffer_write_region(struct pb_buffer * const buffer,
+    void *buf, size_t len, size_t used,
+    const struct pb_allocator *allocator) {
+  struct pb_io_region *region =
+    (used >= (len - (len / 2))) ?
+      pb_allocator_malloc(allocator, sizeof(struct pb_io_region)) :
+      NULL;
+
+  // a region that is mostly unused is copied rather than held by the buffer
+  if (!region) {
+    uint64_t written =
+      (used > 0) ? pb_buffer_write_data(buffer, buf, (uint64_t)used) : 0;
+
+    pb_allocator_free(allocator, buf, len);
+
+    return written;
+  }
+
+  region->buf = buf;
+  region->len = len;
+  region->allocator = allocator;
+  region->use_count = 2;
+
+  uint64_t written =
+    pb_buffer_write_data_mem(
+      buffer, buf, (uint64_t)used, &pb_io_region_release, region);
+
+  // the buffer didn't take all of the region, so copy the remainder
+  if (written < used)
+    written +=
+      pb_buffer_write_data(
+        buffer, (uint8_t*)buf + written, (uint64_t)(used - written));
+
+  pb_io_region_put(region);
+
+  return written;
+}
+
+/*******************************************************************************
+ */
+ssize_t pb_buffer_read_fd(struct pb_buffer * const buffer,
+    int fd, size_t len) {
+  return pb_buffer_write_data_fill(buffer, (uint64_t)len, &pb_io_readv, &fd);
+}
+
+/*******************************************************************************
+ */
+ssize_t pb_buffer_write_fd(struct pb_buffer * const buffer,
+    int fd, size_t len) {
+  if (buffer->strategy->rejects_seek) {
+    errno = EPERM;
+
+    return -1;
+  }
+
+  struct iovec iov[PB_IO_IOVEC_SIZE];
+  size_t written = 0;
+
+  while (written < len) {
+    size_t iovcnt =
+      pb_buffer_get_iovec(buffer, 0, len - written, iov, PB_IO_IOVEC_SIZE);
+    if (iovcnt == 0)
+      break;
+
+    size_t iov_len = 0;
+    for (size_t i = 0; i < iovcnt; ++i)
+      iov_len += iov[i].iov_len;
+
+    ssize_t result;
+
+    do {
+      result = writev(fd, iov, (int)iovcnt);
+    } while ((result < 0) && (errno == EINTR));
+
+    if (result < 0) {
+      if (written > 0)
+        break;
+
+      return -1;
+    }
+
+    pb_buffer_seek(buffer, (uint64_t)result);
+
+    written += (size_t)result;
+
+    if ((size_t)result < iov_len)
+      break;
+  }
+
+  return (ssize_t)written;
+}
+
+
+/*******************************************************************************
+ * Receive datagrams into count buffers, where buffers may repeat.
+ *
+ * The datagrams are received into slots of len bytes in a single memory
+ * region.  If the datagrams fill at least half of the region, each is written
+ * to its buffer without being copied, the region being freed once no buffer
+ * references it.  Otherwise they are copied, so that small datagrams fill the
+ * spare capacity of the buffer pages, and the region is freed at once.
+ */
+static int pb_io_recvmmsg(struct pb_buffer * const *buffers, size_t count,
+    int fd, size_t len, size_t *lens) {
+  if (count > PB_IO_MMSG_SIZE)
+    count = PB_IO_MMSG_SIZE;
+
+  for (size_t i = 0; i < count; ++i) {
+    if (buffers[i]->strategy->rejects_write) {
+      errno = EPERM;
+
+      return -1;
+    }
+  }
+
+  if ((count == 0) || (len == 0))
+    return 0;
+
+  const struct pb_allocator *allocator =
+    pb_buffer_get_region_allocator(buffers[0]);
+  size_t region_len = count * len;
+
+  uint8_t *buf = pb_allocator_malloc(allocator, region_len);
+  if (!buf)
+    return -1;
+
+  struct mmsghdr msgs[PB_IO_MMSG_SIZE];
+  struct iovec iov[PB_IO_MMSG_SIZE];
+
+  memset(msgs, 0, count * sizeof(struct mmsghdr));
+
+  for (size_t i = 0; i < count; ++i) {
+    iov[i].iov_base = buf + (i * len);
+    iov[i].iov_len = len;
+
+    msgs[i].msg_hdr.msg_iov = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  int result;
+
+  do {
+    result = recvmmsg(fd, msgs, (unsigned int)count, MSG_WAITFORONE, NULL);
+  } while ((result < 0) && (errno == EINTR));
+
+  if (result <= 0) {
+    int temp_errno = errno;
+
+    pb_allocator_free(allocator, buf, region_len);
+
+    errno = temp_errno;
+
+    return result;
+  }
+
+  size_t used = 0;
+  for (int i = 0; i < result; ++i)
+    used += msgs[i].msg_len;
+
+  // a region that is mostly unused is copied rather than held by the buffers
+  struct pb_io_region *region =
+    (used >= (region_len - (region_len / 2))) ?
+      pb_allocator_malloc(allocator, sizeof(struct pb_io_region)) :
+      NULL;
+
+  if (region) {
+    region->buf = buf;
+    region->len = region_len;
+    region->allocator = allocator;
+    region->use_count = 1;
+  }
+
+  // once a datagram can't be written whole, those that follow are dropped,
+  // so that the boundaries of those written are intact
+  bool failed = false;
+
+  for (int i = 0; i < result; ++i) {
+    uint64_t msg_len = msgs[i].msg_len;
+    uint64_t written = 0;
+
+    if (!failed && region) {
+      __atomic_fetch_add(&region->use_count, 1, __ATOMIC_RELAXED);
+
+      written =
+        pb_buffer_write_data_mem(
+          buffers[i], iov[i].iov_base, msg_len,
+          &pb_io_region_release, region);
+    } else if (!failed) {
+      written = pb_buffer_write_data(buffers[i], iov[i].iov_base, msg_len);
+    }
+
+    if (written < msg_len)
+      failed = true;
+
+    if (lens)
+      lens[i] = (size_t)written;
+  }
+
+  if (region)
+    pb_io_region_put(region);
+  else
+    pb_allocator_free(allocator, buf, region_len);
+
+  if (failed) {
+    errno = ENOMEM;
+
+    return -1;
+  }
+
+  return result;
+}
+
+/*******************************************************************************
+ * Send count datagrams, of lens[i] bytes from offsets[i] of buffers[i], where
+ * buffers may repeat, then seek the datagrams sent from their buffers.
+ */
+static int pb_io_sendmmsg(struct pb_buffer * const *buffers, size_t count,
+    int fd, const uint64_t *offsets, const size_t *lens) {
+  if (count > PB_IO_MMSG_SIZE)
+    count = PB_IO_MMSG_SIZE;
+
+  for (size_t i = 0; i < count; ++i) {
+    if (buffers[i]->strategy->rejects_seek) {
+      errno = EPERM;
+
+      return -1;
+    }
+  }
+
+  struct mmsghdr msgs[PB_IO_MMSG_SIZE];
+  struct iovec iov[PB_IO_IOVEC_SIZE];
+  size_t iovcnt = 0;
+  size_t msgcnt = 0;
+
+  memset(msgs, 0, count * sizeof(struct mmsghdr));
+
+  for (; msgcnt < count; ++msgcnt) {
+    size_t msg_iovcnt =
+      pb_buffer_get_iovec(
+        buffers[msgcnt], offsets[msgcnt], lens[msgcnt],
+        &iov[iovcnt], PB_IO_IOVEC_SIZE - iovcnt);
+
+    size_t msg_len = 0;
+    for (size_t i = 0; i < msg_iovcnt; ++i)
+      msg_len += iov[iovcnt + i].iov_len;
+
+    // a datagram must be sent whole
+    if (msg_len < lens[msgcnt])
+      break;
+
+    msgs[msgcnt].msg_hdr.msg_iov = &iov[iovcnt];
+    msgs[msgcnt].msg_hdr.msg_iovlen = msg_iovcnt;
+
+    iovcnt += msg_iovcnt;
+  }
+
+  if ((msgcnt == 0) && (count > 0)) {
+    errno = EMSGSIZE;
+
+    return -1;
+  }
+
+  if (msgcnt == 0)
+    return 0;
+
+  int result;
+
+  do {
+    result = sendmmsg(fd, msgs, (unsigned int)msgcnt, 0);
+  } while ((result < 0) && (errno == EINTR));
+
+  for (int i = 0; i < result; ++i)
+    pb_buffer_seek(buffers[i], msgs[i].msg_len);
+
+  return result;
+}
+
+/*******************************************************************************
+ */
+int pb_buffer_array_recvmmsg(struct pb_buffer * const *buffers, size_t count,
+    int fd, size_t len) {
+  return pb_io_recvmmsg(buffers, count, fd, len, NULL);
+}
+
+int pb_buffer_recvmmsg(struct pb_buffer * const buffer,
+    int fd, size_t count, size_t len, size_t *lens) {
+  struct pb_buffer *buffers[PB_IO_MMSG_SIZE];
+
+  if (count > PB_IO_MMSG_SIZE)
+    count = PB_IO_MMSG_SIZE;
+
+  for (size_t i = 0; i < count; ++i)
+    buffers[i] = buffer;
+
+  return pb_io_recvmmsg(buffers, count, fd, len, lens);
+}
+
+/*******************************************************************************
+ */
+int pb_buffer_array_sendmmsg(struct pb_buffer * const *buffers, size_t count,
+    int fd) {
+  uint64_t offsets[PB_IO_MMSG_SIZE];
+  size_t lens[PB_IO_MMSG_SIZE];
+
+  if (count > PB_IO_MMSG_SIZE)
+    count = PB_IO_MMSG_SIZE;
+
+  for (size_t i = 0; i < count; ++i) {
+    offsets[i] = 0;
+    lens[i] = (size_t)pb_buffer_get_data_size(buffers[i]);
+  }
+
+  return pb_io_sendmmsg(buffers, count, fd, offsets, lens);
+}
+
+/*******************************************************************************
+ * The datagrams are consecutive in the buffer, so the offset of each is the
+ * total length of those before it, and they are seeked in turn once sent.
+ */
+int pb_buffer_sendmmsg(struct pb_buffer * const buffer,
+    int fd, const size_t *lens, size_t count) {
+  struct pb_buffer *buffers[PB_IO_MMSG_SIZE];
+  uint64_t offsets[PB_IO_MMSG_SIZE];
+  uint64_t offset = 0;
+
+  if (count > PB_IO_MMSG_SIZE)
+    count = PB_IO_MMSG_SIZE;
+
+  for (size_t i = 0; i < count; ++i) {
+    buffers[i] = buffer;
+    offsets[i] = offset;
+
+    offset += lens[i];
+  }
+
+  return pb_io_sendmmsg(buffers, count, fd, offsets, lens);
+}
+
+
+
+
+
+
+/*******************************************************************************
+ */
+struct pb_splice_pipe {
+  const struct pb_allocator *allocator;
+
+  /** The read and write ends of the pipe. */
+  int fds[2];
+
+  /** The amount of data in the pipe. */
+  uint64_t data_size;
+
+  /** The pipe that peeked data is duplicated into, created when first
+   *  needed. */
+  int peek_fds[2];
+};
+
+
+
+/*******************************************************************************
+ */
+static bool pb_splice_pipe_open(int fds[2]) {
+  if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) == -1) {
+    fds[0] = -1;
+    fds[1] = -1;
+
+    return false;
+  }
+
+  return true;
+}
+
+static void pb_splice_pipe_close(int fds[2]) {
+  if (fds[0] != -1)
+    close(fds[0]);
+  if (fds[1] != -1)
+    close(fds[1]);
+
+  fds[0] = -1;
+  fds[1] = -1;
+}
+
+/*******************************************************************************
+ */
+struct pb_splice_pipe *pb_splice_pipe_create(void) {
+  return pb_splice_pipe_create_with_alloc(pb_get_trivial_allocator());
+}
+
+struct pb_splice_pipe *pb_splice_pipe_create_with_alloc(
+    const struct pb_allocator *allocator) {
+  struct pb_splice_pipe *splice_pipe =
+    pb_allocator_calloc(allocator, sizeof(struct pb_splice_pipe));
+  if (!splice_pipe)
+    return NULL;
+
+  splice_pipe->allocator = allocator;
+  splice_pipe->peek_fds[0] = -1;
+  splice_pipe->peek_fds[1] = -1;
+
+  if (!pb_splice_pipe_open(splice_pipe->fds)) {
+    int temp_errno = errno;
+
+    pb_allocator_free(allocator, splice_pipe, sizeof(struct pb_splice_pipe));
+
+    errno = temp_errno;
+
+    return NULL;
+  }
+
+  return splice_pipe;
+}
+
+/*******************************************************************************
+ */
+uint64_t pb_splice_pipe_get_data_size(
+    const struct pb_splice_pipe *splice_pipe) {
+  return splice_pipe->data_size;
+}
+
+/*******************************************************************************
+ */
+ssize_t pb_splice_pipe_splice_in(struct pb_splice_pipe * const splice_pipe,
+    int fd, size_t len) {
+  ssize_t result;
+
+  do {
+    result =
+      splice(
+        fd, NULL, splice_pipe->fds[1], NULL, len,
+        SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+  } while ((result < 0) && (errno == EINTR));
+
+  if (result > 0)
+    splice_pipe->data_size += (uint64_t)result;
+
+  return result;
+}
+
+ssize_t pb_splice_pipe_splice_out(struct pb_splice_pipe * const splice_pipe,
+    int fd, size_t len) {
+  if (len > splice_pipe->data_size)
+    len = (size_t)splice_pipe->data_size;
+
+  if (len == 0)
+    return 0;
+
+  ssize_t result;
+
+  do {
+    result =
+      splice(
+        splice_pipe->fds[0], NULL, fd, NULL, len,
+        SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+  } while ((result < 0) && (errno == EINTR));
+
+  if (result > 0)
+    splice_pipe->data_size -= (uint64_t)result;
+
+  return result;
+}
+
+/*******************************************************************************
+ */
+ssize_t pb_splice_pipe_tee(struct pb_splice_pipe * const splice_pipe,
+    struct pb_splice_pipe * const dst_splice_pipe,
+    size_t len) {
+  if (len > splice_pipe->data_size)
+    len = (size_t)splice_pipe->data_size;
+
+  if (len == 0)
+    return 0;
+
+  ssize_t result;
+
+  do {
+    result =
+      tee(
+        splice_pipe->fds[0], dst_splice_pipe->fds[1], len,
+        SPLICE_F_NONBLOCK);
+  } while ((result < 0) && (errno == EINTR));
+
+  if (result > 0)
+    dst_splice_pipe->data_size += (uint64_t)result;
+
+  return result;
+}
+
+/*******************************************************************************
+ * Peeked data is duplicated into a private pipe by tee, then read from there
+ * into the buffer, leaving the data in the splice pipe untouched.
+ */
+ssize_t pb_splice_pipe_peek(struct pb_splice_pipe * const splice_pipe,
+    struct pb_buffer * const buffer,
+    size_t len) {
+  if (len > splice_pipe->data_size)
+    len = (size_t)splice_pipe->data_size;
+
+  if (len == 0)
+    return 0;
+
+  if ((splice_pipe->peek_fds[0] == -1) &&
+      !pb_splice_pipe_open(splice_pipe->peek_fds))
+    return -1;
+
+  ssize_t result;
+
+  do {
+    result =
+      tee(
+        splice_pipe->fds[0], splice_pipe->peek_fds[1], len,
+        SPLICE_F_NONBLOCK);
+  } while ((result < 0) && (errno == EINTR));
+
+  if (result <= 0)
+    return result;
+
+  size_t peek_len = (size_t)result;
+  size_t peeked = 0;
+
+  while (peeked < peek_len) {
+    result =
+      pb_buffer_read_fd(buffer, splice_pipe->peek_fds[0], peek_len - peeked);
+    if (result <= 0)
+      break;
+
+    peeked += (size_t)result;
+  }
+
+  // don't leave stale data in the peek pipe for the next peek
+  if (peeked < peek_len) {
+    int temp_errno = errno;
+
+    pb_splice_pipe_close(splice_pipe->peek_fds);
+
+    errno = temp_errno;
+
+    if (peeked == 0)
+      return -1;
+  }
+
+  return (ssize_t)peeked;
+}
+
+/*******************************************************************************
+ */
+void pb_splice_pipe_destroy(struct pb_splice_pipe * const splice_pipe) {
+  pb_splice_pipe_close(splice_pipe->peek_fds);
+  pb_splice_pipe_close(splice_pipe->fds);
+
+  pb_allocator_free(
+    splice_pipe->allocator, splice_pipe, sizeof(struct pb_splice_pipe));
+}
+
+
+
+
+
+
+/*******************************************************************************
+ * A send whose pages are referenced until the kernel reports it finished.
+ * The kernel numbers each successful MSG_ZEROCOPY sendmsg on a socket
+ * consecutively from zero, and reports finished sends as ranges of numbers.
+ */
+struct pb_zerocopy_send {
+  struct pb_zerocopy_send *next;
+
+  uint32_t id;
+
+  struct pb_data *data[PB_IO_IOVEC_SIZE];
+  size_t data_count;
+};
+
+
+
+/*******************************************************************************
+ */
+struct pb_zerocopy_sender {
+  const struct pb_allocator *allocator;
+
+  int fd;
+
+  /** The id the kernel will give the next send. */
+  uint32_t next_id;
+
+  /** The sends not yet reported finished, oldest first. */
+  struct pb_zerocopy_send *first_send;
+  struct pb_zerocopy_send *last_send;
+  size_t pending;
+};
+
+
+
+/*******************************************************************************
+ */
+struct pb_zerocopy_sender *pb_zerocopy_sender_create(int fd) {
+  return pb_zerocopy_sender_create_with_alloc(fd, pb_get_trivial_allocator());
+}
+
+struct pb_zerocopy_sender *pb_zerocopy_sender_create_with_alloc(int fd,
+    const struct pb_allocator *allocator) {
+  int one = 1;
+
+  if (setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == -1)
+    return NULL;
+
+  struct pb_zerocopy_sender *zerocopy_sender =
+    pb_allocator_calloc(allocator, sizeof(struct pb_zerocopy_sender));
+  if (!zerocopy_sender)
+    return NULL;
+
+  zerocopy_sender->allocator = allocator;
+  zerocopy_sender->fd = fd;
+
+  return zerocopy_sender;
+}
+
+/*******************************************************************************
+ */
+size_t pb_zerocopy_sender_get_pending(
+    const struct pb_zerocopy_sender *zerocopy_sender) {
+  return zerocopy_sender->pending;
+}
+
+/*******************************************************************************
+ * Each sendmsg takes its iovecs from the head pages of the buffer, and only
+ * once it succeeds are the pb_data instances behind the pages that were sent
+ * referenced, before the bytes sent are seeked.
+ */
+ssize_t pb_zerocopy_sender_send(
+    struct pb_zerocopy_sender * const zerocopy_sender,
+    struct pb_buffer * const buffer,
+    size_t len) {
+  if (buffer->strategy->rejects_seek) {
+    errno = EPERM;
+
+    return -1;
+  }
+
+  struct iovec iov[PB_IO_IOVEC_SIZE];
+  struct pb_data *data[PB_IO_IOVEC_SIZE];
+  size_t written = 0;
+
+  while (written < len) {
+    struct pb_buffer_iterator buffer_iterator;
+    pb_buffer_get_iterator(buffer, &buffer_iterator);
+
+    size_t iovcnt = 0;
+    size_t iov_len = 0;
+
+    while ((iovcnt < PB_IO_IOVEC_SIZE) &&
+           (iov_len < (len - written)) &&
+           !pb_buffer_is_end_iterator(buffer, &buffer_iterator)) {
+      size_t page_len = pb_buffer_iterator_get_len(&buffer_iterator);
+      if (page_len > (len - written - iov_len))
+        page_len = len - written - iov_len;
+
+      iov[iovcnt].iov_base = pb_buffer_iterator_get_base(&buffer_iterator);
+      iov[iovcnt].iov_len = page_len;
+      data[iovcnt] = pb_buffer_iterator_get_data(&buffer_iterator);
+
+      ++iovcnt;
+
+      iov_len += page_len;
+
+      pb_buffer_next_iterator(buffer, &buffer_iterator);
+    }
+
+    if (iovcnt == 0)
+      break;
+
+    struct pb_zerocopy_send *zerocopy_send =
+      pb_allocator_malloc(
+        zerocopy_sender->allocator, sizeof(struct pb_zerocopy_send));
+    if (!zerocopy_send) {
+      if (written > 0)
+        break;
+
+      return -1;
+    }
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iovcnt;
+
+    ssize_t result;
+
+    do {
+      result =
+        sendmsg(zerocopy_sender->fd, &msg, MSG_ZEROCOPY | MSG_NOSIGNAL);
+    } while ((result < 0) && (errno == EINTR));
+
+    if (result < 0) {
+      int temp_errno = errno;
+
+      pb_allocator_free(
+        zerocopy_sender->allocator, zerocopy_send,
+        sizeof(struct pb_zerocopy_send));
+
+      errno = temp_errno;
+
+      if (written > 0)
+        break;
+
+      return -1;
+    }
+
+    // reference the pages holding the bytes sent
+    zerocopy_send->next = NULL;
+    zerocopy_send->id = zerocopy_sender->next_id++;
+    zerocopy_send->data_count = 0;
+
+    for (size_t sent = 0; sent < (size_t)result; ) {
+      struct pb_data *page_data = data[zerocopy_send->data_count];
+
+      pb_data_get(page_data);
+
+      zerocopy_send->data[zerocopy_send->data_count] = page_data;
+
+      sent += iov[zerocopy_send->data_count].iov_len;
+
+      ++zerocopy_send->data_count;
+    }
+
+    if (zerocopy_sender->last_send)
+      zerocopy_sender->last_send->next = zerocopy_send;
+    else
+      zerocopy_sender->first_send = zerocopy_send;
+    zerocopy_sender->last_send = zerocopy_send;
+
+    ++zerocopy_sender->pending;
+
+    pb_buffer_seek(buffer, (uint64_t)result);
+
+    written += (size_t)result;
+
+    if ((size_t)result < iov_len)
+      break;
+  }
+
+  return (ssize_t)written;
+}
+
+/*******************************************************************************
+ */
+static void pb_zerocopy_send_release(
+    struct pb_zerocopy_sender * const zerocopy_sender,
+    struct pb_zerocopy_send * const zerocopy_send) {
+  for (size_t i = 0; i < zerocopy_send->data_count; ++i)
+    pb_data_put(zerocopy_send->data[i]);
+
+  pb_allocator_free(
+    zerocopy_sender->allocator, zerocopy_send,
+    sizeof(struct pb_zerocopy_send));
+}
+
+/*******************************************************************************
+ * Release the sends with ids in the range lo to hi inclusive.  Ranges are
+ * almost always reported in order, so the matching sends are found at the
+ * front of the list.
+ */
+static size_t pb_zerocopy_sender_release(
+    struct pb_zerocopy_sender * const zerocopy_sender,
+    uint32_t lo, uint32_t hi) {
+  struct pb_zerocopy_send *prev_send = NULL;
+  struct pb_zerocopy_send *zerocopy_send = zerocopy_sender->first_send;
+  size_t released = 0;
+
+  while (zerocopy_send) {
+    struct pb_zerocopy_send *next_send = zerocopy_send->next;
+
+    // ids wrap, so compare by distance from the start of the range
+    if ((uint32_t)(zerocopy_send->id - lo) <= (uint32_t)(hi - lo)) {
+      if (prev_send)
+        prev_send->next = next_send;
+      else
+        zerocopy_sender->first_send = next_send;
+      if (zerocopy_sender->last_send == zerocopy_send)
+        zerocopy_sender->last_send = prev_send;
+
+      pb_zerocopy_send_release(zerocopy_sender, zerocopy_send);
+
+      ++released;
+    } else {
+      prev_send = zerocopy_send;
+    }
+
+    zerocopy_send = next_send;
+  }
+
+  zerocopy_sender->pending -= released;
+
+  return released;
+}
+
+/*******************************************************************************
+ */
+ssize_t pb_zerocopy_sender_complete(
+    struct pb_zerocopy_sender * const zerocopy_sender) {
+  size_t released = 0;
+
+  while (zerocopy_sender->pending > 0) {
+    union {
+      struct cmsghdr align;
+      uint8_t buf[CMSG_SPACE(sizeof(struct sock_extended_err) +
+                             sizeof(struct sockaddr_storage))];
+    } control;
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    ssize_t result;
+
+    do {
+      result =
+        recvmsg(zerocopy_sender->fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT);
+    } while ((result < 0) && (errno == EINTR));
+
+    if (result < 0) {
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+        break;
+
+      if (released > 0)
+        break;
+
+      return -1;
+    }
+
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+         cmsg;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      struct sock_extended_err *ee =
+        (struct sock_extended_err*)CMSG_DATA(cmsg);
+
+      if ((ee->ee_errno != 0) ||
+          (ee->ee_origin != SO_EE_ORIGIN_ZEROCOPY))
+        continue;
+
+      released +=
+        pb_zerocopy_sender_release(zerocopy_sender, ee->ee_info, ee->ee_data);
+    }
+  }
+
+  return (ssize_t)released;
+}
+
+/*******************************************************************************
+ * The pages of a send may only be released once the kernel reports it
+ * finished, as until then their memory may still be transmitted from.  So
+ * destroy waits, for a bounded time, for pending sends to finish, and sends
+ * that still haven't are abandoned along with their pb_data references.
+ */
+void pb_zerocopy_sender_destroy(
+    struct pb_zerocopy_sender * const zerocopy_sender) {
+  for (unsigned int i = 0;
+       (zerocopy_sender->pending > 0) &&
+       (i < PB_ZEROCOPY_SENDER_DRAIN_POLL_COUNT);
+       ++i) {
+    if (pb_zerocopy_sender_complete(zerocopy_sender) == -1)
+      break;
+
+    if (zerocopy_sender->pending == 0)
+      break;
+
+    // the error queue is signalled by POLLERR, which needs no request
+    struct pollfd pollfd;
+    pollfd.fd = zerocopy_sender->fd;
+    pollfd.events = 0;
+    pollfd.revents = 0;
+
+    poll(&pollfd, 1, PB_ZEROCOPY_SENDER_DRAIN_POLL_INTERVAL);
+  }
+
+  pb_allocator_free(
+    zerocopy_sender->allocator, zerocopy_sender,
+    sizeof(struct pb_zerocopy_sender));
+}
@@ -0,0 +1,291 @@
+/*******************************************************************************
+ *  Copyright 2017 Nick Jones <nick.fa.jones@gmail.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ ******************************************************************************/
+
+#ifndef PAGEBUF_IO_H
+#define PAGEBUF_IO_H
+
+
+#include <pagebuf/pagebuf.h>
+
+#include <sys/types.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+/** The number of iovecs passed to the kernel in each vectored I/O call. */
+#define PB_IO_IOVEC_SIZE                                  64
+
+
+
+/** The allocator that memory regions written to a buffer by
+ *  pb_buffer_write_region are allocated from.
+ *
+ * This is the allocator of the buffer, except for the mmap buffer, which
+ * copies written data to its backing file, and whose regions are allocated
+ * by the trivial allocator.
+ */
+const struct pb_allocator *pb_buffer_get_region_allocator(
+                                            const struct pb_buffer *buffer);
+
+/** Write a memory region that data has been read into to the end of a buffer.
+ *
+ * buf is a region of len bytes, allocated by allocator, of which the first
+ * used bytes hold data.  If at least half of the region is used, the used
+ * bytes are written to the buffer without being copied, and the whole region
+ * is freed by allocator when the buffer no longer references it.  Otherwise
+ * the used bytes are copied to the buffer and the region is freed at once,
+ * so that the buffer doesn't hold on to memory that is mostly unused.  Any
+ * bytes the buffer doesn't take without copying are also copied.
+ *
+ * Ownership of the region passes to the buffer in all cases.  The return
+ * value is the number of bytes written to the buffer.
+ */
+uint64_t pb_buffer_write_region(struct pb_buffer * const buffer,
+                                void *buf, size_t len, size_t used,
+                                const struct pb_allocator *allocator);
+
+
+
+/** Read data from a file descriptor directly into a buffer.
+ *
+ * Up to len bytes are read by a single readv from fd, as by
+ * pb_buffer_write_data_fill: first into the spare capacity of the tail page
+ * of the buffer, then into new pages for the remainder, so that the data is
+ * never copied and small reads fill pages rather than allocating new ones.
+ *
+ * The return value follows that of read(2): the number of bytes read into
+ * the buffer, zero at end of file, or -1 on error with errno set.  A non
+ * blocking fd with no data available fails with EAGAIN or EWOULDBLOCK,
+ * leaving the buffer unchanged.  Reads interrupted by a signal are retried.
+ * If data was read but the buffer could not take all of it, the call fails
+ * with ENOMEM, and the data that wasn't written is lost.
+ *
+ * The mmap buffer copies written data to its backing file, so for mmap
+ * buffers the data is read to the stack, up to 16KiB at a time, and written
+ * from there.
+ *
+ * If the buffer strategy rejects writes, the call fails with EPERM.
+ */
+ssize_t pb_buffer_read_fd(struct pb_buffer * const buffer,
+                          int fd, size_t len);
+
+
+
+/** Write data from a buffer directly to a file descriptor.
+ *
+ * Up to len bytes are written from the start of the buffer, by writev calls
+ * taking their iovecs straight from the buffer pages, and the bytes accepted
+ * by fd are seeked from the buffer.  Writing continues until len bytes have
+ * been written, the buffer is empty, or fd accepts less than was offered.
+ *
+ * The return value is the number of bytes written and seeked, or -1 on error
+ * with errno set, if nothing could be written.  A non blocking fd that can't
+ * accept data fails with EAGAIN or EWOULDBLOCK.  Writes interrupted by a
+ * signal are retried.
+ *
+ * If the buffer strategy rejects seeks, the call fails with EPERM.
+ */
+ssize_t pb_buffer_write_fd(struct pb_buffer * const buffer,
+                           int fd, size_t len);
+
+
+
+
+/** The maximum number of datagrams passed to the kernel in each recvmmsg or
+ *  sendmmsg call. */
+#define PB_IO_MMSG_SIZE                                   64
+
+
+
+/** Receive datagrams from a file descriptor, by a single recvmmsg(2).
+ *
+ * pb_buffer_array_recvmmsg receives up to count datagrams, one to the end of
+ * each of the count buffers in order.  pb_buffer_recvmmsg receives up to
+ * count datagrams to the end of a single buffer, one after another, and if
+ * lens is not NULL the length of each datagram received is stored in lens,
+ * so that the message boundaries are preserved.  count is limited to
+ * PB_IO_MMSG_SIZE.
+ *
+ * The datagrams are received into slots of len bytes in a single memory
+ * region, allocated from the region allocator of the first buffer.  If the
+ * datagrams received fill at least half of the region, each is written to its
+ * buffer without being copied, and the region is freed once no buffer
+ * references it.  Otherwise the datagrams are copied, filling the spare
+ * capacity of the buffers' tail pages, and the region is freed at once, so
+ * that buffers don't hold on to memory that is mostly unused.  Datagrams
+ * longer than len are truncated.
+ *
+ * The call blocks, unless fd is non blocking, until at least one datagram is
+ * received, then receives those already queued.  The return value is the
+ * number of datagrams received, or -1 on error with errno set, with buffers
+ * that received no datagram left unchanged.  If a buffer strategy rejects
+ * writes, the call fails with EPERM.  If a datagram was received but its
+ * buffer could not take all of it, the call fails with ENOMEM, the datagrams
+ * that follow it are lost, and lens holds the length written of each
+ * datagram received.
+ */
+int pb_buffer_array_recvmmsg(struct pb_buffer * const *buffers, size_t count,
+                             int fd, size_t len);
+int pb_buffer_recvmmsg(struct pb_buffer * const buffer,
+                       int fd, size_t count, size_t len, size_t *lens);
+
+/** Send datagrams to a file descriptor, by a single sendmmsg(2).
+ *
+ * pb_buffer_array_sendmmsg sends the whole content of each of the count
+ * buffers in order, as one datagram per buffer.  pb_buffer_sendmmsg sends
+ * count datagrams from the start of a single buffer, one after another, the
+ * length of each taken from lens.  count is limited to PB_IO_MMSG_SIZE.
+ *
+ * The message headers are built from iovecs taken straight from the buffer
+ * pages, at most PB_IO_IOVEC_SIZE across all the datagrams of a call, so a
+ * call sends fewer datagrams than count when their pages don't all fit.  A
+ * datagram whose pages don't fit alone fails with EMSGSIZE.
+ *
+ * The return value is the number of datagrams sent, whose data is seeked
+ * from the buffers, or -1 on error with errno set.  If a buffer strategy
+ * rejects seeks, the call fails with EPERM.
+ */
+int pb_buffer_array_sendmmsg(struct pb_buffer * const *buffers, size_t count,
+                             int fd);
+int pb_buffer_sendmmsg(struct pb_buffer * const buffer,
+                       int fd, const size_t *lens, size_t count);
+
+
+
+
+
+/** The splice pipe.
+ *
+ * The splice pipe forwards data between file descriptors through a kernel
+ * pipe, using splice(2), so that the data never enters user space.  Data is
+ * spliced into the pipe from a source fd, and out of the pipe to a target fd,
+ * and may be duplicated into a second splice pipe by tee(2), to be forwarded
+ * to a second consumer, without being consumed.
+ *
+ * Forwarded data may be inspected with pb_splice_pipe_peek, which copies up
+ * to len bytes from the front of the pipe into a pb_buffer, without
+ * consuming them, to be read through data or line readers.  Only the bytes
+ * that are peeked are copied into user space.
+ *
+ * The pipe is non blocking: operations that can't make progress fail with
+ * EAGAIN.  Operations return the number of bytes moved, or -1 on error with
+ * errno set, and splicing from a source fd at end of file returns zero.
+ *
+ * Factory functions return NULL with errno set if the pipe can't be created.
+ * If no allocator is supplied, the trivial allocator is used.
+ */
+struct pb_splice_pipe;
+
+struct pb_splice_pipe *pb_splice_pipe_create(void);
+struct pb_splice_pipe *pb_splice_pipe_create_with_alloc(
+                                    const struct pb_allocator *allocator);
+
+/** The amount of data held in the pipe. */
+uint64_t pb_splice_pipe_get_data_size(
+                                    const struct pb_splice_pipe *splice_pipe);
+
+/** Move data from fd into the pipe. */
+ssize_t pb_splice_pipe_splice_in(struct pb_splice_pipe * const splice_pipe,
+                                 int fd, size_t len);
+
+/** Move data from the pipe to fd. */
+ssize_t pb_splice_pipe_splice_out(struct pb_splice_pipe * const splice_pipe,
+                                  int fd, size_t len);
+
+/** Duplicate data from the front of the pipe into dst_splice_pipe. */
+ssize_t pb_splice_pipe_tee(struct pb_splice_pipe * const splice_pipe,
+                           struct pb_splice_pipe * const dst_splice_pipe,
+                           size_t len);
+
+/** Copy data from the front of the pipe to the end of buffer. */
+ssize_t pb_splice_pipe_peek(struct pb_splice_pipe * const splice_pipe,
+                            struct pb_buffer * const buffer,
+                            size_t len);
+
+void pb_splice_pipe_destroy(struct pb_splice_pipe * const splice_pipe);
+
+
+
+
+
+
+
+/** The zero copy sender.
+ *
+ * The zero copy sender writes data from the start of buffers to a socket by
+ * sendmsg(2) with MSG_ZEROCOPY, so that the kernel transmits straight from
+ * the buffer pages instead of copying them.  The bytes accepted by the socket
+ * are seeked from the buffer at once, but the pb_data instances behind the
+ * pages sent are referenced until the kernel reports that it no longer needs
+ * them, so that the memory isn't released or reused while still in use.
+ *
+ * The kernel reports finished sends on the socket error queue, which is
+ * signalled by POLLERR.  pb_zerocopy_sender_complete drains the error queue
+ * and releases the pages of every finished send together.
+ *
+ * pb_zerocopy_sender_send returns the number of bytes sent and seeked, or -1
+ * on error with errno set, in the same way as pb_buffer_write_fd.  A socket
+ * that can't accept data fails with EAGAIN or EWOULDBLOCK, and one whose
+ * zero copy limit is exceeded fails with ENOBUFS, until sends complete.
+ *
+ * Factory functions enable SO_ZEROCOPY on fd, and return NULL with errno set
+ * if the socket doesn't support it.  The kernel numbers the sends of a socket
+ * over its lifetime, so only one sender may ever send on a socket.  If no allocator is supplied, the
+ * trivial allocator is used.
+ *
+ * Destroying the sender first drains the error queue, waiting up to about a
+ * second for pending sends to finish, so the socket must still be open.
+ * Sends that still haven't finished are abandoned without releasing their
+ * pages, whose memory may still be transmitted from, so those pages are never
+ * released.  To avoid this, call pb_zerocopy_sender_complete until
+ * pb_zerocopy_sender_get_pending returns zero before destroying the sender.
+ */
+struct pb_zerocopy_sender;
+
+struct pb_zerocopy_sender *pb_zerocopy_sender_create(int fd);
+struct pb_zerocopy_sender *pb_zerocopy_sender_create_with_alloc(
+                                    int fd,
+                                    const struct pb_allocator *allocator);
+
+/** The number of sends not yet reported finished by the kernel. */
+size_t pb_zerocopy_sender_get_pending(
+                              const struct pb_zerocopy_sender *zerocopy_sender);
+
+/** Send up to len bytes from the start of buffer. */
+ssize_t pb_zerocopy_sender_send(
+                              struct pb_zerocopy_sender * const zerocopy_sender,
+                              struct pb_buffer * const buffer,
+                              size_t len);
+
+/** Release the pages of sends that have finished.
+ *
+ * Returns the number of sends released, or -1 on error with errno set.
+ */
+ssize_t pb_zerocopy_sender_complete(
+                             struct pb_zerocopy_sender * const zerocopy_sender);
+
+void pb_zerocopy_sender_destroy(
+                             struct pb_zerocopy_sender * const zerocopy_sender);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* PAGEBUF_IO_H */
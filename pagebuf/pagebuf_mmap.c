@@ -20,6 +20,7 @@
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <sys/uio.h>
+#include <sys/sendfile.h>
 #include <errno.h>
 #include <assert.h>
 #include <unistd.h>
@@ -68,6 +69,11 @@ static const struct pb_data_operations *pb_get_mmap_data_operations(void);
 /*******************************************************************************
  */
 #define PB_MMAP_ALLOCATOR_BASE_MMAP_SIZE                  4096
+#define PB_MMAP_ALLOCATOR_WRITE_IOVEC_SIZE                64
+
+/** The size of the memory region on the stack that mmap buffers have filled
+ *  by write_data_fill, before copying it to the backing file. */
+#define PB_MMAP_BUFFER_FILL_SIZE                          16384
 
 
 
@@ -537,42 +543,21 @@ static uint64_t pb_mmap_allocator_trim(
   while (len > 0) {
     struct pb_mmap_data *mmap_data;
 
-    uint64_t file_offset = file_size;
+    uint64_t file_offset = file_size - trimmed;
     uint64_t mmap_offset =
-      (file_offset / PB_MMAP_ALLOCATOR_BASE_MMAP_SIZE) *
+      ((file_offset - 1) / PB_MMAP_ALLOCATOR_BASE_MMAP_SIZE) *
          PB_MMAP_ALLOCATOR_BASE_MMAP_SIZE;
 
-    size_t trim_len = 0;
+    uint64_t trim_len =
+      ((file_offset - mmap_offset) < len) ?
+       (file_offset - mmap_offset) : len;
 
+    // the data tree holds no references, so a mapping of the trimmed end of
+    // the file is only retired from it, and freed along with its last page
     PB_HASH_FIND_UINT64(mmap_allocator->data_tree, &mmap_offset, mmap_data);
     if (mmap_data) {
-      size_t mmap_len = pb_data_get_len(&mmap_data->data);
-
-      trim_len = (mmap_len < len) ? mmap_len : len;
-
-      if (trim_len < mmap_len) {
-        mmap_len -= trim_len;
-
-        struct pb_mmap_data *new_mmap_data =
-          pb_mmap_allocator_data_create(mmap_allocator, mmap_offset, mmap_len);
-        if (!new_mmap_data)
-          break;
-
-        PB_HASH_DEL(mmap_allocator->data_tree, mmap_data);
-        mmap_data->obsolete = true;
-
-        PB_HASH_ADD_UINT64(mmap_allocator->data_tree, file_offset, mmap_data);
-        pb_data_get(&mmap_data->data);
-      } else {
-        PB_HASH_DEL(mmap_allocator->data_tree, mmap_data);
-        mmap_data->obsolete = true;
-      }
-
-      pb_data_put(&mmap_data->data);
-    } else {
-      trim_len =
-        ((file_offset - mmap_offset) < len) ?
-         (file_offset - mmap_offset) : len;
+      PB_HASH_DEL(mmap_allocator->data_tree, mmap_data);
+      mmap_data->obsolete = true;
     }
 
     len -= trim_len;
@@ -607,67 +592,33 @@ static uint64_t pb_mmap_allocator_write_data_buffer(
   if (!pb_mmap_allocator_is_open(mmap_allocator))
     return 0;
 
-  struct pb_buffer_iterator src_buffer_iterator;
-  pb_buffer_get_iterator(src_buffer, &src_buffer_iterator);
+  struct pb_buffer_iovec_cursor iovec_cursor;
+  pb_buffer_iovec_cursor_init(src_buffer, &iovec_cursor, 0, len);
 
-  if (pb_buffer_is_end_iterator(src_buffer, &src_buffer_iterator))
-    return 0;
+  struct iovec iov[PB_MMAP_ALLOCATOR_WRITE_IOVEC_SIZE];
+  uint64_t written = 0;
 
-  int iovpos = 0;
-  int iovlim = 2;
+  while (true) {
+    size_t iovcnt =
+      pb_buffer_iovec_cursor_next(
+        src_buffer, &iovec_cursor, iov, PB_MMAP_ALLOCATOR_WRITE_IOVEC_SIZE);
+    if (iovcnt == 0)
+      break;
 
-  struct iovec *iov =
-    pb_allocator_calloc(
-      mmap_allocator->struct_allocator, sizeof(struct iovec) * iovlim);
-  if (!iov)
-    return 0;
+    size_t iov_len = 0;
+    for (size_t i = 0; i < iovcnt; ++i)
+      iov_len += iov[i].iov_len;
 
-  while ((len > 0) &&
-         (!pb_buffer_is_end_iterator(src_buffer, &src_buffer_iterator))) {
-    if (iovpos == iovlim) {
-      if (iovlim == 1024)
-        break;
-
-      iovlim *= 2;
-
-      struct iovec *iov2 =
-        pb_allocator_calloc(
-          mmap_allocator->struct_allocator, sizeof(struct iovec) * iovlim);
-      if (!iov2)
-        break;
+    ssize_t result = writev(mmap_allocator->file_fd, iov, (int)iovcnt);
+    if (result <= 0)
+      break;
 
-      memcpy(iov2, iov, sizeof(struct iovec) * iovpos);
-
-      pb_allocator_free(
-        mmap_allocator->struct_allocator,
-        iov, sizeof(struct iovec) * iovpos);
-
-      iov = iov2;
-    }
+    written += result;
 
-    struct pb_page *src_page = (struct pb_page*)src_buffer_iterator.data_vec;
-
-    uint64_t iov_len =
-      (pb_page_get_len(src_page) < len) ?
-       pb_page_get_len(src_page) : len;
-
-    iov[iovpos].iov_base = pb_page_get_base(src_page);
-    iov[iovpos].iov_len = iov_len;
-
-    len -= iov_len;
-    ++iovpos;
-
-    pb_buffer_next_iterator(src_buffer, &src_buffer_iterator);
+    if ((size_t)result < iov_len)
+      break;
   }
 
-  ssize_t written = writev(mmap_allocator->file_fd, iov, iovpos);
-  if (written < 0)
-    written = 0;
-
-  pb_allocator_free(
-    mmap_allocator->struct_allocator,
-    iov, sizeof(struct iovec) * iovlim);
-
   return written;
 }
 
@@ -776,6 +727,7 @@ static struct pb_buffer_strategy pb_mmap_buffer_strategy = {
   .rejects_trim = false,
   .rejects_write = false,
   .rejects_overwrite = false,
+  .headroom = 0,
 };
 
 static const struct pb_buffer_strategy *pb_get_mmap_buffer_strategy(void) {
@@ -806,6 +758,10 @@ static void pb_mmap_buffer_next_iterator(
 static void pb_mmap_buffer_prev_iterator(
                             struct pb_buffer * const buffer,
                             struct pb_buffer_iterator * const buffer_iterator);
+static size_t pb_mmap_buffer_get_iterator_at(
+                            struct pb_buffer * const buffer,
+                            uint64_t offset,
+                            struct pb_buffer_iterator * const buffer_iterator);
 
 
 static uint64_t pb_mmap_buffer_extend(
@@ -832,15 +788,37 @@ uint64_t pb_mmap_buffer_write_data_ref(
                                    struct pb_buffer * const buffer,
                                    const void *buf,
                                    uint64_t len);
+uint64_t pb_mmap_buffer_write_data_mem(
+                                   struct pb_buffer * const buffer,
+                                   void *buf,
+                                   uint64_t len,
+                                   void (*release)(void *buf, uint64_t len,
+                                                   void *context),
+                                   void *context);
 uint64_t pb_mmap_buffer_write_buffer(
                                    struct pb_buffer * const buffer,
                                    struct pb_buffer * const src_buffer,
                                    uint64_t len);
 
 
+static uint64_t pb_mmap_buffer_compact(
+                                 struct pb_buffer * const buffer,
+                                 size_t threshold);
+
+
 static void pb_mmap_buffer_clear(struct pb_buffer * const buffer);
 static void pb_mmap_buffer_destroy(
                                  struct pb_buffer * const buffer);
+static void pb_mmap_buffer_destroy_deferred(
+                                 struct pb_buffer * const buffer,
+                                 struct pb_reclaimer * const reclaimer);
+
+static ssize_t pb_mmap_buffer_write_data_fill(
+                                 struct pb_buffer * const buffer,
+                                 uint64_t len,
+                                 ssize_t (*fill)(const struct iovec *iov,
+                                                 int iovcnt, void *context),
+                                 void *context);
 
 
 
@@ -858,6 +836,7 @@ static struct pb_trivial_buffer_operations pb_mmap_buffer_operations = {
   .cmp_iterator = &pb_mmap_buffer_cmp_iterator,
   .next_iterator = &pb_mmap_buffer_next_iterator,
   .prev_iterator = &pb_mmap_buffer_prev_iterator,
+  .get_iterator_at = &pb_mmap_buffer_get_iterator_at,
 
   .get_byte_iterator = &pb_trivial_buffer_get_byte_iterator,
   .get_end_byte_iterator = &pb_trivial_buffer_get_end_byte_iterator,
@@ -878,6 +857,7 @@ static struct pb_trivial_buffer_operations pb_mmap_buffer_operations = {
 
   .write_data = &pb_mmap_buffer_write_data,
   .write_data_ref = &pb_mmap_buffer_write_data_ref,
+  .write_data_mem = &pb_mmap_buffer_write_data_mem,
   .write_buffer = &pb_mmap_buffer_write_buffer,
 
   .overwrite_data = &pb_trivial_buffer_overwrite_data,
@@ -885,8 +865,13 @@ static struct pb_trivial_buffer_operations pb_mmap_buffer_operations = {
 
   .read_data = &pb_trivial_buffer_read_data,
 
+  .compact = &pb_mmap_buffer_compact,
+
   .clear = &pb_mmap_buffer_clear,
   .destroy = &pb_mmap_buffer_destroy,
+  .destroy_deferred = &pb_mmap_buffer_destroy_deferred,
+
+  .write_data_fill = &pb_mmap_buffer_write_data_fill,
   },
 
   .page_create = &pb_trivial_buffer_page_create,
@@ -896,7 +881,7 @@ static struct pb_trivial_buffer_operations pb_mmap_buffer_operations = {
   .resolve_iterator = &pb_trivial_buffer_resolve_iterator,
 };
 
-static const struct pb_buffer_operations *pb_get_mmap_buffer_operations(void) {
+const struct pb_buffer_operations *pb_get_mmap_buffer_operations(void) {
   return &pb_mmap_buffer_operations.buffer_operations;
 }
 
@@ -954,6 +939,10 @@ struct pb_mmap_buffer *pb_mmap_buffer_create_with_alloc(const char *file_path,
   mmap_buffer->trivial_buffer.data_revision = 0;
   mmap_buffer->trivial_buffer.data_size = 0;
 
+  mmap_buffer->trivial_buffer.data_factory = pb_get_trivial_data_factory();
+
+  mmap_buffer->trivial_buffer.offset_index = NULL;
+
   return mmap_buffer;
 }
 
@@ -1081,6 +1070,28 @@ void pb_mmap_buffer_prev_iterator(struct pb_buffer * const buffer,
   pb_trivial_buffer_prev_iterator(buffer, buffer_iterator);
 }
 
+/*******************************************************************************
+ * Pages of the mmap buffer are mapped on demand as iterators reach them, so
+ * the pages are walked from the head of the buffer.
+ */
+size_t pb_mmap_buffer_get_iterator_at(struct pb_buffer * const buffer,
+    uint64_t offset,
+    struct pb_buffer_iterator * const buffer_iterator) {
+  pb_mmap_buffer_get_iterator(buffer, buffer_iterator);
+
+  while (!pb_mmap_buffer_is_end_iterator(buffer, buffer_iterator)) {
+    size_t len = pb_buffer_iterator_get_len(buffer_iterator);
+    if (offset < len)
+      return offset;
+
+    offset -= len;
+
+    pb_mmap_buffer_next_iterator(buffer, buffer_iterator);
+  }
+
+  return 0;
+}
+
 /*******************************************************************************
  */
 uint64_t pb_mmap_buffer_extend(struct pb_buffer * const buffer,
@@ -1162,6 +1173,20 @@ uint64_t pb_mmap_buffer_write_data_ref(
   return pb_mmap_allocator_write_data(mmap_allocator, buf, len);
 }
 
+uint64_t pb_mmap_buffer_write_data_mem(
+    struct pb_buffer * const buffer,
+    void *buf,
+    uint64_t len,
+    void (*release)(void *buf, uint64_t len, void *context),
+    void *context) {
+  // data is always copied to the file, so the region is released at once
+  uint64_t written = pb_mmap_buffer_write_data(buffer, buf, len);
+
+  release(buf, len, context);
+
+  return written;
+}
+
 uint64_t pb_mmap_buffer_write_buffer(
     struct pb_buffer * const buffer,
     struct pb_buffer * const src_buffer,
@@ -1175,6 +1200,15 @@ uint64_t pb_mmap_buffer_write_buffer(
   return pb_mmap_allocator_write_data_buffer(mmap_allocator, src_buffer, len);
 }
 
+/*******************************************************************************
+ * The pages of the mmap buffer are views of the backing file, mapped on
+ * demand, so there is nothing to compact.
+ */
+uint64_t pb_mmap_buffer_compact(struct pb_buffer * const buffer,
+    size_t threshold) {
+  return 0;
+}
+
 /*******************************************************************************
  */
 static void pb_mmap_buffer_clear(struct pb_buffer * const buffer) {
@@ -1200,6 +1234,55 @@ static void pb_mmap_buffer_destroy(struct pb_buffer * const buffer) {
   pb_mmap_allocator_put(mmap_allocator);
 }
 
+/*******************************************************************************
+ * The pages of the mmap buffer are released along with the mmap allocator
+ * and its file, so the buffer is destroyed immediately.
+ */
+static void pb_mmap_buffer_destroy_deferred(struct pb_buffer * const buffer,
+    struct pb_reclaimer * const reclaimer) {
+  pb_mmap_buffer_destroy(buffer);
+}
+
+/*******************************************************************************
+ * Data written to the mmap buffer is always copied to the file, so fill is
+ * given a memory region on the stack, up to 16KiB at a time, which is then
+ * written from there.
+ */
+static ssize_t pb_mmap_buffer_write_data_fill(struct pb_buffer * const buffer,
+    uint64_t len,
+    ssize_t (*fill)(const struct iovec *iov, int iovcnt, void *context),
+    void *context) {
+  uint8_t buf[PB_MMAP_BUFFER_FILL_SIZE];
+
+  if (buffer->strategy->rejects_write) {
+    errno = EPERM;
+
+    return -1;
+  }
+
+  if (len == 0)
+    return 0;
+
+  struct iovec iov = {
+    .iov_base = buf,
+    .iov_len = (len < PB_MMAP_BUFFER_FILL_SIZE) ?
+                 (size_t)len : PB_MMAP_BUFFER_FILL_SIZE,
+  };
+
+  ssize_t result = fill(&iov, 1, context);
+  if (result <= 0)
+    return result;
+
+  if (pb_mmap_buffer_write_data(buffer, buf, (uint64_t)result) <
+        (uint64_t)result) {
+    errno = ENOMEM;
+
+    return -1;
+  }
+
+  return result;
+}
+
 
 
 /*******************************************************************************
@@ -1246,6 +1329,71 @@ void pb_mmap_buffer_set_close_action(
   mmap_allocator->close_action = close_action;
 }
 
+/*******************************************************************************
+ * Data is sent from the backing file by the kernel, starting at the head of
+ * the buffer data in the file, without mapping it.  copy_file_range is used
+ * for regular file targets, falling back to sendfile where it isn't
+ * supported between the two files.
+ */
+ssize_t pb_mmap_buffer_send_fd(struct pb_mmap_buffer * const mmap_buffer,
+    int fd, size_t len) {
+  struct pb_buffer *buffer = pb_mmap_buffer_to_buffer(mmap_buffer);
+  struct pb_mmap_allocator *mmap_allocator =
+    (struct pb_mmap_allocator*)buffer->allocator;
+
+  uint64_t data_size = pb_mmap_allocator_get_data_size(mmap_allocator);
+  if (len > data_size)
+    len = (size_t)data_size;
+
+  struct stat fd_stat;
+  bool use_copy_file_range =
+    (fstat(fd, &fd_stat) == 0) && S_ISREG(fd_stat.st_mode);
+
+  size_t sent = 0;
+
+  while (sent < len) {
+    loff_t offset = (loff_t)mmap_allocator->file_head_offset;
+    ssize_t result = -1;
+
+    if (use_copy_file_range) {
+      result =
+        copy_file_range(
+          mmap_allocator->file_fd, &offset, fd, NULL, len - sent, 0);
+      if ((result < 0) &&
+          ((errno == EXDEV) || (errno == ENOSYS) ||
+           (errno == EINVAL) || (errno == EOPNOTSUPP))) {
+        use_copy_file_range = false;
+
+        continue;
+      }
+    } else {
+      off_t sendfile_offset = (off_t)offset;
+
+      result =
+        sendfile(fd, mmap_allocator->file_fd, &sendfile_offset, len - sent);
+    }
+
+    if (result < 0) {
+      if (errno == EINTR)
+        continue;
+
+      if (sent > 0)
+        break;
+
+      return -1;
+    }
+
+    if (result == 0)
+      break;
+
+    pb_mmap_buffer_seek(buffer, (uint64_t)result);
+
+    sent += (size_t)result;
+  }
+
+  return (ssize_t)sent;
+}
+
 /*******************************************************************************
  */
 struct pb_buffer *pb_mmap_buffer_to_buffer(
@@ -21,6 +21,8 @@
 #include <pagebuf/pagebuf.h>
 #include <pagebuf/pagebuf_protected.h>
 
+#include <sys/types.h>
+
 
 #ifdef __cplusplus
 extern "C" {
@@ -117,10 +119,30 @@ void pb_mmap_buffer_set_close_action(
                                    struct pb_mmap_buffer * const mmap_buffer,
                                    enum pb_mmap_close_action close_action);
 
+/** Send data from the start of the mmap buffer to a file descriptor.
+ *
+ * Up to len bytes are sent directly from the backing file by the kernel,
+ * using copy_file_range if fd is a regular file, or sendfile otherwise, and
+ * the bytes sent are seeked from the buffer.  The data is never mapped or
+ * touched in user space.  Sending continues until len bytes have been sent,
+ * the buffer is empty, or fd accepts less than was offered.
+ *
+ * The return value is the number of bytes sent and seeked, or -1 on error
+ * with errno set, if nothing could be sent.  A non blocking fd that can't
+ * accept data fails with EAGAIN.
+ */
+ssize_t pb_mmap_buffer_send_fd(struct pb_mmap_buffer * const mmap_buffer,
+                               int fd, size_t len);
+
 /** mmap buffer conversion function. */
 struct pb_buffer *pb_mmap_buffer_to_buffer(
                                    struct pb_mmap_buffer * const mmap_buffer);
 
+
+
+/** Get the mmap buffer implementation of pb_buffer_operations. */
+const struct pb_buffer_operations *pb_get_mmap_buffer_operations(void);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
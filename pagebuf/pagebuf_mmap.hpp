@@ -117,6 +117,11 @@ class mmap_buffer : public buffer {
       return pb_mmap_buffer_get_fd(mmap_buffer_);
     }
 
+  public:
+    ssize_t send_fd(int fd, size_t len) {
+      return pb_mmap_buffer_send_fd(mmap_buffer_, fd, len);
+    }
+
   public:
     enum close_action get_close_action() const {
       return
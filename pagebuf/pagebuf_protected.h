@@ -136,7 +136,7 @@ struct pb_data {
   enum pb_data_responsibility responsibility;
 
   /** Use count.  How many pb_page instances reference this data (see later) */
-  uint16_t use_count;
+  uint32_t use_count;
 
   /** Operations for the pb_data instance. */
   const struct pb_data_operations *operations;
@@ -243,6 +243,134 @@ void pb_trivial_data_put(struct pb_data * const data);
 
 
 
+
+/** The inline data implementation and its supporting functions.
+ *
+ * Inline data is a variant of owned trivial data that places the pb_data
+ * struct and its memory region in a single allocation, the region starting
+ * just past the struct, so that creating and destroying an instance each
+ * costs a single call to the allocator.  The struct and the first bytes of
+ * the region also tend to share cache lines.
+ *
+ * These are protected functions and should not be called externally.
+ */
+const struct pb_data_operations *pb_get_inline_data_operations(void);
+
+struct pb_data *pb_inline_data_create(size_t len,
+                                      const struct pb_allocator *allocator);
+
+void pb_inline_data_put(struct pb_data * const data);
+
+
+
+
+
+
+/** The atomic data implementation and its supporting functions.
+ *
+ * Atomic data is a variant of trivial data whose use count is maintained
+ * with atomic operations: increments are relaxed, and decrements use
+ * acquire-release ordering so that the final put observes all writes made
+ * through other references before the instance is destroyed.  This allows
+ * a pb_data instance to be shared, zero copy, between buffers operated on by
+ * different threads.
+ *
+ * The buffers themselves remain not thread safe, and the allocator used by
+ * atomic data must be safe to free from any thread that may release the last
+ * reference.
+ *
+ * These are protected functions and should not be called externally.
+ */
+const struct pb_data_operations *pb_get_atomic_data_operations(void);
+
+struct pb_data *pb_atomic_data_create(size_t len,
+                                      const struct pb_allocator *allocator);
+struct pb_data *pb_atomic_data_create_ref(
+                                      const uint8_t *buf, size_t len,
+                                      const struct pb_allocator *allocator);
+
+void pb_atomic_data_get(struct pb_data * const data);
+void pb_atomic_data_put(struct pb_data * const data);
+
+
+
+
+
+
+/** The mem data implementation and its supporting functions.
+ *
+ * Mem data takes over a memory region supplied by its owner, along with a
+ * release function and context.  The region is considered 'owned' by the
+ * instance, however rather than freeing the region when the use count
+ * reaches zero, the instance calls the release function, returning the
+ * region to its owner.
+ *
+ * These are protected functions and should not be called externally.
+ */
+const struct pb_data_operations *pb_get_mem_data_operations(void);
+
+struct pb_data *pb_mem_data_create(void *buf, size_t len,
+                                   void (*release)(void *buf, uint64_t len,
+                                                   void *context),
+                                   void *context,
+                                   const struct pb_allocator *allocator);
+
+void pb_mem_data_put(struct pb_data * const data);
+
+
+
+
+
+
+/** A factory of pb_data instances.
+ *
+ * The data factory is used by buffers to create the pb_data instances that
+ * back new pages, allowing the implementation of pb_data to be selected
+ * independently of the buffer implementation.
+ *
+ * The built in data factories, declared in pagebuf.h, are implemented with
+ * pb_trivial_data_create, pb_split_page_create and pb_split_page_block_create
+ * (trivial), pb_inline_data_create, pb_inline_page_create and
+ * pb_page_block_create (inline) and pb_atomic_data_create (atomic), with the
+ * latter creating one page at a time.
+ *
+ * create: create a pb_data instance that owns a new memory region of the
+ *         given size.
+ *
+ * create_ref: create a pb_data instance that references an existing memory
+ *             region.
+ *
+ * page_create: optionally, create a pb_page instance along with a new pb_data
+ *              instance and memory region of the given size.  If NULL, pages
+ *              are created using create and pb_page_create.
+ *
+ * pages_create: optionally, create a run of pb_page instances, of at most
+ *               page_size bytes each and len bytes in total, each with a new
+ *               pb_data instance and memory region.  The memory region of
+ *               the first page has headroom bytes free in front of it.
+ *               The pages are linked to each other through prev and next,
+ *               with the prev of the first and the next of the last set to
+ *               NULL, and the first page is returned.  If NULL, runs of pages
+ *               are created one page at a time.
+ */
+struct pb_data_factory {
+  struct pb_data *(*create)(size_t len,
+                            const struct pb_allocator *allocator);
+  struct pb_data *(*create_ref)(const uint8_t *buf, size_t len,
+                                const struct pb_allocator *allocator);
+
+  struct pb_page *(*page_create)(size_t len,
+                                 const struct pb_allocator *allocator);
+  struct pb_page *(*pages_create)(size_t len, size_t page_size,
+                                  size_t headroom,
+                                  const struct pb_allocator *allocator);
+};
+
+
+
+
+
+
 /** Non-exclusive owner of a pb_data instance, holding a modifiable reference
  *  to the memory region.
  *
@@ -312,10 +440,32 @@ struct pb_page {
   struct pb_page *prev;
   /** Next page in a buffer structure */
   struct pb_page *next;
+
+  /** The pb_data instance whose allocation also holds this pb_page, or NULL
+   *  if the pb_page was allocated on its own.  An embedded pb_page holds a
+   *  reference to the embedding pb_data, in addition to that held through
+   *  the data member, which is released when the pb_page is destroyed.
+   */
+  struct pb_data *embedding_data;
 };
 
 
 
+/** Get the pb_data instance referenced by the page that an iterator points
+ *  to.
+ *
+ * The page descriptions of every buffer implementation begin with the
+ * data_vec and data members of pb_page, in that order, so this function may
+ * be used with the iterators of any buffer.  Code that handles the pages of
+ * other buffers must only access those two members.
+ *
+ * This is a protected function and should not be called externally.
+ */
+struct pb_data *pb_buffer_iterator_get_data(
+                        const struct pb_buffer_iterator *buffer_iterator);
+
+
+
 /** Functional interfaces for accessing a memory region through pb_page.
  *
  * These functions are public and may be called by authors.
@@ -358,6 +508,94 @@ void pb_page_destroy(struct pb_page *page,
 
 
 
+/** Create a pb_page instance, a pb_data instance and an owned memory region
+ *  of size len, all in a single allocation.
+ *
+ * The pb_page is embedded in the allocation of the pb_data, which is freed
+ * once both the pb_page has been destroyed and the pb_data use count reaches
+ * zero.  Until then, the pb_data may be shared with other pages, for example
+ * by pb_page_transfer, like any other pb_data instance.
+ *
+ * This is a protected function and should not be called externally.
+ */
+struct pb_page *pb_inline_page_create(size_t len,
+                                      const struct pb_allocator *allocator);
+
+
+
+/** Create a run of pb_page instances and an owned memory region of size
+ *  headroom + len, all in a single allocation.
+ *
+ * The region is divided between the pages in order, each page viewing at
+ * most page_size bytes of it, after the first headroom bytes.  Each page is
+ * embedded along with its own pb_data instance, which owns only the part of
+ * the region that the page views, the first also owning the headroom.  So
+ * each page is only seen as sharing its data once that data is shared with
+ * another page, such as one created by pb_page_transfer, exactly as for a
+ * page created by pb_inline_page_create.  The allocation is freed once the
+ * pb_data instances of all of the pages have been released.
+ *
+ * This is a protected function and should not be called externally.
+ */
+struct pb_page *pb_page_block_create(size_t len, size_t page_size,
+                                     size_t headroom,
+                                     const struct pb_allocator *allocator);
+
+
+
+/** Create a run of pb_page instances in a single allocation, each with its
+ *  own pb_data instance that owns a separately allocated memory region.
+ *
+ * The pages are created as by pb_page_block_create, except that the memory
+ * region of each page is allocated on its own, at exactly the size that the
+ * page views, or that plus headroom for the first page.  The memory region of
+ * each pb_data is freed as soon as its use count reaches zero, the allocation
+ * of the pages once the pb_data instances of all of the pages have been
+ * released.
+ *
+ * This is a protected function and should not be called externally.
+ */
+struct pb_page *pb_split_page_block_create(
+                                        size_t len, size_t page_size,
+                                        size_t headroom,
+                                        const struct pb_allocator *allocator);
+
+
+
+/** Create a pb_page instance and a pb_data instance in a single allocation,
+ *  along with a separately allocated memory region of size len.
+ *
+ * This is a run of one page created by pb_split_page_block_create.
+ *
+ * This is a protected function and should not be called externally.
+ */
+struct pb_page *pb_split_page_create(size_t len,
+                                     const struct pb_allocator *allocator);
+
+/** Get the size of the allocation holding the pb_page and pb_data instances
+ *  of a page created by pb_split_page_create.
+ *
+ * Allocators that cache small structs may use this to serve the allocations
+ * made by the trivial data factory for each new page.
+ *
+ * This is a protected function and should not be called externally.
+ */
+size_t pb_split_page_get_header_size(void);
+
+
+
+/** Indicate whether the pb_data instance of a page is referenced by any
+ *  other page.
+ *
+ * The reference an embedded page holds on its embedding pb_data is not
+ * counted as sharing.
+ *
+ * This is a protected function and should not be called externally.
+ */
+bool pb_page_is_data_shared(const struct pb_page *page);
+
+
+
 /** Utility function to set the data object of a page.
  *
  * This is a protected function and should not be called externally.
@@ -370,6 +608,49 @@ void pb_page_set_data(struct pb_page * const page,
 
 
 
+/** A unit of work queued in a reclaimer.
+ *
+ * Buffer implementations embed a reclaim task in a structure that holds the
+ * pages they detach in destroy_deferred, and submit it to the reclaimer.
+ *
+ * release: release up to *count pages, decrementing *count by the number of
+ *          pages released.  Returns true when all pages have been released,
+ *          in which case the task must also have freed itself.
+ */
+struct pb_reclaim_task {
+  struct pb_reclaim_task *next;
+
+  bool (*release)(struct pb_reclaim_task * const task,
+                  uint64_t * const count);
+};
+
+
+
+/** Queue a reclaim task in a reclaimer.
+ *
+ * This is a protected function and should not be called externally.
+ */
+void pb_reclaimer_submit(struct pb_reclaimer * const reclaimer,
+                         struct pb_reclaim_task * const task);
+
+
+
+/** Report the fixed buffer index and offset of the memory region of a
+ *  pb_data instance, as pb_uring_fixed_allocator_get_index does for a
+ *  memory region, see pagebuf_uring.h.
+ *
+ * This is a protected function and should not be called externally.
+ */
+bool pb_uring_fixed_allocator_get_data_index(
+                                const struct pb_allocator *allocator,
+                                const struct pb_data *data,
+                                unsigned int *index, size_t *offset);
+
+
+
+
+
+
 /** The structure that holds the operations that implement specific
  *  pb_trivial_buffer functionality.
  */
@@ -442,6 +723,19 @@ struct pb_trivial_buffer {
    * result to the data_size to assure correctness.
    */
   uint64_t data_size;
+
+  /** The factory used to create the pb_data instances of new pages. */
+  const struct pb_data_factory *data_factory;
+
+  /** An index of the starting offsets of the pages of the buffer.
+   *
+   * The index is created by the first call to get_iterator_at, after which
+   * it is maintained by seek, trim and insert, and extended to cover pages
+   * appended to the end of the buffer at the time of the next lookup.
+   * Compaction invalidates the index so that it is rebuilt at the time of the
+   * next lookup.
+   */
+  struct pb_trivial_buffer_index *offset_index;
 };
 
 
@@ -457,6 +751,8 @@ struct pb_trivial_buffer {
  *
  * page_size: 4096
  *
+ * headroom: 0: no space is left at the front of the first page
+ *
  * clone_on_write: false: zero copy transfer of data from other buffers
  *
  * fragment_as_source: false: fragments written from other buffers or memory
@@ -506,6 +802,10 @@ void pb_trivial_buffer_next_iterator(
 void pb_trivial_buffer_prev_iterator(
                             struct pb_buffer * const buffer,
                             struct pb_buffer_iterator * const buffer_iterator);
+size_t pb_trivial_buffer_get_iterator_at(
+                            struct pb_buffer * const buffer,
+                            uint64_t offset,
+                            struct pb_buffer_iterator * const buffer_iterator);
 
 
 void pb_trivial_buffer_get_byte_iterator(
@@ -597,6 +897,13 @@ uint64_t pb_trivial_buffer_write_data_ref(
                                       struct pb_buffer * const buffer,
                                       const void *buf,
                                       uint64_t len);
+uint64_t pb_trivial_buffer_write_data_mem(
+                                      struct pb_buffer * const buffer,
+                                      void *buf,
+                                      uint64_t len,
+                                      void (*release)(void *buf, uint64_t len,
+                                                      void *context),
+                                      void *context);
 uint64_t pb_trivial_buffer_write_buffer(
                                       struct pb_buffer * const buffer,
                                       struct pb_buffer * const src_buffer,
@@ -617,12 +924,26 @@ uint64_t pb_trivial_buffer_read_data(struct pb_buffer * const buffer,
                                      uint64_t len);
 
 
+uint64_t pb_trivial_buffer_compact(struct pb_buffer * const buffer,
+                                   size_t threshold);
+
+
 void pb_trivial_buffer_clear(struct pb_buffer * const buffer);
 void pb_trivial_pure_buffer_clear(
                              struct pb_buffer * const buffer);
 
 void pb_trivial_buffer_destroy(
                              struct pb_buffer * const buffer);
+void pb_trivial_buffer_destroy_deferred(
+                             struct pb_buffer * const buffer,
+                             struct pb_reclaimer * const reclaimer);
+
+ssize_t pb_trivial_buffer_write_data_fill(
+                             struct pb_buffer * const buffer,
+                             uint64_t len,
+                             ssize_t (*fill)(const struct iovec *iov,
+                                             int iovcnt, void *context),
+                             void *context);
 
 
 /** Implementations of unique Trivial buffer operations. */
@@ -0,0 +1,1794 @@
+/*******************************************************************************
+ *  Copyright 2017 Nick Jones <nick.fa.jones@gmail.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ ******************************************************************************/
+
+#include "pagebuf_ring.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+
+
+/** A slot of a ring buffer chunk.
+ *
+ * index is the position of the slot in the sequence of slots of all of the
+ * chunks of the buffer, which is fixed when the chunk is added to the buffer,
+ * so that an iterator can be resolved to its position without searching.
+ */
+struct pb_ring_slot {
+  struct pb_ring_page page;
+
+  uint64_t index;
+};
+
+/** The first slot index, chosen so that chunks may be added in front of the
+ *  first chunk without the slot indices reaching zero.
+ */
+#define PB_RING_BUFFER_INDEX_ORIGIN               (UINT64_C(1) << 62)
+
+#define PB_RING_BUFFER_CHUNK_SIZE \
+  (PB_RING_BUFFER_CHUNK_CAPACITY * sizeof(struct pb_ring_slot))
+
+
+
+/** The ring buffer.
+ *
+ * The pages of the buffer occupy count consecutive slots, starting at the
+ * slot with index head, of the chunks listed in order in the chunks array.
+ * first_index is the index of the first slot of the first chunk.  Chunks are
+ * never moved once allocated, so only the chunks array is reallocated as
+ * chunks are added.  Chunks emptied by seeking are kept as a spare, for reuse
+ * when a chunk is next added, so a buffer used as a queue reaches a steady
+ * state where it cycles the same chunks.
+ *
+ * At least one slot is always left unused after the last page, and the slot
+ * that follows the last page serves as the 'end' page of the buffer.  Unused
+ * slots are always zeroed.
+ */
+struct pb_ring_buffer {
+  struct pb_buffer buffer;
+
+  struct pb_ring_slot **chunks;
+  size_t chunk_count;
+  size_t chunk_capacity;
+
+  struct pb_ring_slot *spare_chunk;
+
+  uint64_t first_index;
+  uint64_t head;
+  size_t count;
+
+  uint64_t data_revision;
+  uint64_t data_size;
+};
+
+/** Pages are shared with other buffers through their iterators, and only the
+ *  data_vec and data members are accessed across buffer implementations, so
+ *  these must be laid out in a pb_ring_page as they are in a pb_page.
+ */
+typedef char pb_ring_page_layout_check[
+  ((offsetof(struct pb_ring_page, data_vec) ==
+      offsetof(struct pb_page, data_vec)) &&
+   (offsetof(struct pb_ring_page, data) ==
+      offsetof(struct pb_page, data)) &&
+   (offsetof(struct pb_ring_slot, page) == 0)) ? 1 : -1];
+
+
+
+/*******************************************************************************
+ */
+static uint64_t pb_ring_buffer_get_data_revision(
+                              struct pb_buffer * const buffer);
+static uint64_t pb_ring_buffer_get_data_size(
+                              struct pb_buffer * const buffer);
+
+
+static void pb_ring_buffer_get_iterator(
+                            struct pb_buffer * const buffer,
+                            struct pb_buffer_iterator * const buffer_iterator);
+static void pb_ring_buffer_get_end_iterator(
+                            struct pb_buffer * const buffer,
+                            struct pb_buffer_iterator * const buffer_iterator);
+static bool pb_ring_buffer_is_end_iterator(
+                            struct pb_buffer * const buffer,
+                            const struct pb_buffer_iterator *buffer_iterator);
+static bool pb_ring_buffer_cmp_iterator(struct pb_buffer * const buffer,
+                            const struct pb_buffer_iterator *lvalue,
+                            const struct pb_buffer_iterator *rvalue);
+static void pb_ring_buffer_next_iterator(
+                            struct pb_buffer * const buffer,
+                            struct pb_buffer_iterator * const buffer_iterator);
+static void pb_ring_buffer_prev_iterator(
+                            struct pb_buffer * const buffer,
+                            struct pb_buffer_iterator * const buffer_iterator);
+static size_t pb_ring_buffer_get_iterator_at(
+                            struct pb_buffer * const buffer,
+                            uint64_t offset,
+                            struct pb_buffer_iterator * const buffer_iterator);
+
+
+static uint64_t pb_ring_buffer_extend(
+                              struct pb_buffer * const buffer,
+                              uint64_t len);
+static uint64_t pb_ring_buffer_reserve(
+                              struct pb_buffer * const buffer,
+                              uint64_t size);
+static uint64_t pb_ring_buffer_rewind(
+                              struct pb_buffer * const buffer,
+                              uint64_t len);
+static uint64_t pb_ring_buffer_seek(
+                              struct pb_buffer * const buffer,
+                              uint64_t len);
+static uint64_t pb_ring_buffer_trim(
+                              struct pb_buffer * const buffer,
+                              uint64_t len);
+
+
+static uint64_t pb_ring_buffer_insert_data(
+                              struct pb_buffer * const buffer,
+                              const struct pb_buffer_iterator *buffer_iterator,
+                              size_t offset,
+                              const void *buf,
+                              uint64_t len);
+static uint64_t pb_ring_buffer_insert_data_ref(
+                              struct pb_buffer * const buffer,
+                              const struct pb_buffer_iterator *buffer_iterator,
+                              size_t offset,
+                              const void *buf,
+                              uint64_t len);
+static uint64_t pb_ring_buffer_insert_buffer(
+                              struct pb_buffer * const buffer,
+                              const struct pb_buffer_iterator *buffer_iterator,
+                              size_t offset,
+                              struct pb_buffer * const src_buffer,
+                              uint64_t len);
+
+
+static uint64_t pb_ring_buffer_write_data(
+                                   struct pb_buffer * const buffer,
+                                   const void *buf,
+                                   uint64_t len);
+static uint64_t pb_ring_buffer_write_data_ref(
+                                   struct pb_buffer * const buffer,
+                                   const void *buf,
+                                   uint64_t len);
+static uint64_t pb_ring_buffer_write_data_mem(
+                                   struct pb_buffer * const buffer,
+                                   void *buf,
+                                   uint64_t len,
+                                   void (*release)(void *buf, uint64_t len,
+                                                   void *context),
+                                   void *context);
+static uint64_t pb_ring_buffer_write_buffer(
+                                   struct pb_buffer * const buffer,
+                                   struct pb_buffer * const src_buffer,
+                                   uint64_t len);
+static ssize_t pb_ring_buffer_write_data_fill(
+                                   struct pb_buffer * const buffer,
+                                   uint64_t len,
+                                   ssize_t (*fill)(const struct iovec *iov,
+                                                   int iovcnt, void *context),
+                                   void *context);
+
+
+static uint64_t pb_ring_buffer_overwrite_data(
+                                   struct pb_buffer * const buffer,
+                                   const void *buf,
+                                   uint64_t len);
+static uint64_t pb_ring_buffer_overwrite_buffer(
+                                   struct pb_buffer * const buffer,
+                                   struct pb_buffer * const src_buffer,
+                                   uint64_t len);
+
+
+static uint64_t pb_ring_buffer_read_data(
+                                   struct pb_buffer * const buffer,
+                                   void * const buf,
+                                   uint64_t len);
+
+
+static uint64_t pb_ring_buffer_compact(
+                                   struct pb_buffer * const buffer,
+                                   size_t threshold);
+
+
+static void pb_ring_buffer_clear(struct pb_buffer * const buffer);
+static void pb_ring_buffer_destroy(struct pb_buffer * const buffer);
+static void pb_ring_buffer_destroy_deferred(
+                                   struct pb_buffer * const buffer,
+                                   struct pb_reclaimer * const reclaimer);
+
+
+
+/*******************************************************************************
+ */
+static struct pb_buffer_operations pb_ring_buffer_operations = {
+  .get_data_revision = &pb_ring_buffer_get_data_revision,
+
+  .get_data_size = &pb_ring_buffer_get_data_size,
+
+  .get_iterator = &pb_ring_buffer_get_iterator,
+  .get_end_iterator = &pb_ring_buffer_get_end_iterator,
+  .is_end_iterator = &pb_ring_buffer_is_end_iterator,
+  .cmp_iterator = &pb_ring_buffer_cmp_iterator,
+  .next_iterator = &pb_ring_buffer_next_iterator,
+  .prev_iterator = &pb_ring_buffer_prev_iterator,
+  .get_iterator_at = &pb_ring_buffer_get_iterator_at,
+
+  .get_byte_iterator = &pb_trivial_buffer_get_byte_iterator,
+  .get_end_byte_iterator = &pb_trivial_buffer_get_end_byte_iterator,
+  .is_end_byte_iterator = &pb_trivial_buffer_is_end_byte_iterator,
+  .cmp_byte_iterator = &pb_trivial_buffer_cmp_byte_iterator,
+  .next_byte_iterator = &pb_trivial_buffer_next_byte_iterator,
+  .prev_byte_iterator = &pb_trivial_buffer_prev_byte_iterator,
+
+  .extend = &pb_ring_buffer_extend,
+  .reserve = &pb_ring_buffer_reserve,
+  .rewind = &pb_ring_buffer_rewind,
+  .seek = &pb_ring_buffer_seek,
+  .trim = &pb_ring_buffer_trim,
+
+  .insert_data = &pb_ring_buffer_insert_data,
+  .insert_data_ref = &pb_ring_buffer_insert_data_ref,
+  .insert_buffer = &pb_ring_buffer_insert_buffer,
+
+  .write_data = &pb_ring_buffer_write_data,
+  .write_data_ref = &pb_ring_buffer_write_data_ref,
+  .write_data_mem = &pb_ring_buffer_write_data_mem,
+  .write_buffer = &pb_ring_buffer_write_buffer,
+
+  .overwrite_data = &pb_ring_buffer_overwrite_data,
+  .overwrite_buffer = &pb_ring_buffer_overwrite_buffer,
+
+  .read_data = &pb_ring_buffer_read_data,
+
+  .compact = &pb_ring_buffer_compact,
+
+  .clear = &pb_ring_buffer_clear,
+  .destroy = &pb_ring_buffer_destroy,
+  .destroy_deferred = &pb_ring_buffer_destroy_deferred,
+
+  .write_data_fill = &pb_ring_buffer_write_data_fill,
+};
+
+const struct pb_buffer_operations *pb_get_ring_buffer_operations(void) {
+  return &pb_ring_buffer_operations;
+}
+
+
+
+/*******************************************************************************
+ * Add a chunk of unused slots to the end of the buffer, or in front of the
+ * first chunk if front is true, reusing the spare chunk if there is one.
+ */
+static bool pb_ring_buffer_add_chunk(struct pb_ring_buffer * const ring_buffer,
+    bool front) {
+  const struct pb_allocator *allocator = ring_buffer->buffer.allocator;
+
+  if (ring_buffer->chunk_count == ring_buffer->chunk_capacity) {
+    size_t chunk_capacity =
+      (ring_buffer->chunk_capacity != 0) ?
+        ring_buffer->chunk_capacity * 2 : PB_RING_BUFFER_INITIAL_CAPACITY;
+
+    struct pb_ring_slot **chunks =
+      pb_allocator_realloc(
+        allocator,
+        ring_buffer->chunks,
+        ring_buffer->chunk_capacity * sizeof(struct pb_ring_slot*),
+        chunk_capacity * sizeof(struct pb_ring_slot*));
+    if (!chunks)
+      return false;
+
+    ring_buffer->chunks = chunks;
+    ring_buffer->chunk_capacity = chunk_capacity;
+  }
+
+  struct pb_ring_slot *chunk = ring_buffer->spare_chunk;
+  if (chunk) {
+    ring_buffer->spare_chunk = NULL;
+  } else {
+    chunk = pb_allocator_malloc(allocator, PB_RING_BUFFER_CHUNK_SIZE);
+    if (!chunk)
+      return false;
+  }
+
+  uint64_t index;
+
+  if (front) {
+    memmove(
+      &ring_buffer->chunks[1],
+      &ring_buffer->chunks[0],
+      ring_buffer->chunk_count * sizeof(struct pb_ring_slot*));
+
+    ring_buffer->chunks[0] = chunk;
+
+    ring_buffer->first_index -= PB_RING_BUFFER_CHUNK_CAPACITY;
+
+    index = ring_buffer->first_index;
+  } else {
+    ring_buffer->chunks[ring_buffer->chunk_count] = chunk;
+
+    index =
+      ring_buffer->first_index +
+      ring_buffer->chunk_count * PB_RING_BUFFER_CHUNK_CAPACITY;
+  }
+
+  ++ring_buffer->chunk_count;
+
+  for (size_t i = 0; i < PB_RING_BUFFER_CHUNK_CAPACITY; ++i) {
+    memset(&chunk[i].page, 0, sizeof(struct pb_ring_page));
+
+    chunk[i].index = index + i;
+  }
+
+  return true;
+}
+
+/*******************************************************************************
+ * Remove a chunk from the buffer, keeping it as the spare chunk if there is
+ * none already.
+ */
+static void pb_ring_buffer_remove_chunk(
+    struct pb_ring_buffer * const ring_buffer,
+    struct pb_ring_slot * const chunk) {
+  --ring_buffer->chunk_count;
+
+  if (!ring_buffer->spare_chunk) {
+    ring_buffer->spare_chunk = chunk;
+
+    return;
+  }
+
+  pb_allocator_free(
+    ring_buffer->buffer.allocator, chunk, PB_RING_BUFFER_CHUNK_SIZE);
+}
+
+/*******************************************************************************
+ * Remove the chunks before the chunk holding the first page, and those after
+ * the chunk holding the 'end' page.
+ */
+static void pb_ring_buffer_release_chunks(
+    struct pb_ring_buffer * const ring_buffer) {
+  while ((ring_buffer->head - ring_buffer->first_index) >=
+         PB_RING_BUFFER_CHUNK_CAPACITY) {
+    pb_ring_buffer_remove_chunk(ring_buffer, ring_buffer->chunks[0]);
+
+    memmove(
+      &ring_buffer->chunks[0],
+      &ring_buffer->chunks[1],
+      ring_buffer->chunk_count * sizeof(struct pb_ring_slot*));
+
+    ring_buffer->first_index += PB_RING_BUFFER_CHUNK_CAPACITY;
+  }
+
+  while ((ring_buffer->head + ring_buffer->count) <
+         (ring_buffer->first_index +
+          (ring_buffer->chunk_count - 1) * PB_RING_BUFFER_CHUNK_CAPACITY))
+    pb_ring_buffer_remove_chunk(
+      ring_buffer, ring_buffer->chunks[ring_buffer->chunk_count - 1]);
+}
+
+/*******************************************************************************
+ * Free chunks, along with the array of chunk_capacity entries listing them.
+ */
+static void pb_ring_buffer_free_chunks(struct pb_ring_slot **chunks,
+    size_t chunk_count, size_t chunk_capacity,
+    const struct pb_allocator *allocator) {
+  for (size_t i = 0; i < chunk_count; ++i)
+    pb_allocator_free(allocator, chunks[i], PB_RING_BUFFER_CHUNK_SIZE);
+
+  pb_allocator_free(
+    allocator, chunks, chunk_capacity * sizeof(struct pb_ring_slot*));
+}
+
+
+
+/*******************************************************************************
+ */
+struct pb_buffer *pb_ring_buffer_create(void) {
+  return
+    pb_ring_buffer_create_with_strategy_with_alloc(
+      pb_get_trivial_buffer_strategy(), pb_get_trivial_allocator());
+}
+
+struct pb_buffer *pb_ring_buffer_create_with_strategy(
+    const struct pb_buffer_strategy *strategy) {
+  return
+    pb_ring_buffer_create_with_strategy_with_alloc(
+      strategy, pb_get_trivial_allocator());
+}
+
+struct pb_buffer *pb_ring_buffer_create_with_alloc(
+    const struct pb_allocator *allocator) {
+  return
+    pb_ring_buffer_create_with_strategy_with_alloc(
+      pb_get_trivial_buffer_strategy(), allocator);
+}
+
+struct pb_buffer *pb_ring_buffer_create_with_strategy_with_alloc(
+    const struct pb_buffer_strategy *strategy,
+    const struct pb_allocator *allocator) {
+  struct pb_buffer_strategy *buffer_strategy =
+    pb_allocator_calloc(allocator, sizeof(struct pb_buffer_strategy));
+  if (!buffer_strategy)
+    return NULL;
+
+  memcpy(buffer_strategy, strategy, sizeof(struct pb_buffer_strategy));
+
+  struct pb_ring_buffer *ring_buffer =
+    pb_allocator_calloc(allocator, sizeof(struct pb_ring_buffer));
+  if (!ring_buffer) {
+    pb_allocator_free(
+      allocator, buffer_strategy, sizeof(struct pb_buffer_strategy));
+
+    return NULL;
+  }
+
+  ring_buffer->buffer.strategy = buffer_strategy;
+
+  ring_buffer->buffer.operations = pb_get_ring_buffer_operations();
+
+  ring_buffer->buffer.allocator = allocator;
+
+  ring_buffer->chunks = NULL;
+  ring_buffer->chunk_count = 0;
+  ring_buffer->chunk_capacity = 0;
+
+  ring_buffer->spare_chunk = NULL;
+
+  ring_buffer->first_index = PB_RING_BUFFER_INDEX_ORIGIN;
+  ring_buffer->head = PB_RING_BUFFER_INDEX_ORIGIN;
+  ring_buffer->count = 0;
+
+  ring_buffer->data_revision = 0;
+  ring_buffer->data_size = 0;
+
+  // the first chunk holds the 'end' page of the empty buffer
+  if (!pb_ring_buffer_add_chunk(ring_buffer, false)) {
+    pb_allocator_free(
+      allocator, ring_buffer, sizeof(struct pb_ring_buffer));
+    pb_allocator_free(
+      allocator, buffer_strategy, sizeof(struct pb_buffer_strategy));
+
+    return NULL;
+  }
+
+  return &ring_buffer->buffer;
+}
+
+
+
+/*******************************************************************************
+ * Resolve the position of a page in the buffer sequence to its slot.
+ */
+static struct pb_ring_page *pb_ring_buffer_page_at(
+    const struct pb_ring_buffer *ring_buffer, size_t position) {
+  size_t slot =
+    (size_t)(ring_buffer->head - ring_buffer->first_index) + position;
+
+  return
+    &ring_buffer->chunks[slot / PB_RING_BUFFER_CHUNK_CAPACITY]
+      [slot % PB_RING_BUFFER_CHUNK_CAPACITY].page;
+}
+
+/*******************************************************************************
+ * Resolve an iterator to the position of its page in the buffer sequence.
+ */
+static size_t pb_ring_buffer_get_position(
+    const struct pb_ring_buffer *ring_buffer,
+    const struct pb_buffer_iterator *buffer_iterator) {
+  const struct pb_ring_slot *slot =
+    (const struct pb_ring_slot*)
+      ((const uint8_t*)buffer_iterator->data_vec -
+       offsetof(struct pb_ring_page, data_vec));
+
+  return (size_t)(slot->index - ring_buffer->head);
+}
+
+/*******************************************************************************
+ * Assure that there are slots for len more pages after the last page, adding
+ * chunks if required.  Pages are never moved by adding chunks, so iterators
+ * remain valid.
+ */
+static bool pb_ring_buffer_make_room(struct pb_ring_buffer * const ring_buffer,
+    size_t len) {
+  while ((ring_buffer->head + ring_buffer->count + len) >=
+         (ring_buffer->first_index +
+          ring_buffer->chunk_count * PB_RING_BUFFER_CHUNK_CAPACITY)) {
+    if (!pb_ring_buffer_add_chunk(ring_buffer, false))
+      return false;
+  }
+
+  return true;
+}
+
+/*******************************************************************************
+ * Insert a page, referencing a region of a pb_data instance, into the buffer
+ * sequence, before the page currently at position.
+ *
+ * The pb_data instance has its use count incremented.
+ */
+static uint64_t pb_ring_buffer_insert_page(struct pb_buffer * const buffer,
+    size_t position,
+    uint8_t *base,
+    size_t len,
+    struct pb_data * const data) {
+  struct pb_ring_buffer *ring_buffer = (struct pb_ring_buffer*)buffer;
+
+  bool prepend = ((position == 0) && (ring_buffer->count > 0));
+
+  // pages are prepended into the slot before the first page, a chunk being
+  // added in front of the first chunk if required
+  if (prepend) {
+    if ((ring_buffer->head == ring_buffer->first_index) &&
+        !pb_ring_buffer_add_chunk(ring_buffer, true))
+      return 0;
+  } else if (!pb_ring_buffer_make_room(ring_buffer, 1)) {
+    return 0;
+  }
+
+  if ((position != ring_buffer->count) || (ring_buffer->data_size == 0))
+    ++ring_buffer->data_revision;
+
+  if (prepend) {
+    --ring_buffer->head;
+  } else {
+    for (size_t move = ring_buffer->count; move > position; --move)
+      *pb_ring_buffer_page_at(ring_buffer, move) =
+        *pb_ring_buffer_page_at(ring_buffer, move - 1);
+  }
+
+  ++ring_buffer->count;
+
+  struct pb_ring_page *page = pb_ring_buffer_page_at(ring_buffer, position);
+  page->data_vec.base = base;
+  page->data_vec.len = len;
+  page->data = data;
+
+  pb_data_get(data);
+
+  ring_buffer->data_size += len;
+
+  return len;
+}
+
+/*******************************************************************************
+ * Split the page at a position into two pages at offset, so that data may be
+ * inserted between them.  The position is updated to that of the second page.
+ */
+static bool pb_ring_buffer_split_page(struct pb_buffer * const buffer,
+    size_t *position,
+    size_t offset) {
+  struct pb_ring_buffer *ring_buffer = (struct pb_ring_buffer*)buffer;
+
+  if ((offset == 0) || (*position == ring_buffer->count))
+    return true;
+
+  struct pb_ring_page *page = pb_ring_buffer_page_at(ring_buffer, *position);
+
+  if (offset >= page->data_vec.len) {
+    ++*position;
+
+    return true;
+  }
+
+  if (pb_ring_buffer_insert_page(
+        buffer, *position, page->data_vec.base, offset, page->data) == 0)
+    return false;
+
+  ++*position;
+
+  // the page may have moved during the insert
+  page = pb_ring_buffer_page_at(ring_buffer, *position);
+  page->data_vec.base += offset;
+  page->data_vec.len -= offset;
+
+  ring_buffer->data_size -= offset;
+
+  return true;
+}
+
+/*******************************************************************************
+ * Remove the first or last page of the buffer sequence.
+ */
+static void pb_ring_buffer_remove_head(
+    struct pb_ring_buffer * const ring_buffer) {
+  struct pb_ring_page *page = pb_ring_buffer_page_at(ring_buffer, 0);
+
+  pb_data_put(page->data);
+
+  memset(page, 0, sizeof(struct pb_ring_page));
+
+  ++ring_buffer->head;
+  --ring_buffer->count;
+
+  pb_ring_buffer_release_chunks(ring_buffer);
+}
+
+static void pb_ring_buffer_remove_tail(
+    struct pb_ring_buffer * const ring_buffer) {
+  struct pb_ring_page *page =
+    pb_ring_buffer_page_at(ring_buffer, ring_buffer->count - 1);
+
+  pb_data_put(page->data);
+
+  memset(page, 0, sizeof(struct pb_ring_page));
+
+  --ring_buffer->count;
+
+  pb_ring_buffer_release_chunks(ring_buffer);
+}
+
+/*******************************************************************************
+ * Indicate whether a page must have its memory region duplicated before it is
+ * overwritten, following the same rules as the trivial buffer.
+ */
+static bool pb_ring_buffer_requires_dup(
+    const struct pb_buffer * const buffer,
+    const struct pb_ring_page *page) {
+  return
+    !buffer->strategy->clone_on_write ||
+    (page->data->responsibility == pb_data_responsibility_referenced) ||
+    (__atomic_load_n(&page->data->use_count, __ATOMIC_RELAXED) > 1);
+}
+
+static bool pb_ring_buffer_dup_page_data(struct pb_buffer * const buffer,
+    struct pb_ring_page * const page) {
+  struct pb_data *data =
+    pb_trivial_data_create(page->data_vec.len, buffer->allocator);
+  if (!data)
+    return false;
+
+  memcpy(pb_data_get_base(data), page->data_vec.base, page->data_vec.len);
+
+  pb_data_put(page->data);
+
+  page->data_vec.base = pb_data_get_base(data);
+  page->data = data;
+
+  return true;
+}
+
+
+
+/*******************************************************************************
+ */
+static uint64_t pb_ring_buffer_get_data_revision(
+    struct pb_buffer * const buffer) {
+  struct pb_ring_buffer *ring_buffer = (struct pb_ring_buffer*)buffer;
+
+  return ring_buffer->data_revision;
+}
+
+/*******************************************************************************
+ */
+static uint64_t pb_ring_buffer_get_data_size(struct pb_buffer * const buffer) {
+  struct pb_ring_buffer *ring_buffer = (struct pb_ring_buffer*)buffer;
+
+  return ring_buffer->data_size;
+}
+
+/*******************************************************************************
+ */
+static void pb_ring_buffer_get_iterator(struct pb_buffer * const buffer,
+    struct pb_buffer_iterator * const buffer_iterator) {
+  struct pb_ring_buffer *ring_buffer = (struct pb_ring_buffer*)buffer;
+
+  buffer_iterator->data_vec =
+    &pb_ring_buffer_page_at(ring_buffer, 0)->data_vec;
+}
+
+static void pb_ring_buffer_get_end_iterator(struct pb_buffer * const buffer,
+    struct pb_buffer_iterator * const buffer_iterator) {
+  struct pb_ring_buffer *ring_buffer = (struct pb_ring_buffer*)buffer;
+
+  buffer_iterator->data_vec =
+    &pb_ring_buffer_page_at(ring_buffer, ring_buffer->count)->data_vec;
+}
+
+static bool pb_ring_buffer_is_end_iterator(struct pb_buffer * const buffer,
+    const struct pb_buffer_iterator *buffer_iterator) {
+  struct pb_ring_buffer *ring_buffer = (struct pb_ring_buffer*)buffer;
+
+  return
+    (buffer_iterator->data_vec ==
+       &pb_ring_buffer_page_at(ring_buffer, ring_buffer->count)->data_vec);
+}
+
+static bool pb_ring_buffer_cmp_iterator(struct pb_buffer * const buffer,
+    const struct pb_buffer_iterator *lvalue,
+    const struct pb_buffer_iterator *rvalue) {
+  return (lvalue->data_vec == rvalue->data_vec);
+}
+
+static void pb_ring_buffer_next_iterator(struct pb_buffer * const buffer,
+    struct pb_buffer_iterator * const buffer_iterator) {
+  struct pb_ring_buffer *ring_buffer = (struct pb_ring_buffer*)buffer;
+
+  size_t position = pb_ring_buffer_get_position(ring_buffer, buffer_iterator);
+
+  position = (position != ring_buffer->count) ? position + 1 : 0;
+
+  buffer_iterator->data_vec =
+    &pb_ring_buffer_page_at(ring_buffer, position)->data_vec;
+}
+
+static void pb_ring_buffer_prev_iterator(struct pb_buffer * const buffer,
+    struct pb_buffer_iterator * const buffer_iterator) {
+  struct pb_ring_buffer *ring_buffer = (struct pb_ring_buffer*)buffer;
+
+  size_t position = pb_ring_buffer_get_position(ring_buffer, buffer_iterator);
+
+  position = (position != 0) ? position - 1 : ring_buffer->count;
+
+  buffer_iterator->data_vec =
+    &pb_ring_buffer_page_at(ring_buffer, position)->data_vec;
+}
+
+static size_t pb_ring_buffer_get_iterator_at(struct pb_buffer * const buffer,
+    uint64_t offset,
+    struct pb_buffer_iterator * const buffer_iterator) {
+  struct pb_ring_buffer *ring_buffer = (struct pb_ring_buffer*)buffer;
+
+  size_t position = 0;
+
+  if (offset < ring_buffer->data_size) {
+    for (;;) {
+      struct pb_ring_page *page = pb_ring_buffer_page_at(ring_buffer, position);
+      if (offset < page->data_vec.len)
+        break;
+
+      offset -= page->data_vec.len;
+      ++position;
+    }
+  } else {
+    position = ring_buffer->count;
+    offset = 0;
+  }
+
+  buffer_iterator->data_vec =
+    &pb_ring_buffer_page_at(ring_buffer, position)->data_vec;
+
+  return offset;
+}
+
+/*******************************************************************************
+ */
+static uint64_t pb_ring_buffer_extend(struct pb_buffer * const buffer,
+    uint64_t len) {
+  if (buffer->strategy->rejects_extend)
+    return 0;
+
+  struct pb_ring_buffer *ring_buffer = (struct pb_ring_buffer*)buffer;
+  uint64_t extended = 0;
+
+  // the pages of an extension spanning several pages are taken from a single
+  // page block, when it can be allocated
+  struct pb_page *block_page =
+    ((buffer->strategy->page_size != 0) &&
+     (buffer->strategy->page_size < len) &&
+     (len <= SIZE_MAX)) ?
+      pb_split_page_block_create(
+        len, buffer->strategy->page_size, 0, buffer->allocator) :
+      NULL;
+
+  while (len > 0) {
+    uint64_t extend_len =
+      ((buffer->strategy->page_size != 0) &&
+       (buffer->strategy->page_size < len)) ?
+        buffer->strategy->page_size : len;
+
+    struct pb_page *page = block_page;
+    struct pb_data *page_data =
+      (page) ?
+        page->data : pb_trivial_data_create(extend_len, buffer->allocator);
+    if (!page_data)
+      break;
+
+    extend_len =
+      pb_ring_buffer_insert_page(
+        buffer, ring_buffer->count,
+        (page) ? page->data_vec.base : pb_data_get_base(page_data), extend_len,
+        page_data);
+
+    if (page) {
+      block_page = page->next;
+
+      pb_page_destroy(page, buffer->allocator);
+    } else {
+      pb_data_put(page_data);
+    }
+
+    if (extend_len == 0)
+      break;
+
+    len -= extend_len;
+    extended += extend_len;
+  }
+
+  while (block_page) {
+    struct pb_page *next_page = block_page->next;
+
+    pb_page_destroy(block_page, buffer->allocator);
+
+    block_page = next_page;
+  }
+
+  return extended;
+}
+
+/*******************************************************************************
+ */
+static uint64_t pb_ring_buffer_reserve(struct pb_buffer * const buffer,
+    uint64_t size) {
+  uint64_t data_size = pb_ring_buffer_get_data_size(buffer);
+  if (data_size >= size)
+    return 0;
+
+  return pb_ring_buffer_extend(buffer, size - data_size);
+}
+
+/*******************************************************************************
+ */
+static uint64_t pb_ring_buffer_rewind(struct pb_buffer * const buffer,
+    uint64_t len) {
+  if (buffer->strategy->rejects_rewind)
+    return 0;
+
+  uint64_t rewinded = 0;
+
+  while (len > 0) {
+    uint64_t rewind_len =
+      ((buffer->strategy->page_size != 0) &&
+       (buffer->strategy->page_size < len)) ?
+        buffer->strategy->page_size : len;
+
+    struct pb_data *data = pb_trivial_data_create(rewind_len, buffer->allocator);
+    if (!data)
+      return rewinded;
+
+    rewind_len =
+      pb_ring_buffer_insert_page(
+        buffer, 0, pb_data_get_base(data), rewind_len, data);
+
+    pb_data_put(data);
+
+    if (rewind_len == 0)
+      break;
+
+    len -= rewind_len;
+    rewinded += rewind_len;
+  }
+
+  return rewinded;
+}
+
+/*******************************************************************************
+ */
+static uint64_t pb_ring_buffer_seek(struct pb_buffer * const buffer,
+    uint64_t len) {
+  if (buffer->strategy->rejects_seek)
+    return 0;
+
+  struct pb_ring_buffer *ring_buffer = (struct pb_ring_buffer*)buffer;
+  uint64_t seeked = 0;
+
+  while ((len > 0) && (ring_buffer->count > 0)) {
+    struct pb_ring_page *page = pb_ring_buffer_page_at(ring_buffer, 0);
+
+    uint64_t seek_len =
+      (page->data_vec.len < len) ?
+       page->data_vec.len : len;
+
+    page->data_vec.base += seek_len;
+    page->data_vec.len -= seek_len;
+
+    if (page->data_vec.len == 0)
+      pb_ring_buffer_remove_head(ring_buffer);
+
+    len -= seek_len;
+    seeked += seek_len;
+
+    ring_buffer->data_size -= seek_len;
+  }
+
+  if (seeked > 0)
+    ++ring_buffer->data_revision;
+
+  return seeked;
+}
+
+/*******************************************************************************
+ */
+static uint64_t pb_ring_buffer_trim(struct pb_buffer * const buffer,
+    uint64_t len) {
+  if (buffer->strategy->rejects_trim)
+    return 0;
+
+  struct pb_ring_buffer *ring_buffer = (struct pb_ring_buffer*)buffer;
+  uint64_t trimmed = 0;
+
+  while ((len > 0) && (ring_buffer->count > 0)) {
+    struct pb_ring_page *page =
+      pb_ring_buffer_page_at(ring_buffer, ring_buffer->count - 1);
+
+    uint64_t trim_len =
+      (page->data_vec.len < len) ?
+       page->data_vec.len : len;
+
+    page->data_vec.len -= trim_len;
+
+    if (page->data_vec.len == 0)
+      pb_ring_buffer_remove_tail(ring_buffer);
+
+    len -= trim_len;
+    trimmed += trim_len;
+
+    ring_buffer->data_size -= trim_len;
+  }
+
+  if (trimmed > 0)
+    ++ring_buffer->data_revision;
+
+  return trimmed;
+}
+
+/*******************************************************************************
+ */
+static uint64_t pb_ring_buffer_insert_data1(struct pb_buffer * const buffer,
+    size_t position,
+    const uint8_t *buf,
+    uint64_t len) {
+  uint64_t inserted = 0;
+
+  while (len > 0) {
+    uint64_t insert_len =
+      ((buffer->strategy->page_size != 0) &&
+       (buffer->strategy->page_size < len)) ?
+        buffer->strategy->page_size : len;
+
+    struct pb_data *data = pb_trivial_data_create(insert_len, buffer->allocator);
+    if (!data)
+      return inserted;
+
+    memcpy(pb_data_get_base(data), buf + inserted, insert_len);
+
+    insert_len =
+      pb_ring_buffer_insert_page(
+        buffer, position, pb_data_get_base(data), insert_len, data);
+
+    pb_data_put(data);
+
+    if (insert_len == 0)
+      break;
+
+    ++position;
+
+    len -= insert_len;
+    inserted += insert_len;
+  }
+
+  return inserted;
+}
+
+static uint64_t pb_ring_buffer_insert_data(struct pb_buffer * const buffer,
+    const struct pb_buffer_iterator *buffer_iterator,
+    size_t offset,
+    const void *buf,
+    uint64_t len) {
+  if (!pb_ring_buffer_is_end_iterator(buffer, buffer_iterator) &&
+       buffer->strategy->rejects_insert)
+    return 0;
+
+  size_t position =
+    pb_ring_buffer_get_position(
+      (struct pb_ring_buffer*)buffer, buffer_iterator);
+
+  if (!pb_ring_buffer_split_page(buffer, &position, offset))
+    return 0;
+
+  return pb_ring_buffer_insert_data1(buffer, position, buf, len);
+}
+
+/*******************************************************************************
+ */
+static uint64_t pb_ring_buffer_insert_data_ref1(
+    struct pb_buffer * const buffer,
+    size_t position,
+    const uint8_t *buf,
+    uint64_t len) {
+  uint64_t inserted = 0;
+
+  while (len > 0) {
+    uint64_t insert_len =
+      ((buffer->strategy->page_size != 0) &&
+       (buffer->strategy->page_size < len)) ?
+        buffer->strategy->page_size : len;
+
+    struct pb_data *data =
+      pb_trivial_data_create_ref(buf + inserted, insert_len, buffer->allocator);
+    if (!data)
+      return inserted;
+
+    insert_len =
+      pb_ring_buffer_insert_page(
+        buffer, position, pb_data_get_base(data), insert_len, data);
+
+    pb_data_put(data);
+
+    if (insert_len == 0)
+      break;
+
+    ++position;
+
+    len -= insert_len;
+    inserted += insert_len;
+  }
+
+  return inserted;
+}
+
+static uint64_t pb_ring_buffer_insert_data_ref(struct pb_buffer * const buffer,
+    const struct pb_buffer_iterator *buffer_iterator,
+    size_t offset,
+    const void *buf,
+    uint64_t len) {
+  if (!pb_ring_buffer_is_end_iterator(buffer, buffer_iterator) &&
+       buffer->strategy->rejects_insert)
+    return 0;
+
+  size_t position =
+    pb_ring_buffer_get_position(
+      (struct pb_ring_buffer*)buffer, buffer_iterator);
+
+  if (!pb_ring_buffer_split_page(buffer, &position, offset))
+    return 0;
+
+  return pb_ring_buffer_insert_data_ref1(buffer, position, buf, len);
+}
+
+/*******************************************************************************
+ * The pages of the source buffer are either referenced or, if the strategy is
+ * clone_on_write, copied.  If the strategy is fragment_as_target, the source
+ * pages are further divided into pages of no more than page_size.
+ */
+static uint64_t pb_ring_buffer_insert_buffer1(struct pb_buffer * const buffer,
+    size_t position,
+    struct pb_buffer * const src_buffer,
+    uint64_t len) {
+  struct pb_buffer_iterator src_buffer_iterator;
+  pb_buffer_get_iterator(src_buffer, &src_buffer_iterator);
+
+  uint64_t inserted = 0;
+  size_t src_offset = 0;
+
+  while ((len > 0) &&
+         (!pb_buffer_is_end_iterator(src_buffer, &src_buffer_iterator))) {
+    const struct pb_ring_page *src_page =
+      (const struct pb_ring_page*)src_buffer_iterator.data_vec;
+
+    uint64_t insert_len =
+      (src_page->data_vec.len - src_offset < len) ?
+       src_page->data_vec.len - src_offset : len;
+
+    if ((buffer->strategy->fragment_as_target) &&
+        (buffer->strategy->page_size != 0) &&
+        (buffer->strategy->page_size < insert_len))
+      insert_len = buffer->strategy->page_size;
+
+    struct pb_data *data;
+    uint8_t *base;
+
+    if (buffer->strategy->clone_on_write) {
+      data = pb_trivial_data_create(insert_len, buffer->allocator);
+      if (!data)
+        return inserted;
+
+      base = pb_data_get_base(data);
+
+      memcpy(base, src_page->data_vec.base + src_offset, insert_len);
+    } else {
+      data = src_page->data;
+      base = src_page->data_vec.base + src_offset;
+
+      pb_data_get(data);
+    }
+
+    insert_len =
+      pb_ring_buffer_insert_page(buffer, position, base, insert_len, data);
+
+    pb_data_put(data);
+
+    if (insert_len == 0)
+      break;
+
+    ++position;
+
+    len -= insert_len;
+    inserted += insert_len;
+    src_offset += insert_len;
+
+    if (src_offset == src_page->data_vec.len) {
+      pb_buffer_next_iterator(src_buffer, &src_buffer_iterator);
+
+      src_offset = 0;
+    }
+  }
+
+  return inserted;
+}
+
+static uint64_t pb_ring_buffer_insert_buffer(struct pb_buffer * const buffer,
+    const struct pb_buffer_iterator *buffer_iterator,
+    size_t offset,
+    struct pb_buffer * const src_buffer,
+    uint64_t len) {
+  if (!pb_ring_buffer_is_end_iterator(buffer, buffer_iterator) &&
+       buffer->strategy->rejects_insert)
+    return 0;
+
+  size_t position =
+    pb_ring_buffer_get_position(
+      (struct pb_ring_buffer*)buffer, buffer_iterator);
+
+  if (!pb_ring_buffer_split_page(buffer, &position, offset))
+    return 0;
+
+  return pb_ring_buffer_insert_buffer1(buffer, position, src_buffer, len);
+}
+
+/*******************************************************************************
+ * Get the spare capacity of the tail page, as the trivial buffer does, when
+ * its memory region is owned and not shared with other pages.
+ */
+static size_t pb_ring_buffer_get_tail_capacity(
+    struct pb_buffer * const buffer) {
+  struct pb_ring_buffer *ring_buffer = (struct pb_ring_buffer*)buffer;
+
+  if (ring_buffer->count == 0)
+    return 0;
+
+  struct pb_ring_page *page =
+    pb_ring_buffer_page_at(ring_buffer, ring_buffer->count - 1);
+  struct pb_data *data = page->data;
+
+  if ((data->responsibility != pb_data_responsibility_owned) ||
+      (data->operations == pb_get_mem_data_operations()) ||
+      (__atomic_load_n(&data->use_count, __ATOMIC_RELAXED) > 1))
+    return 0;
+
+  uint8_t *page_end = page->data_vec.base + page->data_vec.len;
+  uint8_t *data_end = (uint8_t*)pb_data_get_base_at(data, pb_data_get_len(data));
+
+  return (size_t)(data_end - page_end);
+}
+
+/*******************************************************************************
+ * Append data into the spare capacity of the tail page.
+ */
+static uint64_t pb_ring_buffer_write_tail(struct pb_buffer * const buffer,
+    const uint8_t *buf,
+    uint64_t len) {
+  struct pb_ring_buffer *ring_buffer = (struct pb_ring_buffer*)buffer;
+
+  uint64_t write_len = pb_ring_buffer_get_tail_capacity(buffer);
+  if (write_len > len)
+    write_len = len;
+  if (write_len == 0)
+    return 0;
+
+  struct pb_ring_page *page =
+    pb_ring_buffer_page_at(ring_buffer, ring_buffer->count - 1);
+
+  memcpy(page->data_vec.base + page->data_vec.len, buf, write_len);
+
+  page->data_vec.len += write_len;
+
+  ring_buffer->data_size += write_len;
+
+  return write_len;
+}
+
+static uint64_t pb_ring_buffer_write_data(struct pb_buffer * const buffer,
+    const void *buf,
+    uint64_t len) {
+  if (buffer->strategy->rejects_write)
+    return 0;
+
+  struct pb_ring_buffer *ring_buffer = (struct pb_ring_buffer*)buffer;
+
+  uint64_t written = pb_ring_buffer_write_tail(buffer, buf, len);
+  len -= written;
+
+  while (len > 0) {
+    uint64_t write_len =
+      ((buffer->strategy->page_size != 0) &&
+       (buffer->strategy->page_size < len)) ?
+        buffer->strategy->page_size : len;
+
+    struct pb_data *data =
+      pb_trivial_data_create(
+        (buffer->strategy->page_size != 0) ?
+          buffer->strategy->page_size : write_len,
+        buffer->allocator);
+    if (!data)
+      return written;
+
+    memcpy(pb_data_get_base(data), (const uint8_t*)buf + written, write_len);
+
+    write_len =
+      pb_ring_buffer_insert_page(
+        buffer, ring_buffer->count, pb_data_get_base(data), write_len, data);
+
+    pb_data_put(data);
+
+    if (write_len == 0)
+      break;
+
+    len -= write_len;
+    written += write_len;
+  }
+
+  return written;
+}
+
+static uint64_t pb_ring_buffer_write_data_ref(struct pb_buffer * const buffer,
+    const void *buf,
+    uint64_t len) {
+  if (buffer->strategy->rejects_write)
+    return 0;
+
+  struct pb_ring_buffer *ring_buffer = (struct pb_ring_buffer*)buffer;
+
+  return
+    pb_ring_buffer_insert_data_ref1(buffer, ring_buffer->count, buf, len);
+}
+
+static uint64_t pb_ring_buffer_write_data_mem(struct pb_buffer * const buffer,
+    void *buf,
+    uint64_t len,
+    void (*release)(void *buf, uint64_t len, void *context),
+    void *context) {
+  struct pb_ring_buffer *ring_buffer = (struct pb_ring_buffer*)buffer;
+
+  struct pb_data *data =
+    (!buffer->strategy->rejects_write) ?
+      pb_mem_data_create(buf, len, release, context, buffer->allocator) :
+      NULL;
+  if (!data) {
+    release(buf, len, context);
+
+    return 0;
+  }
+
+  uint64_t written = 0;
+
+  while (len > 0) {
+    uint64_t write_len =
+      ((buffer->strategy->page_size != 0) &&
+       (buffer->strategy->page_size < len)) ?
+        buffer->strategy->page_size : len;
+
+    write_len =
+      pb_ring_buffer_insert_page(
+        buffer, ring_buffer->count,
+        pb_data_get_base_at(data, written), write_len, data);
+
+    if (write_len == 0)
+      break;
+
+    len -= write_len;
+    written += write_len;
+  }
+
+  pb_data_put(data);
+
+  return written;
+}
+
+static uint64_t pb_ring_buffer_write_buffer(struct pb_buffer * const buffer,
+    struct pb_buffer * const src_buffer,
+    uint64_t len) {
+  if (buffer->strategy->rejects_write)
+    return 0;
+
+  struct pb_ring_buffer *ring_buffer = (struct pb_ring_buffer*)buffer;
+
+  return
+    pb_ring_buffer_insert_buffer1(
+      buffer, ring_buffer->count, src_buffer, len);
+}
+
+/*******************************************************************************
+ * Offer the spare capacity of the tail page, then the memory regions of new
+ * pb_data instances of page_size, to fill, as the trivial buffer does.
+ */
+static ssize_t pb_ring_buffer_write_data_fill(struct pb_buffer * const buffer,
+    uint64_t len,
+    ssize_t (*fill)(const struct iovec *iov, int iovcnt, void *context),
+    void *context) {
+  struct pb_ring_buffer *ring_buffer = (struct pb_ring_buffer*)buffer;
+
+  if (buffer->strategy->rejects_write) {
+    errno = EPERM;
+
+    return -1;
+  }
+
+  if (len == 0)
+    return 0;
+
+  struct iovec iov[PB_BUFFER_FILL_IOVEC_SIZE];
+  struct pb_data *datas[PB_BUFFER_FILL_IOVEC_SIZE];
+  size_t data_count = 0;
+  int iovcnt = 0;
+
+  uint64_t tail_len = pb_ring_buffer_get_tail_capacity(buffer);
+  if (tail_len > len)
+    tail_len = len;
+
+  if (tail_len > 0) {
+    struct pb_ring_page *page =
+      pb_ring_buffer_page_at(ring_buffer, ring_buffer->count - 1);
+
+    iov[0].iov_base = page->data_vec.base + page->data_vec.len;
+    iov[0].iov_len = (size_t)tail_len;
+
+    ++iovcnt;
+  }
+
+  uint64_t offered = tail_len;
+
+  while ((offered < len) && (iovcnt < PB_BUFFER_FILL_IOVEC_SIZE)) {
+    uint64_t data_len =
+      ((buffer->strategy->page_size != 0) &&
+       (buffer->strategy->page_size < (len - offered))) ?
+        buffer->strategy->page_size : (len - offered);
+
+    struct pb_data *data =
+      pb_trivial_data_create(
+        (buffer->strategy->page_size != 0) ?
+          buffer->strategy->page_size : data_len,
+        buffer->allocator);
+    if (!data)
+      break;
+
+    datas[data_count++] = data;
+
+    iov[iovcnt].iov_base = pb_data_get_base(data);
+    iov[iovcnt].iov_len = (size_t)data_len;
+
+    ++iovcnt;
+
+    offered += data_len;
+  }
+
+  if (iovcnt == 0) {
+    errno = ENOMEM;
+
+    return -1;
+  }
+
+  ssize_t result = fill(iov, iovcnt, context);
+  int temp_errno = errno;
+
+  uint64_t filled = (result > 0) ? (uint64_t)result : 0;
+  uint64_t written = 0;
+
+  if (tail_len > filled)
+    tail_len = filled;
+
+  if (tail_len > 0) {
+    struct pb_ring_page *page =
+      pb_ring_buffer_page_at(ring_buffer, ring_buffer->count - 1);
+
+    page->data_vec.len += tail_len;
+
+    ring_buffer->data_size += tail_len;
+
+    written += tail_len;
+  }
+
+  bool inserting = true;
+
+  for (size_t i = 0; i < data_count; ++i) {
+    uint64_t data_len = iov[iovcnt - data_count + i].iov_len;
+    if (data_len > filled - written)
+      data_len = filled - written;
+
+    // once an insert fails, the data that follows is dropped
+    if (inserting && (data_len > 0))
+      inserting =
+        (pb_ring_buffer_insert_page(
+           buffer, ring_buffer->count,
+           pb_data_get_base(datas[i]), data_len, datas[i]) == data_len);
+
+    if (inserting)
+      written += data_len;
+
+    pb_data_put(datas[i]);
+  }
+
+  if (written < filled) {
+    errno = ENOMEM;
+
+    return -1;
+  }
+
+  errno = temp_errno;
+
+  return result;
+}
+
+/*******************************************************************************
+ */
+static uint64_t pb_ring_buffer_overwrite_data(struct pb_buffer * const buffer,
+    const void *buf,
+    uint64_t len) {
+  if (buffer->strategy->rejects_overwrite)
+    return 0;
+
+  struct pb_ring_buffer *ring_buffer = (struct pb_ring_buffer*)buffer;
+  uint64_t written = 0;
+
+  for (size_t position = 0;
+       (len > 0) && (position < ring_buffer->count);
+       ++position) {
+    struct pb_ring_page *page = pb_ring_buffer_page_at(ring_buffer, position);
+
+    if (pb_ring_buffer_requires_dup(buffer, page) &&
+        !pb_ring_buffer_dup_page_data(buffer, page))
+      break;
+
+    uint64_t write_len =
+      (page->data_vec.len < len) ?
+       page->data_vec.len : len;
+
+    memcpy(page->data_vec.base, (const uint8_t*)buf + written, write_len);
+
+    len -= write_len;
+    written += write_len;
+  }
+
+  if (written > 0)
+    ++ring_buffer->data_revision;
+
+  return written;
+}
+
+static uint64_t pb_ring_buffer_overwrite_buffer(struct pb_buffer * const buffer,
+    struct pb_buffer * const src_buffer,
+    uint64_t len) {
+  if (buffer->strategy->rejects_overwrite)
+    return 0;
+
+  struct pb_ring_buffer *ring_buffer = (struct pb_ring_buffer*)buffer;
+
+  struct pb_buffer_iterator src_buffer_iterator;
+  pb_buffer_get_iterator(src_buffer, &src_buffer_iterator);
+
+  uint64_t written = 0;
+  size_t position = 0;
+  size_t offset = 0;
+  size_t src_offset = 0;
+
+  while ((len > 0) &&
+         (position < ring_buffer->count) &&
+         (!pb_buffer_is_end_iterator(src_buffer, &src_buffer_iterator))) {
+    struct pb_ring_page *page = pb_ring_buffer_page_at(ring_buffer, position);
+    size_t src_len = pb_buffer_iterator_get_len(&src_buffer_iterator);
+
+    if ((offset == 0) &&
+        pb_ring_buffer_requires_dup(buffer, page) &&
+        !pb_ring_buffer_dup_page_data(buffer, page))
+      break;
+
+    uint64_t write_len =
+      (page->data_vec.len - offset < len) ?
+       page->data_vec.len - offset : len;
+
+    write_len =
+      (src_len - src_offset < write_len) ?
+       src_len - src_offset : write_len;
+
+    memcpy(
+      page->data_vec.base + offset,
+      pb_buffer_iterator_get_base_at(&src_buffer_iterator, src_offset),
+      write_len);
+
+    len -= write_len;
+    written += write_len;
+    offset += write_len;
+    src_offset += write_len;
+
+    if (offset == page->data_vec.len) {
+      ++position;
+
+      offset = 0;
+    }
+
+    if (src_offset == src_len) {
+      pb_buffer_next_iterator(src_buffer, &src_buffer_iterator);
+
+      src_offset = 0;
+    }
+  }
+
+  if (written > 0)
+    ++ring_buffer->data_revision;
+
+  return written;
+}
+
+/*******************************************************************************
+ */
+static uint64_t pb_ring_buffer_read_data(struct pb_buffer * const buffer,
+    void * const buf,
+    uint64_t len) {
+  struct pb_ring_buffer *ring_buffer = (struct pb_ring_buffer*)buffer;
+  uint64_t readed = 0;
+
+  for (size_t position = 0;
+       (len > 0) && (position < ring_buffer->count);
+       ++position) {
+    const struct pb_ring_page *page =
+      pb_ring_buffer_page_at(ring_buffer, position);
+
+    size_t read_len =
+      (page->data_vec.len < len) ?
+       page->data_vec.len : len;
+
+    memcpy((uint8_t*)buf + readed, page->data_vec.base, read_len);
+
+    len -= read_len;
+    readed += read_len;
+  }
+
+  return readed;
+}
+
+/*******************************************************************************
+ * Runs of compactable pages are copied into new pages, and the pages of the
+ * buffer moved down in the array, in a single pass.
+ */
+static bool pb_ring_buffer_is_page_compactable(
+    const struct pb_ring_page *page,
+    size_t threshold) {
+  return
+    (page->data_vec.len < threshold) &&
+    (__atomic_load_n(&page->data->use_count, __ATOMIC_RELAXED) == 1);
+}
+
+static uint64_t pb_ring_buffer_compact(struct pb_buffer * const buffer,
+    size_t threshold) {
+  struct pb_ring_buffer *ring_buffer = (struct pb_ring_buffer*)buffer;
+  size_t page_size = buffer->strategy->page_size;
+
+  if (threshold == 0)
+    threshold = page_size;
+
+  size_t count = ring_buffer->count;
+  size_t position = 0;
+  size_t compact_position = 0;
+
+  while (position < count) {
+    struct pb_ring_page *page = pb_ring_buffer_page_at(ring_buffer, position);
+
+    // measure the run of compactable pages that fit in a single page
+    size_t run_end = position + 1;
+    size_t run_len = page->data_vec.len;
+
+    if (pb_ring_buffer_is_page_compactable(page, threshold)) {
+      while (run_end < count) {
+        struct pb_ring_page *run_page =
+          pb_ring_buffer_page_at(ring_buffer, run_end);
+
+        if (!pb_ring_buffer_is_page_compactable(run_page, threshold) ||
+            ((page_size != 0) &&
+             ((run_len + run_page->data_vec.len) > page_size)))
+          break;
+
+        run_len += run_page->data_vec.len;
+        ++run_end;
+      }
+    }
+
+    struct pb_data *data =
+      ((run_end - position) > 1) ?
+        pb_trivial_data_create(
+          (page_size != 0) ? page_size : run_len, buffer->allocator) :
+        NULL;
+
+    if (!data) {
+      // move the pages of the run down unchanged
+      for (; position < run_end; ++position, ++compact_position)
+        *pb_ring_buffer_page_at(ring_buffer, compact_position) =
+          *pb_ring_buffer_page_at(ring_buffer, position);
+
+      continue;
+    }
+
+    uint8_t *base = pb_data_get_base(data);
+    size_t len = 0;
+
+    for (; position < run_end; ++position) {
+      page = pb_ring_buffer_page_at(ring_buffer, position);
+
+      memcpy(base + len, page->data_vec.base, page->data_vec.len);
+      len += page->data_vec.len;
+
+      pb_data_put(page->data);
+    }
+
+    page = pb_ring_buffer_page_at(ring_buffer, compact_position);
+    page->data_vec.base = base;
+    page->data_vec.len = len;
+    page->data = data;
+
+    ++compact_position;
+  }
+
+  for (position = compact_position; position < count; ++position)
+    memset(
+      pb_ring_buffer_page_at(ring_buffer, position), 0,
+      sizeof(struct pb_ring_page));
+
+  ring_buffer->count = compact_position;
+
+  if (compact_position != count)
+    ++ring_buffer->data_revision;
+
+  return count - compact_position;
+}
+
+/*******************************************************************************
+ */
+static void pb_ring_buffer_clear(struct pb_buffer * const buffer) {
+  struct pb_ring_buffer *ring_buffer = (struct pb_ring_buffer*)buffer;
+
+  ++ring_buffer->data_revision;
+
+  while (ring_buffer->count > 0)
+    pb_ring_buffer_remove_head(ring_buffer);
+
+  ring_buffer->data_size = 0;
+}
+
+/*******************************************************************************
+ */
+static void pb_ring_buffer_destroy(struct pb_buffer * const buffer) {
+  pb_ring_buffer_clear(buffer);
+
+  struct pb_ring_buffer *ring_buffer = (struct pb_ring_buffer*)buffer;
+  struct pb_buffer_strategy *buffer_strategy =
+    (struct pb_buffer_strategy*)buffer->strategy;
+  const struct pb_allocator *allocator = buffer->allocator;
+
+  pb_ring_buffer_free_chunks(
+    ring_buffer->chunks, ring_buffer->chunk_count,
+    ring_buffer->chunk_capacity, allocator);
+
+  if (ring_buffer->spare_chunk)
+    pb_allocator_free(
+      allocator, ring_buffer->spare_chunk, PB_RING_BUFFER_CHUNK_SIZE);
+
+  pb_allocator_free(
+    allocator, buffer_strategy, sizeof(struct pb_buffer_strategy));
+
+  pb_allocator_free(
+    allocator, ring_buffer, sizeof(struct pb_ring_buffer));
+}
+
+/*******************************************************************************
+ */
+/** The chunks detached from a ring buffer, awaiting release.
+ *
+ * slot is the offset of the first page still to be released from the first
+ * slot of the first chunk.
+ */
+struct pb_ring_buffer_reclaim_task {
+  struct pb_reclaim_task task;
+
+  struct pb_ring_slot **chunks;
+  size_t chunk_count;
+  size_t chunk_capacity;
+
+  size_t slot;
+  size_t count;
+
+  const struct pb_allocator *allocator;
+};
+
+static bool pb_ring_buffer_reclaim_task_release(
+    struct pb_reclaim_task * const task,
+    uint64_t * const count) {
+  struct pb_ring_buffer_reclaim_task *reclaim_task =
+    (struct pb_ring_buffer_reclaim_task*)task;
+
+  while ((*count > 0) && (reclaim_task->count > 0)) {
+    struct pb_ring_slot *slot =
+      &reclaim_task->chunks[reclaim_task->slot / PB_RING_BUFFER_CHUNK_CAPACITY]
+        [reclaim_task->slot % PB_RING_BUFFER_CHUNK_CAPACITY];
+
+    pb_data_put(slot->page.data);
+
+    ++reclaim_task->slot;
+    --reclaim_task->count;
+
+    --*count;
+  }
+
+  if (reclaim_task->count > 0)
+    return false;
+
+  pb_ring_buffer_free_chunks(
+    reclaim_task->chunks, reclaim_task->chunk_count,
+    reclaim_task->chunk_capacity, reclaim_task->allocator);
+
+  pb_allocator_free(
+    reclaim_task->allocator,
+    reclaim_task, sizeof(struct pb_ring_buffer_reclaim_task));
+
+  return true;
+}
+
+static void pb_ring_buffer_destroy_deferred(struct pb_buffer * const buffer,
+    struct pb_reclaimer * const reclaimer) {
+  struct pb_ring_buffer *ring_buffer = (struct pb_ring_buffer*)buffer;
+
+  if (ring_buffer->count == 0) {
+    pb_ring_buffer_destroy(buffer);
+
+    return;
+  }
+
+  const struct pb_allocator *allocator = buffer->allocator;
+
+  struct pb_ring_buffer_reclaim_task *reclaim_task =
+    pb_allocator_calloc(
+      allocator, sizeof(struct pb_ring_buffer_reclaim_task));
+  if (!reclaim_task) {
+    pb_ring_buffer_destroy(buffer);
+
+    return;
+  }
+
+  // the chunks themselves move to the task
+  reclaim_task->task.release = &pb_ring_buffer_reclaim_task_release;
+  reclaim_task->chunks = ring_buffer->chunks;
+  reclaim_task->chunk_count = ring_buffer->chunk_count;
+  reclaim_task->chunk_capacity = ring_buffer->chunk_capacity;
+  reclaim_task->slot =
+    (size_t)(ring_buffer->head - ring_buffer->first_index);
+  reclaim_task->count = ring_buffer->count;
+  reclaim_task->allocator = allocator;
+
+  if (ring_buffer->spare_chunk)
+    pb_allocator_free(
+      allocator, ring_buffer->spare_chunk, PB_RING_BUFFER_CHUNK_SIZE);
+
+  struct pb_buffer_strategy *buffer_strategy =
+    (struct pb_buffer_strategy*)buffer->strategy;
+
+  pb_allocator_free(
+    allocator, buffer_strategy, sizeof(struct pb_buffer_strategy));
+
+  pb_allocator_free(
+    allocator, ring_buffer, sizeof(struct pb_ring_buffer));
+
+  pb_reclaimer_submit(reclaimer, &reclaim_task->task);
+}
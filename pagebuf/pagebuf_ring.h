@@ -0,0 +1,103 @@
+/*******************************************************************************
+ *  Copyright 2017 Nick Jones <nick.fa.jones@gmail.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ ******************************************************************************/
+
+#ifndef PAGEBUF_RING_H
+#define PAGEBUF_RING_H
+
+
+#include <pagebuf/pagebuf.h>
+#include <pagebuf/pagebuf_protected.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+/** The ring buffer.
+ *
+ * The ring buffer is an implementation of pb_buffer that stores the
+ * descriptions of its pages in chunks of PB_RING_BUFFER_CHUNK_CAPACITY
+ * adjacent descriptions, rather than as a list of individually allocated
+ * pb_page instances.  Iterating pages is mostly a walk through adjacent
+ * memory, and appending pages to the end of the buffer and seeking pages from
+ * the start of the buffer are constant time operations that don't allocate
+ * page structs.  Chunks emptied by seeking are reused for pages appended
+ * later, so the buffer cycles through its chunks like a ring.  It is well
+ * suited to queue-like use, where data is written to the end of the buffer
+ * and consumed from its start.
+ *
+ * Chunks are added as the buffer grows, and page descriptions never move
+ * between chunks as a result, so growing the buffer doesn't invalidate
+ * iterators.  Inserting data anywhere but the end of the buffer moves page
+ * descriptions, so it increments the data revision of the buffer.
+ *
+ * The ring buffer supports the same strategy options as the trivial buffer,
+ * except for headroom, which is ignored.
+ */
+struct pb_ring_buffer;
+
+
+
+/** A page of a ring buffer.
+ *
+ * The layout matches the leading members of pb_page, so that other buffer
+ * implementations may transfer data from the pages of a ring buffer as they
+ * would from the pages of a trivial buffer.
+ */
+struct pb_ring_page {
+  /** The description of the referenced pb_data memory region description. */
+  struct pb_data_vec data_vec;
+
+  /** The reference to the pb_data instance. */
+  struct pb_data *data;
+};
+
+
+
+/** The number of page descriptions that each chunk of a ring buffer holds. */
+#define PB_RING_BUFFER_CHUNK_CAPACITY                     64
+
+/** The initial number of chunks that a ring buffer has room to list. */
+#define PB_RING_BUFFER_INITIAL_CAPACITY                   16
+
+
+
+/** Factory functions for the ring buffer implementation of pb_buffer.
+ *
+ * If no strategy is supplied, the trivial buffer strategy is used.  If no
+ * allocator is supplied, the trivial heap based allocator is used.
+ */
+struct pb_buffer *pb_ring_buffer_create(void);
+struct pb_buffer *pb_ring_buffer_create_with_strategy(
+                                  const struct pb_buffer_strategy *strategy);
+struct pb_buffer *pb_ring_buffer_create_with_alloc(
+                                  const struct pb_allocator *allocator);
+struct pb_buffer *pb_ring_buffer_create_with_strategy_with_alloc(
+                                  const struct pb_buffer_strategy *strategy,
+                                  const struct pb_allocator *allocator);
+
+
+
+/** Get a ring buffer implementation of pb_buffer_operations. */
+const struct pb_buffer_operations *pb_get_ring_buffer_operations(void);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* PAGEBUF_RING_H */
@@ -0,0 +1,79 @@
+/*******************************************************************************
+ *  Copyright 2017 Nick Jones <nick.fa.jones@gmail.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ ******************************************************************************/
+
+#ifndef PAGEBUF_RING_HPP
+#define PAGEBUF_RING_HPP
+
+
+#include <pagebuf/pagebuf_ring.h>
+
+#include <pagebuf/pagebuf.hpp>
+
+
+namespace pb
+{
+
+/** C++ wrapper around the ring buffer implementation of pb_buffer */
+class ring_buffer : public buffer {
+  public:
+    ring_buffer() :
+        buffer(pb_ring_buffer_create()) {
+    }
+
+    explicit ring_buffer(const struct pb_buffer_strategy *strategy) :
+        buffer(pb_ring_buffer_create_with_strategy(strategy)) {
+    }
+
+    explicit ring_buffer(const struct pb_allocator *allocator) :
+        buffer(pb_ring_buffer_create_with_alloc(allocator)) {
+    }
+
+    ring_buffer(const struct pb_buffer_strategy *strategy,
+                const struct pb_allocator *allocator) :
+        buffer(
+          pb_ring_buffer_create_with_strategy_with_alloc(
+            strategy, allocator)) {
+    }
+
+    ring_buffer(ring_buffer&& rvalue) :
+        buffer(std::move(rvalue)) {
+    }
+
+  private:
+    ring_buffer(const ring_buffer& rvalue) :
+        buffer(static_cast<struct pb_buffer*>(0)) {
+    }
+
+  public:
+    virtual ~ring_buffer() {
+    }
+
+  public:
+    ring_buffer& operator=(ring_buffer&& rvalue) {
+      buffer::operator=(std::move(rvalue));
+
+      return *this;
+    }
+
+  private:
+    ring_buffer& operator=(const buffer& rvalue) {
+      return *this;
+    }
+};
+
+}; /* namespace pb */
+
+#endif /* PAGEBUF_RING_HPP */
@@ -0,0 +1,1042 @@
+/*******************************************************************************
+ *  Copyright 2017 Nick Jones <nick.fa.jones@gmail.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ ******************************************************************************/
+
+#include "pagebuf_uring.h"
+#include "pagebuf_protected.h"
+#include "pagebuf_io.h"
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+
+
+
+
+/*******************************************************************************
+ */
+#define PB_URING_CANCEL_USER_DATA                         0
+
+/** The number of times, and the interval in microseconds at which, destroy
+ *  polls for the completions of requests cancelled by closing the instance.
+ */
+#define PB_URING_TEARDOWN_POLL_COUNT                      1000
+#define PB_URING_TEARDOWN_POLL_INTERVAL                   1000
+
+
+
+/*******************************************************************************
+ * A request that has been queued and not yet completed.
+ */
+struct pb_uring_request {
+  struct pb_uring_request *prev;
+  struct pb_uring_request *next;
+
+  struct pb_buffer *buffer;
+
+  enum pb_uring_op op;
+
+  uint64_t user_data;
+
+  /** The region read into by a read request. */
+  void *region;
+  size_t region_len;
+  const struct pb_allocator *region_allocator;
+
+  /** The iovecs written by a write request, and the pb_data instances behind
+   *  them, which are referenced until the request completes. */
+  struct iovec iov[PB_URING_IOVEC_SIZE];
+  struct pb_data *data[PB_URING_IOVEC_SIZE];
+  size_t iovcnt;
+};
+
+
+
+/*******************************************************************************
+ */
+struct pb_uring {
+  const struct pb_allocator *allocator;
+
+  int fd;
+
+  /** The submission queue ring. */
+  void *sq_ring;
+  size_t sq_ring_len;
+  unsigned int *sq_head;
+  unsigned int *sq_tail;
+  unsigned int sq_mask;
+  unsigned int sq_entries;
+
+  struct io_uring_sqe *sqes;
+  size_t sqes_len;
+
+  /** The completion queue ring, which may share the submission queue
+   *  mapping. */
+  void *cq_ring;
+  size_t cq_ring_len;
+  unsigned int *cq_head;
+  unsigned int *cq_tail;
+  unsigned int cq_mask;
+  unsigned int cq_entries;
+  struct io_uring_cqe *cqes;
+
+  /** The number of entries added to the submission queue and not yet passed
+   *  to the kernel. */
+  unsigned int sq_pending;
+
+  /** The requests queued and not yet completed. */
+  struct pb_uring_request *requests;
+  size_t inflight;
+
+  /** The fixed buffer allocator registered with the instance, if any. */
+  const struct pb_allocator *fixed_allocator;
+};
+
+
+
+/*******************************************************************************
+ */
+static int pb_uring_setup(unsigned int entries, struct io_uring_params *p);
+static int pb_uring_enter(int fd,
+                          unsigned int to_submit, unsigned int min_complete,
+                          unsigned int flags);
+static int pb_uring_register(int fd, unsigned int opcode,
+                             const void *arg, unsigned int nr_args);
+
+
+static struct io_uring_sqe *pb_uring_get_sqe(struct pb_uring * const uring);
+static void pb_uring_queue(struct pb_uring * const uring,
+                           struct io_uring_sqe * const sqe,
+                           struct pb_uring_request * const request);
+
+static struct pb_uring_request *pb_uring_request_create(
+                                             struct pb_uring * const uring,
+                                             struct pb_buffer * const buffer,
+                                             enum pb_uring_op op,
+                                             uint64_t user_data);
+static void pb_uring_request_destroy(struct pb_uring * const uring,
+                                     struct pb_uring_request * const request);
+
+static int pb_uring_request_complete(struct pb_uring * const uring,
+                                     struct pb_uring_request * const request,
+                                     int res);
+
+static void pb_uring_reap(struct pb_uring * const uring);
+static bool pb_uring_cancel(struct pb_uring * const uring);
+
+static bool pb_uring_map(struct pb_uring * const uring,
+                         const struct io_uring_params *p);
+static void pb_uring_unmap(struct pb_uring * const uring);
+
+
+
+/*******************************************************************************
+ */
+static int pb_uring_setup(unsigned int entries, struct io_uring_params *p) {
+  return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int pb_uring_enter(int fd,
+    unsigned int to_submit, unsigned int min_complete,
+    unsigned int flags) {
+  return
+    (int)syscall(
+      __NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int pb_uring_register(int fd, unsigned int opcode,
+    const void *arg, unsigned int nr_args) {
+  return
+    (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/*******************************************************************************
+ */
+static void pb_uring_unmap(struct pb_uring * const uring) {
+  if (uring->sqes)
+    munmap(uring->sqes, uring->sqes_len);
+  if (uring->cq_ring && (uring->cq_ring != uring->sq_ring))
+    munmap(uring->cq_ring, uring->cq_ring_len);
+  if (uring->sq_ring)
+    munmap(uring->sq_ring, uring->sq_ring_len);
+}
+
+/*******************************************************************************
+ */
+static bool pb_uring_map(struct pb_uring * const uring,
+    const struct io_uring_params *p) {
+  uring->sq_ring_len =
+    p->sq_off.array + (p->sq_entries * sizeof(unsigned int));
+  uring->cq_ring_len =
+    p->cq_off.cqes + (p->cq_entries * sizeof(struct io_uring_cqe));
+  uring->sqes_len = p->sq_entries * sizeof(struct io_uring_sqe);
+
+  if (p->features & IORING_FEAT_SINGLE_MMAP) {
+    if (uring->cq_ring_len > uring->sq_ring_len)
+      uring->sq_ring_len = uring->cq_ring_len;
+    uring->cq_ring_len = uring->sq_ring_len;
+  }
+
+  uring->sq_ring =
+    mmap(
+      NULL, uring->sq_ring_len, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQ_RING);
+  if (uring->sq_ring == MAP_FAILED) {
+    uring->sq_ring = NULL;
+
+    return false;
+  }
+
+  if (p->features & IORING_FEAT_SINGLE_MMAP) {
+    uring->cq_ring = uring->sq_ring;
+  } else {
+    uring->cq_ring =
+      mmap(
+        NULL, uring->cq_ring_len, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_CQ_RING);
+    if (uring->cq_ring == MAP_FAILED) {
+      uring->cq_ring = NULL;
+
+      return false;
+    }
+  }
+
+  uring->sqes =
+    mmap(
+      NULL, uring->sqes_len, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQES);
+  if (uring->sqes == MAP_FAILED) {
+    uring->sqes = NULL;
+
+    return false;
+  }
+
+  uint8_t *sq_ring = uring->sq_ring;
+  uint8_t *cq_ring = uring->cq_ring;
+
+  uring->sq_head = (unsigned int*)(sq_ring + p->sq_off.head);
+  uring->sq_tail = (unsigned int*)(sq_ring + p->sq_off.tail);
+  uring->sq_mask = *(unsigned int*)(sq_ring + p->sq_off.ring_mask);
+  uring->sq_entries = p->sq_entries;
+
+  uring->cq_head = (unsigned int*)(cq_ring + p->cq_off.head);
+  uring->cq_tail = (unsigned int*)(cq_ring + p->cq_off.tail);
+  uring->cq_mask = *(unsigned int*)(cq_ring + p->cq_off.ring_mask);
+  uring->cq_entries = p->cq_entries;
+  uring->cqes = (struct io_uring_cqe*)(cq_ring + p->cq_off.cqes);
+
+  // each submission queue slot always refers to the entry of the same index
+  unsigned int *sq_array = (unsigned int*)(sq_ring + p->sq_off.array);
+  for (unsigned int i = 0; i < p->sq_entries; ++i)
+    sq_array[i] = i;
+
+  return true;
+}
+
+/*******************************************************************************
+ */
+struct pb_uring *pb_uring_create(unsigned int entries) {
+  return pb_uring_create_with_alloc(entries, pb_get_trivial_allocator());
+}
+
+struct pb_uring *pb_uring_create_with_alloc(unsigned int entries,
+    const struct pb_allocator *allocator) {
+  struct pb_uring *uring =
+    pb_allocator_calloc(allocator, sizeof(struct pb_uring));
+  if (!uring)
+    return NULL;
+
+  uring->allocator = allocator;
+
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+
+  uring->fd = pb_uring_setup(entries, &p);
+  if (uring->fd == -1) {
+    int temp_errno = errno;
+
+    pb_allocator_free(allocator, uring, sizeof(struct pb_uring));
+
+    errno = temp_errno;
+
+    return NULL;
+  }
+
+  if (!pb_uring_map(uring, &p)) {
+    int temp_errno = errno;
+
+    pb_uring_unmap(uring);
+
+    close(uring->fd);
+
+    pb_allocator_free(allocator, uring, sizeof(struct pb_uring));
+
+    errno = temp_errno;
+
+    return NULL;
+  }
+
+  return uring;
+}
+
+/*******************************************************************************
+ */
+int pb_uring_get_fd(const struct pb_uring *uring) {
+  return uring->fd;
+}
+
+size_t pb_uring_get_inflight(const struct pb_uring *uring) {
+  return uring->inflight;
+}
+
+/*******************************************************************************
+ * The submission queue tail is only written by this side, and the head only
+ * by the kernel.
+ */
+static struct io_uring_sqe *pb_uring_get_sqe(struct pb_uring * const uring) {
+  unsigned int tail = *uring->sq_tail;
+  unsigned int head = __atomic_load_n(uring->sq_head, __ATOMIC_ACQUIRE);
+
+  if ((tail - head) >= uring->sq_entries) {
+    errno = EBUSY;
+
+    return NULL;
+  }
+
+  struct io_uring_sqe *sqe = &uring->sqes[tail & uring->sq_mask];
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+
+  return sqe;
+}
+
+/*******************************************************************************
+ */
+static struct pb_uring_request *pb_uring_request_create(
+    struct pb_uring * const uring,
+    struct pb_buffer * const buffer,
+    enum pb_uring_op op,
+    uint64_t user_data) {
+  // keep the kernel from having to hold completions that don't fit the ring
+  if (uring->inflight >= uring->cq_entries) {
+    errno = EBUSY;
+
+    return NULL;
+  }
+
+  struct pb_uring_request *request =
+    pb_allocator_calloc(uring->allocator, sizeof(struct pb_uring_request));
+  if (!request)
+    return NULL;
+
+  request->buffer = buffer;
+  request->op = op;
+  request->user_data = user_data;
+
+  return request;
+}
+
+static void pb_uring_request_destroy(struct pb_uring * const uring,
+    struct pb_uring_request * const request) {
+  pb_allocator_free(
+    uring->allocator, request, sizeof(struct pb_uring_request));
+}
+
+/*******************************************************************************
+ * Make a prepared submission queue entry visible to the kernel, and track
+ * its request until it completes.
+ */
+static void pb_uring_queue(struct pb_uring * const uring,
+    struct io_uring_sqe * const sqe,
+    struct pb_uring_request * const request) {
+  sqe->user_data = (uint64_t)(uintptr_t)request;
+
+  request->prev = NULL;
+  request->next = uring->requests;
+  if (uring->requests)
+    uring->requests->prev = request;
+  uring->requests = request;
+
+  ++uring->inflight;
+  ++uring->sq_pending;
+
+  __atomic_store_n(uring->sq_tail, *uring->sq_tail + 1, __ATOMIC_RELEASE);
+}
+
+/*******************************************************************************
+ */
+bool pb_uring_read(struct pb_uring * const uring,
+    struct pb_buffer * const buffer,
+    int fd, size_t len, uint64_t user_data) {
+  if (buffer->strategy->rejects_write) {
+    errno = EPERM;
+
+    return false;
+  }
+
+  if (len == 0) {
+    errno = EINVAL;
+
+    return false;
+  }
+
+  // results are reported as int
+  if (len > INT_MAX)
+    len = INT_MAX;
+
+  struct io_uring_sqe *sqe = pb_uring_get_sqe(uring);
+  if (!sqe)
+    return false;
+
+  struct pb_uring_request *request =
+    pb_uring_request_create(uring, buffer, pb_uring_op_read, user_data);
+  if (!request)
+    return false;
+
+  request->region_allocator = pb_buffer_get_region_allocator(buffer);
+  request->region = pb_allocator_malloc(request->region_allocator, len);
+  if (!request->region) {
+    int temp_errno = errno;
+
+    pb_uring_request_destroy(uring, request);
+
+    errno = temp_errno;
+
+    return false;
+  }
+
+  request->region_len = len;
+
+  unsigned int index;
+  size_t offset;
+
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = fd;
+  sqe->off = (uint64_t)-1;
+  sqe->addr = (uint64_t)(uintptr_t)request->region;
+  sqe->len = (uint32_t)len;
+
+  if ((request->region_allocator == uring->fixed_allocator) &&
+      pb_uring_fixed_allocator_get_index(
+        uring->fixed_allocator, request->region, len, &index, &offset)) {
+    sqe->opcode = IORING_OP_READ_FIXED;
+    sqe->buf_index = (uint16_t)index;
+  }
+
+  pb_uring_queue(uring, sqe, request);
+
+  return true;
+}
+
+/*******************************************************************************
+ * The pages written are taken from the start of the buffer, in the same way
+ * as pb_buffer_get_iovec, and the pb_data behind each is referenced so that
+ * the memory stays valid whatever happens to the buffer pages meanwhile.
+ */
+bool pb_uring_write(struct pb_uring * const uring,
+    struct pb_buffer * const buffer,
+    int fd, size_t len, uint64_t user_data) {
+  if (buffer->strategy->rejects_seek) {
+    errno = EPERM;
+
+    return false;
+  }
+
+  if (len > INT_MAX)
+    len = INT_MAX;
+
+  struct io_uring_sqe *sqe = pb_uring_get_sqe(uring);
+  if (!sqe)
+    return false;
+
+  struct pb_uring_request *request =
+    pb_uring_request_create(uring, buffer, pb_uring_op_write, user_data);
+  if (!request)
+    return false;
+
+  struct pb_buffer_iterator buffer_iterator;
+  pb_buffer_get_iterator(buffer, &buffer_iterator);
+
+  while ((request->iovcnt < PB_URING_IOVEC_SIZE) &&
+         (len > 0) &&
+         !pb_buffer_is_end_iterator(buffer, &buffer_iterator)) {
+    size_t iov_len = pb_buffer_iterator_get_len(&buffer_iterator);
+    if (iov_len > len)
+      iov_len = len;
+
+    request->iov[request->iovcnt].iov_base =
+      pb_buffer_iterator_get_base(&buffer_iterator);
+    request->iov[request->iovcnt].iov_len = iov_len;
+
+    request->data[request->iovcnt] =
+      pb_buffer_iterator_get_data(&buffer_iterator);
+    pb_data_get(request->data[request->iovcnt]);
+
+    ++request->iovcnt;
+
+    len -= iov_len;
+
+    pb_buffer_next_iterator(buffer, &buffer_iterator);
+  }
+
+  if (request->iovcnt == 0) {
+    pb_uring_request_destroy(uring, request);
+
+    errno = EINVAL;
+
+    return false;
+  }
+
+  unsigned int index;
+  size_t offset;
+
+  sqe->fd = fd;
+  sqe->off = (uint64_t)-1;
+
+  // a single page held in the fixed buffer arena needs no iovec
+  if ((request->iovcnt == 1) &&
+      uring->fixed_allocator &&
+      pb_uring_fixed_allocator_get_index(
+        uring->fixed_allocator,
+        request->iov[0].iov_base, request->iov[0].iov_len, &index, &offset)) {
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->addr = (uint64_t)(uintptr_t)request->iov[0].iov_base;
+    sqe->len = (uint32_t)request->iov[0].iov_len;
+    sqe->buf_index = (uint16_t)index;
+  } else {
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->addr = (uint64_t)(uintptr_t)request->iov;
+    sqe->len = (uint32_t)request->iovcnt;
+  }
+
+  pb_uring_queue(uring, sqe, request);
+
+  return true;
+}
+
+/*******************************************************************************
+ */
+int pb_uring_submit(struct pb_uring * const uring, unsigned int wait_nr) {
+  unsigned int flags = (wait_nr > 0) ? IORING_ENTER_GETEVENTS : 0;
+
+  if ((uring->sq_pending == 0) && (wait_nr == 0))
+    return 0;
+
+  int result;
+
+  do {
+    result = pb_uring_enter(uring->fd, uring->sq_pending, wait_nr, flags);
+  } while ((result < 0) && (errno == EINTR));
+
+  if (result < 0)
+    return -1;
+
+  uring->sq_pending -= (unsigned int)result;
+
+  return result;
+}
+
+/*******************************************************************************
+ * Apply the result of a request to its buffer, and release the request.
+ */
+static int pb_uring_request_complete(struct pb_uring * const uring,
+    struct pb_uring_request * const request,
+    int res) {
+  if (request->op == pb_uring_op_read) {
+    if (res < 0) {
+      pb_allocator_free(
+        request->region_allocator, request->region, request->region_len);
+    } else {
+      res =
+        (int)pb_buffer_write_region(
+          request->buffer, request->region, request->region_len, (size_t)res,
+          request->region_allocator);
+    }
+  } else {
+    if (res > 0)
+      res = (int)pb_buffer_seek(request->buffer, (uint64_t)res);
+
+    for (size_t i = 0; i < request->iovcnt; ++i)
+      pb_data_put(request->data[i]);
+  }
+
+  if (request->prev)
+    request->prev->next = request->next;
+  else
+    uring->requests = request->next;
+  if (request->next)
+    request->next->prev = request->prev;
+
+  --uring->inflight;
+
+  pb_uring_request_destroy(uring, request);
+
+  return res;
+}
+
+/*******************************************************************************
+ */
+size_t pb_uring_complete(struct pb_uring * const uring,
+    struct pb_uring_completion *completions,
+    size_t max) {
+  unsigned int head = *uring->cq_head;
+  unsigned int tail = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+  size_t count = 0;
+
+  while ((head != tail) && (count < max)) {
+    struct io_uring_cqe *cqe = &uring->cqes[head & uring->cq_mask];
+
+    ++head;
+
+    if (cqe->user_data == PB_URING_CANCEL_USER_DATA)
+      continue;
+
+    struct pb_uring_request *request =
+      (struct pb_uring_request*)(uintptr_t)cqe->user_data;
+
+    completions[count].buffer = request->buffer;
+    completions[count].op = request->op;
+    completions[count].user_data = request->user_data;
+    completions[count].result =
+      pb_uring_request_complete(uring, request, cqe->res);
+
+    ++count;
+  }
+
+  __atomic_store_n(uring->cq_head, head, __ATOMIC_RELEASE);
+
+  return count;
+}
+
+/*******************************************************************************
+ * Apply all completions in the completion queue to their requests, discarding
+ * those of cancellations.
+ */
+static void pb_uring_reap(struct pb_uring * const uring) {
+  unsigned int head = *uring->cq_head;
+  unsigned int tail = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+
+  while (head != tail) {
+    struct io_uring_cqe *cqe = &uring->cqes[head & uring->cq_mask];
+
+    ++head;
+
+    if (cqe->user_data == PB_URING_CANCEL_USER_DATA)
+      continue;
+
+    pb_uring_request_complete(
+      uring,
+      (struct pb_uring_request*)(uintptr_t)cqe->user_data, cqe->res);
+  }
+
+  __atomic_store_n(uring->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/*******************************************************************************
+ * Submit a cancellation of each outstanding request, and wait for all of them
+ * to complete.  Requests that complete before they are cancelled are applied
+ * as usual.
+ *
+ * Completions aren't reaped until every cancellation is queued, as reaping
+ * releases requests.  If the submission queue fills and can't be drained, or
+ * waiting fails, false is returned with requests still in flight.
+ */
+static bool pb_uring_cancel(struct pb_uring * const uring) {
+  struct pb_uring_request *request = uring->requests;
+
+  while (request) {
+    struct io_uring_sqe *sqe = pb_uring_get_sqe(uring);
+    if (!sqe) {
+      if (pb_uring_submit(uring, 0) <= 0)
+        return false;
+
+      continue;
+    }
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = (uint64_t)(uintptr_t)request;
+    sqe->user_data = PB_URING_CANCEL_USER_DATA;
+
+    ++uring->sq_pending;
+
+    __atomic_store_n(uring->sq_tail, *uring->sq_tail + 1, __ATOMIC_RELEASE);
+
+    request = request->next;
+  }
+
+  while (uring->inflight > 0) {
+    if (pb_uring_submit(uring, 1) == -1)
+      return false;
+
+    pb_uring_reap(uring);
+  }
+
+  return true;
+}
+
+/*******************************************************************************
+ * The kernel must no longer reference the memory of any request when it is
+ * freed.  If the requests can't be cancelled and waited for through the
+ * instance, it is closed instead, which cancels whatever is still in flight
+ * as the kernel tears it down.  Completions are still posted to the mapped
+ * completion queue during teardown, so they are polled for, for a bounded
+ * time.  Requests that still haven't completed then are leaked, along with
+ * their memory regions and pb_data references, rather than risk the kernel
+ * writing to freed memory.
+ */
+void pb_uring_destroy(struct pb_uring * const uring) {
+  if (!pb_uring_cancel(uring)) {
+    close(uring->fd);
+    uring->fd = -1;
+
+    for (unsigned int i = 0;
+         (uring->inflight > 0) && (i < PB_URING_TEARDOWN_POLL_COUNT);
+         ++i) {
+      pb_uring_reap(uring);
+
+      if (uring->inflight > 0)
+        usleep(PB_URING_TEARDOWN_POLL_INTERVAL);
+    }
+  }
+
+  pb_uring_unmap(uring);
+
+  if (uring->fd != -1)
+    close(uring->fd);
+
+  pb_allocator_free(uring->allocator, uring, sizeof(struct pb_uring));
+}
+
+
+
+
+
+
+/*******************************************************************************
+ * The allocator that serves memory regions from a registered arena.
+ */
+struct pb_uring_fixed_allocator {
+  struct pb_allocator allocator;
+
+  const struct pb_allocator *fallback_allocator;
+
+  struct pb_uring *uring;
+
+  uint8_t *arena;
+  size_t region_size;
+  size_t region_count;
+
+  /** Regions freed, linked through their first bytes, and the number of
+   *  regions at the end of the arena not yet used. */
+  void *free_regions;
+  size_t unused_index;
+};
+
+
+
+/*******************************************************************************
+ */
+static bool pb_uring_fixed_allocator_owns(
+                  const struct pb_uring_fixed_allocator *fixed_allocator,
+                  const void *obj);
+
+static void *pb_uring_fixed_allocator_malloc(
+                  const struct pb_allocator *allocator, size_t size);
+static void *pb_uring_fixed_allocator_calloc(
+                  const struct pb_allocator *allocator, size_t size);
+static void *pb_uring_fixed_allocator_realloc(
+                  const struct pb_allocator *allocator,
+                  void *obj, size_t oldsize, size_t newsize);
+static void pb_uring_fixed_allocator_free(
+                  const struct pb_allocator *allocator,
+                  void *obj, size_t size);
+
+
+
+/*******************************************************************************
+ */
+static struct pb_allocator_operations pb_uring_fixed_allocator_operations = {
+  .malloc = pb_uring_fixed_allocator_malloc,
+  .calloc = pb_uring_fixed_allocator_calloc,
+  .realloc = pb_uring_fixed_allocator_realloc,
+  .free = pb_uring_fixed_allocator_free,
+};
+
+
+
+/*******************************************************************************
+ */
+static bool pb_uring_fixed_allocator_owns(
+    const struct pb_uring_fixed_allocator *fixed_allocator,
+    const void *obj) {
+  const uint8_t *addr = obj;
+
+  return
+    (addr >= fixed_allocator->arena) &&
+    (addr <
+       (fixed_allocator->arena +
+         (fixed_allocator->region_size * fixed_allocator->region_count)));
+}
+
+/*******************************************************************************
+ */
+static void *pb_uring_fixed_allocator_malloc(
+    const struct pb_allocator *allocator, size_t size) {
+  struct pb_uring_fixed_allocator *fixed_allocator =
+    (struct pb_uring_fixed_allocator*)allocator;
+
+  if ((size < PB_URING_FIXED_ALLOCATOR_THRESHOLD) ||
+      (size > fixed_allocator->region_size))
+    return pb_allocator_malloc(fixed_allocator->fallback_allocator, size);
+
+  if (fixed_allocator->free_regions) {
+    void *region = fixed_allocator->free_regions;
+    fixed_allocator->free_regions = *(void**)region;
+
+    return region;
+  }
+
+  if (fixed_allocator->unused_index < fixed_allocator->region_count)
+    return
+      fixed_allocator->arena +
+        (fixed_allocator->region_size * fixed_allocator->unused_index++);
+
+  return pb_allocator_malloc(fixed_allocator->fallback_allocator, size);
+}
+
+static void *pb_uring_fixed_allocator_calloc(
+    const struct pb_allocator *allocator, size_t size) {
+  void *obj = pb_uring_fixed_allocator_malloc(allocator, size);
+  if (!obj)
+    return NULL;
+
+  memset(obj, 0, size);
+
+  return obj;
+}
+
+static void *pb_uring_fixed_allocator_realloc(
+    const struct pb_allocator *allocator,
+    void *obj, size_t oldsize, size_t newsize) {
+  struct pb_uring_fixed_allocator *fixed_allocator =
+    (struct pb_uring_fixed_allocator*)allocator;
+
+  if (!obj)
+    return pb_uring_fixed_allocator_malloc(allocator, newsize);
+
+  bool owned = pb_uring_fixed_allocator_owns(fixed_allocator, obj);
+
+  // a region is kept for any size it can serve
+  if (owned &&
+      (newsize >= PB_URING_FIXED_ALLOCATOR_THRESHOLD) &&
+      (newsize <= fixed_allocator->region_size))
+    return obj;
+
+  if (!owned &&
+      ((newsize < PB_URING_FIXED_ALLOCATOR_THRESHOLD) ||
+       (newsize > fixed_allocator->region_size)))
+    return
+      pb_allocator_realloc(
+        fixed_allocator->fallback_allocator, obj, oldsize, newsize);
+
+  if (newsize == 0) {
+    pb_uring_fixed_allocator_free(allocator, obj, oldsize);
+
+    return NULL;
+  }
+
+  void *new_obj = pb_uring_fixed_allocator_malloc(allocator, newsize);
+  if (!new_obj)
+    return NULL;
+
+  memcpy(new_obj, obj, (oldsize < newsize) ? oldsize : newsize);
+
+  pb_uring_fixed_allocator_free(allocator, obj, oldsize);
+
+  return new_obj;
+}
+
+static void pb_uring_fixed_allocator_free(const struct pb_allocator *allocator,
+    void *obj, size_t size) {
+  struct pb_uring_fixed_allocator *fixed_allocator =
+    (struct pb_uring_fixed_allocator*)allocator;
+
+  if (!obj)
+    return;
+
+  if (!pb_uring_fixed_allocator_owns(fixed_allocator, obj)) {
+    pb_allocator_free(fixed_allocator->fallback_allocator, obj, size);
+
+    return;
+  }
+
+  *(void**)obj = fixed_allocator->free_regions;
+  fixed_allocator->free_regions = obj;
+}
+
+/*******************************************************************************
+ */
+struct pb_allocator *pb_uring_fixed_allocator_create(
+    struct pb_uring * const uring,
+    size_t region_size, size_t region_count) {
+  return
+    pb_uring_fixed_allocator_create_with_alloc(
+      uring, region_size, region_count, pb_get_trivial_allocator());
+}
+
+struct pb_allocator *pb_uring_fixed_allocator_create_with_alloc(
+    struct pb_uring * const uring,
+    size_t region_size, size_t region_count,
+    const struct pb_allocator *fallback_allocator) {
+  if (uring->fixed_allocator) {
+    errno = EBUSY;
+
+    return NULL;
+  }
+
+  if (region_size == 0)
+    region_size = PB_BUFFER_DEFAULT_PAGE_SIZE;
+
+  if ((region_count == 0) || (region_count > UINT16_MAX)) {
+    errno = EINVAL;
+
+    return NULL;
+  }
+
+  struct pb_uring_fixed_allocator *fixed_allocator =
+    pb_allocator_calloc(
+      fallback_allocator, sizeof(struct pb_uring_fixed_allocator));
+  if (!fixed_allocator)
+    return NULL;
+
+  fixed_allocator->allocator.operations =
+    &pb_uring_fixed_allocator_operations;
+
+  fixed_allocator->fallback_allocator = fallback_allocator;
+  fixed_allocator->uring = uring;
+  fixed_allocator->region_size = region_size;
+  fixed_allocator->region_count = region_count;
+
+  fixed_allocator->arena =
+    mmap(
+      NULL, region_size * region_count, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (fixed_allocator->arena == MAP_FAILED) {
+    int temp_errno = errno;
+
+    pb_allocator_free(
+      fallback_allocator, fixed_allocator,
+      sizeof(struct pb_uring_fixed_allocator));
+
+    errno = temp_errno;
+
+    return NULL;
+  }
+
+  struct iovec *iov =
+    pb_allocator_malloc(
+      fallback_allocator, region_count * sizeof(struct iovec));
+  if (iov) {
+    for (size_t i = 0; i < region_count; ++i) {
+      iov[i].iov_base = fixed_allocator->arena + (region_size * i);
+      iov[i].iov_len = region_size;
+    }
+  }
+
+  if (!iov ||
+      (pb_uring_register(
+         uring->fd, IORING_REGISTER_BUFFERS,
+         iov, (unsigned int)region_count) == -1)) {
+    int temp_errno = errno;
+
+    if (iov)
+      pb_allocator_free(
+        fallback_allocator, iov, region_count * sizeof(struct iovec));
+
+    munmap(fixed_allocator->arena, region_size * region_count);
+
+    pb_allocator_free(
+      fallback_allocator, fixed_allocator,
+      sizeof(struct pb_uring_fixed_allocator));
+
+    errno = temp_errno;
+
+    return NULL;
+  }
+
+  pb_allocator_free(
+    fallback_allocator, iov, region_count * sizeof(struct iovec));
+
+  uring->fixed_allocator = &fixed_allocator->allocator;
+
+  return &fixed_allocator->allocator;
+}
+
+/*******************************************************************************
+ */
+bool pb_uring_fixed_allocator_get_index(const struct pb_allocator *allocator,
+    const void *buf, size_t len,
+    unsigned int *index, size_t *offset) {
+  const struct pb_uring_fixed_allocator *fixed_allocator =
+    (const struct pb_uring_fixed_allocator*)allocator;
+
+  if (!pb_uring_fixed_allocator_owns(fixed_allocator, buf))
+    return false;
+
+  size_t arena_offset = (size_t)((const uint8_t*)buf - fixed_allocator->arena);
+  size_t region_offset = arena_offset % fixed_allocator->region_size;
+
+  if (len > (fixed_allocator->region_size - region_offset))
+    return false;
+
+  *index = (unsigned int)(arena_offset / fixed_allocator->region_size);
+  *offset = region_offset;
+
+  return true;
+}
+
+bool pb_uring_fixed_allocator_get_data_index(
+    const struct pb_allocator *allocator,
+    const struct pb_data *data,
+    unsigned int *index, size_t *offset) {
+  return
+    pb_uring_fixed_allocator_get_index(
+      allocator, data->data_vec.base, data->data_vec.len, index, offset);
+}
+
+/*******************************************************************************
+ */
+void pb_uring_fixed_allocator_destroy(struct pb_allocator * const allocator) {
+  struct pb_uring_fixed_allocator *fixed_allocator =
+    (struct pb_uring_fixed_allocator*)allocator;
+
+  pb_uring_register(
+    fixed_allocator->uring->fd, IORING_UNREGISTER_BUFFERS, NULL, 0);
+
+  fixed_allocator->uring->fixed_allocator = NULL;
+
+  munmap(
+    fixed_allocator->arena,
+    fixed_allocator->region_size * fixed_allocator->region_count);
+
+  pb_allocator_free(
+    fixed_allocator->fallback_allocator, fixed_allocator,
+    sizeof(struct pb_uring_fixed_allocator));
+}
@@ -0,0 +1,215 @@
+/*******************************************************************************
+ *  Copyright 2017 Nick Jones <nick.fa.jones@gmail.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ ******************************************************************************/
+
+#ifndef PAGEBUF_URING_H
+#define PAGEBUF_URING_H
+
+
+#include <pagebuf/pagebuf.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+/** The maximum number of iovecs submitted by a single write request. */
+#define PB_URING_IOVEC_SIZE                               16
+
+
+
+/** The type of an io_uring request. */
+enum pb_uring_op {
+  pb_uring_op_read =                                      1,
+  pb_uring_op_write =                                     2,
+};
+
+
+
+/** The result of a completed io_uring request.
+ *
+ * result is the number of bytes committed to the buffer by a read, or
+ * seeked from the buffer by a write, zero if a read reached end of file, or
+ * the negated errno value if the request failed.
+ */
+struct pb_uring_completion {
+  struct pb_buffer *buffer;
+
+  enum pb_uring_op op;
+
+  int result;
+
+  uint64_t user_data;
+};
+
+
+
+/** The io_uring engine.
+ *
+ * The engine drives asynchronous reads into, and writes out of, pb_buffers
+ * through a Linux io_uring instance, which is operated through the raw
+ * system calls, so that no supporting library is needed.
+ *
+ * A read request reserves a memory region for up to len bytes, from the
+ * allocator of the buffer, and the kernel reads from fd directly into it.
+ * When the request completes, the region is written to the end of the
+ * buffer as by pb_buffer_write_region, without being copied unless most of
+ * it is unused.  The mmap buffer copies written data to its backing file,
+ * so mmap buffer regions are allocated by the trivial allocator, and
+ * released once copied.
+ *
+ * A write request submits up to len bytes from the start of the buffer, by a
+ * writev whose iovecs are taken straight from the buffer pages, at most
+ * PB_URING_IOVEC_SIZE pages at a time.  The pb_data instances behind those
+ * pages are referenced until the request completes, and then the bytes
+ * accepted by fd are seeked from the buffer.
+ *
+ * The kernel never touches the buffer itself for a read: the buffer is only
+ * changed when pb_uring_complete applies the read, which is then a write to
+ * the end of the buffer like any other.  A write covers data at the start of
+ * the buffer, which the kernel reads from while the write is in flight, and
+ * which pb_uring_complete then seeks.  So a buffer may have at most one read
+ * in flight at a time, as reads may complete out of order, and at most one
+ * write, as further writes would cover the same data.  While a write is in
+ * flight the data it covers must not be removed or modified, whether by
+ * seeks, rewinds, trims or overwrites, although data may still be written to
+ * the end of the buffer, including by the completion of a read.  The buffer
+ * must not be destroyed while it has requests in flight.
+ *
+ * Reads into regions of the fixed buffer allocator registered with the
+ * engine, and writes of a single page held in one, are submitted as fixed
+ * buffer operations, see below.
+ *
+ * Requests are queued by pb_uring_read and pb_uring_write, for any number of
+ * buffers and fds, then submitted to the kernel together by a single call to
+ * pb_uring_submit.  Completed requests are applied to their buffers, and
+ * reported, by pb_uring_complete.  user_data is passed through unchanged
+ * from request to completion.
+ *
+ * Queueing a request fails with EBUSY if the submission queue is full, in
+ * which case queued requests must be submitted first.  Requests still in
+ * flight when the engine is destroyed are cancelled, and their buffers are
+ * left unchanged, unless they complete first, in which case they are applied
+ * to their buffers as usual.  If the cancellations can't be submitted, the
+ * io_uring instance is closed to cancel the requests, and any that haven't
+ * completed after about a second are leaked, along with their memory
+ * regions, rather than freed while the kernel may still use them.
+ *
+ * Factory functions return NULL with errno set if the io_uring instance can't
+ * be created, for example with ENOSYS on kernels without io_uring support.
+ * If no allocator is supplied, the trivial allocator is used.
+ */
+struct pb_uring;
+
+struct pb_uring *pb_uring_create(unsigned int entries);
+struct pb_uring *pb_uring_create_with_alloc(
+                                    unsigned int entries,
+                                    const struct pb_allocator *allocator);
+
+/** The io_uring file descriptor, for registering with an event loop. */
+int pb_uring_get_fd(const struct pb_uring *uring);
+
+/** The number of requests queued and not yet completed. */
+size_t pb_uring_get_inflight(const struct pb_uring *uring);
+
+/** Queue a read of up to len bytes from fd to the end of buffer. */
+bool pb_uring_read(struct pb_uring * const uring,
+                   struct pb_buffer * const buffer,
+                   int fd, size_t len, uint64_t user_data);
+
+/** Queue a write of up to len bytes from the start of buffer to fd. */
+bool pb_uring_write(struct pb_uring * const uring,
+                    struct pb_buffer * const buffer,
+                    int fd, size_t len, uint64_t user_data);
+
+/** Submit all queued requests, and wait for at least wait_nr completions.
+ *
+ * Returns the number of requests submitted, or -1 on error with errno set.
+ */
+int pb_uring_submit(struct pb_uring * const uring, unsigned int wait_nr);
+
+/** Apply up to max completed requests to their buffers, and report them in
+ *  completions, without blocking.
+ *
+ * Returns the number of completions reported.
+ */
+size_t pb_uring_complete(struct pb_uring * const uring,
+                         struct pb_uring_completion *completions,
+                         size_t max);
+
+void pb_uring_destroy(struct pb_uring * const uring);
+
+
+
+
+/** The io_uring fixed buffer allocator.
+ *
+ * The fixed buffer allocator carves memory regions from an arena of
+ * region_count regions of region_size bytes each, which is registered with
+ * an io_uring engine, one io_uring fixed buffer per region.  The kernel maps
+ * registered memory once, rather than pinning pages for every request, and
+ * the engine reads into and writes from regions of the arena with
+ * IORING_OP_READ_FIXED and IORING_OP_WRITE_FIXED.  If region_size is zero
+ * then PB_BUFFER_DEFAULT_PAGE_SIZE is used.
+ *
+ * Allocations of at least PB_URING_FIXED_ALLOCATOR_THRESHOLD bytes, and at
+ * most region_size bytes, are served by a whole region of the arena.  Smaller
+ * allocations, such as the pb_page and pb_data structs, larger allocations,
+ * and allocations made once the arena is exhausted, are passed to the
+ * fallback allocator.  If no fallback allocator is supplied, the trivial
+ * allocator will be used.  The trivial data factory allocates each memory
+ * region on its own, so pages of up to region_size bytes are served by the
+ * arena.  Data factories that place headers in front of memory regions in
+ * the same allocation, such as the inline data factory, need region_size to
+ * allow for the header as well as the page_size.
+ *
+ * pb_uring_fixed_allocator_get_index reports the fixed buffer index of the
+ * region holding len bytes at buf, and the offset of buf into that region,
+ * and fails if they aren't held by a single region of the arena.
+ *
+ * Only one fixed buffer allocator may be registered with an engine at a
+ * time, and it must be destroyed before the engine.  It is the
+ * responsibility of authors to ensure that all objects using the allocator
+ * are destroyed before the allocator itself.  The fixed buffer allocator is
+ * not thread safe, an instance should only be used by buffers that are
+ * operated on by a single thread.
+ *
+ * Factory functions return NULL with errno set if the arena can't be mapped
+ * or registered, for example with EBUSY if the engine already has a fixed
+ * buffer allocator.
+ */
+#define PB_URING_FIXED_ALLOCATOR_THRESHOLD                512
+
+struct pb_allocator *pb_uring_fixed_allocator_create(
+                                struct pb_uring * const uring,
+                                size_t region_size, size_t region_count);
+struct pb_allocator *pb_uring_fixed_allocator_create_with_alloc(
+                                struct pb_uring * const uring,
+                                size_t region_size, size_t region_count,
+                                const struct pb_allocator *fallback_allocator);
+
+bool pb_uring_fixed_allocator_get_index(const struct pb_allocator *allocator,
+                                        const void *buf, size_t len,
+                                        unsigned int *index, size_t *offset);
+
+void pb_uring_fixed_allocator_destroy(struct pb_allocator * const allocator);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* PAGEBUF_URING_H */
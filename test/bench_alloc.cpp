@@ -0,0 +1,239 @@
+/*******************************************************************************
+ *  Copyright 2017 Nick Jones <nick.fa.jones@gmail.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ ******************************************************************************/
+
+
+#include <sys/types.h>
+#ifndef __STDC_FORMAT_MACROS
+#define __STDC_FORMAT_MACROS
+#endif
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#include <stdio.h>
+
+#include <string>
+
+#include "pagebuf/pagebuf.h"
+#include "pagebuf/pagebuf_protected.h"
+
+
+/*******************************************************************************
+ */
+#define BENCH_ALLOC_ITERATIONS                            20000
+#define BENCH_ALLOC_WRITES                                100
+#define BENCH_ALLOC_WRITE_SIZE                            40
+
+
+
+/*******************************************************************************
+ * An allocator that counts the calls that pass through it to the trivial
+ * allocator.
+ */
+struct counting_allocator {
+  struct pb_allocator allocator;
+
+  uint64_t count;
+};
+
+static void *counting_allocator_malloc(const struct pb_allocator *allocator,
+    size_t size) {
+  ++((struct counting_allocator*)allocator)->count;
+
+  return pb_trivial_allocator_malloc(allocator, size);
+}
+
+static void *counting_allocator_calloc(const struct pb_allocator *allocator,
+    size_t size) {
+  ++((struct counting_allocator*)allocator)->count;
+
+  return pb_trivial_allocator_calloc(allocator, size);
+}
+
+static void *counting_allocator_realloc(const struct pb_allocator *allocator,
+    void *obj, size_t oldsize, size_t newsize) {
+  ++((struct counting_allocator*)allocator)->count;
+
+  return pb_trivial_allocator_realloc(allocator, obj, oldsize, newsize);
+}
+
+static void counting_allocator_free(const struct pb_allocator *allocator,
+    void *obj, size_t size) {
+  pb_trivial_allocator_free(allocator, obj, size);
+}
+
+static struct pb_allocator_operations counting_allocator_operations = {
+  counting_allocator_malloc,
+  counting_allocator_calloc,
+  counting_allocator_realloc,
+  counting_allocator_free,
+};
+
+
+
+/*******************************************************************************
+ */
+static uint64_t get_time_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+/*******************************************************************************
+ * Perform cycles of small writes followed by a seek of the written data,
+ * reporting the cost per write and returning the allocations per write.
+ */
+static double bench_write_data(
+    const std::string& description,
+    const struct pb_allocator *allocator,
+    const struct pb_data_factory *data_factory,
+    struct counting_allocator *counter) {
+  struct pb_buffer *buffer =
+    pb_trivial_buffer_create_with_data_factory_with_alloc(
+      pb_get_trivial_buffer_strategy(), data_factory, allocator);
+
+  uint8_t input[BENCH_ALLOC_WRITE_SIZE];
+  memset(input, 'a', sizeof(input));
+
+  // warm up, allowing any allocator caches to reach a steady state
+  for (size_t w = 0; w < BENCH_ALLOC_WRITES; ++w)
+    pb_buffer_write_data(buffer, input, sizeof(input));
+  pb_buffer_seek(buffer, pb_buffer_get_data_size(buffer));
+
+  counter->count = 0;
+
+  uint64_t start = get_time_ns();
+
+  for (size_t i = 0; i < BENCH_ALLOC_ITERATIONS; ++i) {
+    for (size_t w = 0; w < BENCH_ALLOC_WRITES; ++w)
+      pb_buffer_write_data(buffer, input, sizeof(input));
+
+    pb_buffer_seek(buffer, pb_buffer_get_data_size(buffer));
+  }
+
+  uint64_t elapsed = get_time_ns() - start;
+  uint64_t ops = (uint64_t)BENCH_ALLOC_ITERATIONS * BENCH_ALLOC_WRITES;
+  double allocs = (double)counter->count / ops;
+
+  printf("%s: pb_buffer_write_data(%d): %8.2f ns/op, %6.3f allocs/op\n",
+    description.c_str(), BENCH_ALLOC_WRITE_SIZE,
+    (double)elapsed / ops,
+    allocs);
+
+  pb_buffer_destroy(buffer);
+
+  return allocs;
+}
+
+/*********************************************************************************
+ * Perform cycles of creating a buffer, writing to it, then discarding it,
+ * reporting the cost per cycle.  When an arena is supplied, buffers are
+ * abandoned and the arena reset rather than destroying each buffer.
+ */
+static void bench_request(
+    const std::string& description,
+    const struct pb_allocator *allocator,
+    struct pb_allocator *arena_allocator,
+    struct counting_allocator *counter) {
+  uint8_t input[BENCH_ALLOC_WRITE_SIZE];
+  memset(input, 'a', sizeof(input));
+
+  counter->count = 0;
+
+  uint64_t start = get_time_ns();
+
+  for (size_t i = 0; i < BENCH_ALLOC_ITERATIONS; ++i) {
+    struct pb_buffer *buffer = pb_trivial_buffer_create_with_alloc(allocator);
+
+    for (size_t w = 0; w < BENCH_ALLOC_WRITES; ++w)
+      pb_buffer_write_data(buffer, input, sizeof(input));
+
+    if (arena_allocator)
+      pb_arena_allocator_reset(arena_allocator);
+    else
+      pb_buffer_destroy(buffer);
+  }
+
+  uint64_t elapsed = get_time_ns() - start;
+
+  printf("%s: request of %d writes(%d): %10.2f ns/op, %8.3f allocs/op\n",
+    description.c_str(), BENCH_ALLOC_WRITES, BENCH_ALLOC_WRITE_SIZE,
+    (double)elapsed / BENCH_ALLOC_ITERATIONS,
+    (double)counter->count / BENCH_ALLOC_ITERATIONS);
+}
+
+
+
+/*******************************************************************************
+ */
+int main(int argc, char **argv) {
+  struct counting_allocator counter;
+  counter.allocator.operations = &counting_allocator_operations;
+  counter.count = 0;
+
+  double trivial_allocs =
+    bench_write_data(
+      "trivial allocator", &counter.allocator,
+      pb_get_trivial_data_factory(), &counter);
+
+  bench_write_data(
+    "inline data      ", &counter.allocator,
+    pb_get_inline_data_factory(), &counter);
+
+  struct pb_allocator *slab_allocator =
+    pb_slab_allocator_create_with_alloc(&counter.allocator);
+
+  double slab_allocs =
+    bench_write_data(
+      "slab allocator   ", slab_allocator,
+      pb_get_trivial_data_factory(), &counter);
+
+  // page headers come from the slabs, leaving only the memory regions
+  printf("slab allocator   : %6.3f allocs/op fewer than trivial allocator\n",
+    trivial_allocs - slab_allocs);
+
+  int result = 0;
+
+  if (slab_allocs >= trivial_allocs) {
+    printf("slab allocator   : no reduction in allocs/op\n");
+
+    result = 1;
+  }
+
+  struct pb_allocator *caching_allocator =
+    pb_caching_allocator_create_with_alloc(
+      PB_BUFFER_DEFAULT_PAGE_SIZE, slab_allocator);
+
+  bench_write_data(
+    "caching allocator", caching_allocator,
+    pb_get_trivial_data_factory(), &counter);
+
+  pb_caching_allocator_destroy(caching_allocator);
+  pb_slab_allocator_destroy(slab_allocator);
+
+  bench_request(
+    "trivial allocator", &counter.allocator, NULL, &counter);
+
+  struct pb_allocator *arena_allocator =
+    pb_arena_allocator_create_with_alloc(0, &counter.allocator);
+
+  bench_request(
+    "arena allocator  ", arena_allocator, arena_allocator, &counter);
+
+  pb_arena_allocator_destroy(arena_allocator);
+
+  return result;
+}
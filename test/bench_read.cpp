@@ -0,0 +1,154 @@
+/*******************************************************************************
+ *  Copyright 2017 Nick Jones <nick.fa.jones@gmail.com>
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ ******************************************************************************/
+
+
+#include <sys/types.h>
+#ifndef __STDC_FORMAT_MACROS
+#define __STDC_FORMAT_MACROS
+#endif
+#include <inttypes.h>
+#include <string.h>
+#include <time.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "pagebuf/pagebuf.h"
+#include "pagebuf/pagebuf_ring.h"
+
+
+/*******************************************************************************
+ */
+#define BENCH_READ_PAGE_SIZE                              2097152L
+#define BENCH_READ_DATA_SIZE                              67108864L
+#define BENCH_READ_ITERATIONS                             20
+
+#define BENCH_QUEUE_ITERATIONS                            2000
+#define BENCH_QUEUE_PAGES                                 1000
+#define BENCH_QUEUE_WRITE_SIZE                            512
+
+
+
+/*******************************************************************************
+ */
+static uint64_t get_time_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+/*******************************************************************************
+ * Fill a buffer of large pages, then repeatedly read all of its data
+ * sequentially, reporting the throughput.
+ */
+static void bench_read_data(
+    const std::string& description,
+    const struct pb_allocator *allocator) {
+  struct pb_buffer_strategy strategy;
+  memset(&strategy, 0, sizeof(strategy));
+  strategy.page_size = BENCH_READ_PAGE_SIZE;
+  strategy.clone_on_write = false;
+  strategy.fragment_as_target = false;
+
+  struct pb_buffer *buffer =
+    pb_trivial_buffer_create_with_strategy_with_alloc(&strategy, allocator);
+
+  std::vector<uint8_t> input(BENCH_READ_DATA_SIZE, 'a');
+  std::vector<uint8_t> output(BENCH_READ_DATA_SIZE);
+
+  pb_buffer_write_data(buffer, &input[0], input.size());
+
+  // warm up, faulting in the pages of both the buffer and the output
+  pb_buffer_read_data(buffer, &output[0], output.size());
+
+  uint64_t start = get_time_ns();
+
+  for (size_t i = 0; i < BENCH_READ_ITERATIONS; ++i)
+    pb_buffer_read_data(buffer, &output[0], output.size());
+
+  uint64_t elapsed = get_time_ns() - start;
+  uint64_t bytes = (uint64_t)BENCH_READ_ITERATIONS * BENCH_READ_DATA_SIZE;
+
+  printf("%s: pb_buffer_read_data(%ld): %8.2f MiB/s\n",
+    description.c_str(), BENCH_READ_DATA_SIZE,
+    ((double)bytes / (1024 * 1024)) / ((double)elapsed / 1000000000));
+
+  pb_buffer_destroy(buffer);
+}
+
+
+
+/*******************************************************************************
+ * Use a buffer as a queue: append a batch of pages, iterate over them, then
+ * consume them from the head, reporting the cost per page.
+ */
+static void bench_queue(
+    const std::string& description,
+    struct pb_buffer *buffer) {
+  uint8_t input[BENCH_QUEUE_WRITE_SIZE];
+  memset(input, 'a', sizeof(input));
+
+  uint64_t checksum = 0;
+
+  uint64_t start = get_time_ns();
+
+  for (size_t i = 0; i < BENCH_QUEUE_ITERATIONS; ++i) {
+    for (size_t p = 0; p < BENCH_QUEUE_PAGES; ++p)
+      pb_buffer_write_data_ref(buffer, input, sizeof(input));
+
+    struct pb_buffer_iterator buffer_iterator;
+    pb_buffer_get_iterator(buffer, &buffer_iterator);
+
+    while (!pb_buffer_is_end_iterator(buffer, &buffer_iterator)) {
+      checksum += pb_buffer_iterator_get_len(&buffer_iterator);
+
+      pb_buffer_next_iterator(buffer, &buffer_iterator);
+    }
+
+    for (size_t p = 0; p < BENCH_QUEUE_PAGES; ++p)
+      pb_buffer_seek(buffer, sizeof(input));
+  }
+
+  uint64_t elapsed = get_time_ns() - start;
+  uint64_t ops = (uint64_t)BENCH_QUEUE_ITERATIONS * BENCH_QUEUE_PAGES;
+
+  printf("%s: queue of %d pages(%d): %8.2f ns/page (%" PRIu64 ")\n",
+    description.c_str(), BENCH_QUEUE_PAGES, BENCH_QUEUE_WRITE_SIZE,
+    (double)elapsed / ops, checksum / ops);
+
+  pb_buffer_destroy(buffer);
+}
+
+
+
+/*******************************************************************************
+ */
+int main(int argc, char **argv) {
+  bench_read_data("trivial allocator  ", pb_get_trivial_allocator());
+
+  struct pb_allocator *hugepage_allocator = pb_hugepage_allocator_create(0);
+
+  bench_read_data("huge page allocator", hugepage_allocator);
+
+  pb_hugepage_allocator_destroy(hugepage_allocator);
+
+  bench_queue("trivial buffer     ", pb_trivial_buffer_create());
+  bench_queue("ring buffer        ", pb_ring_buffer_create());
+
+  return 0;
+}
@@ -21,18 +21,26 @@
 
 
 #include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 #ifndef __STDC_FORMAT_MACROS
 #define __STDC_FORMAT_MACROS
 #endif
 #include <inttypes.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
 #include <string.h>
+#include <stdlib.h>
 
 #include <string>
 #include <list>
+#include <set>
 
 #include "pagebuf/pagebuf.hpp"
 #include "pagebuf/pagebuf_mmap.hpp"
+#include "pagebuf/pagebuf_ring.hpp"
 
 #include <stdio.h>
 
@@ -56,6 +64,80 @@
 
 
 
+/*******************************************************************************
+ * An allocator that counts its live allocations, and that can be set to fail
+ * all allocations other than those of a given size.
+ */
+struct failing_allocator {
+  struct pb_allocator allocator;
+
+  size_t allowed_size;
+  bool failing;
+
+  int64_t live_count;
+};
+
+static void *failing_allocator_malloc(const struct pb_allocator *allocator,
+    size_t size) {
+  struct failing_allocator *failing = (struct failing_allocator*)allocator;
+
+  if (failing->failing && (size != failing->allowed_size))
+    return NULL;
+
+  ++failing->live_count;
+
+  return malloc(size);
+}
+
+static void *failing_allocator_calloc(const struct pb_allocator *allocator,
+    size_t size) {
+  void *obj = failing_allocator_malloc(allocator, size);
+  if (obj)
+    memset(obj, 0, size);
+
+  return obj;
+}
+
+static void *failing_allocator_realloc(const struct pb_allocator *allocator,
+    void *obj, size_t oldsize, size_t newsize) {
+  struct failing_allocator *failing = (struct failing_allocator*)allocator;
+
+  if (failing->failing && (newsize != failing->allowed_size))
+    return NULL;
+
+  if (!obj)
+    ++failing->live_count;
+  else if (newsize == 0)
+    --failing->live_count;
+
+  (void)oldsize;
+
+  return realloc(obj, newsize);
+}
+
+static void failing_allocator_free(const struct pb_allocator *allocator,
+    void *obj, size_t size) {
+  struct failing_allocator *failing = (struct failing_allocator*)allocator;
+
+  if (!obj)
+    return;
+
+  --failing->live_count;
+
+  (void)size;
+
+  free(obj);
+}
+
+static const struct pb_allocator_operations failing_allocator_operations = {
+  failing_allocator_malloc,
+  failing_allocator_calloc,
+  failing_allocator_realloc,
+  failing_allocator_free,
+};
+
+
+
 /*******************************************************************************
  */
 class test_subject {
@@ -92,6 +174,16 @@ class test_subject {
 class test_base {
   public:
     static int final_result;
+
+  protected:
+    static size_t count_pages(const pb::buffer& buffer) {
+      size_t pages = 0;
+
+      for (pb::buffer::iterator itr = buffer.begin(); itr != buffer.end(); ++itr)
+        ++pages;
+
+      return pages;
+    }
 };
 
 int test_base::final_result = 0;
@@ -566,6 +658,59 @@ const char *test_case_overwrite2::output = "abcdefghijklmnopqrstuvwxyz";
 
 
 
+/*******************************************************************************
+ */
+class test_case_overwrite3 : public test_case<test_case_overwrite3> {
+  private:
+    static const char *input1;
+    static const char *input2;
+    static const char *output;
+
+  public:
+    virtual int run_test(const test_subject& subject) {
+      subject.buffer->clear();
+
+      TEST_OPS_EVAL(subject.buffer->get_data_size() != 0)
+        return 1;
+
+      if (subject.buffer->get_strategy().rejects_overwrite)
+        return 0;
+
+      TEST_OPS_EVAL(subject.buffer->write(
+            input1, strlen(input1)) != strlen(input1))
+        return 1;
+
+      const void *base = subject.buffer->begin()->base;
+
+      TEST_OPS_EVAL(subject.buffer->overwrite(
+            input2, strlen(input2)) != strlen(input2))
+        return 1;
+
+      // a clone_on_write page whose data is referenced by nothing but the
+      // page itself must be overwritten in place
+      TEST_OPS_EVAL(subject.buffer->get_strategy().clone_on_write &&
+                    (subject.buffer->begin()->base != base))
+        return 1;
+
+      pb::buffer::byte_iterator byte_itr = subject.buffer->byte_begin();
+
+      for (unsigned int i = 0; i < strlen(output); ++i) {
+        TEST_OPS_EVAL(*byte_itr != output[i])
+          return 1;
+
+        ++byte_itr;
+      }
+
+      return 0;
+    }
+};
+
+const char *test_case_overwrite3::input1 = "----efghijklmnopqrstuvwxyz";
+const char *test_case_overwrite3::input2 = "abcd";
+const char *test_case_overwrite3::output = "abcdefghijklmnopqrstuvwxyz";
+
+
+
 /*******************************************************************************
  */
 class test_case_rewind1 : public test_case<test_case_rewind1> {
@@ -917,6 +1062,139 @@ const char *test_case_extend1::output = "abcdefghijklmnopqrstuvwxyz";
 
 
 
+/*******************************************************************************
+ */
+class test_case_extend2 : public test_case<test_case_extend2> {
+  public:
+    virtual int run_test(const test_subject& subject) {
+      subject.buffer->clear();
+
+      TEST_OPS_EVAL(subject.buffer->get_data_size() != 0)
+        return 1;
+
+      if (subject.buffer->get_strategy().rejects_extend)
+        return 0;
+
+      // an extension spanning many pages
+      size_t page_size = subject.buffer->get_strategy().page_size;
+      size_t len = (10 * ((page_size != 0) ? page_size : 4096)) + 100;
+
+      TEST_OPS_EVAL(subject.buffer->extend(len) != len)
+        return 1;
+
+      TEST_OPS_EVAL(subject.buffer->get_data_size() != len)
+        return 1;
+
+      if ((page_size != 0) &&
+          !dynamic_cast<pb::mmap_buffer*>(subject.buffer)) {
+        TEST_OPS_EVAL(count_pages(*subject.buffer) != 11)
+          return 1;
+      }
+
+      std::string input(len, '\0');
+
+      for (size_t i = 0; i < len; ++i)
+        input[i] = (char)(i % 251);
+
+      TEST_OPS_EVAL(subject.buffer->overwrite(input.data(), len) != len)
+        return 1;
+
+      if (!subject.buffer->get_strategy().rejects_seek) {
+        TEST_OPS_EVAL(subject.buffer->seek(len / 3) != (len / 3))
+          return 1;
+
+        input.erase(0, len / 3);
+      }
+
+      TEST_OPS_EVAL(subject.buffer->extend(50) != 50)
+        return 1;
+
+      std::string output(input.size(), '\0');
+
+      TEST_OPS_EVAL(subject.buffer->read(&output[0], output.size()) !=
+                      output.size())
+        return 1;
+
+      TEST_OPS_EVAL(output != input)
+        return 1;
+
+      TEST_OPS_EVAL(subject.buffer->get_data_size() != (input.size() + 50))
+        return 1;
+
+      subject.buffer->clear();
+
+      return 0;
+    }
+};
+
+
+
+/*******************************************************************************
+ */
+class test_case_extend3 : public test_case<test_case_extend3> {
+  public:
+    virtual int run_test(const test_subject& subject) {
+      subject.buffer->clear();
+
+      TEST_OPS_EVAL(subject.buffer->get_data_size() != 0)
+        return 1;
+
+      if (subject.buffer->get_strategy().rejects_extend ||
+          subject.buffer->get_strategy().rejects_overwrite)
+        return 0;
+
+      size_t page_size = subject.buffer->get_strategy().page_size;
+      size_t len = 3 * ((page_size != 0) ? page_size : 4096);
+
+      TEST_OPS_EVAL(subject.buffer->extend(len) != len)
+        return 1;
+
+      std::list<const void*> bases;
+
+      for (pb::buffer::iterator itr = subject.buffer->begin();
+           itr != subject.buffer->end();
+           ++itr)
+        bases.push_back(itr->base);
+
+      std::string input(len, '\0');
+
+      for (size_t i = 0; i < len; ++i)
+        input[i] = (char)(i % 251);
+
+      TEST_OPS_EVAL(subject.buffer->overwrite(input.data(), len) != len)
+        return 1;
+
+      // freshly extended clone_on_write pages referenced by nothing but
+      // themselves must be overwritten in place
+      if (subject.buffer->get_strategy().clone_on_write) {
+        std::list<const void*>::const_iterator base_itr = bases.begin();
+
+        for (pb::buffer::iterator itr = subject.buffer->begin();
+             itr != subject.buffer->end();
+             ++itr) {
+          TEST_OPS_EVAL((base_itr == bases.end()) || (itr->base != *base_itr))
+            return 1;
+
+          ++base_itr;
+        }
+      }
+
+      std::string output(len, '\0');
+
+      TEST_OPS_EVAL(subject.buffer->read(&output[0], len) != len)
+        return 1;
+
+      TEST_OPS_EVAL(output != input)
+        return 1;
+
+      subject.buffer->clear();
+
+      return 0;
+    }
+};
+
+
+
 /*******************************************************************************
  */
 class test_case_reserve1 : public test_case<test_case_reserve1> {
@@ -956,98 +1234,1956 @@ class test_case_reserve1 : public test_case<test_case_reserve1> {
 
 /*******************************************************************************
  */
-int main(int argc, char **argv) {
-  std::list<test_subject> test_subjects;
+class test_case_write_mem1 : public test_case<test_case_write_mem1> {
+  private:
+    static void release(void *buf, uint64_t len, void *context) {
+      delete[] static_cast<char*>(buf);
 
-  struct pb_buffer_strategy strategy;
-  memset(&strategy, 0, sizeof(strategy));
+      ++*static_cast<int*>(context);
+    }
 
-  strategy.page_size = PB_BUFFER_DEFAULT_PAGE_SIZE;
-  strategy.clone_on_write = false;
-  strategy.fragment_as_target = false;
+  public:
+    virtual int run_test(const test_subject& subject) {
+      subject.buffer->clear();
 
-  test_subjects.push_back(test_subject());
-  test_subjects.back().init(
-    "Standard heap sourced pb_buffer                                       ",
-    new pb::buffer(&strategy));
+      TEST_OPS_EVAL(subject.buffer->get_data_size() != 0)
+        return 1;
 
-  strategy.page_size = PB_BUFFER_DEFAULT_PAGE_SIZE;
-  strategy.clone_on_write = false;
-  strategy.fragment_as_target = true;
+      if (subject.buffer->get_strategy().rejects_write)
+        return 0;
 
-  test_subjects.push_back(test_subject());
-  test_subjects.back().init(
-    "Standard heap sourced pb_buffer, fragment_as_target                   ",
-    new pb::buffer(&strategy));
+      std::string input(10000, 'm');
+      char *mem = new char[input.size()];
+      memcpy(mem, input.data(), input.size());
 
-  strategy.page_size = PB_BUFFER_DEFAULT_PAGE_SIZE;
-  strategy.clone_on_write = true;
-  strategy.fragment_as_target = false;
+      int released = 0;
 
-  test_subjects.push_back(test_subject());
-  test_subjects.back().init(
-    "Standard heap sourced pb_buffer, clone_on_Write                       ",
-    new pb::buffer(&strategy));
+      TEST_OPS_EVAL(
+          subject.buffer->write_mem(
+            mem, input.size(), &release, &released) != input.size())
+        return 1;
 
-  strategy.page_size = PB_BUFFER_DEFAULT_PAGE_SIZE;
-  strategy.clone_on_write = true;
-  strategy.fragment_as_target = true;
+      TEST_OPS_EVAL(subject.buffer->get_data_size() != input.size())
+        return 1;
 
-  test_subjects.push_back(test_subject());
-  test_subjects.back().init(
-    "Standard heap sourced pb_buffer, clone_on_Write and fragment_on_target",
-    new pb::buffer(&strategy));
+      std::string output(input.size(), '\0');
 
-  char buffer_file_path[34];
-  sprintf(buffer_file_path, "/tmp/pb_test_ops_buffer-%05d", getpid());
+      TEST_OPS_EVAL(subject.buffer->read(&output[0], output.size()) !=
+                      output.size())
+        return 1;
 
-  pb::mmap_buffer *mmap_buffer =
-    new pb::mmap_buffer(
-      buffer_file_path,
-      pb::mmap_buffer::open_action_overwrite,
-      pb::mmap_buffer::close_action_retain);
-  TEST_OPS_EVAL_DESCRIPTION(
-      (mmap_buffer->get_file_path() != buffer_file_path),
-      "mmap_buffer test get_file_path")
-    return 1;
-  TEST_OPS_EVAL_DESCRIPTION(
-      (mmap_buffer->get_fd() == 0),
-      "mmap_buffer test get_fd")
-    return 1;
-  TEST_OPS_EVAL_DESCRIPTION(
-      (mmap_buffer->get_close_action() != pb::mmap_buffer::close_action_retain),
-      "mmap_buffer test get_close_action")
-    return 1;
+      TEST_OPS_EVAL(output != input)
+        return 1;
 
-  mmap_buffer->set_close_action(pb::mmap_buffer::close_action_remove);
+      // share the data with a second buffer, which outlives the first
+      pb::buffer shared_buffer;
 
-  TEST_OPS_EVAL_DESCRIPTION(
-      (mmap_buffer->get_close_action() != pb::mmap_buffer::close_action_remove),
-      "mmap_buffer test set_close_action")
-    return 1;
+      TEST_OPS_EVAL(
+          shared_buffer.write(*subject.buffer, input.size()) != input.size())
+        return 1;
 
-  test_subjects.push_back(test_subject());
-  test_subjects.back().init(
-    "mmap file backed pb_buffer                                            ",
-    mmap_buffer);
+      subject.buffer->clear();
 
-  test_case<test_case_iterate1>::run_test(test_subjects);
-  test_case<test_case_iterate2>::run_test(test_subjects);
-  test_case<test_case_iterate3>::run_test(test_subjects);
-  test_case<test_case_insert1>::run_test(test_subjects);
-  test_case<test_case_insert2>::run_test(test_subjects);
-  test_case<test_case_insert3>::run_test(test_subjects);
-  test_case<test_case_overwrite1>::run_test(test_subjects);
-  test_case<test_case_overwrite2>::run_test(test_subjects);
-  test_case<test_case_rewind1>::run_test(test_subjects);
-  test_case<test_case_rewind2>::run_test(test_subjects);
-  test_case<test_case_trim1>::run_test(test_subjects);
-  //test_case<test_case_trim2>::run_test(test_subjects);
-  test_case<test_case_trim3>::run_test(test_subjects);
-  test_case<test_case_extend1>::run_test(test_subjects);
-  test_case<test_case_reserve1>::run_test(test_subjects);
+      // the memory region is still referenced by the second buffer, unless
+      // the subject copied it, as the mmap buffer does, and released it at once
+      bool copies = (dynamic_cast<pb::mmap_buffer*>(subject.buffer) != 0);
 
-  test_subjects.clear();
+      TEST_OPS_EVAL(released != (copies ? 1 : 0))
+        return 1;
+
+      shared_buffer.clear();
+
+      TEST_OPS_EVAL(released != 1)
+        return 1;
+
+      return 0;
+    }
+};
+
+
+
+/*******************************************************************************
+ */
+class test_case_write_tail1 : public test_case<test_case_write_tail1> {
+  public:
+    virtual int run_test(const test_subject& subject) {
+      subject.buffer->clear();
+
+      TEST_OPS_EVAL(subject.buffer->get_data_size() != 0)
+        return 1;
+
+      if (subject.buffer->get_strategy().rejects_write)
+        return 0;
+
+      std::string input(40, 't');
+
+      for (size_t i = 0; i < 10; ++i) {
+        TEST_OPS_EVAL(
+            subject.buffer->write(input.data(), input.size()) != input.size())
+          return 1;
+      }
+
+      TEST_OPS_EVAL(subject.buffer->get_data_size() != (10 * input.size()))
+        return 1;
+
+      // share the tail page, which must then no longer be appended to
+      pb::buffer shared_buffer;
+
+      TEST_OPS_EVAL(
+          shared_buffer.write(*subject.buffer, 10 * input.size()) !=
+            (10 * input.size()))
+        return 1;
+
+      std::string append(40, 'u');
+
+      TEST_OPS_EVAL(
+          subject.buffer->write(append.data(), append.size()) != append.size())
+        return 1;
+
+      std::string shared_append(40, 'v');
+
+      TEST_OPS_EVAL(
+          shared_buffer.write(shared_append.data(), shared_append.size()) !=
+            shared_append.size())
+        return 1;
+
+      std::string output(11 * input.size(), '\0');
+
+      TEST_OPS_EVAL(subject.buffer->read(&output[0], output.size()) !=
+                      output.size())
+        return 1;
+
+      TEST_OPS_EVAL(output != (std::string(10 * input.size(), 't') + append))
+        return 1;
+
+      TEST_OPS_EVAL(shared_buffer.read(&output[0], output.size()) !=
+                      output.size())
+        return 1;
+
+      TEST_OPS_EVAL(
+          output != (std::string(10 * input.size(), 't') + shared_append))
+        return 1;
+
+      // an unshared tail page accumulates small writes
+      shared_buffer.clear();
+      shared_buffer.write(input.data(), input.size());
+      shared_buffer.write(input.data(), input.size());
+
+      TEST_OPS_EVAL(count_pages(shared_buffer) != 1)
+        return 1;
+
+      return 0;
+    }
+};
+
+
+
+/*******************************************************************************
+ */
+class test_case_iterator_at1 : public test_case<test_case_iterator_at1> {
+  private:
+    static const char *head_input;
+
+    static bool check_offsets(
+        const pb::buffer& buffer, const std::string& expected) {
+      for (uint64_t offset = 0; offset < expected.size(); offset += 331) {
+        size_t page_offset = 0;
+        pb::buffer::iterator itr = buffer.iterator_at(offset, page_offset);
+
+        if ((itr == buffer.end()) ||
+            (page_offset >= itr->len) ||
+            (itr->base[page_offset] != (uint8_t)expected[offset]))
+          return false;
+      }
+
+      size_t page_offset = 0;
+      pb::buffer::iterator itr =
+        buffer.iterator_at(expected.size(), page_offset);
+
+      return ((itr == buffer.end()) && (page_offset == 0));
+    }
+
+    static void write_pattern(
+        pb::buffer& buffer, std::string& expected, size_t len) {
+      std::string input(len, '\0');
+
+      for (size_t i = 0; i < len; ++i)
+        input[i] = (char)((expected.size() + i) % 251);
+
+      expected.append(input.substr(0, buffer.write(input.data(), len)));
+    }
+
+  public:
+    virtual int run_test(const test_subject& subject) {
+      subject.buffer->clear();
+
+      TEST_OPS_EVAL(subject.buffer->get_data_size() != 0)
+        return 1;
+
+      if (subject.buffer->get_strategy().rejects_write)
+        return 0;
+
+      std::string expected;
+
+      for (size_t i = 0; i < 40; ++i)
+        write_pattern(*subject.buffer, expected, 1000);
+
+      // the first lookup builds the index, which later lookups must find
+      // updated rather than rebuilt
+      TEST_OPS_EVAL(!check_offsets(*subject.buffer, expected))
+        return 1;
+
+      if (!subject.buffer->get_strategy().rejects_trim) {
+        TEST_OPS_EVAL(subject.buffer->trim(3000) != 3000)
+          return 1;
+
+        expected.resize(expected.size() - 3000);
+
+        TEST_OPS_EVAL(!check_offsets(*subject.buffer, expected))
+          return 1;
+      }
+
+      if (!subject.buffer->get_strategy().rejects_seek) {
+        TEST_OPS_EVAL(subject.buffer->seek(5000) != 5000)
+          return 1;
+
+        expected.erase(0, 5000);
+
+        TEST_OPS_EVAL(!check_offsets(*subject.buffer, expected))
+          return 1;
+      }
+
+      if (!subject.buffer->get_strategy().rejects_insert) {
+        std::string input("inserted");
+
+        size_t page_offset = 0;
+        pb::buffer::iterator itr =
+          subject.buffer->iterator_at(10000, page_offset);
+
+        TEST_OPS_EVAL(
+            subject.buffer->insert(
+              itr, page_offset, input.data(), input.size()) != input.size())
+          return 1;
+
+        expected.insert(10000, input);
+
+        TEST_OPS_EVAL(!check_offsets(*subject.buffer, expected))
+          return 1;
+
+        itr = subject.buffer->iterator_at(0, page_offset);
+
+        TEST_OPS_EVAL(
+            subject.buffer->insert_ref(
+              itr, page_offset, head_input, strlen(head_input)) !=
+                strlen(head_input))
+          return 1;
+
+        expected.insert(0, head_input);
+
+        TEST_OPS_EVAL(!check_offsets(*subject.buffer, expected))
+          return 1;
+
+        // repeated prepends make room at the front of the index
+        for (size_t i = 0; i < 100; ++i) {
+          itr = subject.buffer->iterator_at(0, page_offset);
+
+          TEST_OPS_EVAL(
+              subject.buffer->insert_ref(
+                itr, page_offset, head_input, strlen(head_input)) !=
+                  strlen(head_input))
+            return 1;
+
+          expected.insert(0, head_input);
+        }
+
+        TEST_OPS_EVAL(!check_offsets(*subject.buffer, expected))
+          return 1;
+      }
+
+      write_pattern(*subject.buffer, expected, 5000);
+
+      TEST_OPS_EVAL(!check_offsets(*subject.buffer, expected))
+        return 1;
+
+      return 0;
+    }
+};
+
+const char *test_case_iterator_at1::head_input = "head";
+
+
+
+/*******************************************************************************
+ */
+class test_case_headroom1 : public test_case<test_case_headroom1> {
+  public:
+    virtual int run_test(const test_subject& subject) {
+      subject.buffer->clear();
+
+      TEST_OPS_EVAL(subject.buffer->get_data_size() != 0)
+        return 1;
+
+      if (subject.buffer->get_strategy().headroom < 64)
+        return 0;
+
+      std::string input(40, 'b');
+
+      TEST_OPS_EVAL(
+          subject.buffer->write(input.data(), input.size()) != input.size())
+        return 1;
+
+      // rewind into the headroom
+      size_t rewind_len = 16;
+
+      TEST_OPS_EVAL(subject.buffer->rewind(rewind_len) != rewind_len)
+        return 1;
+
+      TEST_OPS_EVAL(count_pages(*subject.buffer) != 1)
+        return 1;
+
+      // insert at the head into the remaining headroom
+      std::string header(32, 'h');
+
+      TEST_OPS_EVAL(
+          subject.buffer->insert(
+            subject.buffer->begin(), 0, header.data(), header.size()) !=
+              header.size())
+        return 1;
+
+      TEST_OPS_EVAL(count_pages(*subject.buffer) != 1)
+        return 1;
+
+      std::string output(header.size() + rewind_len + input.size(), '\0');
+
+      TEST_OPS_EVAL(subject.buffer->read(&output[0], output.size()) !=
+                      output.size())
+        return 1;
+
+      TEST_OPS_EVAL(output.substr(0, header.size()) != header)
+        return 1;
+
+      TEST_OPS_EVAL(output.substr(header.size() + rewind_len) != input)
+        return 1;
+
+      // an insert larger than the remaining headroom uses a new page
+      std::string large(subject.buffer->get_strategy().headroom, 'l');
+
+      TEST_OPS_EVAL(
+          subject.buffer->insert(
+            subject.buffer->begin(), 0, large.data(), large.size()) !=
+              large.size())
+        return 1;
+
+      TEST_OPS_EVAL(count_pages(*subject.buffer) != 2)
+        return 1;
+
+      output.resize(large.size() + header.size());
+
+      TEST_OPS_EVAL(subject.buffer->read(&output[0], output.size()) !=
+                      output.size())
+        return 1;
+
+      TEST_OPS_EVAL(output != (large + header))
+        return 1;
+
+      return 0;
+    }
+};
+
+
+
+/*******************************************************************************
+ */
+class test_case_compact1 : public test_case<test_case_compact1> {
+  public:
+    virtual int run_test(const test_subject& subject) {
+      subject.buffer->clear();
+
+      TEST_OPS_EVAL(subject.buffer->get_data_size() != 0)
+        return 1;
+
+      if (subject.buffer->get_strategy().rejects_write)
+        return 0;
+
+      // referenced writes produce a page per write
+      std::string input;
+
+      for (size_t i = 0; i < 2000; ++i)
+        input.push_back((char)(i % 251));
+
+      for (size_t i = 0; i < 100; ++i) {
+        TEST_OPS_EVAL(subject.buffer->write_ref(&input[i * 20], 20) != 20)
+          return 1;
+      }
+
+      size_t pages = count_pages(*subject.buffer);
+
+      uint64_t removed = subject.buffer->compact();
+
+      TEST_OPS_EVAL((pages - removed) != count_pages(*subject.buffer))
+        return 1;
+
+      if (!dynamic_cast<pb::mmap_buffer*>(subject.buffer) &&
+          (subject.buffer->get_strategy().page_size >= 40)) {
+        TEST_OPS_EVAL((pages > 1) && (removed == 0))
+          return 1;
+      }
+
+      // nothing further to compact, and the data revision is unchanged
+      uint64_t revision = subject.buffer->get_data_revision();
+
+      TEST_OPS_EVAL(subject.buffer->compact() != 0)
+        return 1;
+
+      TEST_OPS_EVAL(subject.buffer->get_data_revision() != revision)
+        return 1;
+
+      std::string output(input.size(), '\0');
+
+      TEST_OPS_EVAL(subject.buffer->read(&output[0], output.size()) !=
+                      output.size())
+        return 1;
+
+      TEST_OPS_EVAL(output != input)
+        return 1;
+
+      subject.buffer->clear();
+
+      return 0;
+    }
+};
+
+
+
+/*******************************************************************************
+ */
+class test_case_iovec1 : public test_case<test_case_iovec1> {
+  private:
+    static std::string join(const struct iovec *iov, size_t iovcnt) {
+      std::string output;
+
+      for (size_t i = 0; i < iovcnt; ++i)
+        output.append((const char*)iov[i].iov_base, iov[i].iov_len);
+
+      return output;
+    }
+
+  public:
+    virtual int run_test(const test_subject& subject) {
+      subject.buffer->clear();
+
+      TEST_OPS_EVAL(subject.buffer->get_data_size() != 0)
+        return 1;
+
+      if (subject.buffer->get_strategy().rejects_write)
+        return 0;
+
+      std::string input;
+
+      for (size_t i = 0; i < 2000; ++i)
+        input.push_back((char)(i % 251));
+
+      for (size_t i = 0; i < 100; ++i) {
+        TEST_OPS_EVAL(subject.buffer->write_ref(&input[i * 20], 20) != 20)
+          return 1;
+      }
+
+      struct iovec iov[256];
+
+      size_t iovcnt = subject.buffer->get_iovec(30, 1500, iov, 256);
+
+      TEST_OPS_EVAL(join(iov, iovcnt) != input.substr(30, 1500))
+        return 1;
+
+      // a short array describes a prefix of the range
+      iovcnt = subject.buffer->get_iovec(30, 1500, iov, 3);
+
+      TEST_OPS_EVAL(
+          (iovcnt > 3) ||
+          (join(iov, iovcnt) != input.substr(30, join(iov, iovcnt).size())))
+        return 1;
+
+      TEST_OPS_EVAL(subject.buffer->get_iovec(input.size(), 10, iov, 256) != 0)
+        return 1;
+
+      // a cursor resumes from where the previous step finished
+      struct pb_buffer_iovec_cursor iovec_cursor;
+      subject.buffer->iovec_cursor_init(&iovec_cursor, 10, input.size());
+
+      std::string output;
+
+      while ((iovcnt = subject.buffer->iovec_cursor_next(
+                         &iovec_cursor, iov, 7)) > 0)
+        output.append(join(iov, iovcnt));
+
+      TEST_OPS_EVAL(output != input.substr(10))
+        return 1;
+
+      subject.buffer->clear();
+
+      return 0;
+    }
+};
+
+
+
+/*******************************************************************************
+ */
+class test_case_fd1 : public test_case<test_case_fd1> {
+  public:
+    virtual int run_test(const test_subject& subject) {
+      subject.buffer->clear();
+
+      TEST_OPS_EVAL(subject.buffer->get_data_size() != 0)
+        return 1;
+
+      if (subject.buffer->get_strategy().rejects_write ||
+          subject.buffer->get_strategy().rejects_seek)
+        return 0;
+
+      int fds[2];
+
+      TEST_OPS_EVAL(pipe(fds) != 0)
+        return 1;
+
+      fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+
+      // an empty non blocking fd leaves the buffer unchanged
+      TEST_OPS_EVAL(
+          (subject.buffer->read_fd(fds[0], 1024) != -1) ||
+          ((errno != EAGAIN) && (errno != EWOULDBLOCK)) ||
+          (subject.buffer->get_data_size() != 0))
+        return 1;
+
+      std::string input;
+
+      for (size_t i = 0; i < 10000; ++i)
+        input.push_back((char)(i % 251));
+
+      TEST_OPS_EVAL(
+          write(fds[1], input.data(), input.size()) != (ssize_t)input.size())
+        return 1;
+
+      ssize_t result;
+
+      while ((result = subject.buffer->read_fd(fds[0], 3000)) > 0);
+
+      TEST_OPS_EVAL(
+          (result != -1) ||
+          (subject.buffer->get_data_size() != input.size()))
+        return 1;
+
+      // write the buffer back through the pipe, in two parts
+      std::string output(input.size(), '\0');
+
+      TEST_OPS_EVAL(subject.buffer->write_fd(fds[1], 4000) != 4000)
+        return 1;
+
+      TEST_OPS_EVAL(
+          (subject.buffer->write_fd(fds[1], input.size()) !=
+            (ssize_t)(input.size() - 4000)) ||
+          (subject.buffer->get_data_size() != 0))
+        return 1;
+
+      TEST_OPS_EVAL(
+          read(fds[0], &output[0], output.size()) != (ssize_t)output.size())
+        return 1;
+
+      TEST_OPS_EVAL(output != input)
+        return 1;
+
+      // a small read lands in the spare capacity of the tail page, without a
+      // new page or a change of data revision, and the rest overflows into
+      // new pages
+      if (!dynamic_cast<pb::mmap_buffer*>(subject.buffer) &&
+          (subject.buffer->get_strategy().page_size >= 2000)) {
+        TEST_OPS_EVAL(subject.buffer->write(input.data(), 1000) != 1000)
+          return 1;
+
+        size_t pages = count_pages(*subject.buffer);
+        uint64_t revision = subject.buffer->get_data_revision();
+
+        TEST_OPS_EVAL(write(fds[1], input.data() + 1000, 500) != 500)
+          return 1;
+
+        TEST_OPS_EVAL(
+            (subject.buffer->read_fd(fds[0], 500) != 500) ||
+            (count_pages(*subject.buffer) != pages) ||
+            (subject.buffer->get_data_revision() != revision))
+          return 1;
+
+        TEST_OPS_EVAL(write(fds[1], input.data() + 1500, 8500) != 8500)
+          return 1;
+
+        TEST_OPS_EVAL(
+            (subject.buffer->read_fd(fds[0], 8500) != 8500) ||
+            (count_pages(*subject.buffer) <= pages) ||
+            (subject.buffer->get_data_size() != input.size()))
+          return 1;
+
+        TEST_OPS_EVAL(
+            subject.buffer->read(&output[0], output.size()) != output.size())
+          return 1;
+
+        TEST_OPS_EVAL(output != input)
+          return 1;
+
+        subject.buffer->clear();
+      }
+
+      close(fds[0]);
+      close(fds[1]);
+
+      return 0;
+    }
+};
+
+
+
+/*******************************************************************************
+ */
+class test_case_splice1 : public test_case<test_case_splice1> {
+  public:
+    virtual int run_test(const test_subject& subject) {
+      subject.buffer->clear();
+
+      TEST_OPS_EVAL(subject.buffer->get_data_size() != 0)
+        return 1;
+
+      if (subject.buffer->get_strategy().rejects_write)
+        return 0;
+
+      int src_fds[2];
+      int dst_fds[2];
+
+      TEST_OPS_EVAL((pipe(src_fds) != 0) || (pipe(dst_fds) != 0))
+        return 1;
+
+      struct pb_splice_pipe *splice_pipe = pb_splice_pipe_create();
+      struct pb_splice_pipe *tee_pipe = pb_splice_pipe_create();
+
+      TEST_OPS_EVAL((splice_pipe == NULL) || (tee_pipe == NULL))
+        return 1;
+
+      std::string input;
+
+      for (size_t i = 0; i < 5000; ++i)
+        input.push_back((char)(i % 251));
+
+      TEST_OPS_EVAL(
+          write(src_fds[1], input.data(), input.size()) !=
+            (ssize_t)input.size())
+        return 1;
+
+      TEST_OPS_EVAL(
+          (pb_splice_pipe_splice_in(splice_pipe, src_fds[0], input.size()) !=
+            (ssize_t)input.size()) ||
+          (pb_splice_pipe_get_data_size(splice_pipe) != input.size()))
+        return 1;
+
+      TEST_OPS_EVAL(
+          pb_splice_pipe_tee(splice_pipe, tee_pipe, input.size()) !=
+            (ssize_t)input.size())
+        return 1;
+
+      // peeking copies data out without consuming it
+      TEST_OPS_EVAL(
+          subject.buffer->peek_splice_pipe(splice_pipe, 100) != 100)
+        return 1;
+
+      std::string output(100, '\0');
+
+      TEST_OPS_EVAL(
+          (subject.buffer->read(&output[0], output.size()) != output.size()) ||
+          (output != input.substr(0, 100)) ||
+          (pb_splice_pipe_get_data_size(splice_pipe) != input.size()))
+        return 1;
+
+      // both pipes forward the whole input
+      output.resize(input.size());
+
+      TEST_OPS_EVAL(
+          (pb_splice_pipe_splice_out(splice_pipe, dst_fds[1], input.size()) !=
+            (ssize_t)input.size()) ||
+          (read(dst_fds[0], &output[0], output.size()) !=
+            (ssize_t)output.size()) ||
+          (output != input))
+        return 1;
+
+      TEST_OPS_EVAL(
+          (pb_splice_pipe_splice_out(tee_pipe, dst_fds[1], input.size()) !=
+            (ssize_t)input.size()) ||
+          (read(dst_fds[0], &output[0], output.size()) !=
+            (ssize_t)output.size()) ||
+          (output != input))
+        return 1;
+
+      TEST_OPS_EVAL(
+          (pb_splice_pipe_get_data_size(splice_pipe) != 0) ||
+          (pb_splice_pipe_get_data_size(tee_pipe) != 0))
+        return 1;
+
+      pb_splice_pipe_destroy(tee_pipe);
+      pb_splice_pipe_destroy(splice_pipe);
+
+      close(src_fds[0]);
+      close(src_fds[1]);
+      close(dst_fds[0]);
+      close(dst_fds[1]);
+
+      subject.buffer->clear();
+
+      return 0;
+    }
+};
+
+
+
+/*******************************************************************************
+ */
+class test_case_send_fd1 : public test_case<test_case_send_fd1> {
+  public:
+    virtual int run_test(const test_subject& subject) {
+      pb::mmap_buffer *mmap_buffer =
+        dynamic_cast<pb::mmap_buffer*>(subject.buffer);
+      if (!mmap_buffer)
+        return 0;
+
+      mmap_buffer->clear();
+
+      TEST_OPS_EVAL(mmap_buffer->get_data_size() != 0)
+        return 1;
+
+      std::string input;
+
+      for (size_t i = 0; i < 10000; ++i)
+        input.push_back((char)(i % 251));
+
+      TEST_OPS_EVAL(
+          mmap_buffer->write(input.data(), input.size()) != input.size())
+        return 1;
+
+      // send part of the data to a pipe
+      int fds[2];
+
+      TEST_OPS_EVAL(pipe(fds) != 0)
+        return 1;
+
+      TEST_OPS_EVAL(
+          (mmap_buffer->send_fd(fds[1], 4000) != 4000) ||
+          (mmap_buffer->get_data_size() != (input.size() - 4000)))
+        return 1;
+
+      std::string output(4000, '\0');
+
+      TEST_OPS_EVAL(
+          (read(fds[0], &output[0], output.size()) !=
+            (ssize_t)output.size()) ||
+          (output != input.substr(0, 4000)))
+        return 1;
+
+      close(fds[0]);
+      close(fds[1]);
+
+      // send the remainder to a regular file
+      char file_path[36];
+      sprintf(file_path, "/tmp/pb_test_ops_send_fd-%05d", getpid());
+
+      int fd = open(file_path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+
+      TEST_OPS_EVAL(fd == -1)
+        return 1;
+
+      unlink(file_path);
+
+      TEST_OPS_EVAL(
+          (mmap_buffer->send_fd(fd, input.size()) !=
+            (ssize_t)(input.size() - 4000)) ||
+          (mmap_buffer->get_data_size() != 0))
+        return 1;
+
+      output.resize(input.size() - 4000);
+
+      TEST_OPS_EVAL(
+          (pread(fd, &output[0], output.size(), 0) !=
+            (ssize_t)output.size()) ||
+          (output != input.substr(4000)))
+        return 1;
+
+      close(fd);
+
+      return 0;
+    }
+};
+
+
+
+/*******************************************************************************
+ */
+class test_case_uring1 : public test_case<test_case_uring1> {
+  public:
+    virtual int run_test(const test_subject& subject) {
+      subject.buffer->clear();
+
+      TEST_OPS_EVAL(subject.buffer->get_data_size() != 0)
+        return 1;
+
+      if (subject.buffer->get_strategy().rejects_write ||
+          subject.buffer->get_strategy().rejects_seek)
+        return 0;
+
+      struct pb_uring *uring = pb_uring_create(8);
+      if (!uring)
+        return 0;
+
+      int src_fds[2];
+      int dst_fds[2];
+
+      TEST_OPS_EVAL((pipe(src_fds) != 0) || (pipe(dst_fds) != 0))
+        return 1;
+
+      std::string input;
+
+      for (size_t i = 0; i < 10000; ++i)
+        input.push_back((char)(i % 251));
+
+      TEST_OPS_EVAL(
+          write(src_fds[1], input.data(), 6000) != 6000)
+        return 1;
+
+      struct pb_uring_completion completions[4];
+
+      // read the first part of the input, one request at a time
+      while (subject.buffer->get_data_size() < 6000) {
+        TEST_OPS_EVAL(!subject.buffer->uring_read(uring, src_fds[0], 4096, 1))
+          return 1;
+
+        TEST_OPS_EVAL(pb_uring_submit(uring, 1) != 1)
+          return 1;
+
+        TEST_OPS_EVAL(
+            (pb_uring_complete(uring, completions, 4) != 1) ||
+            (completions[0].op != pb_uring_op_read) ||
+            (completions[0].user_data != 1) ||
+            (completions[0].result <= 0))
+          return 1;
+      }
+
+      TEST_OPS_EVAL(
+          write(src_fds[1], input.data() + 6000, input.size() - 6000) !=
+            (ssize_t)(input.size() - 6000))
+        return 1;
+
+      // write the first part while reading the remainder, in one submission
+      TEST_OPS_EVAL(
+          !subject.buffer->uring_write(uring, dst_fds[1], 6000, 2) ||
+          !subject.buffer->uring_read(uring, src_fds[0], 8192, 3))
+        return 1;
+
+      TEST_OPS_EVAL(pb_uring_get_inflight(uring) != 2)
+        return 1;
+
+      TEST_OPS_EVAL(pb_uring_submit(uring, 2) != 2)
+        return 1;
+
+      TEST_OPS_EVAL(pb_uring_complete(uring, completions, 4) != 2)
+        return 1;
+
+      for (size_t i = 0; i < 2; ++i) {
+        bool is_write = (completions[i].user_data == 2);
+
+        TEST_OPS_EVAL(
+            (completions[i].op !=
+              (is_write ? pb_uring_op_write : pb_uring_op_read)) ||
+            (completions[i].result !=
+              (is_write ? 6000 : (int)(input.size() - 6000))))
+          return 1;
+      }
+
+      TEST_OPS_EVAL(
+          (pb_uring_get_inflight(uring) != 0) ||
+          (subject.buffer->get_data_size() != (input.size() - 6000)))
+        return 1;
+
+      // write the remainder
+      TEST_OPS_EVAL(
+          !subject.buffer->uring_write(uring, dst_fds[1], input.size(), 4))
+        return 1;
+
+      TEST_OPS_EVAL(
+          (pb_uring_submit(uring, 1) != 1) ||
+          (pb_uring_complete(uring, completions, 4) != 1) ||
+          (completions[0].result != (int)(input.size() - 6000)) ||
+          (subject.buffer->get_data_size() != 0))
+        return 1;
+
+      std::string output(input.size(), '\0');
+
+      TEST_OPS_EVAL(
+          (read(dst_fds[0], &output[0], output.size()) !=
+            (ssize_t)output.size()) ||
+          (output != input))
+        return 1;
+
+      // a read that never completes is cancelled by destroy
+      TEST_OPS_EVAL(
+          !subject.buffer->uring_read(uring, src_fds[0], 1024, 5) ||
+          (pb_uring_submit(uring, 0) != 1))
+        return 1;
+
+      pb_uring_destroy(uring);
+
+      TEST_OPS_EVAL(subject.buffer->get_data_size() != 0)
+        return 1;
+
+      close(src_fds[0]);
+      close(src_fds[1]);
+      close(dst_fds[0]);
+      close(dst_fds[1]);
+
+      return 0;
+    }
+};
+
+
+
+/*******************************************************************************
+ */
+class test_case_zerocopy1 : public test_case<test_case_zerocopy1> {
+  public:
+    virtual int run_test(const test_subject& subject) {
+      subject.buffer->clear();
+
+      TEST_OPS_EVAL(subject.buffer->get_data_size() != 0)
+        return 1;
+
+      if (subject.buffer->get_strategy().rejects_write ||
+          subject.buffer->get_strategy().rejects_seek)
+        return 0;
+
+      // zero copy needs a TCP or UDP socket, so connect over loopback
+      int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+
+      TEST_OPS_EVAL(listen_fd == -1)
+        return 1;
+
+      struct sockaddr_in addr;
+      memset(&addr, 0, sizeof(addr));
+      addr.sin_family = AF_INET;
+      addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+      socklen_t addr_len = sizeof(addr);
+
+      TEST_OPS_EVAL(
+          (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) ||
+          (listen(listen_fd, 1) != 0) ||
+          (getsockname(listen_fd, (struct sockaddr*)&addr, &addr_len) != 0))
+        return 1;
+
+      int send_fd = socket(AF_INET, SOCK_STREAM, 0);
+
+      TEST_OPS_EVAL(
+          (send_fd == -1) ||
+          (connect(send_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0))
+        return 1;
+
+      int recv_fd = accept(listen_fd, NULL, NULL);
+
+      TEST_OPS_EVAL(recv_fd == -1)
+        return 1;
+
+      struct pb_zerocopy_sender *zerocopy_sender =
+        pb_zerocopy_sender_create(send_fd);
+      if (!zerocopy_sender) {
+        close(recv_fd);
+        close(send_fd);
+        close(listen_fd);
+
+        return 0;
+      }
+
+      std::string input;
+
+      for (size_t i = 0; i < 10000; ++i)
+        input.push_back((char)(i % 251));
+
+      TEST_OPS_EVAL(
+          subject.buffer->write(input.data(), input.size()) != input.size())
+        return 1;
+
+      // the buffer is seeked at once, while the pages stay referenced
+      TEST_OPS_EVAL(
+          (subject.buffer->zerocopy_send(zerocopy_sender, 4000) != 4000) ||
+          (subject.buffer->zerocopy_send(zerocopy_sender, input.size()) !=
+            (ssize_t)(input.size() - 4000)) ||
+          (subject.buffer->get_data_size() != 0) ||
+          (pb_zerocopy_sender_get_pending(zerocopy_sender) == 0))
+        return 1;
+
+      std::string output(input.size(), '\0');
+      size_t received = 0;
+
+      while (received < output.size()) {
+        ssize_t result =
+          read(recv_fd, &output[received], output.size() - received);
+
+        TEST_OPS_EVAL(result <= 0)
+          return 1;
+
+        received += (size_t)result;
+      }
+
+      TEST_OPS_EVAL(output != input)
+        return 1;
+
+      // completions arrive on the error queue once the data is acknowledged
+      for (size_t i = 0;
+           (i < 1000) && (pb_zerocopy_sender_get_pending(zerocopy_sender) > 0);
+           ++i) {
+        TEST_OPS_EVAL(pb_zerocopy_sender_complete(zerocopy_sender) < 0)
+          return 1;
+
+        if (pb_zerocopy_sender_get_pending(zerocopy_sender) > 0)
+          usleep(1000);
+      }
+
+      TEST_OPS_EVAL(pb_zerocopy_sender_get_pending(zerocopy_sender) != 0)
+        return 1;
+
+      pb_zerocopy_sender_destroy(zerocopy_sender);
+
+      close(recv_fd);
+      close(send_fd);
+      close(listen_fd);
+
+      return 0;
+    }
+};
+
+
+
+/*******************************************************************************
+ */
+class test_case_mmsg1 : public test_case<test_case_mmsg1> {
+  public:
+    virtual int run_test(const test_subject& subject) {
+      subject.buffer->clear();
+
+      TEST_OPS_EVAL(subject.buffer->get_data_size() != 0)
+        return 1;
+
+      if (subject.buffer->get_strategy().rejects_write ||
+          subject.buffer->get_strategy().rejects_seek)
+        return 0;
+
+      int fds[2];
+
+      TEST_OPS_EVAL(socketpair(AF_UNIX, SOCK_DGRAM, 0, fds) != 0)
+        return 1;
+
+      std::string input;
+
+      for (size_t i = 0; i < 6000; ++i)
+        input.push_back((char)(i % 251));
+
+      const size_t input_lens[] = { 100, 5000, 1, 899 };
+      size_t offset = 0;
+
+      for (size_t i = 0; i < 4; ++i) {
+        TEST_OPS_EVAL(
+            send(fds[1], &input[offset], input_lens[i], 0) !=
+              (ssize_t)input_lens[i])
+          return 1;
+
+        offset += input_lens[i];
+      }
+
+      // all queued datagrams are received by one call, boundaries intact
+      size_t lens[8];
+
+      TEST_OPS_EVAL(
+          (subject.buffer->recvmmsg(fds[0], 8, 8192, lens) != 4) ||
+          (subject.buffer->get_data_size() != input.size()))
+        return 1;
+
+      for (size_t i = 0; i < 4; ++i) {
+        TEST_OPS_EVAL(lens[i] != input_lens[i])
+          return 1;
+      }
+
+      // send the datagrams back, with the same boundaries
+      TEST_OPS_EVAL(
+          (subject.buffer->sendmmsg(fds[0], lens, 4) != 4) ||
+          (subject.buffer->get_data_size() != 0))
+        return 1;
+
+      offset = 0;
+
+      for (size_t i = 0; i < 4; ++i) {
+        std::string output(8192, '\0');
+
+        ssize_t result = recv(fds[1], &output[0], output.size(), 0);
+
+        TEST_OPS_EVAL(
+            (result != (ssize_t)input_lens[i]) ||
+            (output.substr(0, (size_t)result) !=
+              input.substr(offset, input_lens[i])))
+          return 1;
+
+        offset += input_lens[i];
+      }
+
+      close(fds[0]);
+      close(fds[1]);
+
+      return 0;
+    }
+};
+
+
+
+/*******************************************************************************
+ */
+int main(int argc, char **argv) {
+  std::list<test_subject> test_subjects;
+
+  struct pb_buffer_strategy strategy;
+  memset(&strategy, 0, sizeof(strategy));
+
+  strategy.page_size = PB_BUFFER_DEFAULT_PAGE_SIZE;
+  strategy.clone_on_write = false;
+  strategy.fragment_as_target = false;
+
+  test_subjects.push_back(test_subject());
+  test_subjects.back().init(
+    "Standard heap sourced pb_buffer                                       ",
+    new pb::buffer(&strategy));
+
+  strategy.page_size = PB_BUFFER_DEFAULT_PAGE_SIZE;
+  strategy.clone_on_write = false;
+  strategy.fragment_as_target = true;
+
+  test_subjects.push_back(test_subject());
+  test_subjects.back().init(
+    "Standard heap sourced pb_buffer, fragment_as_target                   ",
+    new pb::buffer(&strategy));
+
+  strategy.page_size = PB_BUFFER_DEFAULT_PAGE_SIZE;
+  strategy.clone_on_write = true;
+  strategy.fragment_as_target = false;
+
+  test_subjects.push_back(test_subject());
+  test_subjects.back().init(
+    "Standard heap sourced pb_buffer, clone_on_Write                       ",
+    new pb::buffer(&strategy));
+
+  strategy.page_size = PB_BUFFER_DEFAULT_PAGE_SIZE;
+  strategy.clone_on_write = true;
+  strategy.fragment_as_target = true;
+
+  test_subjects.push_back(test_subject());
+  test_subjects.back().init(
+    "Standard heap sourced pb_buffer, clone_on_Write and fragment_on_target",
+    new pb::buffer(&strategy));
+
+  strategy.page_size = PB_BUFFER_DEFAULT_PAGE_SIZE;
+  strategy.clone_on_write = false;
+  strategy.fragment_as_target = false;
+
+  test_subjects.push_back(test_subject());
+  test_subjects.back().init(
+    "Inline data pb_buffer                                                 ",
+    new pb::buffer(&strategy, pb_get_inline_data_factory()));
+
+  test_subjects.push_back(test_subject());
+  test_subjects.back().init(
+    "Atomic data pb_buffer                                                 ",
+    new pb::buffer(&strategy, pb_get_atomic_data_factory()));
+
+  test_subjects.push_back(test_subject());
+  test_subjects.back().init(
+    "Ring pb_buffer                                                        ",
+    new pb::ring_buffer(&strategy));
+
+  strategy.page_size = PB_BUFFER_DEFAULT_PAGE_SIZE;
+  strategy.clone_on_write = true;
+  strategy.fragment_as_target = true;
+
+  test_subjects.push_back(test_subject());
+  test_subjects.back().init(
+    "Ring pb_buffer, clone_on_Write and fragment_on_target                 ",
+    new pb::ring_buffer(&strategy));
+
+  strategy.page_size = PB_BUFFER_DEFAULT_PAGE_SIZE;
+  strategy.clone_on_write = false;
+  strategy.fragment_as_target = false;
+
+  strategy.headroom = 128;
+
+  test_subjects.push_back(test_subject());
+  test_subjects.back().init(
+    "Headroom pb_buffer                                                    ",
+    new pb::buffer(&strategy));
+
+  strategy.headroom = 0;
+
+  struct pb_allocator *slab_allocator = pb_slab_allocator_create();
+  TEST_OPS_EVAL_DESCRIPTION(
+      (slab_allocator == NULL),
+      "slab_allocator test create")
+    return 1;
+
+  strategy.page_size = PB_BUFFER_DEFAULT_PAGE_SIZE;
+  strategy.clone_on_write = false;
+  strategy.fragment_as_target = false;
+
+  test_subjects.push_back(test_subject());
+  test_subjects.back().init(
+    "Slab allocator sourced pb_buffer                                      ",
+    new pb::buffer(&strategy, slab_allocator));
+
+  struct pb_allocator *caching_allocator =
+    pb_caching_allocator_create(PB_BUFFER_DEFAULT_PAGE_SIZE);
+  TEST_OPS_EVAL_DESCRIPTION(
+      (caching_allocator == NULL),
+      "caching_allocator test create")
+    return 1;
+
+  test_subjects.push_back(test_subject());
+  test_subjects.back().init(
+    "Caching allocator sourced pb_buffer                                   ",
+    new pb::buffer(&strategy, caching_allocator));
+
+  struct pb_allocator *arena_allocator = pb_arena_allocator_create(0);
+  TEST_OPS_EVAL_DESCRIPTION(
+      (arena_allocator == NULL),
+      "arena_allocator test create")
+    return 1;
+
+  test_subjects.push_back(test_subject());
+  test_subjects.back().init(
+    "Arena allocator sourced pb_buffer                                     ",
+    new pb::buffer(&strategy, arena_allocator));
+
+  struct pb_allocator *stats_allocator = pb_stats_allocator_create(true);
+  TEST_OPS_EVAL_DESCRIPTION(
+      (stats_allocator == NULL),
+      "stats_allocator test create")
+    return 1;
+
+  test_subjects.push_back(test_subject());
+  test_subjects.back().init(
+    "Stats allocator sourced pb_buffer                                     ",
+    new pb::buffer(&strategy, stats_allocator));
+
+  struct pb_allocator *deferred_stats_allocator =
+    pb_stats_allocator_create(false);
+  struct pb_allocator *deferred_allocator =
+    pb_deferred_allocator_create_with_alloc(deferred_stats_allocator);
+  TEST_OPS_EVAL_DESCRIPTION(
+      (deferred_allocator == NULL),
+      "deferred_allocator test create")
+    return 1;
+
+  test_subjects.push_back(test_subject());
+  test_subjects.back().init(
+    "Deferred allocator sourced pb_buffer                                  ",
+    new pb::buffer(&strategy, deferred_allocator));
+
+  char buffer_file_path[34];
+  sprintf(buffer_file_path, "/tmp/pb_test_ops_buffer-%05d", getpid());
+
+  pb::mmap_buffer *mmap_buffer =
+    new pb::mmap_buffer(
+      buffer_file_path,
+      pb::mmap_buffer::open_action_overwrite,
+      pb::mmap_buffer::close_action_retain);
+  TEST_OPS_EVAL_DESCRIPTION(
+      (mmap_buffer->get_file_path() != buffer_file_path),
+      "mmap_buffer test get_file_path")
+    return 1;
+  TEST_OPS_EVAL_DESCRIPTION(
+      (mmap_buffer->get_fd() == 0),
+      "mmap_buffer test get_fd")
+    return 1;
+  TEST_OPS_EVAL_DESCRIPTION(
+      (mmap_buffer->get_close_action() != pb::mmap_buffer::close_action_retain),
+      "mmap_buffer test get_close_action")
+    return 1;
+
+  mmap_buffer->set_close_action(pb::mmap_buffer::close_action_remove);
+
+  TEST_OPS_EVAL_DESCRIPTION(
+      (mmap_buffer->get_close_action() != pb::mmap_buffer::close_action_remove),
+      "mmap_buffer test set_close_action")
+    return 1;
+
+  test_subjects.push_back(test_subject());
+  test_subjects.back().init(
+    "mmap file backed pb_buffer                                            ",
+    mmap_buffer);
+
+  test_case<test_case_iterate1>::run_test(test_subjects);
+  test_case<test_case_iterate2>::run_test(test_subjects);
+  test_case<test_case_iterate3>::run_test(test_subjects);
+  test_case<test_case_insert1>::run_test(test_subjects);
+  test_case<test_case_insert2>::run_test(test_subjects);
+  test_case<test_case_insert3>::run_test(test_subjects);
+  test_case<test_case_overwrite1>::run_test(test_subjects);
+  test_case<test_case_overwrite2>::run_test(test_subjects);
+  test_case<test_case_overwrite3>::run_test(test_subjects);
+  test_case<test_case_rewind1>::run_test(test_subjects);
+  test_case<test_case_rewind2>::run_test(test_subjects);
+  test_case<test_case_trim1>::run_test(test_subjects);
+  //test_case<test_case_trim2>::run_test(test_subjects);
+  test_case<test_case_trim3>::run_test(test_subjects);
+  test_case<test_case_extend1>::run_test(test_subjects);
+  test_case<test_case_extend2>::run_test(test_subjects);
+  test_case<test_case_extend3>::run_test(test_subjects);
+  test_case<test_case_reserve1>::run_test(test_subjects);
+  test_case<test_case_write_mem1>::run_test(test_subjects);
+  test_case<test_case_write_tail1>::run_test(test_subjects);
+  test_case<test_case_iterator_at1>::run_test(test_subjects);
+  test_case<test_case_headroom1>::run_test(test_subjects);
+  test_case<test_case_compact1>::run_test(test_subjects);
+  test_case<test_case_iovec1>::run_test(test_subjects);
+  test_case<test_case_fd1>::run_test(test_subjects);
+  test_case<test_case_splice1>::run_test(test_subjects);
+  test_case<test_case_send_fd1>::run_test(test_subjects);
+  test_case<test_case_uring1>::run_test(test_subjects);
+  test_case<test_case_zerocopy1>::run_test(test_subjects);
+  test_case<test_case_mmsg1>::run_test(test_subjects);
+
+  test_subjects.clear();
+
+  struct pb_allocator_stats stats;
+  pb_stats_allocator_get_stats(stats_allocator, &stats);
+
+  TEST_OPS_EVAL_DESCRIPTION(
+      ((stats.live_bytes != 0) ||
+       (stats.high_water_bytes == 0) ||
+       (stats.alloc_count == 0) ||
+       (stats.alloc_count != stats.free_count)),
+      "stats_allocator test stats")
+    return 1;
+
+  pb_stats_allocator_destroy(stats_allocator);
+
+  pb_deferred_allocator_reclaim(deferred_allocator);
+  pb_deferred_allocator_destroy(deferred_allocator);
+
+  pb_stats_allocator_get_stats(deferred_stats_allocator, &stats);
+
+  TEST_OPS_EVAL_DESCRIPTION(
+      ((stats.live_bytes != 0) ||
+       (stats.alloc_count != stats.free_count)),
+      "deferred_allocator test reclaim")
+    return 1;
+
+  pb_stats_allocator_destroy(deferred_stats_allocator);
+
+  struct pb_allocator *reclaim_stats_allocator =
+    pb_stats_allocator_create(false);
+  struct pb_reclaimer *reclaimer = pb_reclaimer_create();
+  TEST_OPS_EVAL_DESCRIPTION(
+      (reclaimer == NULL),
+      "reclaimer test create")
+    return 1;
+
+  for (int i = 0; i < 3; ++i) {
+    struct pb_buffer *reclaim_buffer =
+      (i == 1) ?
+        pb_ring_buffer_create_with_alloc(reclaim_stats_allocator) :
+        pb_trivial_buffer_create_with_alloc(reclaim_stats_allocator);
+
+    for (int j = 0; j < 1000; ++j)
+      pb_buffer_write_data_ref(reclaim_buffer, "reclaim", 7);
+
+    pb_buffer_destroy_deferred(reclaim_buffer, reclaimer);
+
+    if (i < 2) {
+      TEST_OPS_EVAL_DESCRIPTION(
+          ((pb_reclaimer_reclaim(reclaimer, 10) != 10) ||
+           pb_reclaimer_is_empty(reclaimer) ||
+           (pb_reclaimer_reclaim(reclaimer, 2000) != 990) ||
+           !pb_reclaimer_is_empty(reclaimer)),
+          "reclaimer test reclaim")
+        return 1;
+
+      continue;
+    }
+
+    TEST_OPS_EVAL_DESCRIPTION(
+        !pb_reclaimer_start(reclaimer),
+        "reclaimer test start")
+      return 1;
+
+    while (!pb_reclaimer_is_empty(reclaimer))
+      usleep(100);
+  }
+
+  pb_reclaimer_destroy(reclaimer);
+
+  pb_stats_allocator_get_stats(reclaim_stats_allocator, &stats);
+
+  TEST_OPS_EVAL_DESCRIPTION(
+      ((stats.live_bytes != 0) ||
+       (stats.alloc_count != stats.free_count)),
+      "reclaimer test stats")
+    return 1;
+
+  pb_stats_allocator_destroy(reclaim_stats_allocator);
+
+  // pages released by the reclaimer thread while the main thread releases
+  // other references to their data
+  struct pb_allocator *threaded_stats_allocator =
+    pb_stats_allocator_create(true);
+  struct pb_reclaimer *threaded_reclaimer = pb_reclaimer_create();
+  TEST_OPS_EVAL_DESCRIPTION(
+      ((threaded_reclaimer == NULL) ||
+       !pb_reclaimer_start(threaded_reclaimer)),
+      "reclaimer test threaded start")
+    return 1;
+
+  struct pb_buffer_strategy threaded_strategy =
+    *pb_get_trivial_buffer_strategy();
+  threaded_strategy.page_size = 16;
+
+  struct pb_buffer *live_buffer =
+    pb_trivial_buffer_create_with_data_factory_with_alloc(
+      &threaded_strategy, pb_get_atomic_data_factory(),
+      threaded_stats_allocator);
+
+  for (int i = 0; i < 20; ++i) {
+    struct pb_buffer *shared_buffer =
+      pb_trivial_buffer_create_with_data_factory_with_alloc(
+        &threaded_strategy, pb_get_atomic_data_factory(),
+        threaded_stats_allocator);
+
+    for (int j = 0; j < 1000; ++j)
+      pb_buffer_write_data(shared_buffer, "reclaim", 7);
+
+    uint64_t shared_size = pb_buffer_get_data_size(shared_buffer);
+
+    TEST_OPS_EVAL_DESCRIPTION(
+        (pb_buffer_write_buffer(
+           live_buffer, shared_buffer, shared_size) != shared_size),
+        "reclaimer test threaded share")
+      return 1;
+
+    pb_buffer_destroy_deferred(shared_buffer, threaded_reclaimer);
+
+    pb_reclaimer_reclaim(threaded_reclaimer, 100);
+
+    pb_buffer_seek(live_buffer, shared_size);
+  }
+
+  while (!pb_reclaimer_is_empty(threaded_reclaimer))
+    usleep(100);
+
+  pb_buffer_destroy(live_buffer);
+
+  pb_reclaimer_destroy(threaded_reclaimer);
+
+  pb_stats_allocator_get_stats(threaded_stats_allocator, &stats);
+
+  TEST_OPS_EVAL_DESCRIPTION(
+      ((stats.live_bytes != 0) ||
+       (stats.alloc_count != stats.free_count)),
+      "reclaimer test threaded stats")
+    return 1;
+
+  pb_stats_allocator_destroy(threaded_stats_allocator);
+
+  // zero copy sends keep their pages until the kernel reports them finished,
+  // whether by pb_zerocopy_sender_complete or by destroy
+  struct pb_allocator *zerocopy_stats_allocator =
+    pb_stats_allocator_create(false);
+  struct pb_buffer *zerocopy_buffer =
+    pb_trivial_buffer_create_with_alloc(zerocopy_stats_allocator);
+
+  // kernels without zero copy support skip the test, and as the kernel
+  // numbers sends per socket, each sender has a connection of its own
+  for (int i = 0; i < 2; ++i) {
+    int zerocopy_listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    struct sockaddr_in zerocopy_addr;
+    memset(&zerocopy_addr, 0, sizeof(zerocopy_addr));
+    zerocopy_addr.sin_family = AF_INET;
+    zerocopy_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    socklen_t zerocopy_addr_len = sizeof(zerocopy_addr);
+
+    TEST_OPS_EVAL_DESCRIPTION(
+        ((zerocopy_listen_fd == -1) ||
+         (bind(zerocopy_listen_fd,
+               (struct sockaddr*)&zerocopy_addr,
+               sizeof(zerocopy_addr)) != 0) ||
+         (listen(zerocopy_listen_fd, 1) != 0) ||
+         (getsockname(zerocopy_listen_fd,
+                      (struct sockaddr*)&zerocopy_addr,
+                      &zerocopy_addr_len) != 0)),
+        "zerocopy_sender test listen")
+      return 1;
+
+    int zerocopy_send_fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    TEST_OPS_EVAL_DESCRIPTION(
+        ((zerocopy_send_fd == -1) ||
+         (connect(zerocopy_send_fd,
+                  (struct sockaddr*)&zerocopy_addr,
+                  sizeof(zerocopy_addr)) != 0)),
+        "zerocopy_sender test connect")
+      return 1;
+
+    int zerocopy_recv_fd = accept(zerocopy_listen_fd, NULL, NULL);
+
+    TEST_OPS_EVAL_DESCRIPTION(
+        (zerocopy_recv_fd == -1),
+        "zerocopy_sender test accept")
+      return 1;
+
+    struct pb_zerocopy_sender *zerocopy_sender =
+      pb_zerocopy_sender_create(zerocopy_send_fd);
+    if (!zerocopy_sender) {
+      close(zerocopy_recv_fd);
+      close(zerocopy_send_fd);
+      close(zerocopy_listen_fd);
+
+      break;
+    }
+
+    pb_stats_allocator_get_stats(zerocopy_stats_allocator, &stats);
+
+    uint64_t empty_live_bytes = stats.live_bytes;
+
+    std::string zerocopy_input(10000, 'z');
+
+    TEST_OPS_EVAL_DESCRIPTION(
+        ((pb_buffer_write_data(
+            zerocopy_buffer,
+            zerocopy_input.data(), zerocopy_input.size()) !=
+              zerocopy_input.size()) ||
+         (pb_zerocopy_sender_send(
+            zerocopy_sender, zerocopy_buffer, zerocopy_input.size()) !=
+              (ssize_t)zerocopy_input.size()) ||
+         (pb_buffer_get_data_size(zerocopy_buffer) != 0)),
+        "zerocopy_sender test send")
+      return 1;
+
+    pb_stats_allocator_get_stats(zerocopy_stats_allocator, &stats);
+
+    TEST_OPS_EVAL_DESCRIPTION(
+        ((pb_zerocopy_sender_get_pending(zerocopy_sender) == 0) ||
+         (stats.live_bytes < (empty_live_bytes + zerocopy_input.size()))),
+        "zerocopy_sender test pages retained")
+      return 1;
+
+    std::string zerocopy_output(zerocopy_input.size(), '\0');
+    size_t received = 0;
+
+    while (received < zerocopy_output.size()) {
+      ssize_t result =
+        read(
+          zerocopy_recv_fd,
+          &zerocopy_output[received], zerocopy_output.size() - received);
+
+      TEST_OPS_EVAL_DESCRIPTION(
+          (result <= 0),
+          "zerocopy_sender test receive")
+        return 1;
+
+      received += (size_t)result;
+    }
+
+    if (i == 0) {
+      for (size_t j = 0;
+           (j < 1000) && (pb_zerocopy_sender_get_pending(zerocopy_sender) > 0);
+           ++j) {
+        TEST_OPS_EVAL_DESCRIPTION(
+            (pb_zerocopy_sender_complete(zerocopy_sender) < 0),
+            "zerocopy_sender test complete")
+          return 1;
+
+        if (pb_zerocopy_sender_get_pending(zerocopy_sender) > 0)
+          usleep(1000);
+      }
+    }
+
+    pb_zerocopy_sender_destroy(zerocopy_sender);
+
+    pb_stats_allocator_get_stats(zerocopy_stats_allocator, &stats);
+
+    TEST_OPS_EVAL_DESCRIPTION(
+        (stats.live_bytes != empty_live_bytes),
+        "zerocopy_sender test pages released")
+      return 1;
+
+    close(zerocopy_recv_fd);
+    close(zerocopy_send_fd);
+    close(zerocopy_listen_fd);
+  }
+
+  pb_buffer_destroy(zerocopy_buffer);
+
+  pb_stats_allocator_get_stats(zerocopy_stats_allocator, &stats);
+
+  TEST_OPS_EVAL_DESCRIPTION(
+      ((stats.live_bytes != 0) ||
+       (stats.alloc_count != stats.free_count)),
+      "zerocopy_sender test stats")
+    return 1;
+
+  pb_stats_allocator_destroy(zerocopy_stats_allocator);
+
+  pb_arena_allocator_reset(arena_allocator);
+
+  struct pb_buffer *arena_buffer =
+    pb_trivial_buffer_create_with_alloc(arena_allocator);
+  TEST_OPS_EVAL_DESCRIPTION(
+      (arena_buffer == NULL),
+      "arena_allocator test create after reset")
+    return 1;
+  TEST_OPS_EVAL_DESCRIPTION(
+      (pb_buffer_write_data(arena_buffer, "arena", 5) != 5),
+      "arena_allocator test write after reset")
+    return 1;
+
+  pb_arena_allocator_destroy(arena_allocator);
+
+  struct pb_allocator *hugepage_allocator = pb_hugepage_allocator_create(0);
+  TEST_OPS_EVAL_DESCRIPTION(
+      (hugepage_allocator == NULL),
+      "hugepage_allocator test create")
+    return 1;
+
+  strategy.page_size = PB_HUGEPAGE_ALLOCATOR_PAGE_SIZE;
+
+  struct pb_buffer *hugepage_buffer =
+    pb_trivial_buffer_create_with_strategy_with_alloc(
+      &strategy, hugepage_allocator);
+  TEST_OPS_EVAL_DESCRIPTION(
+      (hugepage_buffer == NULL),
+      "hugepage_allocator test buffer create")
+    return 1;
+
+  std::string hugepage_input(PB_HUGEPAGE_ALLOCATOR_PAGE_SIZE + 1, 'h');
+  std::string hugepage_output(hugepage_input.size(), '\0');
+
+  TEST_OPS_EVAL_DESCRIPTION(
+      (pb_buffer_write_data(
+         hugepage_buffer,
+         hugepage_input.data(), hugepage_input.size()) !=
+           hugepage_input.size()),
+      "hugepage_allocator test write")
+    return 1;
+  TEST_OPS_EVAL_DESCRIPTION(
+      ((pb_buffer_read_data(
+         hugepage_buffer,
+         &hugepage_output[0], hugepage_output.size()) !=
+           hugepage_output.size()) ||
+       (hugepage_output != hugepage_input)),
+      "hugepage_allocator test read")
+    return 1;
+
+  pb_buffer_destroy(hugepage_buffer);
+  pb_hugepage_allocator_destroy(hugepage_allocator);
+  pb_caching_allocator_destroy(caching_allocator);
+
+  // a full magazine that can't be exchanged for an empty one stays with the
+  // thread, and must not also be handed to the depot
+  struct failing_allocator magazine_fallback;
+  magazine_fallback.allocator.operations = &failing_allocator_operations;
+  magazine_fallback.allowed_size = 1024;
+  magazine_fallback.failing = false;
+  magazine_fallback.live_count = 0;
+
+  struct pb_allocator *magazine_allocator =
+    pb_caching_allocator_create_with_alloc(
+      1024, &magazine_fallback.allocator);
+  TEST_OPS_EVAL_DESCRIPTION(
+      (magazine_allocator == NULL),
+      "caching_allocator magazine test create")
+    return 1;
+
+  std::list<void*> magazine_regions;
+  for (size_t i = 0; i < (PB_CACHING_ALLOCATOR_MAGAZINE_SIZE + 1); ++i)
+    magazine_regions.push_back(
+      pb_allocator_malloc(magazine_allocator, 1024));
+
+  magazine_fallback.failing = true;
+
+  while (!magazine_regions.empty()) {
+    pb_allocator_free(magazine_allocator, magazine_regions.front(), 1024);
+
+    magazine_regions.pop_front();
+  }
+
+  magazine_fallback.failing = false;
+
+  std::set<void*> magazine_distinct;
+  for (size_t i = 0; i < (PB_CACHING_ALLOCATOR_MAGAZINE_SIZE * 2); ++i) {
+    void *region = pb_allocator_malloc(magazine_allocator, 1024);
+
+    magazine_regions.push_back(region);
+    magazine_distinct.insert(region);
+  }
+  TEST_OPS_EVAL_DESCRIPTION(
+      (magazine_distinct.size() != magazine_regions.size()),
+      "caching_allocator magazine test distinct regions")
+    return 1;
+
+  while (!magazine_regions.empty()) {
+    pb_allocator_free(magazine_allocator, magazine_regions.front(), 1024);
+
+    magazine_regions.pop_front();
+  }
+
+  // regions of part of a page are served by cached regions, while smaller
+  // allocations still reach the fallback allocator
+  magazine_fallback.failing = true;
+
+  void *short_region = pb_allocator_malloc(magazine_allocator, 700);
+  TEST_OPS_EVAL_DESCRIPTION(
+      (short_region == NULL),
+      "caching_allocator size class test short region")
+    return 1;
+
+  void *small_region = pb_allocator_malloc(magazine_allocator, 100);
+  TEST_OPS_EVAL_DESCRIPTION(
+      (small_region != NULL),
+      "caching_allocator size class test small region")
+    return 1;
+
+  magazine_fallback.failing = false;
+
+  pb_allocator_free(magazine_allocator, short_region, 700);
+
+  pb_caching_allocator_destroy(magazine_allocator);
+  TEST_OPS_EVAL_DESCRIPTION(
+      (magazine_fallback.live_count != 0),
+      "caching_allocator magazine test live count")
+    return 1;
+
+  pb_slab_allocator_destroy(slab_allocator);
+
+  // a ring buffer growing while a reader is part way through it must not
+  // move the pages under the reader
+  struct pb_buffer *growth_buffer = pb_ring_buffer_create();
+  std::string growth_input;
+
+  for (size_t i = 0; i < 10; ++i)
+    growth_input.append(8, (char)('a' + i));
+
+  for (size_t i = 0; i < 10; ++i)
+    pb_buffer_write_data_ref(growth_buffer, &growth_input[i * 8], 8);
+
+  struct pb_data_reader *growth_reader = pb_data_reader_create(growth_buffer);
+  std::string growth_output(growth_input.size(), '\0');
+  uint64_t growth_revision = pb_buffer_get_data_revision(growth_buffer);
+
+  TEST_OPS_EVAL_DESCRIPTION(
+      ((pb_data_reader_read(
+          growth_reader, &growth_output[0], growth_output.size()) !=
+          growth_output.size()) ||
+       (growth_output != growth_input)),
+      "ring_buffer growth test read")
+    return 1;
+
+  std::string growth_append(PB_RING_BUFFER_CHUNK_CAPACITY * 2 * 8, 'z');
+
+  for (size_t i = 0; i < (PB_RING_BUFFER_CHUNK_CAPACITY * 2); ++i)
+    pb_buffer_write_data_ref(growth_buffer, &growth_append[i * 8], 8);
+
+  growth_output.assign(growth_append.size(), '\0');
+
+  TEST_OPS_EVAL_DESCRIPTION(
+      ((pb_buffer_get_data_revision(growth_buffer) != growth_revision) ||
+       (pb_data_reader_read(
+          growth_reader, &growth_output[0], growth_output.size()) !=
+          growth_output.size()) ||
+       (growth_output != growth_append)),
+      "ring_buffer growth test read after growth")
+    return 1;
+
+  pb_data_reader_destroy(growth_reader);
+  pb_buffer_destroy(growth_buffer);
+
+  int mmsg_fds[2];
+  TEST_OPS_EVAL_DESCRIPTION(
+      (socketpair(AF_UNIX, SOCK_DGRAM, 0, mmsg_fds) != 0),
+      "mmsg test socketpair")
+    return 1;
+
+  struct pb_buffer *mmsg_buffers[3];
+  for (size_t i = 0; i < 3; ++i) {
+    mmsg_buffers[i] = pb_trivial_buffer_create();
+
+    pb_buffer_write_data(mmsg_buffers[i], "mmsg", i + 1);
+  }
+
+  // each buffer is sent as one datagram, and received into its own buffer
+  TEST_OPS_EVAL_DESCRIPTION(
+      ((pb_buffer_array_sendmmsg(mmsg_buffers, 3, mmsg_fds[0]) != 3) ||
+       (pb_buffer_get_data_size(mmsg_buffers[0]) != 0) ||
+       (pb_buffer_get_data_size(mmsg_buffers[2]) != 0)),
+      "mmsg test array send")
+    return 1;
+  TEST_OPS_EVAL_DESCRIPTION(
+      ((pb_buffer_array_recvmmsg(mmsg_buffers, 3, mmsg_fds[1], 16) != 3) ||
+       (pb_buffer_get_data_size(mmsg_buffers[0]) != 1) ||
+       (pb_buffer_get_data_size(mmsg_buffers[1]) != 2) ||
+       (pb_buffer_get_data_size(mmsg_buffers[2]) != 3)),
+      "mmsg test array recv")
+    return 1;
+
+  for (size_t i = 0; i < 3; ++i)
+    pb_buffer_destroy(mmsg_buffers[i]);
+
+  // small datagrams are received into one region per call, and copied
+  struct pb_allocator *mmsg_allocator = pb_stats_allocator_create(false);
+  struct pb_buffer *mmsg_buffer =
+    pb_trivial_buffer_create_with_alloc(mmsg_allocator);
+
+  for (size_t i = 0; i < 8; ++i)
+    send(mmsg_fds[0], "datagram", 8, 0);
+
+  size_t mmsg_lens[8];
+  struct pb_allocator_stats mmsg_stats;
+
+  TEST_OPS_EVAL_DESCRIPTION(
+      ((pb_buffer_recvmmsg(mmsg_buffer, mmsg_fds[1], 8, 4096, mmsg_lens) !=
+          8) ||
+       (mmsg_lens[7] != 8) ||
+       (pb_buffer_get_data_size(mmsg_buffer) != 64)),
+      "mmsg test small recv")
+    return 1;
+
+  pb_stats_allocator_get_stats(mmsg_allocator, &mmsg_stats);
+
+  TEST_OPS_EVAL_DESCRIPTION(
+      ((mmsg_stats.alloc_count >= 8) ||
+       (mmsg_stats.live_bytes >= 4096 * 2)),
+      "mmsg test small recv allocations")
+    return 1;
+
+  pb_buffer_destroy(mmsg_buffer);
+  pb_stats_allocator_destroy(mmsg_allocator);
+
+  close(mmsg_fds[0]);
+  close(mmsg_fds[1]);
+
+  // fixed buffers need io_uring, which may not be available
+  struct pb_uring *uring = pb_uring_create(8);
+  if (uring) {
+    struct pb_allocator *fixed_allocator =
+      pb_uring_fixed_allocator_create(uring, 4096, 4);
+    TEST_OPS_EVAL_DESCRIPTION(
+        (fixed_allocator == NULL),
+        "uring_fixed_allocator test create")
+      return 1;
+    TEST_OPS_EVAL_DESCRIPTION(
+        ((pb_uring_fixed_allocator_create(uring, 4096, 4) != NULL) ||
+         (errno != EBUSY)),
+        "uring_fixed_allocator test create twice")
+      return 1;
+
+    struct pb_buffer *fixed_buffer =
+      pb_trivial_buffer_create_with_alloc(fixed_allocator);
+
+    int fds[2];
+    TEST_OPS_EVAL_DESCRIPTION(
+        (pipe(fds) != 0),
+        "uring_fixed_allocator test pipe")
+      return 1;
+
+    std::string fixed_input(3000, 'f');
+    std::string fixed_output(fixed_input.size(), '\0');
+
+    TEST_OPS_EVAL_DESCRIPTION(
+        (write(fds[1], fixed_input.data(), fixed_input.size()) !=
+           (ssize_t)fixed_input.size()),
+        "uring_fixed_allocator test pipe write")
+      return 1;
+
+    struct pb_uring_completion completion;
+
+    // the read region is carved from the arena, and read into as fixed
+    TEST_OPS_EVAL_DESCRIPTION(
+        (!pb_uring_read(uring, fixed_buffer, fds[0], 4096, 1) ||
+         (pb_uring_submit(uring, 1) != 1) ||
+         (pb_uring_complete(uring, &completion, 1) != 1) ||
+         (completion.result != (int)fixed_input.size())),
+        "uring_fixed_allocator test read")
+      return 1;
+
+    struct pb_buffer_iterator fixed_iterator;
+    pb_buffer_get_iterator(fixed_buffer, &fixed_iterator);
+
+    unsigned int index = 4;
+    size_t offset = 1;
+
+    TEST_OPS_EVAL_DESCRIPTION(
+        (!pb_uring_fixed_allocator_get_data_index(
+           fixed_allocator, ((struct pb_page*)fixed_iterator.data_vec)->data,
+           &index, &offset) ||
+         (index >= 4) ||
+         (offset != 0) ||
+         pb_uring_fixed_allocator_get_index(
+           fixed_allocator, &fixed_input[0], 1, &index, &offset)),
+        "uring_fixed_allocator test get index")
+      return 1;
+
+    TEST_OPS_EVAL_DESCRIPTION(
+        (!pb_uring_write(uring, fixed_buffer, fds[1], 4096, 2) ||
+         (pb_uring_submit(uring, 1) != 1) ||
+         (pb_uring_complete(uring, &completion, 1) != 1) ||
+         (completion.result != (int)fixed_input.size()) ||
+         (pb_buffer_get_data_size(fixed_buffer) != 0) ||
+         (read(fds[0], &fixed_output[0], fixed_output.size()) !=
+            (ssize_t)fixed_output.size()) ||
+         (fixed_output != fixed_input)),
+        "uring_fixed_allocator test write")
+      return 1;
+
+    // the regions of pages written by the default data factory are exactly
+    // the page size, so they are all carved from the arena
+    std::string arena_input(4096 * 3, 'w');
+
+    TEST_OPS_EVAL_DESCRIPTION(
+        (pb_buffer_write_data(
+           fixed_buffer, arena_input.data(), arena_input.size()) !=
+           arena_input.size()),
+        "uring_fixed_allocator test write_data")
+      return 1;
+
+    std::set<unsigned int> arena_indices;
+
+    for (pb_buffer_get_iterator(fixed_buffer, &fixed_iterator);
+         !pb_buffer_is_end_iterator(fixed_buffer, &fixed_iterator);
+         pb_buffer_next_iterator(fixed_buffer, &fixed_iterator)) {
+      TEST_OPS_EVAL_DESCRIPTION(
+          (!pb_uring_fixed_allocator_get_data_index(
+             fixed_allocator, ((struct pb_page*)fixed_iterator.data_vec)->data,
+             &index, &offset) ||
+           (offset != 0)),
+          "uring_fixed_allocator test write_data in arena")
+        return 1;
+
+      arena_indices.insert(index);
+    }
+    TEST_OPS_EVAL_DESCRIPTION(
+        (arena_indices.size() != 3),
+        "uring_fixed_allocator test write_data pages")
+      return 1;
+
+    close(fds[0]);
+    close(fds[1]);
+
+    pb_buffer_destroy(fixed_buffer);
+    pb_uring_fixed_allocator_destroy(fixed_allocator);
+    pb_uring_destroy(uring);
+  }
 
   return test_base::final_result;
 }